@@ -19,4 +19,28 @@ class AppConfig {
 
   static const Duration localRequestTimeout = Duration(seconds: 6);
   static const Duration localProbeTimeout = Duration(milliseconds: 800);
+
+  // How long an idle keep-alive connection to the lock is reused. Kept below
+  // the firmware's kHttpKeepAliveIdleMs (5 s) so the app never sends on a
+  // socket the lock is about to close.
+  static const Duration localKeepAliveIdle = Duration(seconds: 4);
+
+  // The lock's other addresses besides the configured base URL: its
+  // always-on fallback hotspot and its mDNS name. The unlock races them all.
+  static const List<String> localAlternateBaseUrls = <String>[
+    'http://192.168.4.1',
+    'http://poot.local',
+  ];
+
+  // Happy-eyeballs delay: how long one path may stay unanswered before the
+  // next one is started alongside it. A path that fails starts the next one
+  // at once.
+  static const Duration unlockPathStagger = Duration(milliseconds: 250);
+  // The shortest delay used after a path remembered to answer quickly.
+  static const Duration unlockPathMinStagger = Duration(milliseconds: 50);
+
+  // After asking the OS to join the home Wi-Fi, the lock is polled this often
+  // until it answers or the wait runs out.
+  static const Duration homeWifiJoinPoll = Duration(milliseconds: 250);
+  static const Duration homeWifiJoinWait = Duration(seconds: 4);
 }
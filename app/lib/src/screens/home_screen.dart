@@ -70,6 +70,9 @@ class _HomeScreenState extends State<HomeScreen> {
     }
     _didAutoUnlock = true;
 
+    // Connect to the lock while the biometric prompt is up, so the unlock
+    // itself goes out on a warm connection.
+    unawaited(widget.services.localUnlockService.warmUp());
     final bool ok = await widget.services.biometricService.confirmUnlock();
     if (!ok) {
       if (mounted) {
@@ -2,6 +2,7 @@ import 'biometric_service.dart';
 import 'local_unlock_service.dart';
 import 'settings_service.dart';
 import 'unlock_orchestrator.dart';
+import 'unlock_path_memory.dart';
 
 class AppServices {
   AppServices._({
@@ -23,6 +24,7 @@ class AppServices {
       localUnlockService: localUnlockService,
       unlockOrchestrator: UnlockOrchestrator(
         localUnlockService: localUnlockService,
+        pathMemory: UnlockPathMemory(),
       ),
     );
   }
@@ -2,7 +2,9 @@ import 'dart:async';
 import 'dart:convert';
 import 'dart:io';
 
+import 'package:crypto/crypto.dart';
 import 'package:http/http.dart' as http;
+import 'package:http/io_client.dart';
 import 'package:wifi_iot/wifi_iot.dart';
 
 import '../config/app_config.dart';
@@ -16,23 +18,85 @@ class LocalUnlockResult {
   final String reason;
 }
 
+// A nonce from the lock's GET /api/challenge, good for one unlock.
+class _Challenge {
+  const _Challenge({required this.nonce, required this.expiresAt});
+
+  final String nonce;
+  final DateTime expiresAt;
+}
+
 class LocalUnlockService {
   LocalUnlockService({
     required SettingsService settingsService,
     http.Client? httpClient,
   }) : _settingsService = settingsService,
-       _httpClient = httpClient ?? http.Client();
+       _httpClient = httpClient ?? _keepAliveClient();
 
   final SettingsService _settingsService;
   final http.Client _httpClient;
 
+  // All keyed by the lock address's origin, since the same lock may be
+  // reached over several (see [candidateBaseUrls]).
+  //
+  // Set while the last exchange over an address is recent enough that its
+  // keep-alive connection is still open, so a probe would only cost an RTT.
+  final Map<String, DateTime> _warmUntil = <String, DateTime>{};
+  final Map<String, Future<bool>> _probesInFlight = <String, Future<bool>>{};
+  // Fetched by the probe, so an unlock right after it is a single request.
+  final Map<String, _Challenge> _challenges = <String, _Challenge>{};
+
+  // Nonces are used this long before the lock says they expire, so one is
+  // not sent just as it runs out.
+  static const Duration _challengeMargin = Duration(seconds: 2);
+
+  /// The `mac` the lock expects for [nonce]: the hex HMAC-SHA256 of
+  /// `poot-unlock:<nonce>` under the shared key. The key itself is never
+  /// sent.
+  static String signChallenge(String sharedKey, String nonce) {
+    final Hmac hmac = Hmac(sha256, utf8.encode(sharedKey));
+    return hmac.convert(utf8.encode('poot-unlock:$nonce')).toString();
+  }
+
+  // One client for every request, so the probe and the unlock share a
+  // connection instead of paying for two TCP handshakes.
+  static http.Client _keepAliveClient() {
+    final HttpClient client = HttpClient()
+      ..idleTimeout = AppConfig.localKeepAliveIdle;
+    return IOClient(client);
+  }
+
+  bool _isWarm(String origin) {
+    final DateTime? warmUntil = _warmUntil[origin];
+    return warmUntil != null && DateTime.now().isBefore(warmUntil);
+  }
+
+  void _markWarm(String origin) {
+    _warmUntil[origin] = DateTime.now().add(AppConfig.localKeepAliveIdle);
+  }
+
+  /// Opens (or refreshes) the connection to the lock ahead of an unlock, e.g.
+  /// while the biometric prompt is up. A following [unlock] then skips its
+  /// probe and only pays for the unlock request itself.
+  Future<bool> warmUp() async {
+    try {
+      final LocalUnlockSettings? settings = await _readConfiguredSettings();
+      if (settings == null) {
+        return false;
+      }
+      return _probe(settings.baseUrl);
+    } catch (_) {
+      return false;
+    }
+  }
+
   Future<bool> canReachDirectLanUnlock() async {
     try {
       final LocalUnlockSettings? settings = await _readConfiguredSettings();
       if (settings == null) {
         return false;
       }
-      return _isReachable(Uri.parse('${settings.baseUrl}/'));
+      return _probe(settings.baseUrl);
     } catch (_) {
       return false;
     }
@@ -59,7 +123,65 @@ class LocalUnlockService {
     }
   }
 
-  // Checks reachability, connects to home WiFi if needed, then unlocks.
+  /// Every address the lock may answer on, the configured base URL first,
+  /// or none when local unlock is not configured.
+  Future<List<String>> candidateBaseUrls() async {
+    final LocalUnlockSettings? settings = await _readConfiguredSettings();
+    if (settings == null) {
+      return const <String>[];
+    }
+    final Map<String, String> byOrigin = <String, String>{};
+    for (final String baseUrl in <String>[
+      settings.baseUrl,
+      ...AppConfig.localAlternateBaseUrls,
+    ]) {
+      byOrigin.putIfAbsent(Uri.parse(baseUrl).origin, () => baseUrl);
+    }
+    return byOrigin.values.toList();
+  }
+
+  /// Whether the lock answers at [baseUrl]. A yes leaves a nonce behind, so
+  /// [unlockAt] the same address is a single request.
+  Future<bool> probe(String baseUrl) async {
+    try {
+      return await _probe(baseUrl);
+    } catch (_) {
+      return false;
+    }
+  }
+
+  /// Whether [probe] at [baseUrl] would send a request of its own, rather
+  /// than answer at once from a warm connection or join a probe already in
+  /// flight. Only such a probe's time says how fast the address answers.
+  bool probeWouldSend(String baseUrl) {
+    final String origin = Uri.parse(baseUrl).origin;
+    return !_isWarm(origin) && !_probesInFlight.containsKey(origin);
+  }
+
+  /// Unlocks at [baseUrl] without probing or joining Wi-Fi first.
+  Future<LocalUnlockResult> unlockAt(String baseUrl) async {
+    try {
+      final LocalUnlockSettings? settings = await _readConfiguredSettings();
+      if (settings == null) {
+        return const LocalUnlockResult(
+          success: false,
+          reason: 'local_settings_not_configured',
+        );
+      }
+      return _requestLocalUnlock(
+        uri: Uri.parse('$baseUrl/api/local-unlock'),
+        sharedKey: settings.sharedKey,
+      );
+    } catch (_) {
+      return const LocalUnlockResult(
+        success: false,
+        reason: 'local_request_failed',
+      );
+    }
+  }
+
+  // Checks reachability, connects to home WiFi if needed, then unlocks. The
+  // probe is skipped when a recent exchange left the connection warm.
   Future<LocalUnlockResult> unlock() async {
     try {
       final LocalUnlockSettings? settings = await _readConfiguredSettings();
@@ -70,8 +192,7 @@ class LocalUnlockService {
         );
       }
 
-      final bool reachable =
-          await _isReachable(Uri.parse('${settings.baseUrl}/'));
+      final bool reachable = await _probe(settings.baseUrl);
       if (!reachable) {
         await _connectToHomeWifi(settings);
       }
@@ -88,38 +209,55 @@ class LocalUnlockService {
     }
   }
 
+  // Signs a nonce instead of sending the key. A stale_nonce refusal (the
+  // nonce expired in flight, or the lock rebooted) is retried once with a
+  // fresh one.
   Future<LocalUnlockResult> _requestLocalUnlock({
     required Uri uri,
     required String sharedKey,
   }) async {
+    final String origin = uri.origin;
     try {
-      final Uri requestUri = uri.replace(
-        queryParameters: <String, String>{'key': sharedKey},
-      );
-      final http.Response response = await _httpClient
-          .get(requestUri)
-          .timeout(AppConfig.localRequestTimeout);
+      for (int attempt = 0; ; attempt++) {
+        final _Challenge? challenge =
+            _takeChallenge(origin) ??
+            await _fetchChallenge(
+              uri.resolve('/api/challenge'),
+              AppConfig.localRequestTimeout,
+            );
+        if (challenge == null) {
+          return const LocalUnlockResult(
+            success: false,
+            reason: 'local_challenge_failed',
+          );
+        }
+        final Uri requestUri = uri.replace(
+          queryParameters: <String, String>{
+            'nonce': challenge.nonce,
+            'mac': signChallenge(sharedKey, challenge.nonce),
+          },
+        );
+        final http.Response response = await _httpClient
+            .get(requestUri)
+            .timeout(AppConfig.localRequestTimeout);
 
-      if (response.statusCode >= 200 && response.statusCode < 300) {
-        return const LocalUnlockResult(success: true, reason: 'ok');
-      }
+        // Any reply means the connection is up and kept alive.
+        _markWarm(origin);
+        if (response.statusCode >= 200 && response.statusCode < 300) {
+          return const LocalUnlockResult(success: true, reason: 'ok');
+        }
 
-      try {
-        final Map<String, dynamic> body =
-            jsonDecode(response.body) as Map<String, dynamic>;
-        return LocalUnlockResult(
-          success: false,
-          reason: (body['code'] ?? 'local_unlock_denied').toString(),
-        );
-      } catch (_) {
-        return const LocalUnlockResult(
-          success: false,
-          reason: 'local_unlock_denied',
-        );
+        final String reason = _refusalReason(response);
+        if (reason == 'stale_nonce' && attempt == 0) {
+          continue;
+        }
+        return LocalUnlockResult(success: false, reason: reason);
       }
     } on TimeoutException {
+      _warmUntil.remove(origin);
       return const LocalUnlockResult(success: false, reason: 'local_timeout');
     } catch (_) {
+      _warmUntil.remove(origin);
       return const LocalUnlockResult(
         success: false,
         reason: 'local_request_failed',
@@ -127,6 +265,44 @@ class LocalUnlockService {
     }
   }
 
+  String _refusalReason(http.Response response) {
+    try {
+      final Map<String, dynamic> body =
+          jsonDecode(response.body) as Map<String, dynamic>;
+      return (body['code'] ?? 'local_unlock_denied').toString();
+    } catch (_) {
+      return 'local_unlock_denied';
+    }
+  }
+
+  _Challenge? _takeChallenge(String origin) {
+    final _Challenge? challenge = _challenges.remove(origin);
+    if (challenge == null || !DateTime.now().isBefore(challenge.expiresAt)) {
+      return null;
+    }
+    return challenge;
+  }
+
+  Future<_Challenge?> _fetchChallenge(Uri uri, Duration timeout) async {
+    final http.Response response = await _httpClient.get(uri).timeout(timeout);
+    if (response.statusCode != 200) {
+      return null;
+    }
+    final Map<String, dynamic> body =
+        jsonDecode(response.body) as Map<String, dynamic>;
+    final Object? nonce = body['nonce'];
+    final Object? ttlMs = body['ttl_ms'];
+    if (nonce is! String || ttlMs is! int) {
+      return null;
+    }
+    return _Challenge(
+      nonce: nonce,
+      expiresAt: DateTime.now()
+          .add(Duration(milliseconds: ttlMs))
+          .subtract(_challengeMargin),
+    );
+  }
+
   Future<LocalUnlockSettings?> _readConfiguredSettings() async {
     final LocalUnlockSettings settings = await _settingsService.readSettings();
     if (!settings.isConfigured) {
@@ -135,16 +311,39 @@ class LocalUnlockService {
     return settings;
   }
 
-  Future<bool> _isReachable(Uri uri) async {
+  // Concurrent callers (warmUp() racing unlock()) share one probe per
+  // address.
+  Future<bool> _probe(String baseUrl) {
+    final Uri uri = Uri.parse('$baseUrl/api/challenge');
+    final String origin = uri.origin;
+    if (_isWarm(origin)) {
+      return Future<bool>.value(true);
+    }
+    return _probesInFlight[origin] ??= _prefetchChallenge(
+      uri,
+    ).whenComplete(() => _probesInFlight.remove(origin));
+  }
+
+  // The probe asks for a challenge: a reply shows the lock is reachable and
+  // leaves the nonce the unlock needs.
+  Future<bool> _prefetchChallenge(Uri uri) async {
+    final String origin = uri.origin;
     try {
-      final http.Response response = await _httpClient
-          .get(uri)
-          .timeout(AppConfig.localProbeTimeout);
-      return response.statusCode == 200 &&
-          response.body.trim() == 'Poot lock online';
+      final _Challenge? challenge = await _fetchChallenge(
+        uri,
+        AppConfig.localProbeTimeout,
+      );
+      if (challenge == null) {
+        return false;
+      }
+      _challenges[origin] = challenge;
+      _markWarm(origin);
+      return true;
     } on TimeoutException {
+      _warmUntil.remove(origin);
       return false;
     } catch (_) {
+      _warmUntil.remove(origin);
       return false;
     }
   }
@@ -173,6 +372,14 @@ class LocalUnlockService {
       // iOS may require user confirmation via system prompt.
     }
 
-    await Future<void>.delayed(const Duration(seconds: 2));
+    // Polled rather than slept on: the lock usually answers well before the
+    // wait is up, and the answer leaves the nonce the unlock needs.
+    final DateTime giveUpAt = DateTime.now().add(AppConfig.homeWifiJoinWait);
+    while (DateTime.now().isBefore(giveUpAt)) {
+      if (await _probe(settings.baseUrl)) {
+        return;
+      }
+      await Future<void>.delayed(AppConfig.homeWifiJoinPoll);
+    }
   }
 }
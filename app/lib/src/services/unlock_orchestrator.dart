@@ -1,11 +1,19 @@
+import 'dart:async';
+
+import '../config/app_config.dart';
 import '../models/unlock_result.dart';
 import 'local_unlock_service.dart';
+import 'unlock_path_memory.dart';
 
 class UnlockOrchestrator {
-  UnlockOrchestrator({required LocalUnlockService localUnlockService})
-    : _localUnlockService = localUnlockService;
+  UnlockOrchestrator({
+    required LocalUnlockService localUnlockService,
+    UnlockPathMemory? pathMemory,
+  }) : _localUnlockService = localUnlockService,
+       _pathMemory = pathMemory ?? UnlockPathMemory();
 
   final LocalUnlockService _localUnlockService;
+  final UnlockPathMemory _pathMemory;
 
   Future<UnlockResult> unlock({bool Function()? isCancelled}) async {
     bool cancelled() => isCancelled?.call() == true;
@@ -22,7 +30,7 @@ class UnlockOrchestrator {
 
     final LocalUnlockResult result;
     try {
-      result = await _localUnlockService.unlock();
+      result = await _unlockOverFastestPath(cancelled);
     } catch (_) {
       return const UnlockResult(
         success: false,
@@ -49,4 +57,122 @@ class UnlockOrchestrator {
       message: 'Unlock failed: ${result.reason}',
     );
   }
+
+  // Races the lock's addresses happy-eyeballs style (RFC 8305): each probe
+  // gets a head start over the next, the one remembered to have won on this
+  // network goes first, and the unlock is sent once, over the first address
+  // to answer. Only when none answers is the slow path taken: join the home
+  // Wi-Fi and unlock at the configured address.
+  Future<LocalUnlockResult> _unlockOverFastestPath(
+    bool Function() cancelled,
+  ) async {
+    final List<String> baseUrls = List<String>.of(
+      await _localUnlockService.candidateBaseUrls(),
+    );
+    if (baseUrls.isEmpty) {
+      return _localUnlockService.unlock();
+    }
+
+    final String network = await _pathMemory.currentNetwork();
+    final UnlockPathRecord? remembered = await _pathMemory.winnerOn(network);
+    if (remembered != null && baseUrls.remove(remembered.baseUrl)) {
+      baseUrls.insert(0, remembered.baseUrl);
+    }
+
+    final _PathWin? win = await _firstToAnswer(
+      baseUrls,
+      remembered,
+      cancelled,
+    );
+    if (cancelled()) {
+      return const LocalUnlockResult(success: false, reason: 'canceled');
+    }
+    if (win == null) {
+      return _localUnlockService.unlock();
+    }
+
+    final LocalUnlockResult result = await _localUnlockService.unlockAt(
+      win.baseUrl,
+    );
+    final Duration? latency = win.latency;
+    if (result.success && latency != null) {
+      await _pathMemory.recordWin(network, win.baseUrl, latency);
+    }
+    return result;
+  }
+
+  // Completes with the first address whose probe succeeds, or null once all
+  // have failed. Paths not yet started when one wins (or the user cancels)
+  // never start; the answers of those already in flight are ignored.
+  Future<_PathWin?> _firstToAnswer(
+    List<String> baseUrls,
+    UnlockPathRecord? remembered,
+    bool Function() cancelled,
+  ) {
+    final Completer<_PathWin?> done = Completer<_PathWin?>();
+    int next = 0;
+    int pending = 0;
+    Timer? stagger;
+
+    void finish(_PathWin? win) {
+      stagger?.cancel();
+      if (!done.isCompleted) {
+        done.complete(win);
+      }
+    }
+
+    void startNext() {
+      stagger?.cancel();
+      if (done.isCompleted) {
+        return;
+      }
+      if (cancelled() || next >= baseUrls.length) {
+        if (pending == 0) {
+          finish(null);
+        }
+        return;
+      }
+      final String baseUrl = baseUrls[next++];
+      pending++;
+      stagger = Timer(_staggerAfter(baseUrl, remembered), startNext);
+      // A warm or shared probe answers sooner than the address would, so
+      // its time is not recorded.
+      final bool timed = _localUnlockService.probeWouldSend(baseUrl);
+      final Stopwatch stopwatch = Stopwatch()..start();
+      _localUnlockService.probe(baseUrl).then((bool reachable) {
+        pending--;
+        if (reachable) {
+          finish(_PathWin(baseUrl, timed ? stopwatch.elapsed : null));
+        } else {
+          startNext();
+        }
+      });
+    }
+
+    startNext();
+    return done.future;
+  }
+
+  // Twice the remembered answer time, so a path that is usually quick is
+  // given up on early, but never longer than the default head start.
+  Duration _staggerAfter(String baseUrl, UnlockPathRecord? remembered) {
+    if (remembered == null || remembered.baseUrl != baseUrl) {
+      return AppConfig.unlockPathStagger;
+    }
+    final Duration stagger = remembered.latency * 2;
+    if (stagger < AppConfig.unlockPathMinStagger) {
+      return AppConfig.unlockPathMinStagger;
+    }
+    return stagger > AppConfig.unlockPathStagger
+        ? AppConfig.unlockPathStagger
+        : stagger;
+  }
+}
+
+class _PathWin {
+  const _PathWin(this.baseUrl, this.latency);
+
+  final String baseUrl;
+  // Null when the probe did not go out on its own (see probeWouldSend).
+  final Duration? latency;
 }
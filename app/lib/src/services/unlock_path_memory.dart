@@ -0,0 +1,113 @@
+import 'dart:convert';
+import 'dart:io';
+
+import 'package:shared_preferences/shared_preferences.dart';
+import 'package:wifi_iot/wifi_iot.dart';
+
+/// The lock address that answered first on a network, and how fast.
+class UnlockPathRecord {
+  const UnlockPathRecord({required this.baseUrl, required this.latency});
+
+  final String baseUrl;
+  final Duration latency;
+}
+
+/// Remembers, per Wi-Fi network, which of the lock's addresses won the last
+/// unlock race and a running average of how long it took to answer, so the
+/// next race starts with it and knows how long to wait before trying others.
+class UnlockPathMemory {
+  UnlockPathMemory({Future<String?> Function()? currentNetwork})
+    : _currentNetwork = currentNetwork ?? _wifiSsid;
+
+  final Future<String?> Function() _currentNetwork;
+  Map<String, UnlockPathRecord>? _records;
+
+  static const String _recordsKey = 'unlock_path_memory';
+  // Networks whose SSID cannot be read (no permission, cellular) share one
+  // record.
+  static const String _unknownNetwork = '';
+  static const int _maxNetworks = 8;
+  // Weight of the newest answer time in the running average.
+  static const double _latencyWeight = 0.25;
+
+  static Future<String?> _wifiSsid() async {
+    if (!Platform.isAndroid && !Platform.isIOS) {
+      return null;
+    }
+    return WiFiForIoTPlugin.getSSID();
+  }
+
+  Future<String> currentNetwork() async {
+    try {
+      return (await _currentNetwork())?.trim() ?? _unknownNetwork;
+    } catch (_) {
+      return _unknownNetwork;
+    }
+  }
+
+  Future<UnlockPathRecord?> winnerOn(String network) async {
+    return (await _load())[network];
+  }
+
+  /// Notes that [baseUrl] answered first on [network] after [latency]. A new
+  /// winner starts its average over.
+  Future<void> recordWin(
+    String network,
+    String baseUrl,
+    Duration latency,
+  ) async {
+    try {
+      final Map<String, UnlockPathRecord> records = await _load();
+      final UnlockPathRecord? previous = records.remove(network);
+      final Duration average = previous == null || previous.baseUrl != baseUrl
+          ? latency
+          : previous.latency * (1 - _latencyWeight) + latency * _latencyWeight;
+      // Re-inserted last, so the least recently used network is dropped.
+      records[network] = UnlockPathRecord(baseUrl: baseUrl, latency: average);
+      while (records.length > _maxNetworks) {
+        records.remove(records.keys.first);
+      }
+
+      final SharedPreferences prefs = await SharedPreferences.getInstance();
+      await prefs.setString(
+        _recordsKey,
+        jsonEncode(<String, Object>{
+          for (final MapEntry<String, UnlockPathRecord> entry
+              in records.entries)
+            entry.key: <String, Object>{
+              'base_url': entry.value.baseUrl,
+              'latency_ms': entry.value.latency.inMilliseconds,
+            },
+        }),
+      );
+    } catch (_) {
+      // Losing the record only costs the next unlock its head start.
+    }
+  }
+
+  Future<Map<String, UnlockPathRecord>> _load() async {
+    final Map<String, UnlockPathRecord>? loaded = _records;
+    if (loaded != null) {
+      return loaded;
+    }
+    final Map<String, UnlockPathRecord> records = <String, UnlockPathRecord>{};
+    try {
+      final SharedPreferences prefs = await SharedPreferences.getInstance();
+      final String? stored = prefs.getString(_recordsKey);
+      if (stored != null) {
+        final Map<String, dynamic> decoded =
+            jsonDecode(stored) as Map<String, dynamic>;
+        decoded.forEach((String network, dynamic value) {
+          final Map<String, dynamic> record = value as Map<String, dynamic>;
+          records[network] = UnlockPathRecord(
+            baseUrl: record['base_url'] as String,
+            latency: Duration(milliseconds: record['latency_ms'] as int),
+          );
+        });
+      }
+    } catch (_) {
+      records.clear();
+    }
+    return _records = records;
+  }
+}
@@ -1,3 +1,6 @@
+import 'dart:convert';
+
+import 'package:crypto/crypto.dart';
 import 'package:flutter_test/flutter_test.dart';
 import 'package:http/http.dart' as http;
 import 'package:http/testing.dart';
@@ -14,6 +17,11 @@ class FakeSettingsService extends SettingsService {
   Future<LocalUnlockSettings> readSettings() async => _settings;
 }
 
+const String nonce = '00112233445566778899aabbccddeeff';
+
+http.Response challengeReply() =>
+    http.Response('{"ok":true,"nonce":"$nonce","ttl_ms":30000}', 200);
+
 void main() {
   const LocalUnlockSettings settings = LocalUnlockSettings(
     homeWifiSsid: 'HomeWiFi',
@@ -22,15 +30,31 @@ void main() {
     baseUrl: 'http://192.168.1.192',
   );
 
-  test('unlockViaLan sends correct request and returns success', () async {
+  test('signChallenge matches the firmware', () {
+    // The same known answer as the firmware bench (auth/signed_unlock).
+    expect(
+      LocalUnlockService.signChallenge('host-local-shared-key', nonce),
+      'bd7f8f57ec40769fc2314b9a03b775b792d0071b554988e3d4d559bcd1359520',
+    );
+  });
+
+  test('unlockViaLan signs a fresh challenge and returns success', () async {
     final List<Uri> requests = <Uri>[];
+    final String mac = Hmac(
+      sha256,
+      utf8.encode(settings.sharedKey),
+    ).convert(utf8.encode('poot-unlock:$nonce')).toString();
     final LocalUnlockService service = LocalUnlockService(
       settingsService: FakeSettingsService(settings),
       httpClient: MockClient((http.Request request) async {
         requests.add(request.url);
         expect(request.method, 'GET');
+        if (request.url.path == '/api/challenge') {
+          return challengeReply();
+        }
         expect(request.url.queryParameters, <String, String>{
-          'key': settings.sharedKey,
+          'nonce': nonce,
+          'mac': mac,
         });
         return http.Response('{"ok":true,"code":"ok"}', 200);
       }),
@@ -40,23 +64,70 @@ void main() {
 
     expect(result.success, isTrue);
     expect(requests, <Uri>[
-      Uri.parse('http://192.168.1.192/api/local-unlock?key=shared-key'),
+      Uri.parse('http://192.168.1.192/api/challenge'),
+      Uri.parse('http://192.168.1.192/api/local-unlock?nonce=$nonce&mac=$mac'),
     ]);
+    expect(requests.last.query, isNot(contains(settings.sharedKey)));
   });
 
   test('unlockViaLan returns invalid_key reason on 401', () async {
+    final LocalUnlockService service = LocalUnlockService(
+      settingsService: FakeSettingsService(settings),
+      httpClient: MockClient((http.Request request) async {
+        if (request.url.path == '/api/challenge') {
+          return challengeReply();
+        }
+        return http.Response('{"ok":false,"code":"invalid_key"}', 401);
+      }),
+    );
+
+    final LocalUnlockResult result = await service.unlockViaLan();
+
+    expect(result.success, isFalse);
+    expect(result.reason, 'invalid_key');
+  });
+
+  test('unlockViaLan retries a stale nonce once with a fresh one', () async {
+    final List<String> paths = <String>[];
+    int unlocks = 0;
+    final LocalUnlockService service = LocalUnlockService(
+      settingsService: FakeSettingsService(settings),
+      httpClient: MockClient((http.Request request) async {
+        paths.add(request.url.path);
+        if (request.url.path == '/api/challenge') {
+          return challengeReply();
+        }
+        unlocks++;
+        if (unlocks == 1) {
+          return http.Response('{"ok":false,"code":"stale_nonce"}', 401);
+        }
+        return http.Response('{"ok":true,"code":"ok"}', 200);
+      }),
+    );
+
+    final LocalUnlockResult result = await service.unlockViaLan();
+
+    expect(result.success, isTrue);
+    expect(paths, <String>[
+      '/api/challenge',
+      '/api/local-unlock',
+      '/api/challenge',
+      '/api/local-unlock',
+    ]);
+  });
+
+  test('unlockViaLan fails when the lock hands out no challenge', () async {
     final LocalUnlockService service = LocalUnlockService(
       settingsService: FakeSettingsService(settings),
       httpClient: MockClient(
-        (_) async =>
-            http.Response('{"ok":false,"code":"invalid_key"}', 401),
+        (_) async => http.Response('{"ok":false,"code":"not_found"}', 404),
       ),
     );
 
     final LocalUnlockResult result = await service.unlockViaLan();
 
     expect(result.success, isFalse);
-    expect(result.reason, 'invalid_key');
+    expect(result.reason, 'local_challenge_failed');
   });
 
   test('unlock calls LAN endpoint when lock is reachable via probe', () async {
@@ -65,8 +136,8 @@ void main() {
       settingsService: FakeSettingsService(settings),
       httpClient: MockClient((http.Request request) async {
         requests.add(request.url);
-        if (request.url.path == '/') {
-          return http.Response('Poot lock online', 200);
+        if (request.url.path == '/api/challenge') {
+          return challengeReply();
         }
         return http.Response('{"ok":true,"code":"ok"}', 200);
       }),
@@ -75,7 +146,11 @@ void main() {
     final LocalUnlockResult result = await service.unlock();
 
     expect(result.success, isTrue);
-    expect(requests.last.path, '/api/local-unlock');
+    // The probe's nonce signs the unlock; no second challenge.
+    expect(requests.map((Uri uri) => uri.path), <String>[
+      '/api/challenge',
+      '/api/local-unlock',
+    ]);
   });
 
   test('unlock proceeds to LAN endpoint even when probe fails', () async {
@@ -84,9 +159,12 @@ void main() {
       settingsService: FakeSettingsService(settings),
       httpClient: MockClient((http.Request request) async {
         requests.add(request.url);
-        if (request.url.path == '/') {
+        if (request.url.path == '/api/challenge' && requests.length == 1) {
           throw Exception('network unreachable');
         }
+        if (request.url.path == '/api/challenge') {
+          return challengeReply();
+        }
         return http.Response('{"ok":true,"code":"ok"}', 200);
       }),
     );
@@ -98,4 +176,100 @@ void main() {
     expect(result.success, isTrue);
     expect(requests.last.path, '/api/local-unlock');
   });
+
+  test('unlock after warmUp reuses the warm connection without a probe',
+      () async {
+    final List<String> paths = <String>[];
+    final LocalUnlockService service = LocalUnlockService(
+      settingsService: FakeSettingsService(settings),
+      httpClient: MockClient((http.Request request) async {
+        paths.add(request.url.path);
+        if (request.url.path == '/api/challenge') {
+          return challengeReply();
+        }
+        return http.Response('{"ok":true,"code":"ok"}', 200);
+      }),
+    );
+
+    expect(await service.warmUp(), isTrue);
+    final LocalUnlockResult result = await service.unlock();
+
+    expect(result.success, isTrue);
+    expect(paths, <String>['/api/challenge', '/api/local-unlock']);
+  });
+
+  test('warmUp racing unlock sends a single probe', () async {
+    final List<String> paths = <String>[];
+    final LocalUnlockService service = LocalUnlockService(
+      settingsService: FakeSettingsService(settings),
+      httpClient: MockClient((http.Request request) async {
+        paths.add(request.url.path);
+        if (request.url.path == '/api/challenge') {
+          await Future<void>.delayed(const Duration(milliseconds: 10));
+          return challengeReply();
+        }
+        return http.Response('{"ok":true,"code":"ok"}', 200);
+      }),
+    );
+
+    final Future<bool> warm = service.warmUp();
+    final LocalUnlockResult result = await service.unlock();
+
+    expect(await warm, isTrue);
+    expect(result.success, isTrue);
+    expect(paths, <String>['/api/challenge', '/api/local-unlock']);
+  });
+
+  test('candidateBaseUrls lists the lock\'s addresses once each', () async {
+    final LocalUnlockService service = LocalUnlockService(
+      settingsService: FakeSettingsService(settings),
+      httpClient: MockClient((_) async => http.Response('', 404)),
+    );
+    final LocalUnlockService onHotspot = LocalUnlockService(
+      settingsService: FakeSettingsService(
+        const LocalUnlockSettings(
+          homeWifiSsid: 'HomeWiFi',
+          homeWifiPassword: 'password123',
+          sharedKey: 'shared-key',
+          baseUrl: 'http://192.168.4.1',
+        ),
+      ),
+      httpClient: MockClient((_) async => http.Response('', 404)),
+    );
+
+    expect(await service.candidateBaseUrls(), <String>[
+      'http://192.168.1.192',
+      'http://192.168.4.1',
+      'http://poot.local',
+    ]);
+    expect(await onHotspot.candidateBaseUrls(), <String>[
+      'http://192.168.4.1',
+      'http://poot.local',
+    ]);
+  });
+
+  test('unlockAt spends the nonce its own address handed out', () async {
+    final List<Uri> requests = <Uri>[];
+    final LocalUnlockService service = LocalUnlockService(
+      settingsService: FakeSettingsService(settings),
+      httpClient: MockClient((http.Request request) async {
+        requests.add(request.url);
+        if (request.url.path == '/api/challenge') {
+          return challengeReply();
+        }
+        return http.Response('{"ok":true,"code":"ok"}', 200);
+      }),
+    );
+
+    expect(await service.probe('http://192.168.4.1'), isTrue);
+    final LocalUnlockResult result = await service.unlockAt(
+      'http://192.168.4.1',
+    );
+
+    expect(result.success, isTrue);
+    expect(requests.map((Uri uri) => '${uri.host}${uri.path}'), <String>[
+      '192.168.4.1/api/challenge',
+      '192.168.4.1/api/local-unlock',
+    ]);
+  });
 }
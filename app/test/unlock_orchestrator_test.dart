@@ -3,6 +3,8 @@ import 'package:poot/src/models/unlock_result.dart';
 import 'package:poot/src/services/local_unlock_service.dart';
 import 'package:poot/src/services/settings_service.dart';
 import 'package:poot/src/services/unlock_orchestrator.dart';
+import 'package:poot/src/services/unlock_path_memory.dart';
+import 'package:shared_preferences/shared_preferences.dart';
 
 class FakeSettingsService extends SettingsService {}
 
@@ -14,6 +16,10 @@ class FakeLocalUnlockService extends LocalUnlockService {
   final Object? error;
   int calls = 0;
 
+  // No addresses to race, so the orchestrator goes straight to unlock().
+  @override
+  Future<List<String>> candidateBaseUrls() async => const <String>[];
+
   @override
   Future<LocalUnlockResult> unlock() async {
     calls++;
@@ -24,6 +30,53 @@ class FakeLocalUnlockService extends LocalUnlockService {
   }
 }
 
+// A lock reachable at some addresses: each probe answers after its delay.
+class RacingLocalUnlockService extends LocalUnlockService {
+  RacingLocalUnlockService(this.paths)
+    : super(settingsService: FakeSettingsService());
+
+  // Base URL to (reachable, answer delay), in candidate order.
+  final Map<String, (bool, Duration)> paths;
+  final List<String> probed = <String>[];
+  final List<String> unlockedAt = <String>[];
+  // Addresses with a warm connection: their probes answer without traffic.
+  final Set<String> warm = <String>{};
+  int fallbacks = 0;
+
+  @override
+  Future<List<String>> candidateBaseUrls() async => paths.keys.toList();
+
+  @override
+  bool probeWouldSend(String baseUrl) => !warm.contains(baseUrl);
+
+  @override
+  Future<bool> probe(String baseUrl) async {
+    probed.add(baseUrl);
+    final (bool reachable, Duration delay) = paths[baseUrl]!;
+    await Future<void>.delayed(delay);
+    return reachable;
+  }
+
+  @override
+  Future<LocalUnlockResult> unlockAt(String baseUrl) async {
+    unlockedAt.add(baseUrl);
+    return const LocalUnlockResult(success: true, reason: 'ok');
+  }
+
+  @override
+  Future<LocalUnlockResult> unlock() async {
+    fallbacks++;
+    return const LocalUnlockResult(success: false, reason: 'local_timeout');
+  }
+}
+
+const String lanUrl = 'http://192.168.1.192';
+const String apUrl = 'http://192.168.4.1';
+const String mdnsUrl = 'http://poot.local';
+
+UnlockPathMemory homeMemory() =>
+    UnlockPathMemory(currentNetwork: () async => 'HomeWiFi');
+
 void main() {
   test('returns success with local path when unlock succeeds', () async {
     final FakeLocalUnlockService local = FakeLocalUnlockService(
@@ -85,4 +138,184 @@ void main() {
     expect(result.message, contains('canceled'));
     expect(local.calls, 0);
   });
+
+  group('path race', () {
+    setUp(() => SharedPreferences.setMockInitialValues(<String, Object>{}));
+
+    test('unlocks once over the first address to answer', () async {
+      final RacingLocalUnlockService local = RacingLocalUnlockService(
+        <String, (bool, Duration)>{
+          lanUrl: (false, const Duration(milliseconds: 20)),
+          apUrl: (true, const Duration(milliseconds: 10)),
+          mdnsUrl: (true, const Duration(milliseconds: 500)),
+        },
+      );
+      final UnlockPathMemory memory = homeMemory();
+      final UnlockOrchestrator orchestrator = UnlockOrchestrator(
+        localUnlockService: local,
+        pathMemory: memory,
+      );
+
+      final UnlockResult result = await orchestrator.unlock();
+
+      expect(result.success, isTrue);
+      // The LAN address failed fast, so the hotspot started without waiting
+      // out the stagger, and its answer kept mDNS from starting at all.
+      expect(local.probed, <String>[lanUrl, apUrl]);
+      expect(local.unlockedAt, <String>[apUrl]);
+      expect(local.fallbacks, 0);
+      expect((await memory.winnerOn('HomeWiFi'))?.baseUrl, apUrl);
+    });
+
+    test('does not time an answer from a warm connection', () async {
+      final RacingLocalUnlockService local = RacingLocalUnlockService(
+        <String, (bool, Duration)>{lanUrl: (true, Duration.zero)},
+      )..warm.add(lanUrl);
+      final UnlockPathMemory memory = homeMemory();
+      await memory.recordWin(
+        'HomeWiFi',
+        lanUrl,
+        const Duration(milliseconds: 40),
+      );
+      final UnlockOrchestrator orchestrator = UnlockOrchestrator(
+        localUnlockService: local,
+        pathMemory: memory,
+      );
+
+      final UnlockResult result = await orchestrator.unlock();
+
+      expect(result.success, isTrue);
+      expect(local.unlockedAt, <String>[lanUrl]);
+      expect(
+        (await memory.winnerOn('HomeWiFi'))?.latency,
+        const Duration(milliseconds: 40),
+      );
+    });
+
+    test('starts the next address while a slow one is pending', () async {
+      final RacingLocalUnlockService local = RacingLocalUnlockService(
+        <String, (bool, Duration)>{
+          lanUrl: (true, const Duration(seconds: 2)),
+          apUrl: (true, const Duration(milliseconds: 10)),
+          mdnsUrl: (true, const Duration(milliseconds: 10)),
+        },
+      );
+      final UnlockOrchestrator orchestrator = UnlockOrchestrator(
+        localUnlockService: local,
+        pathMemory: homeMemory(),
+      );
+
+      final Stopwatch stopwatch = Stopwatch()..start();
+      final UnlockResult result = await orchestrator.unlock();
+
+      expect(result.success, isTrue);
+      expect(stopwatch.elapsed, lessThan(const Duration(seconds: 2)));
+      expect(local.probed, <String>[lanUrl, apUrl]);
+      expect(local.unlockedAt, <String>[apUrl]);
+    });
+
+    test('tries the address that won on this network first', () async {
+      final RacingLocalUnlockService local = RacingLocalUnlockService(
+        <String, (bool, Duration)>{
+          lanUrl: (true, Duration.zero),
+          apUrl: (true, Duration.zero),
+          mdnsUrl: (true, Duration.zero),
+        },
+      );
+      final UnlockPathMemory memory = homeMemory();
+      await memory.recordWin(
+        'HomeWiFi',
+        mdnsUrl,
+        const Duration(milliseconds: 30),
+      );
+      final UnlockOrchestrator orchestrator = UnlockOrchestrator(
+        localUnlockService: local,
+        pathMemory: memory,
+      );
+
+      final UnlockResult result = await orchestrator.unlock();
+
+      expect(result.success, isTrue);
+      expect(local.probed, <String>[mdnsUrl]);
+      expect(local.unlockedAt, <String>[mdnsUrl]);
+    });
+
+    test('falls back to joining Wi-Fi when no address answers', () async {
+      final RacingLocalUnlockService local = RacingLocalUnlockService(
+        <String, (bool, Duration)>{
+          lanUrl: (false, Duration.zero),
+          apUrl: (false, Duration.zero),
+          mdnsUrl: (false, Duration.zero),
+        },
+      );
+      final UnlockOrchestrator orchestrator = UnlockOrchestrator(
+        localUnlockService: local,
+        pathMemory: homeMemory(),
+      );
+
+      final UnlockResult result = await orchestrator.unlock();
+
+      expect(result.success, isFalse);
+      expect(result.message, contains('local_timeout'));
+      expect(local.probed, <String>[lanUrl, apUrl, mdnsUrl]);
+      expect(local.unlockedAt, isEmpty);
+      expect(local.fallbacks, 1);
+    });
+
+    test('sends no unlock once canceled mid-race', () async {
+      bool canceled = false;
+      final RacingLocalUnlockService local = RacingLocalUnlockService(
+        <String, (bool, Duration)>{
+          lanUrl: (true, const Duration(milliseconds: 50)),
+        },
+      );
+      final UnlockOrchestrator orchestrator = UnlockOrchestrator(
+        localUnlockService: local,
+        pathMemory: homeMemory(),
+      );
+
+      final Future<UnlockResult> pending = orchestrator.unlock(
+        isCancelled: () => canceled,
+      );
+      await Future<void>.delayed(const Duration(milliseconds: 10));
+      canceled = true;
+      final UnlockResult result = await pending;
+
+      expect(result.message, contains('canceled'));
+      expect(local.unlockedAt, isEmpty);
+    });
+  });
+
+  test(
+    'path memory averages a repeat winner and resets on a new one',
+    () async {
+      SharedPreferences.setMockInitialValues(<String, Object>{});
+      final UnlockPathMemory memory = homeMemory();
+
+      await memory.recordWin(
+        'HomeWiFi',
+        lanUrl,
+        const Duration(milliseconds: 100),
+      );
+      await memory.recordWin(
+        'HomeWiFi',
+        lanUrl,
+        const Duration(milliseconds: 20),
+      );
+      expect(
+        (await memory.winnerOn('HomeWiFi'))?.latency,
+        const Duration(milliseconds: 80),
+      );
+
+      await memory.recordWin(
+        'HomeWiFi',
+        apUrl,
+        const Duration(milliseconds: 40),
+      );
+      final UnlockPathRecord? record = await homeMemory().winnerOn('HomeWiFi');
+      expect(record?.baseUrl, apUrl);
+      expect(record?.latency, const Duration(milliseconds: 40));
+      expect(await memory.winnerOn('Office'), isNull);
+    },
+  );
 }
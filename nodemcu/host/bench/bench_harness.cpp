@@ -0,0 +1,81 @@
+#include "bench_harness.h"
+
+#include "alloc_tracker.h"
+
+namespace poot_bench {
+
+// operator new/delete are replaced by the sketch's alloc_tracker.cpp, so every
+// heap allocation made by sketch code (String, std::function captures,
+// Print::printf spill buffers) is counted there.
+AllocCounters allocCounters() {
+  const poot_alloc::Totals& totals = poot_alloc::totals();
+  return AllocCounters{totals.allocs, totals.frees, totals.bytes};
+}
+
+Options parseOptions(int argc, char** argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      options.quick = true;
+    } else if (strcmp(argv[i], "--json") == 0) {
+      options.json = true;
+    } else if (strncmp(argv[i], "--filter=", 9) == 0) {
+      options.filter = argv[i] + 9;
+    } else {
+      fprintf(stderr, "usage: %s [--quick] [--json] [--filter=substring]\n",
+              argv[0]);
+      exit(2);
+    }
+  }
+  if (!options.json) {
+    printf("%-44s %12s %10s %10s %12s\n", "benchmark", "ns/op", "allocs/op",
+           "bytes/op", "iterations");
+  }
+  return options;
+}
+
+void Runner::report(const char* name, uint64_t iterations, double elapsedNs,
+                    const AllocCounters& before, const AllocCounters& after) {
+  cases_++;
+  const double n = static_cast<double>(iterations);
+  const double nsPerOp = elapsedNs / n;
+  const double allocsPerOp = static_cast<double>(after.allocs - before.allocs) / n;
+  const double bytesPerOp = static_cast<double>(after.bytes - before.bytes) / n;
+  if (options_.json) {
+    printf("{\"name\":\"%s\",\"ns_per_op\":%.1f,\"allocs_per_op\":%.2f,"
+           "\"bytes_per_op\":%.1f,\"iterations\":%llu}\n",
+           name, nsPerOp, allocsPerOp, bytesPerOp,
+           static_cast<unsigned long long>(iterations));
+  } else {
+    printf("%-44s %12.1f %10.2f %10.1f %12llu\n", name, nsPerOp, allocsPerOp,
+           bytesPerOp, static_cast<unsigned long long>(iterations));
+  }
+  fflush(stdout);
+}
+
+void Runner::metric(const char* name, const char* unit, double value) {
+  if (options_.filter != nullptr && strstr(name, options_.filter) == nullptr) {
+    return;
+  }
+  if (options_.json) {
+    printf("{\"name\":\"%s\",\"value\":%.1f,\"unit\":\"%s\"}\n", name,
+           value, unit);
+  } else {
+    printf("%-44s %12.1f %s\n", name, value, unit);
+  }
+  fflush(stdout);
+}
+
+void Runner::fail(const char* name, const char* reason) {
+  failures_++;
+  fprintf(stderr, "FAIL %s: %s\n", name, reason);
+}
+
+int Runner::finish() {
+  if (!options_.json) {
+    printf("%d case(s), %d failure(s)\n", cases_, failures_);
+  }
+  return failures_ == 0 ? 0 : 1;
+}
+
+}  // namespace poot_bench
@@ -0,0 +1,88 @@
+#pragma once
+
+// Minimal self-calibrating microbenchmark runner. Each case is timed over a
+// batch large enough to fill the target duration and reports ns/op plus the
+// number of operator new calls per op (counted by alloc_tracker.cpp).
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+
+namespace poot_bench {
+
+struct AllocCounters {
+  uint64_t allocs;
+  uint64_t frees;
+  uint64_t bytes;
+};
+
+AllocCounters allocCounters();
+
+struct Options {
+  bool quick = false;
+  bool json = false;
+  const char* filter = nullptr;
+};
+
+Options parseOptions(int argc, char** argv);
+
+class Runner {
+ public:
+  explicit Runner(const Options& options) : options_(options) {}
+
+  template <typename Fn>
+  void run(const char* name, Fn&& op) {
+    if (options_.filter != nullptr && strstr(name, options_.filter) == nullptr) {
+      return;
+    }
+    op();  // warm up caches and lazily-initialised state
+
+    const double targetNs = options_.quick ? 2e6 : 200e6;
+    uint64_t iterations = 1;
+    for (;;) {
+      const AllocCounters before = allocCounters();
+      const auto start = Clock::now();
+      for (uint64_t i = 0; i < iterations; i++) {
+        op();
+      }
+      const double elapsedNs = static_cast<double>(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                               start)
+              .count());
+      const AllocCounters after = allocCounters();
+      if (elapsedNs >= targetNs || iterations >= (1ULL << 32)) {
+        report(name, iterations, elapsedNs, before, after);
+        return;
+      }
+      const double scale =
+          elapsedNs <= 0 ? 10.0 : (targetNs * 1.2) / elapsedNs;
+      const double next = static_cast<double>(iterations) *
+                          (scale > 10.0 ? 10.0 : (scale < 1.5 ? 1.5 : scale));
+      iterations = static_cast<uint64_t>(next) + 1;
+    }
+  }
+
+  // Prints the footer and returns the process exit code.
+  int finish();
+
+  // Marks the run as failed (used by sanity checks before timing a case).
+  void fail(const char* name, const char* reason);
+
+  // Reports a derived figure (e.g. a simulated latency percentile) that is
+  // not a timed case. Honours --filter and --json like run().
+  void metric(const char* name, const char* unit, double value);
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  void report(const char* name, uint64_t iterations, double elapsedNs,
+              const AllocCounters& before, const AllocCounters& after);
+
+  Options options_;
+  int cases_ = 0;
+  int failures_ = 0;
+};
+
+}  // namespace poot_bench
@@ -0,0 +1,601 @@
+#include "cloud_standin.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#ifdef POOT_HOST_TLS
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+#endif
+
+#include "Arduino.h"
+
+namespace poot_bench {
+
+namespace {
+
+// Database time at millis() == 0: 2025-10-09, any fixed point will do.
+constexpr uint64_t kEpochMs = 1760000000000ULL;
+
+constexpr char kPushChars[] =
+    "-0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ_abcdefghijklmnopqrstuvwxyz";
+
+void setNonBlocking(int fd) {
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+std::string queryParam(const std::string& target, const char* name) {
+  const std::string key = std::string(name) + "=";
+  size_t at = target.find('?');
+  while (at != std::string::npos) {
+    at++;
+    if (target.compare(at, key.size(), key) == 0) {
+      const size_t begin = at + key.size();
+      const size_t end = target.find('&', begin);
+      return target.substr(begin, end == std::string::npos ? std::string::npos
+                                                            : end - begin);
+    }
+    at = target.find('&', at);
+  }
+  return std::string();
+}
+
+}  // namespace
+
+CloudStandIn::~CloudStandIn() { stop(); }
+
+bool CloudStandIn::start() {
+  listenFd_ = socket(AF_INET, SOCK_STREAM, 0);
+  if (listenFd_ < 0) {
+    return false;
+  }
+  const int on = 1;
+  setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t length = sizeof(address);
+  if (bind(listenFd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) !=
+          0 ||
+      listen(listenFd_, 8) != 0 ||
+      getsockname(listenFd_, reinterpret_cast<sockaddr*>(&address),
+                  &length) != 0) {
+    stop();
+    return false;
+  }
+  setNonBlocking(listenFd_);
+  port_ = ntohs(address.sin_port);
+#ifdef POOT_HOST_TLS
+  if (!startTls()) {
+    stop();
+    return false;
+  }
+#endif
+  return true;
+}
+
+#ifdef POOT_HOST_TLS
+
+// Server side of what BearSSL can do: TLS 1.2, sessions resumed by id from
+// the server's cache (no tickets), MFLN honoured when asked for. The
+// certificate names both hosts the bench uses.
+bool CloudStandIn::startTls() {
+  EVP_PKEY* key = EVP_EC_gen("P-256");
+  X509* cert = X509_new();
+  bool ok = key != nullptr && cert != nullptr;
+  if (ok) {
+    X509_set_version(cert, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert), -3600);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 24 * 3600);
+    X509_set_pubkey(cert, key);
+    X509_NAME* name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(
+        name, "CN", MBSTRING_ASC,
+        reinterpret_cast<const unsigned char*>("poot cloud stand-in"), -1, -1,
+        0);
+    X509_set_issuer_name(cert, name);
+    X509V3_CTX v3;
+    X509V3_set_ctx_nodb(&v3);
+    X509V3_set_ctx(&v3, cert, cert, nullptr, nullptr, 0);
+    X509_EXTENSION* names = X509V3_EXT_conf_nid(
+        nullptr, &v3, NID_subject_alt_name, "DNS:localhost,IP:127.0.0.1");
+    ok = names != nullptr && X509_add_ext(cert, names, -1) == 1 &&
+         X509_sign(cert, key, EVP_sha256()) > 0;
+    X509_EXTENSION_free(names);
+  }
+  if (ok) {
+    context_ = SSL_CTX_new(TLS_server_method());
+    SSL_CTX_set_max_proto_version(context_, TLS1_2_VERSION);
+    SSL_CTX_set_options(context_, SSL_OP_NO_TICKET);
+    SSL_CTX_set_session_cache_mode(context_, SSL_SESS_CACHE_SERVER);
+    ok = SSL_CTX_use_certificate(context_, cert) == 1 &&
+         SSL_CTX_use_PrivateKey(context_, key) == 1;
+    forgetSessions();
+  }
+  if (ok) {
+    BIO* bio = BIO_new(BIO_s_mem());
+    PEM_write_bio_X509(bio, cert);
+    char* pem = nullptr;
+    const long length = BIO_get_mem_data(bio, &pem);
+    certificatePem_.assign(pem, static_cast<size_t>(length));
+    BIO_free(bio);
+  }
+  X509_free(cert);
+  EVP_PKEY_free(key);
+  ERR_clear_error();
+  return ok;
+}
+
+// Sessions carry the id context they were made under; one that no longer
+// matches is not resumed.
+void CloudStandIn::forgetSessions() {
+  if (context_ == nullptr) {
+    return;
+  }
+  const std::string id = "poot-" + std::to_string(++sessionGeneration_);
+  SSL_CTX_set_session_id_context(
+      context_, reinterpret_cast<const unsigned char*>(id.data()),
+      static_cast<unsigned int>(id.size()));
+}
+
+void CloudStandIn::receiveTls(Connection& c) {
+  if (!c.secured) {
+    const int result = SSL_accept(c.ssl);
+    if (result != 1) {
+      const int error = SSL_get_error(c.ssl, result);
+      if (error != SSL_ERROR_WANT_READ && error != SSL_ERROR_WANT_WRITE) {
+        close(c);  // failed handshake, e.g. the probe hanging up
+      }
+      return;
+    }
+    c.secured = true;
+    handshakes_++;
+    if (SSL_session_reused(c.ssl)) {
+      resumedHandshakes_++;
+    }
+  }
+  char buffer[2048];
+  for (;;) {
+    const int n = SSL_read(c.ssl, buffer, sizeof(buffer));
+    if (n > 0) {
+      c.in.append(buffer, static_cast<size_t>(n));
+      continue;
+    }
+    const int error = SSL_get_error(c.ssl, n);
+    if (error != SSL_ERROR_WANT_READ && error != SSL_ERROR_WANT_WRITE) {
+      close(c);
+    }
+    return;
+  }
+}
+
+#else  // !POOT_HOST_TLS
+
+void CloudStandIn::forgetSessions() {}
+
+#endif  // POOT_HOST_TLS
+
+void CloudStandIn::receive(Connection& c) {
+#ifdef POOT_HOST_TLS
+  if (c.ssl != nullptr) {
+    receiveTls(c);
+    return;
+  }
+#endif
+  char buffer[2048];
+  for (;;) {
+    const ssize_t n = recv(c.fd, buffer, sizeof(buffer), 0);
+    if (n > 0) {
+      c.in.append(buffer, static_cast<size_t>(n));
+      continue;
+    }
+    if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+      close(c);
+    }
+    return;
+  }
+}
+
+void CloudStandIn::stop() {
+  for (Connection& c : connections_) {
+    close(c);
+  }
+  connections_.clear();
+  if (listenFd_ >= 0) {
+    ::close(listenFd_);
+  }
+  listenFd_ = -1;
+#ifdef POOT_HOST_TLS
+  SSL_CTX_free(context_);
+  context_ = nullptr;
+  certificatePem_.clear();
+#endif
+}
+
+uint64_t CloudStandIn::nowMs() const { return kEpochMs + millis(); }
+
+int CloudStandIn::openStreams() const {
+  return static_cast<int>(
+      std::count_if(connections_.begin(), connections_.end(),
+                    [](const Connection& c) { return c.fd >= 0 && c.stream; }));
+}
+
+void CloudStandIn::pump() {
+  if (listenFd_ < 0) {
+    return;
+  }
+  for (;;) {
+    const int fd = accept(listenFd_, nullptr, nullptr);
+    if (fd < 0) {
+      break;
+    }
+    setNonBlocking(fd);
+    // Replies and events go out as written, like the real service's.
+    const int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    Connection c;
+    c.fd = fd;
+#ifdef POOT_HOST_TLS
+    if (context_ != nullptr) {
+      c.ssl = SSL_new(context_);
+      SSL_set_fd(c.ssl, fd);
+      SSL_set_accept_state(c.ssl);
+    }
+#endif
+    connections_.push_back(c);
+  }
+  for (size_t i = 0; i < connections_.size(); i++) {
+    Connection& c = connections_[i];
+    receive(c);
+    if (c.fd < 0 || c.stream) {
+      continue;
+    }
+    const size_t headEnd = c.in.find("\r\n\r\n");
+    if (headEnd == std::string::npos) {
+      continue;
+    }
+    const std::string head = c.in.substr(0, headEnd + 4);
+    size_t bodyLength = 0;
+    const size_t lengthAt = head.find("Content-Length: ");
+    if (lengthAt != std::string::npos) {
+      bodyLength = strtoul(head.c_str() + lengthAt + 16, nullptr, 10);
+    }
+    if (c.in.size() < head.size() + bodyLength) {
+      continue;
+    }
+    const std::string body = c.in.substr(head.size(), bodyLength);
+    c.in.clear();
+    handle(c, head, body);
+  }
+  connections_.erase(
+      std::remove_if(connections_.begin(), connections_.end(),
+                     [](const Connection& c) { return c.fd < 0; }),
+      connections_.end());
+}
+
+void CloudStandIn::handle(Connection& c, const std::string& head,
+                          const std::string& body) {
+  if (c.requests++ > 0) {
+    reusedConnections_++;
+  }
+  const size_t targetBegin = head.find(' ') + 1;
+  const std::string target =
+      head.substr(targetBegin, head.find(' ', targetBegin) - targetBegin);
+
+  if (head.compare(0, 5, "POST ") == 0 &&
+      target.compare(0, 31, "/v1/accounts:signInWithPassword") == 0) {
+    if (body.find("\"returnSecureToken\":true") == std::string::npos) {
+      sendAll(c, "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n"
+                 "Connection: close\r\n\r\n");
+      close(c);
+      return;
+    }
+    // Real ID tokens are JWTs of about a kilobyte.
+    signIns_++;
+    token_ = "standin." + std::string(900, 'x') + "." +
+             std::to_string(signIns_);
+    const std::string reply = "{\"kind\":\"identitytoolkit#VerifyPassword\","
+                              "\"localId\":\"standin-device\",\"idToken\": \"" +
+                              token_ +
+                              "\",\"refreshToken\":\"r\",\"expiresIn\":"
+                              "\"3600\"}";
+    sendAll(c, "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+               "Content-Length: " +
+                   std::to_string(reply.size()) +
+                   "\r\nConnection: close\r\n\r\n" + reply);
+    close(c);
+    return;
+  }
+
+  if (head.compare(0, 4, "GET ") == 0 &&
+      target.find("/commands.json") != std::string::npos &&
+      head.find("Accept: text/event-stream") != std::string::npos) {
+    if (token_.empty() || queryParam(target, "auth") != token_) {
+      const std::string reply = "{\"error\" : \"Permission denied\"}";
+      sendAll(c, "HTTP/1.1 401 Unauthorized\r\nContent-Length: " +
+                     std::to_string(reply.size()) +
+                     "\r\nConnection: close\r\n\r\n" + reply);
+      close(c);
+      return;
+    }
+    if (!redirectHost_.empty()) {
+      sendAll(c, std::string("HTTP/1.1 307 Temporary Redirect\r\nLocation: ") +
+                     (tls() ? "https://" : "http://") +
+                     redirectHost_ + ":" + std::to_string(port_) + target +
+                     "\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+      redirectHost_.clear();
+      close(c);
+      return;
+    }
+    openStream(c, target);
+    return;
+  }
+
+  if (head.compare(0, 6, "PATCH ") == 0 &&
+      target.compare(0, 7, "/locks/") == 0 &&
+      target.find(".json") != std::string::npos) {
+    if (token_.empty() || queryParam(target, "auth") != token_) {
+      sendAll(c, "HTTP/1.1 401 Unauthorized\r\nContent-Length: 0\r\n"
+                 "Connection: close\r\n\r\n");
+      close(c);
+      return;
+    }
+    if (failWrites_ > 0) {
+      failWrites_--;
+      writesRefused_++;
+      sendAll(c, "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\n"
+                 "Connection: close\r\n\r\n");
+      close(c);
+      return;
+    }
+    write(c, body);
+    return;
+  }
+
+  sendAll(c, "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n"
+             "Connection: close\r\n\r\n");
+  close(c);
+}
+
+// Splits the update into its top-level children. Good enough for what the
+// firmware sends: no escaped quotes inside keys.
+void CloudStandIn::write(Connection& c, const std::string& body) {
+  int depth = 0;
+  bool inString = false;
+  std::string key;
+  size_t keyBegin = 0;
+  size_t valueBegin = 0;
+  int children = 0;
+  for (size_t i = 0; i < body.size(); i++) {
+    const char ch = body[i];
+    if (inString) {
+      if (ch == '\\') {
+        i++;
+      } else if (ch == '"') {
+        inString = false;
+        if (depth == 1 && valueBegin == 0) {
+          key = body.substr(keyBegin, i - keyBegin);
+        }
+      }
+      continue;
+    }
+    if (ch == '"') {
+      inString = true;
+      keyBegin = i + 1;
+    } else if (ch == ':' && depth == 1 && valueBegin == 0) {
+      valueBegin = i + 1;
+    } else if (ch == '{' || ch == '[') {
+      depth++;
+    } else if ((ch == ',' && depth == 1) || ((ch == '}' || ch == ']') &&
+                                             --depth == 0)) {
+      if (valueBegin != 0) {
+        written_[key] = body.substr(valueBegin, i - valueBegin);
+        children++;
+      }
+      valueBegin = 0;
+    }
+  }
+  if (depth != 0 || children == 0) {
+    sendAll(c, "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n"
+               "Connection: close\r\n\r\n");
+    close(c);
+    return;
+  }
+  writes_++;
+  lastWriteChildren_ = children;
+  sendAll(c, "HTTP/1.1 204 No Content\r\nDate: " + date() + "\r\n\r\n");
+}
+
+void CloudStandIn::openStream(Connection& c, const std::string& target) {
+  c.stream = true;
+  streamsOpened_++;
+  lastStreamQuery_ = target.substr(target.find('?') + 1);
+  // Drop the token so the query is readable in a failure message.
+  const size_t auth = lastStreamQuery_.find("auth=");
+  if (auth != std::string::npos) {
+    lastStreamQuery_.erase(auth, lastStreamQuery_.find('&', auth) + 1 - auth);
+  }
+
+  std::string startAt = queryParam(target, "startAt");
+  if (startAt.size() >= 6) {
+    startAt = startAt.substr(3, startAt.size() - 6);  // strip %22 quotes
+  }
+  std::string children;
+  size_t first = 0;
+  if (startAt.empty()) {
+    first = commands_.empty() ? 0 : commands_.size() - 1;  // limitToLast=1
+  }
+  for (size_t i = first; i < commands_.size(); i++) {
+    if (!startAt.empty() && commands_[i].key < startAt) {
+      continue;
+    }
+    children += (children.empty() ? "\"" : ",\"") + commands_[i].key +
+                "\":" + commands_[i].json;
+  }
+  sendAll(c, "HTTP/1.1 200 OK\r\nDate: " + date() +
+                 "\r\nContent-Type: text/event-stream\r\n"
+                 "Cache-Control: no-cache\r\nTransfer-Encoding: chunked\r\n"
+                 "\r\n");
+  sendEvent(c, "put",
+            "{\"path\":\"/\",\"data\":" +
+                (children.empty() ? std::string("null")
+                                  : "{" + children + "}") +
+                "}");
+}
+
+std::string CloudStandIn::pushCommand(const char* action,
+                                      uint64_t createdAtMs) {
+  Command command;
+  command.key = nextPushId();
+  command.json = std::string("{\"action\":\"") + action +
+                 "\",\"createdAt\":" +
+                 std::to_string(createdAtMs != 0 ? createdAtMs : nowMs()) +
+                 ",\"uid\":\"standin-user\"}";
+  commands_.push_back(command);
+  for (Connection& c : connections_) {
+    if (c.fd >= 0 && c.stream) {
+      sendEvent(c, "put",
+                "{\"path\":\"/" + command.key + "\",\"data\":" +
+                    command.json + "}");
+    }
+  }
+  return command.key;
+}
+
+void CloudStandIn::sendKeepAlive() {
+  for (Connection& c : connections_) {
+    if (c.fd >= 0 && c.stream) {
+      sendEvent(c, "keep-alive", "null");
+    }
+  }
+}
+
+void CloudStandIn::revokeAuth() {
+  token_.clear();
+  for (Connection& c : connections_) {
+    if (c.fd >= 0 && c.stream) {
+      sendEvent(c, "auth_revoked", "\"credential is no longer valid\"");
+      close(c);
+    }
+  }
+}
+
+void CloudStandIn::dropConnections() {
+  for (Connection& c : connections_) {
+    close(c, false);
+  }
+}
+
+void CloudStandIn::sendEvent(Connection& c, const char* event,
+                             const std::string& data) {
+  const std::string payload =
+      std::string("event: ") + event + "\ndata: " + data + "\n\n";
+  char size[16];
+  snprintf(size, sizeof(size), "%zx\r\n", payload.size());
+  sendAll(c, size + payload + "\r\n");
+}
+
+void CloudStandIn::sendAll(Connection& c, const std::string& bytes) {
+#ifdef POOT_HOST_TLS
+  if (c.ssl != nullptr) {
+    size_t sent = 0;
+    while (c.fd >= 0 && c.secured && sent < bytes.size()) {
+      const int n = SSL_write(c.ssl, bytes.data() + sent,
+                              static_cast<int>(bytes.size() - sent));
+      const int error = n > 0 ? SSL_ERROR_NONE : SSL_get_error(c.ssl, n);
+      if (n > 0) {
+        sent += static_cast<size_t>(n);
+      } else if (error == SSL_ERROR_WANT_WRITE ||
+                 error == SSL_ERROR_WANT_READ) {
+        pollfd pfd = {c.fd, POLLOUT, 0};
+        poll(&pfd, 1, 100);
+      } else {
+        close(c);
+      }
+    }
+    return;
+  }
+#endif
+  size_t sent = 0;
+  while (c.fd >= 0 && sent < bytes.size()) {
+    const ssize_t n =
+        send(c.fd, bytes.data() + sent, bytes.size() - sent, MSG_NOSIGNAL);
+    if (n > 0) {
+      sent += static_cast<size_t>(n);
+    } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      pollfd pfd = {c.fd, POLLOUT, 0};
+      poll(&pfd, 1, 100);
+    } else {
+      close(c);
+    }
+  }
+}
+
+// Without `notify` nothing more is sent, but the session stays resumable,
+// as real servers keep it after a lost link.
+void CloudStandIn::close(Connection& c, bool notify) {
+#ifdef POOT_HOST_TLS
+  if (c.ssl != nullptr) {
+    if (c.secured && c.fd >= 0) {
+      SSL_set_quiet_shutdown(c.ssl, notify ? 0 : 1);
+      SSL_shutdown(c.ssl);
+    }
+    SSL_free(c.ssl);
+    ERR_clear_error();
+  }
+  c.ssl = nullptr;
+#else
+  (void)notify;
+#endif
+  if (c.fd >= 0) {
+    ::close(c.fd);
+  }
+  c.fd = -1;
+}
+
+// Same layout as the client SDKs' push ids: 8 characters of creation time,
+// then 12 that keep ids made in the same millisecond in order.
+std::string CloudStandIn::nextPushId() {
+  const uint64_t now = nowMs();
+  pushSequence_ = now == lastPushMs_ ? pushSequence_ + 1 : 0;
+  lastPushMs_ = now;
+  char id[21];
+  uint64_t time = now;
+  for (int i = 7; i >= 0; i--) {
+    id[i] = kPushChars[time % 64];
+    time /= 64;
+  }
+  uint64_t sequence = pushSequence_;
+  for (int i = 19; i >= 8; i--) {
+    id[i] = kPushChars[sequence % 64];
+    sequence /= 64;
+  }
+  id[20] = '\0';
+  return id;
+}
+
+std::string CloudStandIn::date() const {
+  const time_t seconds = static_cast<time_t>(nowMs() / 1000);
+  tm utc;
+  gmtime_r(&seconds, &utc);
+  char text[40];
+  strftime(text, sizeof(text), "%a, %d %b %Y %H:%M:%S GMT", &utc);
+  return text;
+}
+
+}  // namespace poot_bench
@@ -0,0 +1,136 @@
+#pragma once
+
+// Loopback stand-in for the cloud endpoints the firmware talks to: the
+// Identity Toolkit password sign-in, the Realtime Database REST stream of
+// /locks/{lockId}/commands and PATCH writes to /locks/{lockId} (the audit
+// trail). Speaks TLS 1.2 on 127.0.0.1 when the host build has OpenSSL
+// (POOT_HOST_TLS), with a self-signed certificate made at start() and a
+// session cache, so resumption and MFLN work as against the real hosts;
+// plain HTTP otherwise. Single-threaded and non-blocking: the bench calls
+// pump() next to the sketch's loop(), and from fake_hal::setYieldHook() so
+// handshakes can finish while the client blocks in connect().
+//
+// The stream reply is chunked like a proxied one, starts with a put of the
+// matching children (limitToLast=1 or startAt=<key>) and then carries a put
+// per pushed command. The database clock is millis() plus a fixed epoch, so
+// advancing the fake clock ages commands too.
+//
+// A PATCH is answered like print=silent (204, connection kept open), so the
+// client can send its next request on the same connection.
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+struct ssl_ctx_st;
+struct ssl_st;
+
+namespace poot_bench {
+
+class CloudStandIn {
+ public:
+  ~CloudStandIn();
+
+  // Listens on an ephemeral loopback port.
+  bool start();
+  void stop();
+  uint16_t port() const { return port_; }
+  bool tls() const { return context_ != nullptr; }
+  // The certificate in PEM, for the client's trust anchors; empty without
+  // TLS.
+  const std::string& certificatePem() const { return certificatePem_; }
+
+  // Accepts connections, answers complete requests. Call every loop() pass.
+  void pump();
+
+  // Adds a command child (as the app's push() would) and sends it to every
+  // open stream. createdAtMs 0 means "now". Returns the new key.
+  std::string pushCommand(const char* action, uint64_t createdAtMs = 0);
+  void sendKeepAlive();
+  // Sends auth_revoked and closes the streams, like an expired token.
+  void revokeAuth();
+  // Closes every open connection without a word (a dropped link).
+  void dropConnections();
+  // Answers the next stream request with a 307 to `host` (same port).
+  void redirectNextStream(const char* host) { redirectHost_ = host; }
+  // Answers the next `count` PATCHes with 503.
+  void failNextWrites(int count) { failWrites_ = count; }
+  // Makes every session handed out so far unresumable, like a server
+  // restart or an expired cache.
+  void forgetSessions();
+
+  uint64_t nowMs() const;
+  int signIns() const { return signIns_; }
+  int streamsOpened() const { return streamsOpened_; }
+  int openStreams() const;
+  const std::string& lastStreamQuery() const { return lastStreamQuery_; }
+
+  // Accepted PATCHes, how many children the last one had, and every child
+  // written so far by path (a path written twice keeps the newest value).
+  int writes() const { return writes_; }
+  int writesRefused() const { return writesRefused_; }
+  int lastWriteChildren() const { return lastWriteChildren_; }
+  const std::map<std::string, std::string>& written() const {
+    return written_;
+  }
+  // Requests that arrived on a connection that had already been used.
+  int reusedConnections() const { return reusedConnections_; }
+  // Completed TLS handshakes, and how many of them resumed a session.
+  int handshakes() const { return handshakes_; }
+  int resumedHandshakes() const { return resumedHandshakes_; }
+
+ private:
+  struct Connection {
+    int fd = -1;
+    ssl_st* ssl = nullptr;
+    bool secured = false;  // handshake done
+    std::string in;
+    bool stream = false;
+    int requests = 0;
+  };
+
+  struct Command {
+    std::string key;
+    std::string json;
+  };
+
+  bool startTls();
+  // Reads what has arrived into c.in (finishing the handshake first).
+  void receive(Connection& c);
+  void receiveTls(Connection& c);
+  void handle(Connection& c, const std::string& head, const std::string& body);
+  void openStream(Connection& c, const std::string& target);
+  void write(Connection& c, const std::string& body);
+  void sendEvent(Connection& c, const char* event, const std::string& data);
+  void sendAll(Connection& c, const std::string& bytes);
+  void close(Connection& c, bool notify = true);
+  std::string nextPushId();
+  std::string date() const;
+
+  int listenFd_ = -1;
+  uint16_t port_ = 0;
+  ssl_ctx_st* context_ = nullptr;
+  std::string certificatePem_;
+  int sessionGeneration_ = 0;
+  std::vector<Connection> connections_;
+  std::vector<Command> commands_;
+  std::string token_;
+  std::string redirectHost_;
+  std::string lastStreamQuery_;
+  uint64_t lastPushMs_ = 0;
+  uint32_t pushSequence_ = 0;
+  int signIns_ = 0;
+  int streamsOpened_ = 0;
+  int failWrites_ = 0;
+  int writes_ = 0;
+  int writesRefused_ = 0;
+  int lastWriteChildren_ = 0;
+  int reusedConnections_ = 0;
+  int handshakes_ = 0;
+  int resumedHandshakes_ = 0;
+  std::map<std::string, std::string> written_;
+};
+
+}  // namespace poot_bench
@@ -0,0 +1,1905 @@
+// Microbenchmarks for the firmware hot paths, built against the host HAL.
+//
+// The sketch is compiled into this translation unit unchanged so its globals,
+// route lambdas and templates (sendJson) are reachable exactly as they are on
+// the device.
+
+#include "poot_lock.ino"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "bench_harness.h"
+#include "cloud_standin.h"
+#include "fake_hal.h"
+#include "fake_net.h"
+
+namespace {
+
+using poot_bench::Runner;
+
+const IPAddress kBenchClient(192, 168, 4, 2);
+
+// One request per connection, like a client without keep-alive.
+#define BENCH_REQUEST(target)                            \
+  "GET " target " HTTP/1.1\r\nHost: poot.local\r\n" \
+  "Connection: close\r\n\r\n"
+
+// Opens a connection, sends `text` and runs the server until it closes the
+// connection (streamed replies take several passes). Returns the connection
+// id; the reply is in fake_net::connection(id)->received.
+int request(const char* text) {
+  const int id = fake_net::asyncConnect(poot::kLocalHttpPort, kBenchClient);
+  fake_net::asyncSend(id, text);
+  for (int pass = 0; pass < 1000 && fake_net::asyncOpen(id); pass++) {
+    server.loop();
+  }
+  return id;
+}
+
+int statusOf(int id) {
+  const fake_net::Connection* c = fake_net::connection(id);
+  if (c == nullptr || c->received.compare(0, 9, "HTTP/1.1 ") != 0) {
+    return -1;
+  }
+  return atoi(c->received.c_str() + 9);
+}
+
+// Sends `text` once so its status can be checked before timing.
+bool expectStatus(Runner& runner, const char* name, const char* text,
+                  int expected) {
+  const int id = request(text);
+  const int actual = statusOf(id);
+  if (actual != expected || fake_net::asyncOpen(id)) {
+    char reason[80];
+    snprintf(reason, sizeof(reason), "expected HTTP %d, got %d%s", expected,
+             actual, fake_net::asyncOpen(id) ? " (left open)" : "");
+    runner.fail(name, reason);
+    return false;
+  }
+  return true;
+}
+
+// Skips the pulse and cooldown and ends the sketch relay's pulse, as its
+// task would have, along with any pulse that was queued behind it. Full runs
+// skip months in total; a pulse left running across more than 24.8 days of
+// that would look like it ends in the future.
+void skipPastCooldown() {
+  do {
+    fake_hal::advanceMillis(poot::kUnlockPulseMs + poot::kUnlockCooldownMs +
+                            1);
+  } while (relay.loop());
+}
+
+// Each case times a whole exchange: accept, parse, handler, reply, close.
+void benchRequest(Runner& runner, const char* name, const char* text,
+                  int expected) {
+  if (expectStatus(runner, name, text, expected)) {
+    runner.run(name, [text] { request(text); });
+  }
+}
+
+// The app's probe + unlock pattern: one warmed connection, several requests.
+// Streamed replies close the connection, so this uses the challenge probe.
+void benchKeepAlive(Runner& runner) {
+  const char* name = "http/challenge (keep-alive)";
+  static const char kText[] =
+      "GET /api/challenge HTTP/1.1\r\nHost: poot.local\r\n\r\n";
+  static int id = -1;
+  static size_t replyBytes = 0;
+  const auto exchange = [] {
+    if (!fake_net::asyncOpen(id)) {
+      // Closed after kHttpKeepAliveMaxRequests; reconnect like a client.
+      id = fake_net::asyncConnect(poot::kLocalHttpPort, kBenchClient);
+    }
+    fake_net::Connection* c = fake_net::connection(id);
+    c->received.clear();
+    fake_net::asyncSend(id, kText);
+    server.loop();
+    replyBytes = c->received.size();
+  };
+
+  id = fake_net::asyncConnect(poot::kLocalHttpPort, kBenchClient);
+  const uint32_t reusedBefore = server.requestsReusingConnection();
+  exchange();
+  exchange();
+  if (statusOf(id) != 200 || !fake_net::asyncOpen(id) ||
+      server.requestsReusingConnection() != reusedBefore + 1 ||
+      replyBytes == 0) {
+    runner.fail(name, "connection was not reused");
+  } else {
+    runner.run(name, exchange);
+  }
+  fake_net::asyncPeerClose(id);
+}
+
+// Every slot held by an idle kept-alive connection: a new client takes the
+// oldest one's slot, which has to be free before close() returns, since the
+// library only tears a closed connection down on its next poll.
+void benchEvictIdle(Runner& runner) {
+  const char* name = "http/evict_idle";
+  static const char kText[] =
+      "GET /api/challenge HTTP/1.1\r\nHost: poot.local\r\n\r\n";
+  int ids[poot::kHttpMaxConnections];
+  for (uint8_t i = 0; i < poot::kHttpMaxConnections; i++) {
+    ids[i] = fake_net::asyncConnect(poot::kLocalHttpPort,
+                                    IPAddress(192, 168, 4, 100 + i));
+    fake_net::asyncSend(ids[i], kText);
+    server.loop();
+    fake_hal::advanceMillis(1);
+  }
+  const int id = fake_net::asyncConnect(poot::kLocalHttpPort,
+                                        IPAddress(192, 168, 4, 99));
+  fake_net::asyncSend(id, kText);
+  server.loop();
+  if (statusOf(id) != 200 || fake_net::asyncOpen(ids[0]) ||
+      !fake_net::connection(ids[0])->closedByServer ||
+      !fake_net::asyncOpen(ids[1])) {
+    runner.fail(name, "oldest idle connection did not give way");
+  }
+  fake_net::asyncPeerClose(id);
+  for (int idle : ids) {
+    fake_net::asyncPeerClose(idle);
+  }
+}
+
+// A reply several times the socket's send buffer, read by a client that
+// acks slowly: it has to arrive whole, a buffer's worth per ack, rather
+// than be cut off once the buffer fills.
+void benchSlowReader(Runner& runner) {
+  const char* name = "http/slow_reader";
+  static char body[3 * fake_net::kTcpSendBuffer + 100];
+  memset(body, 'x', sizeof(body));
+  server.on("/bench/large", poot_http::Method::kGet, [] {
+    server.send(200, poot_http::kContentTypeText, body, sizeof(body));
+  });
+  fake_net::setAsyncAutoAck(false);
+  const int id = fake_net::asyncConnect(poot::kLocalHttpPort, kBenchClient);
+  fake_net::asyncSend(id, BENCH_REQUEST("/bench/large"));
+  int acks = 0;
+  for (int pass = 0; pass < 100 && fake_net::asyncOpen(id); pass++) {
+    server.loop();
+    if (fake_net::connection(id)->received.size() >
+        (acks + 1) * fake_net::kTcpSendBuffer) {
+      break;  // more in flight than the buffer holds
+    }
+    fake_net::asyncAck(id);
+    acks++;
+  }
+  fake_net::setAsyncAutoAck(true);
+  const std::string& reply = fake_net::connection(id)->received;
+  const size_t bodyAt = reply.find("\r\n\r\n");
+  if (statusOf(id) != 200 || fake_net::asyncOpen(id) ||
+      bodyAt == std::string::npos ||
+      reply.size() - bodyAt - 4 != sizeof(body) || acks < 3) {
+    runner.fail(name, "long reply was not sent whole as acks came in");
+    fake_net::asyncPeerClose(id);
+    return;
+  }
+  runner.metric("http/slow_reader/acks", "count", acks);
+}
+
+void benchHttp(Runner& runner) {
+  {
+    const char* name = "http/local_unlock/ok (+relay.loop)";
+    static const char kText[] =
+        BENCH_REQUEST("/api/local-unlock?key=" LOCAL_SHARED_KEY);
+    skipPastCooldown();
+    if (expectStatus(runner, name, kText, 200)) {
+      runner.run(name, [] {
+        skipPastCooldown();
+        request(kText);
+      });
+    }
+  }
+  // The pulse from the case above is still running: joined, not refused.
+  benchRequest(runner, "http/local_unlock/coalesced",
+               BENCH_REQUEST("/api/local-unlock?key=" LOCAL_SHARED_KEY), 200);
+  fake_hal::advanceMillis(poot::kUnlockPulseMs);
+  relay.loop();
+  benchRequest(runner, "http/local_unlock/queued",
+               BENCH_REQUEST("/api/local-unlock?key=" LOCAL_SHARED_KEY), 202);
+  benchRequest(runner, "http/local_unlock/invalid_key",
+               BENCH_REQUEST("/api/local-unlock?key=wrong-key"), 401);
+  benchRequest(runner, "http/local_unlock/missing_key",
+               BENCH_REQUEST("/api/local-unlock"), 400);
+  benchRequest(runner, "http/health/ok",
+               BENCH_REQUEST("/api/health?key=" LOCAL_SHARED_KEY), 200);
+  benchRequest(runner, "http/health/denied",
+               BENCH_REQUEST("/api/health?key=wrong-key"), 401);
+  benchRequest(runner, "http/perf",
+               BENCH_REQUEST("/api/perf?key=" LOCAL_SHARED_KEY), 200);
+  benchRequest(runner, "http/root", BENCH_REQUEST("/"), 200);
+  benchRequest(runner, "http/not_found", BENCH_REQUEST("/missing"), 404);
+  benchRequest(runner, "http/bad_request", "BREW /\r\n\r\n", 400);
+  benchKeepAlive(runner);
+  benchEvictIdle(runner);
+  benchSlowReader(runner);
+}
+
+// ---- Signed local unlock ----
+//
+// GET /api/challenge, then /api/local-unlock with the nonce and its HMAC, as
+// the app sends it. The known answer was computed with Python's hmac module.
+
+// By value rather than as a std::string, so the timed case counts only what
+// the firmware allocates.
+struct Nonce {
+  char hex[poot_auth::kNonceHexChars + 1];
+};
+
+Nonce fetchNonce() {
+  Nonce nonce = {};
+  const int id = request(BENCH_REQUEST("/api/challenge"));
+  const std::string& reply = fake_net::connection(id)->received;
+  const size_t at = reply.find("\"nonce\":\"");
+  if (at != std::string::npos) {
+    reply.copy(nonce.hex, poot_auth::kNonceHexChars, at + 9);
+  }
+  return nonce;
+}
+
+// Status of an unlock signed for `nonce`, or with `mac` when given.
+int signedUnlock(const Nonce& nonce, const char* mac = nullptr) {
+  char signature[poot_auth::kMacHexChars + 1];
+  localAuth.sign(nonce.hex, signature);
+  char text[256];
+  snprintf(text, sizeof(text),
+           BENCH_REQUEST("/api/local-unlock?nonce=%s&mac=%s"), nonce.hex,
+           mac != nullptr ? mac : signature);
+  return statusOf(request(text));
+}
+
+void benchAuth(Runner& runner) {
+  const char* name = "auth/signed_unlock";
+  char mac[poot_auth::kMacHexChars + 1];
+  localAuth.sign("00112233445566778899aabbccddeeff", mac);
+  if (strcmp(mac, "bd7f8f57ec40769fc2314b9a03b775b792d0071b554988e3d4d559bcd"
+                  "1359520") != 0) {
+    runner.fail(name, "HMAC differs from the known answer");
+    return;
+  }
+  skipPastCooldown();
+  const Nonce nonce = fetchNonce();
+  if (strlen(nonce.hex) != poot_auth::kNonceHexChars ||
+      signedUnlock(nonce) != 200) {
+    runner.fail(name, "a signed unlock was not let through");
+    return;
+  }
+  skipPastCooldown();
+  if (signedUnlock(nonce) != 401) {
+    runner.fail(name, "a spent nonce was taken again");
+  }
+  const Nonce forged = fetchNonce();
+  if (signedUnlock(forged, "00000000000000000000000000000000000000000000000"
+                           "00000000000000000") != 401 ||
+      signedUnlock(fetchNonce(), "xyz") != 400 ||
+      signedUnlock(forged) != 401) {
+    runner.fail(name, "a bad or malformed mac was not refused for good");
+  }
+  const Nonce old = fetchNonce();
+  fake_hal::advanceMillis(poot::kAuthNonceTtlMs + 1);
+  if (signedUnlock(old) != 401) {
+    runner.fail(name, "an expired nonce was taken");
+  }
+
+  // Another client polling for challenges only ever recycles its own.
+  const Nonce kept = fetchNonce();
+  const IPAddress poller(192, 168, 4, 50);
+  char polled[poot_auth::kNonceHexChars + 1];
+  for (uint8_t i = 0; i < poot::kAuthNonceSlots * 2; i++) {
+    localAuth.issue(millis(), poller, polled);
+  }
+  skipPastCooldown();
+  if (signedUnlock(kept) != 200) {
+    runner.fail(name, "another client's challenges evicted a nonce");
+  }
+
+  // What the handler adds over a plain request: one issue and one verify.
+  runner.run("auth/issue+verify", [] {
+    char fresh[poot_auth::kNonceHexChars + 1];
+    char signature[poot_auth::kMacHexChars + 1];
+    localAuth.issue(millis(), kBenchClient, fresh);
+    localAuth.sign(fresh, signature);
+    localAuth.verify(fresh, signature, millis());
+  });
+  runner.run("http/local_unlock/signed (+challenge)", [] {
+    skipPastCooldown();
+    signedUnlock(fetchNonce());
+  });
+  runner.metric("auth/verify", "us",
+                poot_perf::cyclesToMicros(localAuth.lastVerifyCycles()));
+}
+
+void benchSendJson(Runner& runner) {
+  server.on("/bench/json", poot_http::Method::kGet, [] {
+    StaticJsonDocument<128> response;
+    response["ok"] = false;
+    response["code"] = "not_found";
+    response["message"] = "Route not found";
+    sendJson(404, response);
+  });
+  benchRequest(runner, "sendJson/error_reply", BENCH_REQUEST("/bench/json"),
+               404);
+}
+
+// ---- concurrency scenario ----
+//
+// Three clients poll /api/health (100 ms think time between replies) while a
+// fourth connects and then sits on its request for kStallMs, like a phone
+// that dropped off WiFi mid-request. Runs in virtual time with one server
+// pass per millisecond and reports the fast clients' latency.
+
+constexpr uint32_t kScenarioMs = 8000;
+constexpr uint32_t kStallStartMs = 500;
+constexpr uint32_t kStallMs = 4000;
+constexpr uint32_t kThinkMs = 100;
+constexpr int kFastClients = 3;
+const char kProbe[] = BENCH_REQUEST("/api/health?key=" LOCAL_SHARED_KEY);
+
+struct FastClient {
+  uint32_t nextSendMs;
+  uint32_t sentMs;
+  int id;  // connection id while a request is in flight, else -1
+};
+
+void reportLatency(Runner& runner, const char* variant,
+                   std::vector<uint32_t> samples) {
+  char name[80];
+  snprintf(name, sizeof(name), "http/concurrency/%s/requests", variant);
+  runner.metric(name, "count", static_cast<double>(samples.size()));
+  if (samples.empty()) {
+    return;
+  }
+  std::sort(samples.begin(), samples.end());
+  const auto pct = [&samples](double p) {
+    const size_t rank = static_cast<size_t>(p * samples.size() + 0.999999);
+    return static_cast<double>(samples[rank == 0 ? 0 : rank - 1]);
+  };
+  snprintf(name, sizeof(name), "http/concurrency/%s/p50", variant);
+  runner.metric(name, "ms", pct(0.50));
+  snprintf(name, sizeof(name), "http/concurrency/%s/p99", variant);
+  runner.metric(name, "ms", pct(0.99));
+  snprintf(name, sizeof(name), "http/concurrency/%s/max", variant);
+  runner.metric(name, "ms", static_cast<double>(samples.back()));
+}
+
+// The previous server (ESP8266WebServer::handleClient, core 3.x) served one
+// connection at a time: an accepted client that had not sent its request yet
+// was polled for up to HTTP_MAX_DATA_WAIT (5 s) while later connections
+// waited in the accept backlog. Modelled here since it is no longer built.
+void scenarioBlockingModel(Runner& runner) {
+  constexpr uint32_t kMaxDataWaitMs = 5000;
+  struct Pending {
+    int client;  // -1 for the stalled client
+    uint32_t readyMs;
+  };
+  std::vector<Pending> backlog;
+  bool haveCurrent = false;
+  Pending current = {};
+  uint32_t currentSinceMs = 0;
+  FastClient clients[kFastClients];
+  for (int i = 0; i < kFastClients; i++) {
+    clients[i] = FastClient{static_cast<uint32_t>(i) * 33, 0, -1};
+  }
+  std::vector<uint32_t> samples;
+
+  for (uint32_t now = 0; now < kScenarioMs; now++) {
+    // One handleClient() pass.
+    if (!haveCurrent && !backlog.empty()) {
+      current = backlog.front();
+      backlog.erase(backlog.begin());
+      haveCurrent = true;
+      currentSinceMs = now;
+    }
+    if (haveCurrent) {
+      if (now >= current.readyMs) {
+        if (current.client >= 0) {
+          FastClient& c = clients[current.client];
+          samples.push_back(now - c.sentMs);
+          c.id = -1;
+          c.nextSendMs = now + kThinkMs;
+        }
+        haveCurrent = false;
+      } else if (now - currentSinceMs >= kMaxDataWaitMs) {
+        haveCurrent = false;
+      }
+    }
+    // Client side.
+    if (now == kStallStartMs) {
+      backlog.push_back(Pending{-1, kStallStartMs + kStallMs});
+    }
+    for (int i = 0; i < kFastClients; i++) {
+      FastClient& c = clients[i];
+      if (c.id < 0 && now >= c.nextSendMs) {
+        c.id = 0;
+        c.sentMs = now;
+        backlog.push_back(Pending{i, now});
+      }
+    }
+  }
+  reportLatency(runner, "blocking_model", samples);
+}
+
+void scenarioAsyncServer(Runner& runner) {
+  FastClient clients[kFastClients];
+  for (int i = 0; i < kFastClients; i++) {
+    clients[i] = FastClient{static_cast<uint32_t>(i) * 33, 0, -1};
+  }
+  std::vector<uint32_t> samples;
+  int stalled = -1;
+  const uint32_t timedOutBefore = server.requestsTimedOut();
+
+  for (uint32_t now = 0; now < kScenarioMs; now++) {
+    fake_hal::advanceMillis(1);
+    server.loop();
+    for (int i = 0; i < kFastClients; i++) {
+      FastClient& c = clients[i];
+      if (c.id >= 0 && !fake_net::asyncOpen(c.id)) {
+        if (statusOf(c.id) == 200) {
+          samples.push_back(now - c.sentMs);
+        }
+        c.id = -1;
+        c.nextSendMs = now + kThinkMs;
+      }
+    }
+    if (now == kStallStartMs) {
+      stalled = fake_net::asyncConnect(poot::kLocalHttpPort, kBenchClient);
+    }
+    if (now == kStallStartMs + kStallMs) {
+      fake_net::asyncSend(stalled, kProbe);
+    }
+    for (int i = 0; i < kFastClients; i++) {
+      FastClient& c = clients[i];
+      if (c.id < 0 && now >= c.nextSendMs) {
+        c.id = fake_net::asyncConnect(poot::kLocalHttpPort, kBenchClient);
+        c.sentMs = now;
+        fake_net::asyncSend(c.id, kProbe);
+      }
+    }
+  }
+  for (const FastClient& c : clients) {
+    fake_net::asyncPeerClose(c.id);
+  }
+  fake_net::asyncPeerClose(stalled);
+  reportLatency(runner, "async", samples);
+  if (server.requestsTimedOut() - timedOutBefore != 1) {
+    runner.fail("http/concurrency/async", "stalled client was not timed out");
+  }
+}
+
+void benchConcurrency(Runner& runner) {
+  scenarioBlockingModel(runner);
+  scenarioAsyncServer(runner);
+}
+
+// ---- load shedding ----
+//
+// One device opens kFloodPerMs connections every virtual millisecond, each
+// asking for /api/health, while the phone sends one unlock halfway through.
+// The flood should get no more than its token bucket allows, no loop() pass
+// should run more than kHttpDispatchPerPass handlers, and the unlock should
+// be answered as quickly as on an idle server.
+
+const IPAddress kFloodClient(192, 168, 4, 3);
+constexpr uint32_t kFloodMs = 2000;
+constexpr int kFloodPerMs = 4;
+
+void benchShedding(Runner& runner) {
+  const char* name = "http/shed";
+  server.setClientLimits(poot::kHttpClientBurst, poot::kHttpClientRefillMs,
+                         poot::kHttpMaxConnectionsPerClient);
+  skipPastCooldown();
+  const uint32_t servedBefore = server.requestsServed();
+  const uint32_t shedBefore = server.requestsShed() + server.connectionsShed();
+  const uint32_t startMs = millis();
+  std::vector<int> flood;
+  int unlock = -1;
+  int unlockStatus = -1;
+  uint32_t unlockSentMs = 0;
+  uint32_t unlockMs = 0;
+  uint32_t maxPerPass = 0;
+  for (uint32_t now = 0; now < kFloodMs; now++) {
+    fake_hal::advanceMillis(1);
+    for (int i = 0; i < kFloodPerMs; i++) {
+      const int id = fake_net::asyncConnect(poot::kLocalHttpPort, kFloodClient);
+      if (fake_net::asyncOpen(id)) {
+        fake_net::asyncSend(id, kProbe);
+        flood.push_back(id);
+      }
+    }
+    if (now == kFloodMs / 2) {
+      unlock = fake_net::asyncConnect(poot::kLocalHttpPort, kBenchClient);
+      fake_net::asyncSend(
+          unlock, BENCH_REQUEST("/api/local-unlock?key=" LOCAL_SHARED_KEY));
+      unlockSentMs = now;
+    }
+    const uint32_t passBefore = server.requestsServed();
+    server.loop();
+    maxPerPass = std::max(maxPerPass, server.requestsServed() - passBefore);
+    if (unlock >= 0 && !fake_net::asyncOpen(unlock)) {
+      unlockStatus = statusOf(unlock);  // before the id is reused
+      unlockMs = now - unlockSentMs;
+      unlock = -1;
+    }
+  }
+  for (int id : flood) {
+    if (fake_net::asyncOpen(id)) {
+      fake_net::asyncPeerClose(id);
+    }
+  }
+  const uint32_t served = server.requestsServed() - servedBefore;
+  const uint32_t floodMs = millis() - startMs;  // virtual plus host time
+  const uint32_t shed =
+      server.requestsShed() + server.connectionsShed() - shedBefore;
+  const int health =
+      request(BENCH_REQUEST("/api/health?key=" LOCAL_SHARED_KEY));
+  const std::string& body = fake_net::connection(health)->received;
+  server.setClientLimits(0, 0, 0);
+  skipPastCooldown();
+
+  // The unlock is one of the requests served.
+  const uint32_t floodAllowed =
+      poot::kHttpClientBurst + floodMs / poot::kHttpClientRefillMs + 1;
+  if (unlockStatus != 200 || unlockMs > 1) {
+    runner.fail(name, "unlock was held up by the flood");
+    return;
+  }
+  if (served - 1 > floodAllowed || shed == 0 ||
+      maxPerPass > poot::kHttpDispatchPerPass) {
+    runner.fail(name, "flood was not held to its bucket");
+    return;
+  }
+  if (statusOf(health) != 200 ||
+      body.find("\"http\":{\"served\":") == std::string::npos ||
+      body.find("\"shed\":0,") != std::string::npos) {
+    runner.fail(name, "/api/health does not report the shed requests");
+    return;
+  }
+  runner.metric("http/shed/flood_requests", "count",
+                static_cast<double>(kFloodMs * kFloodPerMs));
+  runner.metric("http/shed/flood_served", "count",
+                static_cast<double>(served - 1));
+  runner.metric("http/shed/shed", "count", static_cast<double>(shed));
+  runner.metric("http/shed/unlock_latency", "ms",
+                static_cast<double>(unlockMs));
+}
+
+// ---- UDP unlock ----
+
+const uint16_t kUdpClientPort = 50000;
+
+struct UdpBench {
+  poot_udp::Key key;
+  poot_udp::Request request;
+  uint8_t packet[poot_udp::kRequestBytes];
+  fake_net::Datagram reply;
+  uint16_t windowMs;  // of the last reply
+};
+UdpBench gUdp;
+
+// Delivers gUdp.packet and returns the lock's reply status, or -1.
+int udpExchange() {
+  fake_net::udpDeliver(poot::kUdpUnlockPort, kBenchClient, kUdpClientPort,
+                       gUdp.packet, sizeof(gUdp.packet));
+  udpUnlock.loop();
+  poot_udp::Reply reply;
+  if (!fake_net::udpTakeSent(gUdp.reply) ||
+      !poot_udp::decodeReply(gUdp.key, gUdp.reply.data, gUdp.reply.size,
+                             reply)) {
+    return -1;
+  }
+  gUdp.windowMs = reply.windowMs;
+  return static_cast<int>(reply.status);
+}
+
+void nextUdpRequest() {
+  gUdp.request.counter++;
+  poot_udp::encodeRequest(gUdp.key, gUdp.request, gUdp.packet);
+}
+
+bool expectUdp(Runner& runner, const char* name, poot_udp::Status expected) {
+  const int actual = udpExchange();
+  if (actual != static_cast<int>(expected)) {
+    char reason[64];
+    snprintf(reason, sizeof(reason), "expected %s, got %d",
+             poot_udp::statusName(expected), actual);
+    runner.fail(name, reason);
+    return false;
+  }
+  return true;
+}
+
+void benchUdp(Runner& runner) {
+  using poot_udp::Status;
+  poot_udp::initKey(gUdp.key, LOCAL_SHARED_KEY);
+  gUdp.request = poot_udp::Request{};
+  gUdp.request.client = 0x0b0b0001;
+  poot_udp::setLockId(gUdp.request, LOCK_ID);
+
+  nextUdpRequest();
+  if (!expectUdp(runner, "udp/unlock", Status::kStaleEpoch)) {
+    return;
+  }
+  gUdp.request.epoch = udpUnlock.epoch();
+  {
+    const char* name = "udp/unlock/ok (+relay.loop)";
+    skipPastCooldown();
+    nextUdpRequest();
+    if (expectUdp(runner, name, Status::kOk)) {
+      runner.run(name, [] {
+        skipPastCooldown();
+        nextUdpRequest();
+        udpExchange();
+      });
+    }
+  }
+  {
+    const char* name = "udp/unlock/coalesced";
+    nextUdpRequest();
+    if (expectUdp(runner, name, Status::kCoalesced)) {
+      runner.run(name, [] {
+        nextUdpRequest();
+        udpExchange();
+      });
+    }
+  }
+  {
+    // A resend of the newest packet: answered again, relay untouched.
+    const char* name = "udp/unlock/resend";
+    if (expectUdp(runner, name, Status::kCoalesced)) {
+      runner.run(name, [] { udpExchange(); });
+    }
+  }
+  {
+    const char* name = "udp/unlock/replay";
+    gUdp.request.counter -= 40;
+    poot_udp::encodeRequest(gUdp.key, gUdp.request, gUdp.packet);
+    gUdp.request.counter += 40;
+    if (expectUdp(runner, name, Status::kReplay)) {
+      runner.run(name, [] { udpExchange(); });
+    }
+  }
+  {
+    const char* name = "udp/unlock/bad_mac";
+    nextUdpRequest();
+    gUdp.packet[sizeof(gUdp.packet) - 1] ^= 0x01;
+    if (udpExchange() != -1) {
+      runner.fail(name, "forged datagram was answered");
+    } else {
+      runner.run(name, [] { udpExchange(); });
+    }
+  }
+}
+
+// ---- unlock coalescing ----
+//
+// Two people tapping at once, or a retry after a timeout: whatever lands in
+// the pulse is answered as success with the time the door stays open, and
+// whatever lands in the cooldown is queued and fires when it ends, so nobody
+// has to retry by hand.
+
+// millis() also follows the host clock, so a few ms pass between steps.
+bool within(long actual, long expected) {
+  return actual <= expected && actual >= expected - 50;
+}
+
+long replyField(int id, const char* field) {
+  const std::string& body = fake_net::connection(id)->received;
+  const size_t at = body.find(field);
+  return at == std::string::npos ? -1 : atol(body.c_str() + at + strlen(field));
+}
+
+void benchUnlockCoalescing(Runner& runner) {
+  using poot_udp::Status;
+  const char* name = "unlock/coalesce";
+  static const char kText[] =
+      BENCH_REQUEST("/api/local-unlock?key=" LOCAL_SHARED_KEY);
+  const long pulseMs = static_cast<long>(poot::kUnlockPulseMs);
+  const long cooldownMs = static_cast<long>(poot::kUnlockCooldownMs);
+  skipPastCooldown();
+  const uint32_t unlocksBefore =
+      poot_blackbox::counter(poot_blackbox::Counter::kUnlocks);
+  int id = request(kText);
+  if (statusOf(id) != 200 || !within(replyField(id, "\"open_ms\":"), pulseMs)) {
+    runner.fail(name, "first unlock did not fire");
+    return;
+  }
+  fake_hal::advanceMillis(1000);
+  id = request(kText);
+  nextUdpRequest();
+  if (statusOf(id) != 200 ||
+      replyField(id, "\"code\":\"coalesced\",") < 0 ||
+      !within(replyField(id, "\"open_ms\":"), pulseMs - 1000) ||
+      udpExchange() != static_cast<int>(Status::kCoalesced) ||
+      !within(gUdp.windowMs, pulseMs - 1000)) {
+    runner.fail(name, "requests during the pulse were not coalesced");
+    return;
+  }
+
+  const char* queued = "unlock/queue";
+  fake_hal::advanceMillis(poot::kUnlockPulseMs - 1000);
+  loop();  // the relay task ends the pulse
+  fake_hal::advanceMillis(1000);
+  id = request(kText);
+  const long opensInMs = replyField(id, "\"opens_in_ms\":");
+  nextUdpRequest();
+  if (relay.isRelayOn() || statusOf(id) != 202 ||
+      !within(opensInMs, cooldownMs - 1000) ||
+      udpExchange() != static_cast<int>(Status::kQueued) ||
+      !within(gUdp.windowMs, opensInMs)) {
+    runner.fail(queued, "requests during the cooldown were not queued");
+    return;
+  }
+  fake_hal::advanceMillis(static_cast<uint32_t>(opensInMs));
+  loop();  // the relay task fires the queued pulse
+  if (!relay.isRelayOn() || relay.hasQueuedPulse() ||
+      poot_blackbox::counter(poot_blackbox::Counter::kUnlocks) !=
+          unlocksBefore + 2) {
+    runner.fail(queued, "queued pulse did not fire once the cooldown ended");
+    return;
+  }
+  runner.metric("unlock/queue/opens_in", "ms",
+                static_cast<double>(opensInMs));
+  skipPastCooldown();
+}
+
+void benchDiagnostics(Runner& runner) {
+  runner.run("diag/logf/literal", [] {
+    poot_diag::logf("BENCH", "pulse ended");
+  });
+  runner.run("diag/logf/formatted", [] {
+    poot_diag::logf("BENCH", "trigger denied: cooldown until=%lu now=%lu",
+                    123456UL, 120000UL);
+  });
+  runner.run("blackbox/checkpoint", [] { poot_blackbox::checkpoint(); });
+}
+
+void benchLoopProfiler(Runner& runner) {
+  using poot_perf::Stage;
+  static poot_perf::LoopProfiler profiler;
+  runner.run("perf/loop_profiler/iteration", [] {
+    profiler.beginIteration();
+    for (uint8_t i = 0; i < static_cast<uint8_t>(Stage::kCount); i++) {
+      profiler.mark(static_cast<Stage>(i));
+    }
+    profiler.endIteration();
+  });
+  runner.run("loop/idle", [] { loop(); });
+}
+
+void benchScheduler(Runner& runner) {
+  static poot_sched::Scheduler sched;
+  for (uint8_t i = 0; i < 6; i++) {
+    sched.addPeriodic("bench", 1000 + i * 100, [] {}, 1000 + i * 100);
+  }
+  runner.run("sched/runDue/idle", [] { sched.runDue(); });
+  static poot_sched::TaskId oneShot = sched.addOneShot("bench_one_shot", [] {});
+  runner.run("sched/scheduleIn+cancel", [] {
+    sched.scheduleIn(oneShot, 500);
+    sched.cancel(oneShot);
+  });
+}
+
+void benchHealth(Runner& runner) {
+  runner.run("health/notePass", [] { healthMonitor.notePass(millis()); });
+  // A healthy sample: the reading plus the limit checks the "health" task
+  // runs every kHealthSampleMs.
+  runner.run("health/sample+check",
+             [] { healthMonitor.check(readHealthSample()); });
+}
+
+// ---- WiFi power save ----
+//
+// A policy with sleep allowed (the sketch's follows kEnablePowerSave and is
+// off by default) and the soft AP dropped while asleep, walked through idle,
+// traffic, a busy relay and a burst on virtual time, then the sketch
+// applying a sleep decision and waking.
+
+void benchPower(Runner& runner) {
+  using poot_power::Mode;
+  const char* modes = "power/modes";
+  static poot_power::PowerPolicy policy(/*sleepAllowed=*/true, 500,
+                                        /*dropsAp=*/true);
+  poot_power::Sample sample = {1000, 0, 0, 0, false, true};
+  policy.update(sample);
+  sample.nowMs += poot::kPowerActiveHoldMs;
+  policy.update(sample);
+  if (policy.decision().mode != Mode::kModemSleep ||
+      policy.decision().listenInterval != 1) {
+    runner.fail(modes, "not modem-sleeping once the hold ran out");
+  }
+  sample.nowMs = 1000 + poot::kPowerLightSleepAfterMs;
+  policy.update(sample);
+  if (policy.decision().mode != Mode::kLightSleep ||
+      policy.decision().listenInterval < 2 ||
+      policy.addedLatencyMs(Mode::kLightSleep) > policy.latencyBudgetMs() ||
+      policy.idleDelayMs() == 0) {
+    runner.fail(modes, "light sleep missing or over the latency budget");
+  }
+  policy.noteUnlock(1234);
+  sample.nowMs += poot::kPowerSampleMs;
+  sample.requests++;
+  policy.update(sample);
+  if (policy.decision().mode != Mode::kAwake || policy.asleepUnlocks() != 1 ||
+      policy.maxAsleepUnlockUs() != 1234 || policy.idleDelayMs() != 0) {
+    runner.fail(modes, "a request did not wake it, or its unlock went unseen");
+  }
+  if (policy.dutyPermille() >= 500 ||
+      policy.msIn(Mode::kLightSleep) != poot::kPowerSampleMs) {
+    runner.fail(modes, "mostly asleep but the duty estimate disagrees");
+  }
+
+  // Any of these keeps the radio up however long the lock has been idle.
+  poot_power::Sample busy = sample;
+  busy.nowMs += poot::kPowerLightSleepAfterMs;
+  busy.relayBusy = true;
+  policy.update(busy);
+  busy.relayBusy = false;
+  busy.apStations = 1;
+  policy.update(busy);
+  busy.apStations = 0;
+  busy.staUp = false;
+  policy.update(busy);
+  if (policy.decision().mode != Mode::kAwake) {
+    runner.fail(modes, "slept with the relay busy, a station or no STA");
+  }
+  // A budget shorter than one DTIM period rules out any sleep.
+  poot_power::PowerPolicy tight(true, poot::kPowerDtimMs - 1);
+  poot_power::Sample quiet = {0, 0, 0, 0, false, true};
+  tight.update(quiet);
+  quiet.nowMs = poot::kPowerLightSleepAfterMs;
+  tight.update(quiet);
+  if (tight.decision().mode != Mode::kAwake) {
+    runner.fail(modes, "slept past a budget below one DTIM period");
+  }
+  // Keeping the soft AP stops at modem sleep, with the radio counted as on.
+  poot_power::PowerPolicy keepAp(true, 500, /*dropsAp=*/false);
+  quiet.nowMs = 0;
+  keepAp.update(quiet);
+  quiet.nowMs = 2 * poot::kPowerLightSleepAfterMs;
+  keepAp.update(quiet);
+  if (keepAp.decision().mode != Mode::kModemSleep ||
+      keepAp.dutyPermille() != 1000) {
+    runner.fail(modes, "light-slept, or counted the radio off, with the AP up");
+  }
+
+  const char* boost = "power/boost";
+  poot_power::Sample burst = busy;
+  burst.staUp = true;
+  for (uint8_t i = 0; i < poot::kPowerBurstRequests; i++) {
+    burst.nowMs += 100;
+    burst.requests++;
+    policy.update(burst);
+  }
+  const bool boosted = policy.decision().boostCpu;
+  burst.nowMs += poot::kPowerBurstWindowMs + 1;
+  policy.update(burst);
+  if (!boosted || policy.decision().boostCpu || policy.boosts() != 1) {
+    runner.fail(boost, "the clock did not follow the burst");
+  }
+  // The clock does not depend on kEnablePowerSave: a policy that may not
+  // sleep still boosts, and stays awake.
+  poot_power::PowerPolicy awake(/*sleepAllowed=*/false, 500);
+  awake.update(burst);
+  for (uint8_t i = 0; i < poot::kPowerBurstRequests; i++) {
+    burst.nowMs += 100;
+    burst.requests++;
+    awake.update(burst);
+  }
+  if (!awake.decision().boostCpu || awake.decision().mode != Mode::kAwake) {
+    runner.fail(boost, "power save off changed the clock or the radio");
+  }
+
+  const char* apply = "power/apply";
+  // The soft AP only goes down for a sleep with kPowerSleepDropsAp.
+  const bool dropsAp = poot::kPowerSleepDropsAp;
+  applyPowerDecision(poot_power::Decision{
+      dropsAp ? Mode::kLightSleep : Mode::kModemSleep, 3, true});
+  const bool slept =
+      WiFi.getMode() == (dropsAp ? WIFI_STA : WIFI_AP_STA) &&
+      WiFi.getSleepMode() == (dropsAp ? WIFI_LIGHT_SLEEP : WIFI_MODEM_SLEEP) &&
+      WiFi.getListenInterval() == 3 && ESP.getCpuFreqMHz() == 160;
+  applyPowerDecision(poot_power::Decision{Mode::kAwake, 0, false});
+  if (!slept || WiFi.getMode() != WIFI_AP_STA ||
+      WiFi.getSleepMode() != WIFI_NONE_SLEEP || ESP.getCpuFreqMHz() != 80) {
+    runner.fail(apply, "sleep, soft AP and clock not applied and restored");
+  }
+  const int id = request(BENCH_REQUEST("/api/health?key=" LOCAL_SHARED_KEY));
+  if (fake_net::connection(id)->received.find(
+          "\"power\":{\"mode\":\"awake\"") == std::string::npos) {
+    runner.fail(apply, "/api/health lacks the power policy");
+  }
+
+  runner.run("power/sample+update", [] {
+    powerPolicy.update(readPowerSample());
+  });
+}
+
+// Timed loops skip far more virtual time than a device could go without
+// running loop(), and an armed deadline left more than 24.8 days behind
+// reads as still ahead. Makes every armed task due again.
+void catchUpScheduler() {
+  for (poot_sched::TaskId id = 0; id < poot_sched::Scheduler::kMaxTasks;
+       id++) {
+    if (scheduler.isArmed(id)) {
+      scheduler.scheduleIn(id, 0);
+    }
+  }
+}
+
+// Two pins switched as one channel, GPIO16 (driven through the RTC block)
+// among them.
+using BenchRelayPins = poot_gpio::OutputPins<true, D2, D0>;
+
+bool benchRelayPinsAre(int level) {
+  return fake_hal::pinLevel(D2) == level && fake_hal::pinLevel(D0) == level;
+}
+
+void benchRelay(Runner& runner) {
+  static Relay<BenchRelayPins> benchRelay;
+  benchRelay.begin();
+  if (!benchRelayPinsAre(HIGH)) {
+    runner.fail("relay/channels", "active-low pins not idle high");
+  }
+  benchRelay.triggerPulse(poot::kUnlockPulseMs, poot::kUnlockCooldownMs);
+  const bool on = benchRelayPinsAre(LOW);
+  fake_hal::advanceMillis(poot::kUnlockPulseMs);
+  benchRelay.loop();
+  if (!on || !benchRelayPinsAre(HIGH)) {
+    runner.fail("relay/channels", "pins did not follow the pulse together");
+  }
+  fake_hal::advanceMillis(poot::kUnlockCooldownMs);
+  benchRelay.loop();
+  // One pin write each way, on a relay channel. The registers are emulated
+  // here, so logRelayWriteCycles() is what measures the device.
+  runner.run("gpio/write/digitalWrite", [] { digitalWrite(D2, HIGH); });
+  runner.run("gpio/write/register", [] { BenchRelayPins::off(); });
+  runner.run("relay/triggerPulse/fire (+loop)", [] {
+    skipPastCooldown();
+    benchRelay.loop();
+    benchRelay.triggerPulse(poot::kUnlockPulseMs, poot::kUnlockCooldownMs);
+  });
+  benchRelay.triggerPulse(poot::kUnlockPulseMs, poot::kUnlockCooldownMs);
+  runner.run("relay/triggerPulse/coalesced", [] {
+    benchRelay.triggerPulse(poot::kUnlockPulseMs, poot::kUnlockCooldownMs);
+  });
+  fake_hal::advanceMillis(poot::kUnlockPulseMs);
+  benchRelay.loop();
+  runner.run("relay/triggerPulse/cooldown", [] {
+    benchRelay.triggerPulse(poot::kUnlockPulseMs, poot::kUnlockCooldownMs);
+  });
+  // The default maxWaitMs of 0 refused all of those; a long enough one queues.
+  if (benchRelay.hasQueuedPulse() ||
+      benchRelay.triggerPulse(poot::kUnlockPulseMs, poot::kUnlockCooldownMs,
+                              poot::kUnlockCooldownMs) !=
+          RelayController::Result::kQueued) {
+    runner.fail("relay/triggerPulse/queued", "cooldown did not queue");
+  }
+  // An unlock that gets in between the cooldown ending and loop() starting
+  // the queued pulse fires it; nothing is left queued behind it.
+  fake_hal::advanceMillis(poot::kUnlockCooldownMs);
+  if (benchRelay.triggerPulse(poot::kUnlockPulseMs, poot::kUnlockCooldownMs) !=
+          RelayController::Result::kFired ||
+      benchRelay.hasQueuedPulse()) {
+    runner.fail("relay/triggerPulse/queued", "stale queued pulse left behind");
+  }
+}
+
+// ---- boot ----
+//
+// main() times setup() and an unlock over the soft AP sent right after it,
+// before the STA has joined: with serve-first startup that one already gets
+// its 200. Host times, so only the ordering carries over to the device.
+
+struct BootTimes {
+  double setupUs;
+  double firstUnlockUs;  // from entering setup() to the unlock's reply
+  int firstUnlockStatus;
+};
+
+void benchBoot(Runner& runner, const BootTimes& times) {
+  using poot_boot::Phase;
+  const char* name = "boot/serve_first";
+  if (times.firstUnlockStatus != 200 ||
+      !poot_boot::reached(Phase::kFirstUnlock)) {
+    runner.fail(name, "unlock over the soft AP right after setup() failed");
+    return;
+  }
+  if (!poot_boot::reached(Phase::kReady) ||
+      poot_boot::at(Phase::kReady) > poot_boot::at(Phase::kStaBegin) ||
+      poot_boot::at(Phase::kStaBegin) > poot_boot::at(Phase::kSetup) ||
+      !poot_boot::reached(Phase::kStaIp)) {
+    runner.fail(name, "boot phases missing or out of order");
+    return;
+  }
+
+  // The survey scan waits for the join, then runs in the background.
+  const char* survey = "boot/survey";
+  if (fake_hal::scansStarted() != 0) {
+    runner.fail(survey, "setup() scanned before the join settled");
+    return;
+  }
+  for (int i = 0; i < 3 && fake_hal::scansStarted() == 0; i++) {
+    fake_hal::advanceMillis(poot::kWiFiSurveyPollMs);
+    loop();
+  }
+  if (fake_hal::scansStarted() != 1 || poot_boot::reached(Phase::kSurvey)) {
+    runner.fail(survey, "async scan did not start once connected");
+    return;
+  }
+  fake_hal::finishScan();
+  fake_hal::advanceMillis(poot::kWiFiSurveyPollMs);
+  loop();
+  if (!poot_boot::reached(Phase::kSurvey)) {
+    runner.fail(survey, "finished scan was not logged");
+    return;
+  }
+
+  const int id = request(BENCH_REQUEST("/api/health?key=" LOCAL_SHARED_KEY));
+  const std::string& body = fake_net::connection(id)->received;
+  if (body.find("\"boot\":{\"soft_ap\":") == std::string::npos ||
+      body.find("\"cloud\":-1,") == std::string::npos) {
+    runner.fail("boot/health", "/api/health lacks the boot timeline");
+    return;
+  }
+  runner.metric("boot/setup", "us", times.setupUs);
+  runner.metric("boot/first_unlock", "us", times.firstUnlockUs);
+}
+
+// ---- STA rejoin ----
+//
+// setup() had nothing cached, so it scanned; the access point it joined is
+// cached from then on. The host does not model the SDK's scan, so these
+// check which begin() the sketch makes and that the cache outlives RTC
+// memory; join times are whatever the bench puts between begin() and IP.
+
+constexpr uint32_t kModelJoinMs = 400;
+const uint8_t kRoamedBssid[6] = {0x02, 0x50, 0x4f, 0x4f, 0x54, 0x02};
+constexpr int32_t kRoamedChannel = 11;
+
+// Lets the "wifi_status" task run a few times.
+void pumpWiFiStatus() {
+  for (int i = 0; i < 4; i++) {
+    fake_hal::advanceMillis(poot::kWiFiStatusPollMs);
+    loop();
+  }
+}
+
+bool joinedAt(const uint8_t* bssid, int32_t channel) {
+  fake_hal::advanceMillis(kModelJoinMs);
+  fake_hal::setStaConnected(kStaIp, WIFI_STA_SSID, -55);
+  pumpWiFiStatus();
+  const poot_sta::AccessPoint* target = poot_sta::fastTarget();
+  return WiFi.status() == WL_CONNECTED && target != nullptr &&
+         memcmp(target->bssid, bssid, 6) == 0 && target->channel == channel;
+}
+
+bool begunFast(const uint8_t* bssid, int32_t channel) {
+  const uint8_t* asked = fake_hal::lastBeginBssid();
+  return asked != nullptr && memcmp(asked, bssid, 6) == 0 &&
+         fake_hal::lastBeginChannel() == channel;
+}
+
+bool begunScan() {
+  return fake_hal::lastBeginBssid() == nullptr &&
+         fake_hal::lastBeginChannel() == 0;
+}
+
+void benchStaJoin(Runner& runner) {
+  const char* name = "sta/join";
+  const uint8_t home[6] = {WiFi.BSSID()[0], WiFi.BSSID()[1], WiFi.BSSID()[2],
+                           WiFi.BSSID()[3], WiFi.BSSID()[4], WiFi.BSSID()[5]};
+  const int32_t homeChannel = WiFi.channel();
+  catchUpScheduler();
+  if (poot_sta::scanJoins() != 1 || poot_sta::fastTarget() == nullptr ||
+      fake_hal::flashFileSize("/sta.bin") == 0) {
+    runner.fail(name, "first join was not cached");
+    return;
+  }
+
+  // A reset keeps RTC memory: the next join goes straight to the AP.
+  poot_sta::begin(WIFI_STA_SSID);
+  connectSta(true);
+  if (!begunFast(home, homeChannel) || !joinedAt(home, homeChannel) ||
+      poot_sta::lastJoin() != poot_sta::JoinKind::kFast ||
+      poot_sta::lastJoinMs() < kModelJoinMs) {
+    runner.fail(name, "reset did not join with the cached BSSID and channel");
+    return;
+  }
+
+  // Power loss clears RTC memory; flash still has the AP.
+  memset(fake_hal::rtcUserMemory() + poot::kRtcStaJoinBlock * 4, 0, 16);
+  poot_sta::begin(WIFI_STA_SSID);
+  connectSta(true);
+  if (!begunFast(home, homeChannel) || !joinedAt(home, homeChannel)) {
+    runner.fail(name, "power-on did not join from the flash copy");
+    return;
+  }
+
+  // The AP moved channel: the fast join is refused and a scan finds it.
+  fake_hal::setStaAccessPoint(kRoamedBssid, kRoamedChannel);
+  const uint32_t missesBefore = poot_sta::fastMisses();
+  connectSta(true);
+  fake_hal::setStaDisconnected(WIFI_DISCONNECT_REASON_NO_AP_FOUND);
+  pumpWiFiStatus();
+  if (poot_sta::fastMisses() != missesBefore + 1 || !begunScan() ||
+      !joinedAt(kRoamedBssid, kRoamedChannel) ||
+      poot_sta::lastJoin() != poot_sta::JoinKind::kScan) {
+    runner.fail(name, "refused fast join did not fall back to a scan");
+    return;
+  }
+
+  // Nothing heard back within the timeout is a miss too.
+  connectSta(true);
+  if (!begunFast(kRoamedBssid, kRoamedChannel)) {
+    runner.fail(name, "join after the scan was not fast again");
+    return;
+  }
+  fake_hal::advanceMillis(poot::kWiFiFastJoinTimeoutMs);
+  pumpWiFiStatus();
+  if (poot_sta::fastMisses() != missesBefore + 2 || !begunScan() ||
+      !joinedAt(kRoamedBssid, kRoamedChannel)) {
+    runner.fail(name, "silent fast join did not fall back to a scan");
+    return;
+  }
+
+  const int id = request(BENCH_REQUEST("/api/health?key=" LOCAL_SHARED_KEY));
+  const std::string& body = fake_net::connection(id)->received;
+  if (body.find("\"join\":\"scan\",\"join_ms\":") == std::string::npos) {
+    runner.fail("sta/join/health", "/api/health lacks the join stats");
+    return;
+  }
+  runner.metric("sta/join/fast_joins", "count", poot_sta::fastJoins());
+  runner.metric("sta/join/fast_misses", "count", poot_sta::fastMisses());
+  runner.metric("sta/join/scan_joins", "count", poot_sta::scanJoins());
+}
+
+
+// ---- cloud command stream ----
+//
+// The sketch's FirebaseClient against CloudStandIn on loopback: sign-in, a
+// redirect, then commands pushed while the stream is open. Loopback has no
+// network latency, so the stream's command-to-relay time is the firmware's
+// own cost. With polling every kPollModelMs a command instead waits for the
+// next poll, on average half the interval (plus that request's own round
+// trip, not modelled here).
+
+constexpr int kCloudCommands = 20;
+constexpr uint32_t kPollModelMs = 2000;
+
+poot_bench::CloudStandIn gCloud;
+
+// Runs the stand-in and the sketch until `done` (or gives up).
+template <typename Fn>
+bool pumpCloudUntil(Fn done) {
+  for (int pass = 0; pass < 20000; pass++) {
+    if (done()) {
+      return true;
+    }
+    gCloud.pump();
+    loop();
+  }
+  return done();
+}
+
+void reportCloudLatency(Runner& runner, const char* variant, const char* unit,
+                        std::vector<double> samples) {
+  std::sort(samples.begin(), samples.end());
+  char name[80];
+  snprintf(name, sizeof(name), "cloud/%s/command_to_relay/p50", variant);
+  runner.metric(name, unit, samples[samples.size() / 2]);
+  snprintf(name, sizeof(name), "cloud/%s/command_to_relay/max", variant);
+  runner.metric(name, unit, samples.back());
+}
+
+bool auditIdle() { return auditLog.pending() == 0 && cloud.streaming(); }
+
+// Makes the next unlock fire; keep-alives stop the skipped time from
+// looking like a dead stream. The skip also ends the audit flush window, so
+// the previous unlock's event is written before the stream is timed again.
+void readyForCloudUnlock() {
+  gCloud.sendKeepAlive();
+  skipPastCooldown();
+  pumpCloudUntil([] { return !relay.isRelayOn(); });
+  pumpCloudUntil(auditIdle);
+}
+
+bool scenarioCloudStream(Runner& runner) {
+  using Clock = std::chrono::steady_clock;
+  std::vector<double> samples;
+  for (int i = 0; i < kCloudCommands; i++) {
+    readyForCloudUnlock();
+    const Clock::time_point start = Clock::now();
+    gCloud.pushCommand("unlock");
+    if (!pumpCloudUntil([] { return relay.isRelayOn(); })) {
+      runner.fail("cloud/stream", "pushed unlock did not fire the relay");
+      return false;
+    }
+    samples.push_back(
+        std::chrono::duration<double, std::micro>(Clock::now() - start)
+            .count());
+  }
+  reportCloudLatency(runner, "stream", "us", samples);
+
+  std::vector<double> model;
+  for (int i = 0; i < kCloudCommands; i++) {
+    const uint32_t arrivalMs = i * kPollModelMs / kCloudCommands;
+    model.push_back(static_cast<double>(kPollModelMs - arrivalMs));
+  }
+  reportCloudLatency(runner, "poll_model", "ms", model);
+  return true;
+}
+
+bool scenarioCloudResume(Runner& runner) {
+  const char* name = "cloud/resume";
+  const std::string seen = cloud.lastCommandId();
+  const uint32_t runBefore = cloud.commandsRun();
+  gCloud.dropConnections();
+  if (!pumpCloudUntil([] { return !cloud.streaming(); })) {
+    runner.fail(name, "dropped stream was not noticed");
+    return false;
+  }
+  // Written while the lock is reconnecting; must run once on resume.
+  gCloud.pushCommand("unlock");
+  readyForCloudUnlock();
+  if (!pumpCloudUntil([] { return cloud.streaming(); }) ||
+      !pumpCloudUntil([] { return relay.isRelayOn(); })) {
+    runner.fail(name, "command written while disconnected did not run");
+    return false;
+  }
+  for (int pass = 0; pass < 100; pass++) {
+    gCloud.pump();
+    loop();
+  }
+  const std::string query = gCloud.lastStreamQuery();
+  if (cloud.commandsRun() != runBefore + 1 ||
+      query.find("startAt=%22" + seen + "%22") == std::string::npos) {
+    runner.fail(name, ("expected one command after startAt, query: " + query)
+                          .c_str());
+    return false;
+  }
+  return true;
+}
+
+bool scenarioCloudStaleAndRevoke(Runner& runner) {
+  const uint32_t skippedBefore = cloud.commandsSkipped();
+  const uint32_t runBefore = cloud.commandsRun();
+  gCloud.pushCommand("unlock",
+                     gCloud.nowMs() - poot::kCloudCommandMaxAgeMs - 1000);
+  if (!pumpCloudUntil([&] { return cloud.commandsSkipped() > skippedBefore; }) ||
+      cloud.commandsRun() != runBefore) {
+    runner.fail("cloud/stale", "stale command was not skipped");
+    return false;
+  }
+  // The resumed command's pulse is still on, so signing in again (a
+  // blocking handshake) has to wait for it.
+  const int signInsBefore = gCloud.signIns();
+  const uint32_t deferredBefore = cloud.connectsDeferred();
+  gCloud.revokeAuth();
+  pumpCloudUntil([] { return !cloud.streaming(); });
+  fake_hal::advanceMillis(2 * poot::kCloudBackoffMinMs);  // past the backoff
+  for (int pass = 0; pass < 100 && relay.isRelayOn(); pass++) {
+    gCloud.pump();
+    loop();
+  }
+  if (!relay.isRelayOn() || gCloud.signIns() != signInsBefore ||
+      cloud.connectsDeferred() == deferredBefore) {
+    runner.fail("cloud/defer_while_busy",
+                "reconnected while the relay was on");
+    return false;
+  }
+  skipPastCooldown();
+  if (!pumpCloudUntil([&] {
+        return gCloud.signIns() > signInsBefore && cloud.streaming();
+      })) {
+    runner.fail("cloud/auth_revoked", "did not sign in again");
+    return false;
+  }
+  return true;
+}
+
+// Drops the link and times the way back to an open stream, backoff
+// skipped: TCP connect, TLS handshake, the stream request and its reply.
+double reconnectUs() {
+  using Clock = std::chrono::steady_clock;
+  gCloud.dropConnections();
+  pumpCloudUntil([] { return !cloud.streaming(); });
+  fake_hal::advanceMillis(poot::kCloudBackoffMaxMs);
+  gCloud.sendKeepAlive();
+  const Clock::time_point start = Clock::now();
+  if (!pumpCloudUntil([] { return cloud.streaming(); })) {
+    return -1;
+  }
+  return std::chrono::duration<double, std::micro>(Clock::now() - start)
+      .count();
+}
+
+// Reconnects offer the last session and the stand-in resumes it; once it
+// has forgotten its sessions every reconnect is a full handshake again.
+// MFLN was taken, so the client runs with the small receive buffer.
+bool scenarioCloudTls(Runner& runner) {
+  if (!gCloud.tls()) {
+    return true;  // built without OpenSSL: nothing to resume
+  }
+  constexpr int kReconnects = 5;
+  if (cloud.tlsRecvBufferBytes() != poot::kCloudTlsRecvBytes) {
+    runner.fail("cloud/tls/mfln", "receive buffer was not reduced");
+    return false;
+  }
+  std::vector<double> resumed;
+  std::vector<double> full;
+  const uint32_t resumedBefore = cloud.resumedHandshakes();
+  const uint32_t fullBefore = cloud.fullHandshakes();
+  const int serverResumedBefore = gCloud.resumedHandshakes();
+  for (int i = 0; i < kReconnects; i++) {
+    resumed.push_back(reconnectUs());
+  }
+  if (cloud.resumedHandshakes() != resumedBefore + kReconnects ||
+      cloud.fullHandshakes() != fullBefore ||
+      gCloud.resumedHandshakes() != serverResumedBefore + kReconnects) {
+    runner.fail("cloud/tls/resume", "reconnects did not resume the session");
+    return false;
+  }
+  for (int i = 0; i < kReconnects; i++) {
+    gCloud.forgetSessions();
+    full.push_back(reconnectUs());
+  }
+  if (cloud.fullHandshakes() != fullBefore + kReconnects ||
+      cloud.resumedHandshakes() != resumedBefore + kReconnects) {
+    runner.fail("cloud/tls/full", "forgotten sessions were not renegotiated");
+    return false;
+  }
+  std::sort(resumed.begin(), resumed.end());
+  std::sort(full.begin(), full.end());
+  if (resumed.front() < 0 || full.front() < 0) {
+    runner.fail("cloud/tls", "stream did not come back after a drop");
+    return false;
+  }
+  runner.metric("cloud/tls/reconnect_resumed/p50", "us",
+                resumed[resumed.size() / 2]);
+  runner.metric("cloud/tls/reconnect_full/p50", "us", full[full.size() / 2]);
+  runner.metric("cloud/tls/full_handshakes", "count", cloud.fullHandshakes());
+  runner.metric("cloud/tls/resumed_handshakes", "count",
+                cloud.resumedHandshakes());
+  return true;
+}
+
+// ---- audit trail ----
+
+constexpr int kAuditBurst = 5;
+
+void unlockOverHttp() {
+  skipPastCooldown();
+  request(BENCH_REQUEST("/api/local-unlock?key=" LOCAL_SHARED_KEY));
+}
+
+// Has the stream read a keep-alive, so a jump in time does not look like a
+// dead stream; the jump then also covers kAuditStreamQuietMs.
+void keepStreamAlive() {
+  const uint32_t events = cloud.events();
+  gCloud.sendKeepAlive();
+  pumpCloudUntil([&] { return cloud.events() > events; });
+}
+
+// Ends the flush window and runs until the queue is written.
+bool flushAudit() {
+  keepStreamAlive();
+  fake_hal::advanceMillis(poot::kAuditFlushWindowMs);
+  return pumpCloudUntil(auditIdle);
+}
+
+// A burst of requests (one unlock, then ones coalesced into it) goes out as one
+// PATCH once the window ends, and the stream comes back on the same
+// connection.
+bool scenarioAuditBatch(Runner& runner) {
+  const char* name = "audit/batch";
+  if (!flushAudit()) {
+    runner.fail(name, "earlier events were not written");
+    return false;
+  }
+  const int writesBefore = gCloud.writes();
+  const int streamsBefore = gCloud.streamsOpened();
+  const int reusedBefore = gCloud.reusedConnections();
+  unlockOverHttp();
+  for (int i = 1; i < kAuditBurst; i++) {
+    request(BENCH_REQUEST("/api/local-unlock?key=" LOCAL_SHARED_KEY));
+  }
+  using Clock = std::chrono::steady_clock;
+  keepStreamAlive();
+  fake_hal::advanceMillis(poot::kAuditFlushWindowMs);
+  const Clock::time_point start = Clock::now();
+  if (!pumpCloudUntil(auditIdle)) {
+    runner.fail(name, "burst was not written");
+    return false;
+  }
+  const double flushUs =
+      std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+  if (gCloud.writes() != writesBefore + 1 ||
+      gCloud.lastWriteChildren() != kAuditBurst ||
+      gCloud.streamsOpened() != streamsBefore + 1 ||
+      gCloud.reusedConnections() != reusedBefore + 1) {
+    runner.fail(name, "expected one PATCH of the burst, then the stream on "
+                      "the same connection");
+    return false;
+  }
+  auto event = gCloud.written().rbegin();
+  for (int i = 1; i < kAuditBurst; i++) {
+    ++event;
+  }
+  const std::string& first = event->second;
+  const std::string& last = gCloud.written().rbegin()->second;
+  if (first.find("\"source\":\"local_http\",\"outcome\":\"unlocked\"") ==
+          std::string::npos ||
+      last.find("\"outcome\":\"coalesced\"") == std::string::npos ||
+      last.find("\"at\":") == std::string::npos) {
+    runner.fail(name, ("unexpected events: " + first + " " + last).c_str());
+    return false;
+  }
+  runner.metric("audit/batch/events_per_write", "events",
+                static_cast<double>(kAuditBurst));
+  runner.metric("audit/batch/write_and_resume", "us", flushUs);
+  runner.metric("audit/batch/flush_latency", "ms", cloud.lastFlushMs());
+  return true;
+}
+
+// Events from while the STA link is down survive a reboot and are written
+// once it is back.
+bool scenarioAuditOffline(Runner& runner) {
+  const char* name = "audit/offline";
+  const int writesBefore = gCloud.writes();
+  const size_t childrenBefore = gCloud.written().size();
+  fake_hal::setStaDisconnected(8);
+  pumpCloudUntil([] {
+    return cloud.state() == poot_cloud::FirebaseClient::State::kOffline;
+  });
+  for (int i = 0; i < 3; i++) {
+    unlockOverHttp();  // over the AP
+  }
+  for (int pass = 0; pass < 10; pass++) {
+    loop();  // the "audit" task persists them
+  }
+  auditLog.begin();  // as after a reset: only flash is left
+  if (auditLog.pending() != 3 || !auditLog.persistent()) {
+    runner.fail(name, "offline events were not on flash after a restart");
+    return false;
+  }
+  fake_hal::setStaConnected(kStaIp, WIFI_STA_SSID, -55);
+  if (!flushAudit() || gCloud.writes() != writesBefore + 1 ||
+      gCloud.written().size() != childrenBefore + 3) {
+    runner.fail(name, "offline events were not written once online");
+    return false;
+  }
+  // Written after the "reset", so there is no clock to date them by.
+  if (gCloud.written().rbegin()->second.find("\"at\":") !=
+      std::string::npos) {
+    runner.fail(name, "event from before the restart was given a time");
+    return false;
+  }
+  return true;
+}
+
+// Refused writes back off without holding up the stream, and the retried
+// batch lands under the same keys.
+bool scenarioAuditRetry(Runner& runner) {
+  const char* name = "audit/retry";
+  const int writesBefore = gCloud.writes();
+  const uint32_t failuresBefore = cloud.auditFailures();
+  const size_t childrenBefore = gCloud.written().size();
+  gCloud.failNextWrites(2);
+  unlockOverHttp();
+  keepStreamAlive();
+  fake_hal::advanceMillis(poot::kAuditFlushWindowMs);
+  if (!pumpCloudUntil([&] {
+        return cloud.auditFailures() == failuresBefore + 1 &&
+               cloud.streaming();
+      }) ||
+      auditLog.pending() != 1) {
+    runner.fail(name, "refused write did not leave the event queued");
+    return false;
+  }
+  // Inside the first backoff nothing is retried.
+  for (int pass = 0; pass < 50; pass++) {
+    gCloud.pump();
+    loop();
+  }
+  if (gCloud.writesRefused() != 1) {
+    runner.fail(name, "write retried before its backoff");
+    return false;
+  }
+  for (uint32_t delayMs = poot::kAuditBackoffMinMs;
+       gCloud.writes() == writesBefore &&
+       delayMs <= poot::kAuditBackoffMinMs * 4;
+       delayMs *= 2) {
+    const uint32_t failures = cloud.auditFailures();
+    keepStreamAlive();
+    fake_hal::advanceMillis(delayMs + delayMs / 4 + 1);
+    pumpCloudUntil([&] {
+      return gCloud.writes() > writesBefore ||
+             cloud.auditFailures() > failures;
+    });
+    pumpCloudUntil([] { return cloud.streaming(); });
+  }
+  if (gCloud.writes() != writesBefore + 1 || gCloud.writesRefused() != 2 ||
+      !auditIdle() || gCloud.written().size() != childrenBefore + 1) {
+    runner.fail(name, "event was not written once after two refusals");
+    return false;
+  }
+  return true;
+}
+
+void benchCloud(Runner& runner) {
+  if (!gCloud.start()) {
+    runner.fail("cloud", "stand-in could not listen");
+    return;
+  }
+  poot_cloud::Config config = {};
+  config.dbHost = "127.0.0.1";
+  config.port = gCloud.port();
+  config.authHost = "127.0.0.1";
+  config.apiKey = "standin-api-key";
+  config.email = "lock-device@example.com";
+  config.password = "standin-password";
+  config.lockId = LOCK_ID;
+  config.caPem = gCloud.tls() ? gCloud.certificatePem().c_str() : nullptr;
+  // The client blocks in its handshake; the stand-in answers from yield().
+  fake_hal::setYieldHook([] { gCloud.pump(); });
+  gCloud.redirectNextStream("localhost");
+  cloud.begin(config, onCloudCommand);
+  cloud.attachAudit(&auditLog);
+  if (!pumpCloudUntil([] { return cloud.streaming(); }) ||
+      gCloud.signIns() != 1 || gCloud.streamsOpened() != 1) {
+    runner.fail("cloud/open", "sign-in, redirect and stream did not succeed");
+    cloud.stop();
+    return;
+  }
+  if (scenarioCloudStream(runner) && scenarioCloudResume(runner) &&
+      scenarioCloudStaleAndRevoke(runner) && scenarioCloudTls(runner) &&
+      scenarioAuditBatch(runner) &&
+      scenarioAuditOffline(runner) && scenarioAuditRetry(runner)) {
+    const int id = request(BENCH_REQUEST("/api/health?key=" LOCAL_SHARED_KEY));
+    const std::string& body = fake_net::connection(id)->received;
+    if (statusOf(id) != 200 ||
+        body.find("\"cloud\":{\"state\":\"streaming\"") == std::string::npos) {
+      runner.fail("cloud/health", "/api/health lacks the cloud state");
+    } else if (body.find("\"tls\":{\"full\":") == std::string::npos) {
+      runner.fail("cloud/tls/health", "/api/health lacks the TLS counters");
+    } else if (body.find("\"audit\":{\"queued\":0,") == std::string::npos) {
+      runner.fail("audit/health", "/api/health lacks the audit queue");
+    }
+  }
+  cloud.stop();
+  fake_hal::setYieldHook(nullptr);
+  gCloud.stop();
+
+  static poot_cloud::EventStreamParser parser;
+  static const char kEvent[] =
+      "event: put\n"
+      "data: {\"path\":\"/-OAbCdEfGhIjKlMnOpQr\",\"data\":{\"action\":"
+      "\"unlock\",\"createdAt\":1760000000000,\"uid\":\"standin-user\"}}\n\n";
+  runner.run("cloud/sse/parse_put_event", [] {
+    for (const char* p = kEvent; *p != '\0'; p++) {
+      parser.feed(*p);
+    }
+  });
+
+  // What an unlock handler pays (RAM only), and the "audit" task's flash
+  // write after it.
+  runner.run("audit/record", [] {
+    auditLog.record(poot_audit::Source::kLocalHttp,
+                    poot_audit::Outcome::kUnlocked);
+  });
+  runner.run("audit/record+persist", [] {
+    auditLog.record(poot_audit::Source::kLocalHttp,
+                    poot_audit::Outcome::kUnlocked);
+    auditLog.persist();
+  });
+}
+
+// ---- /api/events ----
+//
+// Two subscribers get the state on connect and then only changes: the relay
+// through a pulse and its cooldown, and an AP station joining. A third is
+// turned away, a quiet subscriber gets heartbeats and nothing else, and one
+// that falls more than the ring behind is sent the state afresh. Times the
+// server pass with both subscribers idle, which every loop() now pays.
+
+const char kEventsRequest[] =
+    "GET /api/events?key=" LOCAL_SHARED_KEY
+    " HTTP/1.1\r\nHost: poot.local\r\n\r\n";
+
+// What the sketch sent on `id` since the last call.
+std::string takeReceived(int id) {
+  fake_net::Connection* c = fake_net::connection(id);
+  std::string sent = c->received;
+  c->received.clear();
+  return sent;
+}
+
+bool sentEvent(const std::string& sent, const char* event) {
+  return sent.find(event) != std::string::npos;
+}
+
+void benchEvents(Runner& runner) {
+  const char* name = "events/subscribe";
+  skipPastCooldown();
+  loop();  // publishes the end of any cooldown left by earlier cases
+  int ids[2];
+  for (int& id : ids) {
+    id = fake_net::asyncConnect(poot::kLocalHttpPort, kBenchClient);
+    fake_net::asyncSend(id, kEventsRequest);
+    server.loop();
+  }
+  const int refused = request(kEventsRequest);
+  char hello[160];
+  snprintf(hello, sizeof(hello),
+           "retry: %lu\nevent: state\ndata: {\"relay\":false,"
+           "\"cooldown\":false,\"sta\":true,\"ap\":%u}\n\n",
+           (unsigned long)poot::kEventsRetryMs,
+           (unsigned)WiFi.softAPgetStationNum());
+  const std::string first = takeReceived(ids[0]);
+  takeReceived(ids[1]);
+  if (statusOf(refused) != 503 || !fake_net::asyncOpen(ids[0]) ||
+      first.find("Content-Type: text/event-stream\r\n") == std::string::npos ||
+      !sentEvent(first, hello)) {
+    runner.fail(name, "subscribers not greeted with the state, or a third "
+                      "was let in");
+  } else {
+    const char* changes = "events/changes";
+    static const uint8_t kMac[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x09};
+    request(BENCH_REQUEST("/api/local-unlock?key=" LOCAL_SHARED_KEY));
+    server.loop();
+    const std::string on = takeReceived(ids[1]);
+    fake_hal::advanceMillis(poot::kUnlockPulseMs);
+    loop();  // the relay task ends the pulse
+    const std::string off = takeReceived(ids[1]);
+    fake_hal::advanceMillis(poot::kUnlockCooldownMs);
+    loop();  // and wakes again when the cooldown ends
+    const std::string ready = takeReceived(ids[1]);
+    fake_hal::apStationJoined(kMac);
+    loop();
+    const std::string joined = takeReceived(ids[1]);
+    fake_hal::apStationLeft(kMac);
+    loop();
+    takeReceived(ids[1]);
+    if (on != "event: relay\ndata: {\"relay\":true}\n\n" ||
+        off != "event: relay\ndata: {\"relay\":false}\n\n"
+               "event: cooldown\ndata: {\"cooldown\":true}\n\n" ||
+        ready != "event: cooldown\ndata: {\"cooldown\":false}\n\n" ||
+        !sentEvent(joined, "event: ap\ndata: {\"ap\":")) {
+      runner.fail(changes, "relay, cooldown or AP changes not pushed as they "
+                           "happened");
+    } else {
+      const char* quiet = "events/heartbeat";
+      for (int pass = 0; pass < 10; pass++) {
+        server.loop();
+      }
+      const std::string idle = takeReceived(ids[1]);
+      fake_hal::advanceMillis(poot::kEventsHeartbeatMs);
+      server.loop();
+      const std::string beat = takeReceived(ids[1]);
+      if (!idle.empty() || beat != ":\n\n") {
+        runner.fail(quiet, "idle subscriber not sent only heartbeats");
+      }
+
+      const char* behind = "events/resync";
+      takeReceived(ids[0]);
+      for (uint8_t i = 0; i <= poot::kEventsRingSlots; i++) {
+        poot_events::LockState state = poot_events::current();
+        state.apStations++;
+        poot_events::publish(state);
+      }
+      publishLockState();
+      server.loop();
+      const std::string resync = takeReceived(ids[0]);
+      if (resync.compare(0, 20, "event: state\ndata: {") != 0 ||
+          sentEvent(resync, "event: ap")) {
+        runner.fail(behind, "a subscriber behind the ring was not resent "
+                            "the state");
+      }
+      runner.run("http/events/idle_pass", [] { server.loop(); });
+    }
+  }
+  for (int id : ids) {
+    fake_net::asyncPeerClose(id);
+  }
+  skipPastCooldown();
+}
+
+// ---- /metrics ----
+//
+// Runs last, so the exposition covers everything the other cases did
+// (disconnects from the STA join cases, cloud unlocks). Checks that unlocks,
+// pulses, the latency histogram (a queued unlock is timed to its pulse) and
+// AP joins are counted, that the scrape carries them, and times a scrape.
+
+// Whether the last reply contains `line` (a whole line).
+bool hasLine(int id, const char* line) {
+  const fake_net::Connection* c = fake_net::connection(id);
+  const std::string needle = std::string("\n") + line + "\n";
+  return c != nullptr && c->received.find(needle) != std::string::npos;
+}
+
+uint32_t responsesFor(const char* path, int code) {
+  using poot_http::HttpServer;
+  for (uint8_t route = 0; route < HttpServer::kRouteSlots; route++) {
+    const char* name = server.routeName(route);
+    if (name == nullptr || strcmp(name, path) != 0) {
+      continue;
+    }
+    for (uint8_t status = 0; status < HttpServer::kStatusSlots; status++) {
+      if (HttpServer::statusCode(status) == code) {
+        return server.responses(route, status);
+      }
+    }
+  }
+  return 0;
+}
+
+// Every route and task the sketch registers has its own /api/alloc scope
+// rather than being folded into "other", and malloc is counted in them.
+void benchAllocScopes(Runner& runner) {
+  static const char* const kExpected[] = {
+      "/api/events", "/metrics", "blackbox", "health", "power", "cloud"};
+  for (const char* expected : kExpected) {
+    bool found = false;
+    for (uint8_t i = 0; i < poot_alloc::scopeCount(); i++) {
+      found = found || strcmp(poot_alloc::scope(i).name, expected) == 0;
+    }
+    if (!found) {
+      runner.fail("alloc/scopes", expected);
+    }
+  }
+
+  // String grows with realloc, which only the malloc wrappers see.
+  const poot_alloc::ScopeId id = poot_alloc::registerScope("bench_string");
+  const uint32_t before = poot_alloc::scope(id).allocs;
+  {
+    poot_alloc::Scope scope(id);
+    String grown;
+    grown.reserve(64);
+  }
+  if (!poot_alloc::hooksInstalled() ||
+      poot_alloc::scope(id).allocs != before + 1) {
+    runner.fail("alloc/malloc_hooks", "String's heap buffer not counted");
+  }
+}
+
+void benchMetrics(Runner& runner) {
+  using poot_audit::Source;
+  using poot_metrics::Counter;
+  const char* name = "metrics/unlock";
+  static const char kUnlock[] =
+      BENCH_REQUEST("/api/local-unlock?key=" LOCAL_SHARED_KEY);
+  static const char kScrape[] = BENCH_REQUEST("/metrics?key=" LOCAL_SHARED_KEY);
+  const uint8_t http = static_cast<uint8_t>(Source::kLocalHttp);
+  const uint8_t fired = static_cast<uint8_t>(RelayController::Result::kFired);
+  const uint8_t queued =
+      static_cast<uint8_t>(RelayController::Result::kQueued);
+  const uint32_t firedBefore = poot_metrics::unlocks(http, fired);
+  const uint32_t queuedBefore = poot_metrics::unlocks(http, queued);
+  const uint32_t pulsesBefore = poot_metrics::counter(Counter::kRelayPulses);
+  const uint32_t timedBefore = poot_metrics::unlockLatency(http).count;
+  const uint64_t sumBefore = poot_metrics::unlockLatency(http).sumUs;
+
+  skipPastCooldown();
+  request(kUnlock);
+  fake_hal::advanceMillis(poot::kUnlockPulseMs);
+  loop();  // the relay task ends the pulse
+  const int queuedId = request(kUnlock);
+  const uint32_t waitMs = relay.msUntilReady();
+  if (statusOf(queuedId) != 202 ||
+      poot_metrics::unlockLatency(http).count != timedBefore + 1) {
+    runner.fail(name, "fired unlock not timed, or queued one timed early");
+    return;
+  }
+  fake_hal::advanceMillis(waitMs);
+  loop();  // the relay task fires the queued pulse
+  // Both unlocks' latencies; the queued one waited out the cooldown.
+  const uint64_t queuedUs = poot_metrics::unlockLatency(http).sumUs - sumBefore;
+  if (poot_metrics::unlocks(http, fired) != firedBefore + 1 ||
+      poot_metrics::unlocks(http, queued) != queuedBefore + 1 ||
+      poot_metrics::counter(Counter::kRelayPulses) != pulsesBefore + 2 ||
+      poot_metrics::unlockLatency(http).count != timedBefore + 2 ||
+      queuedUs < waitMs * 1000ULL || queuedUs > (waitMs + 1000) * 1000ULL) {
+    runner.fail(name, "unlocks, pulses or queued latency miscounted");
+    return;
+  }
+  skipPastCooldown();
+
+  const char* wifi = "metrics/wifi";
+  static const uint8_t kMac[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x07};
+  const uint32_t joinsBefore = poot_metrics::counter(Counter::kApStationJoins);
+  fake_hal::apStationJoined(kMac);
+  fake_hal::apStationLeft(kMac);
+  uint32_t disconnects = 0;
+  for (uint8_t i = 0; i < poot_metrics::disconnectReasonCount(); i++) {
+    disconnects += poot_metrics::disconnects(i);
+  }
+  if (poot_metrics::counter(Counter::kApStationJoins) != joinsBefore + 1 ||
+      poot_metrics::counter(Counter::kApStationLeaves) == 0 ||
+      disconnects == 0 ||
+      disconnects !=
+          poot_blackbox::counter(poot_blackbox::Counter::kWiFiDisconnects)) {
+    runner.fail(wifi, "AP joins or STA disconnects miscounted");
+    return;
+  }
+
+  const char* scrape = "http/metrics";
+  const int id = request(kScrape);
+  char pulses[64];
+  snprintf(pulses, sizeof(pulses), "poot_relay_pulses_total %lu",
+           (unsigned long)poot_metrics::counter(Counter::kRelayPulses));
+  char queuedReplies[96];
+  snprintf(queuedReplies, sizeof(queuedReplies),
+           "poot_http_responses_total{route=\"/api/local-unlock\","
+           "code=\"202\"} %lu",
+           (unsigned long)responsesFor("/api/local-unlock", 202));
+  char reason[80];
+  snprintf(reason, sizeof(reason),
+           "poot_wifi_sta_disconnects_total{reason=\"%u\"} %lu",
+           (unsigned)poot_metrics::disconnectReason(0),
+           (unsigned long)poot_metrics::disconnects(0));
+  const fake_net::Connection* c = fake_net::connection(id);
+  if (statusOf(id) != 200 ||
+      c->received.find("Content-Type: text/plain; version=0.0.4\r\n") ==
+          std::string::npos ||
+      !hasLine(id, pulses) || !hasLine(id, reason) ||
+      !hasLine(id, "# TYPE poot_unlock_latency_seconds histogram") ||
+      !hasLine(id, queuedReplies) ||
+      c->received.compare(c->received.size() - 1, 1, "\n") != 0) {
+    runner.fail(scrape, "exposition is missing series");
+    return;
+  }
+  runner.metric("http/metrics/bytes", "B",
+                static_cast<double>(c->received.size()));
+  runner.run(scrape, [] { request(kScrape); });
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const poot_bench::Options options = poot_bench::parseOptions(argc, argv);
+  using Clock = std::chrono::steady_clock;
+  const Clock::time_point powerOn = Clock::now();
+  setup();
+  BootTimes boot;
+  boot.setupUs =
+      std::chrono::duration<double, std::micro>(Clock::now() - powerOn)
+          .count();
+  const int firstUnlock =
+      request(BENCH_REQUEST("/api/local-unlock?key=" LOCAL_SHARED_KEY));
+  boot.firstUnlockUs =
+      std::chrono::duration<double, std::micro>(Clock::now() - powerOn)
+          .count();
+  boot.firstUnlockStatus = statusOf(firstUnlock);
+  fake_hal::setStaConnected(kStaIp, WIFI_STA_SSID, -55);
+  loop();
+
+  Runner runner(options);
+  benchBoot(runner, boot);
+  // The timed cases send thousands of requests from one client while
+  // virtual time stands still; benchShedding turns the limits back on.
+  server.setClientLimits(0, 0, 0);
+  benchHttp(runner);
+  benchAuth(runner);
+  benchSendJson(runner);
+  benchConcurrency(runner);
+  benchShedding(runner);
+  benchUdp(runner);
+  benchUnlockCoalescing(runner);
+  benchDiagnostics(runner);
+  benchLoopProfiler(runner);
+  benchScheduler(runner);
+  benchHealth(runner);
+  benchPower(runner);
+  benchRelay(runner);
+  benchStaJoin(runner);
+  benchCloud(runner);
+  benchEvents(runner);
+  benchMetrics(runner);
+  benchAllocScopes(runner);
+  return runner.finish();
+}
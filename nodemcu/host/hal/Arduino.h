@@ -0,0 +1,110 @@
+#pragma once
+
+// Host stand-in for the ESP8266 Arduino core. Covers only what the poot_lock
+// sketch uses; behaviour that matters for timing or allocation is modelled,
+// everything else is a no-op. Test hooks live in fake_hal.h.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "IPAddress.h"
+#include "Print.h"
+#include "WString.h"
+#include "esp8266_peri.h"
+
+#define PROGMEM
+#define PGM_P const char*
+#define PSTR(s) (s)
+#define FPSTR(p) (reinterpret_cast<const __FlashStringHelper*>(p))
+#define F(s) FPSTR(s)
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define snprintf_P snprintf
+
+class __FlashStringHelper;
+
+static constexpr uint8_t LOW = 0;
+static constexpr uint8_t HIGH = 1;
+static constexpr uint8_t INPUT = 0;
+static constexpr uint8_t OUTPUT = 1;
+static constexpr uint8_t INPUT_PULLUP = 2;
+
+// NodeMCU pin aliases (GPIO numbers).
+static constexpr uint8_t D0 = 16;
+static constexpr uint8_t D1 = 5;
+static constexpr uint8_t D2 = 4;
+static constexpr uint8_t D3 = 0;
+static constexpr uint8_t D4 = 2;
+static constexpr uint8_t D5 = 14;
+static constexpr uint8_t D6 = 12;
+static constexpr uint8_t D7 = 13;
+static constexpr uint8_t D8 = 15;
+static constexpr uint8_t LED_BUILTIN = 2;
+static constexpr uint8_t A0 = 17;
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+void randomSeed(unsigned long seed);
+long random(long max);
+long random(long min, long max);
+
+class HardwareSerial : public Print {
+ public:
+  void begin(unsigned long baud) { baud_ = baud; }
+  void end() {}
+  int available() { return 0; }
+  int read() { return -1; }
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t* buffer, size_t size) override;
+  int availableForWrite() override { return 128; }
+  void flush() override {}
+  using Print::write;
+
+ private:
+  unsigned long baud_ = 0;
+};
+
+extern HardwareSerial Serial;
+
+struct rst_info;
+
+class EspClass {
+ public:
+  uint32_t getFreeHeap();
+  uint32_t getMaxFreeBlockSize();
+  uint8_t getHeapFragmentation();
+  // Unused part of the 4 KB loop() stack, as of the last repaint.
+  uint32_t getFreeContStack();
+  void resetFreeContStack();
+  String getResetReason();
+  rst_info* getResetInfoPtr();
+  // RTC user memory: 512 bytes addressed in 4-byte blocks. Survives
+  // ESP.restart() and watchdog resets, like the device.
+  bool rtcUserMemoryRead(uint32_t offset, uint32_t* data, size_t size);
+  bool rtcUserMemoryWrite(uint32_t offset, uint32_t* data, size_t size);
+  uint32_t getChipId() { return 0x00c0ffee; }
+  // 80 unless system_update_cpu_freq() changed it.
+  uint8_t getCpuFreqMHz();
+  // Runs at the CPU clock, so twice as fast at 160 MHz.
+  uint32_t getCycleCount();
+  // Hardware RNG on the device.
+  uint32_t random();
+  void restart();
+  void reset() { restart(); }
+};
+
+extern EspClass ESP;
@@ -0,0 +1,184 @@
+#pragma once
+
+// Host stand-in for the subset of ArduinoJson 6 the sketch uses:
+// StaticJsonDocument with object members, createNestedObject(),
+// createNestedArray() of objects and serializeJson()/measureJson(). Like the real library, a StaticJsonDocument
+// never touches the heap; const char* values are stored by pointer and
+// String/char* values are copied into the document's own pool.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <type_traits>
+
+#include "Arduino.h"
+
+namespace ArduinoJsonHost {
+
+struct Slot {
+  enum Type : uint8_t {
+    kNull,
+    kBool,
+    kSigned,
+    kUnsigned,
+    kDouble,
+    kString,
+    kObject,
+    kArray,
+  };
+
+  Type type = kNull;
+  const char* key = nullptr;
+  union {
+    bool b;
+    long long i;
+    unsigned long long u;
+    double d;
+    const char* s;
+  } value = {false};
+  int16_t firstChild = -1;
+  int16_t lastChild = -1;
+  int16_t next = -1;
+};
+
+}  // namespace ArduinoJsonHost
+
+class JsonDocument;
+
+class MemberProxy {
+ public:
+  MemberProxy(JsonDocument* doc, int16_t parent, const char* key)
+      : doc_(doc), parent_(parent), key_(key) {}
+
+  MemberProxy& operator=(bool value);
+  MemberProxy& operator=(const char* value);
+  MemberProxy& operator=(char* value);
+  MemberProxy& operator=(const String& value);
+
+  template <typename T>
+  typename std::enable_if<std::is_integral<T>::value &&
+                              !std::is_same<T, bool>::value,
+                          MemberProxy&>::type
+  operator=(T value) {
+    if (std::is_signed<T>::value) {
+      return setSigned(static_cast<long long>(value));
+    }
+    return setUnsigned(static_cast<unsigned long long>(value));
+  }
+
+  template <typename T>
+  typename std::enable_if<std::is_floating_point<T>::value,
+                          MemberProxy&>::type
+  operator=(T value) {
+    return setDouble(static_cast<double>(value));
+  }
+
+ private:
+  MemberProxy& setSigned(long long value);
+  MemberProxy& setUnsigned(unsigned long long value);
+  MemberProxy& setDouble(double value);
+  ArduinoJsonHost::Slot* slot();
+
+  JsonDocument* doc_;
+  int16_t parent_;
+  const char* key_;
+};
+
+class JsonArray;
+
+class JsonObject {
+ public:
+  JsonObject() = default;
+  JsonObject(JsonDocument* doc, int16_t slot) : doc_(doc), slot_(slot) {}
+
+  MemberProxy operator[](const char* key) const {
+    return MemberProxy(doc_, slot_, key);
+  }
+  JsonObject createNestedObject(const char* key) const;
+  JsonArray createNestedArray(const char* key) const;
+  bool isNull() const { return doc_ == nullptr || slot_ < 0; }
+
+ private:
+  JsonDocument* doc_ = nullptr;
+  int16_t slot_ = -1;
+};
+
+class JsonArray {
+ public:
+  JsonArray() = default;
+  JsonArray(JsonDocument* doc, int16_t slot) : doc_(doc), slot_(slot) {}
+
+  JsonObject createNestedObject() const;
+  bool isNull() const { return doc_ == nullptr || slot_ < 0; }
+
+ private:
+  JsonDocument* doc_ = nullptr;
+  int16_t slot_ = -1;
+};
+
+class JsonDocument {
+ public:
+  JsonDocument(const JsonDocument&) = delete;
+  JsonDocument& operator=(const JsonDocument&) = delete;
+
+  MemberProxy operator[](const char* key) { return root()[key]; }
+  JsonObject createNestedObject(const char* key) {
+    return root().createNestedObject(key);
+  }
+  JsonArray createNestedArray(const char* key) {
+    return root().createNestedArray(key);
+  }
+  void clear();
+  bool overflowed() const { return overflowed_; }
+  size_t memoryUsage() const { return stringsUsed_ + slotsUsed_ * 16; }
+
+  // Internal API used by MemberProxy/JsonObject/serializers.
+  ArduinoJsonHost::Slot* slotAt(int16_t index) {
+    return index < 0 ? nullptr : &slots_[index];
+  }
+  const ArduinoJsonHost::Slot* slotAt(int16_t index) const {
+    return index < 0 ? nullptr : &slots_[index];
+  }
+  int16_t findOrAddMember(int16_t parent, const char* key);
+  int16_t addElement(int16_t parent);
+  const char* copyString(const char* str, size_t length);
+
+ protected:
+  JsonDocument(ArduinoJsonHost::Slot* slots, int16_t slotCapacity,
+               char* strings, size_t stringCapacity);
+
+ private:
+  JsonObject root() { return JsonObject(this, 0); }
+
+  ArduinoJsonHost::Slot* slots_;
+  int16_t slotCapacity_;
+  int16_t slotsUsed_ = 0;
+  char* strings_;
+  size_t stringCapacity_;
+  size_t stringsUsed_ = 0;
+  bool overflowed_ = false;
+};
+
+template <size_t kCapacity>
+class StaticJsonDocument : public JsonDocument {
+ public:
+  StaticJsonDocument()
+      : JsonDocument(slotStorage_, kSlotCount, stringStorage_, kCapacity) {
+    // The storage members are constructed after the base, so the root can
+    // only be set up here.
+    clear();
+  }
+
+ private:
+  // Host pointers are wider than the ESP8266's, so the slot budget is sized
+  // from the byte capacity rather than packed into it.
+  static constexpr int16_t kSlotCount = kCapacity / 8 + 1;
+
+  ArduinoJsonHost::Slot slotStorage_[kSlotCount];
+  char stringStorage_[kCapacity];
+};
+
+size_t serializeJson(const JsonDocument& doc, String& output);
+size_t serializeJson(const JsonDocument& doc, char* output, size_t size);
+size_t serializeJson(const JsonDocument& doc, Print& output);
+size_t measureJson(const JsonDocument& doc);
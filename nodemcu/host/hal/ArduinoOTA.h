@@ -0,0 +1,43 @@
+#pragma once
+
+#include <functional>
+
+#include "Arduino.h"
+
+#define U_FLASH 0
+#define U_FS 100
+
+typedef enum {
+  OTA_AUTH_ERROR,
+  OTA_BEGIN_ERROR,
+  OTA_CONNECT_ERROR,
+  OTA_RECEIVE_ERROR,
+  OTA_END_ERROR,
+} ota_error_t;
+
+class ArduinoOTAClass {
+ public:
+  using THandlerFunction = std::function<void()>;
+  using THandlerFunction_Error = std::function<void(ota_error_t)>;
+  using THandlerFunction_Progress =
+      std::function<void(unsigned int, unsigned int)>;
+
+  void setHostname(const char* hostname) { (void)hostname; }
+  void setPort(uint16_t port) { (void)port; }
+  void setPassword(const char* password) { (void)password; }
+  void onStart(THandlerFunction fn) { onStart_ = fn; }
+  void onEnd(THandlerFunction fn) { onEnd_ = fn; }
+  void onProgress(THandlerFunction_Progress fn) { onProgress_ = fn; }
+  void onError(THandlerFunction_Error fn) { onError_ = fn; }
+  void begin(bool useMDNS = true) { (void)useMDNS; }
+  void handle() {}
+  int getCommand() const { return U_FLASH; }
+
+ private:
+  THandlerFunction onStart_;
+  THandlerFunction onEnd_;
+  THandlerFunction_Progress onProgress_;
+  THandlerFunction_Error onError_;
+};
+
+extern ArduinoOTAClass ArduinoOTA;
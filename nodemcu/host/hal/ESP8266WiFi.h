@@ -0,0 +1,178 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+
+#include "Arduino.h"
+
+enum wl_status_t : uint8_t {
+  WL_NO_SHIELD = 255,
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_SCAN_COMPLETED = 2,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_CONNECTION_LOST = 5,
+  WL_WRONG_PASSWORD = 6,
+  WL_DISCONNECTED = 7,
+};
+
+#define WIFI_SCAN_RUNNING (-1)
+#define WIFI_SCAN_FAILED (-2)
+
+enum WiFiMode_t { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 };
+
+enum WiFiSleepType_t {
+  WIFI_NONE_SLEEP = 0,
+  WIFI_LIGHT_SLEEP = 1,
+  WIFI_MODEM_SLEEP = 2,
+};
+
+// The reasons the sketch looks at; the SDK has many more.
+enum WiFiDisconnectReason : uint8_t {
+  WIFI_DISCONNECT_REASON_UNSPECIFIED = 1,
+  WIFI_DISCONNECT_REASON_AUTH_EXPIRE = 2,
+  WIFI_DISCONNECT_REASON_ASSOC_LEAVE = 8,
+  WIFI_DISCONNECT_REASON_BEACON_TIMEOUT = 200,
+  WIFI_DISCONNECT_REASON_NO_AP_FOUND = 201,
+  WIFI_DISCONNECT_REASON_AUTH_FAIL = 202,
+};
+
+enum wl_enc_type {
+  ENC_TYPE_WEP = 5,
+  ENC_TYPE_TKIP = 2,
+  ENC_TYPE_CCMP = 4,
+  ENC_TYPE_NONE = 7,
+  ENC_TYPE_AUTO = 8,
+};
+
+struct WiFiEventStationModeDisconnected {
+  String ssid;
+  uint8_t bssid[6] = {0};
+  uint8_t reason = 0;
+};
+
+struct WiFiEventStationModeGotIP {
+  IPAddress ip;
+  IPAddress mask;
+  IPAddress gw;
+};
+
+struct WiFiEventSoftAPModeStationConnected {
+  uint8_t mac[6] = {0};
+  uint8_t aid = 0;
+};
+
+struct WiFiEventSoftAPModeStationDisconnected {
+  uint8_t mac[6] = {0};
+  uint8_t aid = 0;
+};
+
+struct WiFiEventHandlerOpaque {
+  virtual ~WiFiEventHandlerOpaque() = default;
+};
+using WiFiEventHandler = std::shared_ptr<WiFiEventHandlerOpaque>;
+
+// Outbound TCP over real host sockets, so the sketch's cloud client can be
+// run against a stand-in server on loopback. connect() blocks like the
+// device's; reads and available() never do.
+class WiFiClient : public Print {
+ public:
+  WiFiClient() = default;
+  ~WiFiClient() override;
+
+  WiFiClient(const WiFiClient&) = delete;
+  WiFiClient& operator=(const WiFiClient&) = delete;
+
+  // Virtual like the core's, so the TLS client can layer on top.
+  virtual int connect(const char* host, uint16_t port);
+  int connect(IPAddress ip, uint16_t port);
+  virtual uint8_t connected();
+  virtual int available();
+  int read();
+  virtual int read(uint8_t* buffer, size_t size);
+  virtual void stop();
+  void setTimeout(unsigned long timeoutMs) { timeoutMs_ = timeoutMs; }
+  void setNoDelay(bool noDelay);
+
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t* buffer, size_t size) override;
+  int availableForWrite() override { return fd_ < 0 ? 0 : 1460; }
+  using Print::write;
+
+ protected:
+  int fd() const { return fd_; }
+  unsigned long timeoutMs() const { return timeoutMs_; }
+
+ private:
+  // Reads into peek_ without blocking; false once the peer has closed.
+  bool fill();
+
+  int fd_ = -1;
+  unsigned long timeoutMs_ = 5000;
+  uint8_t peek_[512];
+  size_t peekBegin_ = 0;
+  size_t peekEnd_ = 0;
+  bool peerClosed_ = false;
+};
+
+class ESP8266WiFiClass {
+ public:
+  void persistent(bool persistent) { (void)persistent; }
+  bool setAutoReconnect(bool autoReconnect);
+  // listenInterval: DTIM periods between wakes (1-10); 0 keeps the default.
+  bool setSleepMode(WiFiSleepType_t type, uint8_t listenInterval = 0);
+  WiFiSleepType_t getSleepMode() const { return sleepMode_; }
+  uint8_t getListenInterval() const { return listenInterval_; }
+  bool mode(WiFiMode_t mode);
+  WiFiMode_t getMode() const { return mode_; }
+  bool setHostname(const char* hostname);
+
+  bool config(IPAddress local, IPAddress gateway, IPAddress subnet,
+              IPAddress dns1 = IPAddress(), IPAddress dns2 = IPAddress());
+  wl_status_t begin(const char* ssid, const char* passphrase = nullptr,
+                    int32_t channel = 0, const uint8_t* bssid = nullptr,
+                    bool connect = true);
+  bool disconnect(bool wifiOff = false);
+  wl_status_t status();
+
+  IPAddress localIP();
+  String SSID() const;
+  int32_t RSSI();
+  // The access point joined; see fake_hal::setStaAccessPoint().
+  int32_t channel();
+  uint8_t* BSSID();
+
+  bool softAPConfig(IPAddress local, IPAddress gateway, IPAddress subnet);
+  bool softAP(const char* ssid, const char* passphrase = nullptr,
+              int channel = 1, int hidden = 0, int maxConnection = 4);
+  IPAddress softAPIP();
+  uint8_t softAPgetStationNum();
+
+  // An async scan stays running until fake_hal::finishScan(); a blocking
+  // one finds nothing.
+  int8_t scanNetworks(bool async = false, bool showHidden = false);
+  int8_t scanComplete();
+  void scanDelete();
+  String SSID(uint8_t index);
+  int32_t RSSI(uint8_t index);
+  int32_t channel(uint8_t index);
+  uint8_t encryptionType(uint8_t index);
+
+  WiFiEventHandler onStationModeDisconnected(
+      std::function<void(const WiFiEventStationModeDisconnected&)> handler);
+  WiFiEventHandler onStationModeGotIP(
+      std::function<void(const WiFiEventStationModeGotIP&)> handler);
+  WiFiEventHandler onSoftAPModeStationConnected(
+      std::function<void(const WiFiEventSoftAPModeStationConnected&)> handler);
+  WiFiEventHandler onSoftAPModeStationDisconnected(
+      std::function<void(const WiFiEventSoftAPModeStationDisconnected&)>
+          handler);
+
+ private:
+  WiFiMode_t mode_ = WIFI_OFF;
+  WiFiSleepType_t sleepMode_ = WIFI_MODEM_SLEEP;
+  uint8_t listenInterval_ = 0;
+};
+
+extern ESP8266WiFiClass WiFi;
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "Arduino.h"
+
+class MDNSResponder {
+ public:
+  bool begin(const char* hostname) {
+    hostname_ = hostname;
+    return true;
+  }
+  bool addService(const char* service, const char* proto, uint16_t port) {
+    (void)service;
+    (void)proto;
+    (void)port;
+    return true;
+  }
+  void notifyAPChange() {}
+  bool update() { return true; }
+  bool isRunning() const { return hostname_ != nullptr; }
+
+ private:
+  const char* hostname_ = nullptr;
+};
+
+extern MDNSResponder MDNS;
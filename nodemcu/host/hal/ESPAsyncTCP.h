@@ -0,0 +1,111 @@
+#pragma once
+
+// Host stand-in for ESPAsyncTCP. On the device these callbacks run in lwIP's
+// SYS context; here they fire synchronously from the fake_net::async* hooks
+// (fake_net.h), and everything a client writes is captured per connection.
+// Only the calls the sketch uses are modelled.
+
+#include <functional>
+
+#include "Arduino.h"
+
+#define ASYNC_WRITE_FLAG_COPY 0x01
+#define ASYNC_WRITE_FLAG_MORE 0x02
+
+class AsyncClient;
+
+using AcConnectHandler = std::function<void(void*, AsyncClient*)>;
+using AcDataHandler =
+    std::function<void(void*, AsyncClient*, void* data, size_t len)>;
+using AcErrorHandler = std::function<void(void*, AsyncClient*, int8_t error)>;
+using AcTimeoutHandler =
+    std::function<void(void*, AsyncClient*, uint32_t time)>;
+using AcAckHandler =
+    std::function<void(void*, AsyncClient*, size_t len, uint32_t time)>;
+
+class AsyncClient {
+ public:
+  explicit AsyncClient(int connectionId);
+  ~AsyncClient();
+
+  AsyncClient(const AsyncClient&) = delete;
+  AsyncClient& operator=(const AsyncClient&) = delete;
+
+  void onDisconnect(AcConnectHandler cb, void* arg = nullptr);
+  void onData(AcDataHandler cb, void* arg = nullptr);
+  void onError(AcErrorHandler cb, void* arg = nullptr);
+  void onTimeout(AcTimeoutHandler cb, void* arg = nullptr);
+  void onAck(AcAckHandler cb, void* arg = nullptr);
+
+  size_t space();
+  bool canSend() { return space() > 0; }
+  size_t add(const char* data, size_t size,
+             uint8_t apiflags = ASYNC_WRITE_FLAG_COPY);
+  bool send();
+  size_t write(const char* data, size_t size,
+               uint8_t apiflags = ASYNC_WRITE_FLAG_COPY);
+
+  // Like the library, close() only marks the client and the next poll (any
+  // fake_net call) tears it down; close(true) and abort() fire onDisconnect
+  // before returning. The handler may delete this client.
+  void close(bool now = false);
+  int8_t abort();
+  bool connected();
+  bool freeable() { return !connected(); }
+
+  void setRxTimeout(uint32_t timeout) { rxTimeout_ = timeout; }
+  void setNoDelay(bool nodelay) { (void)nodelay; }
+
+  IPAddress remoteIP();
+  uint16_t remotePort();
+
+  // ---- host harness (used by fake_net) ----
+  int connectionId() const { return connectionId_; }
+  void hostDeliver(const char* data, size_t size);
+  void hostAck(size_t size);
+  void hostPeerClosed();
+  // Runs a close() deferred to the library's poll.
+  void hostPoll();
+
+ private:
+  void fireDisconnect();
+
+  int connectionId_;
+  bool closed_ = false;
+  bool closePending_ = false;
+  size_t unacked_ = 0;
+  size_t pending_ = 0;
+  uint32_t rxTimeout_ = 0;
+  AcConnectHandler disconnectCb_;
+  void* disconnectArg_ = nullptr;
+  AcDataHandler dataCb_;
+  void* dataArg_ = nullptr;
+  AcErrorHandler errorCb_;
+  void* errorArg_ = nullptr;
+  AcTimeoutHandler timeoutCb_;
+  void* timeoutArg_ = nullptr;
+  AcAckHandler ackCb_;
+  void* ackArg_ = nullptr;
+};
+
+class AsyncServer {
+ public:
+  explicit AsyncServer(uint16_t port) : port_(port) {}
+  ~AsyncServer() { end(); }
+
+  void onClient(AcConnectHandler cb, void* arg);
+  void begin();
+  void end();
+  void setNoDelay(bool nodelay) { (void)nodelay; }
+  uint8_t status() const { return listening_ ? 1 : 0; }
+
+  // ---- host harness ----
+  uint16_t hostPort() const { return port_; }
+  void hostAccept(AsyncClient* client);
+
+ private:
+  uint16_t port_;
+  bool listening_ = false;
+  AcConnectHandler clientCb_;
+  void* clientArg_ = nullptr;
+};
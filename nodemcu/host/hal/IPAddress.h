@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "WString.h"
+
+class IPAddress {
+ public:
+  IPAddress() = default;
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+      : octets_{a, b, c, d} {}
+  explicit IPAddress(uint32_t address) {
+    for (int i = 0; i < 4; i++) {
+      octets_[i] = static_cast<uint8_t>(address >> (8 * i));
+    }
+  }
+
+  // Network byte order packed into a little-endian word, like lwIP.
+  operator uint32_t() const {
+    return static_cast<uint32_t>(octets_[0]) |
+           (static_cast<uint32_t>(octets_[1]) << 8) |
+           (static_cast<uint32_t>(octets_[2]) << 16) |
+           (static_cast<uint32_t>(octets_[3]) << 24);
+  }
+
+  uint8_t operator[](int index) const { return octets_[index]; }
+  bool operator==(const IPAddress& other) const {
+    return static_cast<uint32_t>(*this) == static_cast<uint32_t>(other);
+  }
+  bool operator!=(const IPAddress& other) const { return !(*this == other); }
+  bool isSet() const { return static_cast<uint32_t>(*this) != 0; }
+
+  String toString() const;
+
+ private:
+  uint8_t octets_[4] = {0, 0, 0, 0};
+};
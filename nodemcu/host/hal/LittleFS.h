@@ -0,0 +1,47 @@
+#pragma once
+
+// Host stand-in for the LittleFS flash filesystem. Files live in process
+// memory, so they survive ESP.restart() within one run like flash would.
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Arduino.h"
+
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+
+class File : public Print {
+ public:
+  File() = default;
+
+  explicit operator bool() const { return data_ != nullptr; }
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+  int read(uint8_t* buffer, size_t size);
+  int available() const;
+  bool seek(uint32_t pos, SeekMode mode = SeekSet);
+  size_t size() const;
+  void close();
+
+ private:
+  friend class FS;
+
+  std::shared_ptr<std::vector<uint8_t>> data_;
+  size_t position_ = 0;
+  bool writable_ = false;
+  bool append_ = false;
+};
+
+class FS {
+ public:
+  bool begin();
+  void end();
+  File open(const char* path, const char* mode);
+  bool exists(const char* path);
+  bool remove(const char* path);
+  bool rename(const char* from, const char* to);
+};
+
+extern FS LittleFS;
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "WString.h"
+
+// Host stand-in for the core Print base class. printf() follows the core's
+// behaviour of formatting into a 64-byte stack buffer and only falling back to
+// the heap for longer output.
+class Print {
+ public:
+  virtual ~Print() = default;
+
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size);
+  size_t write(const char* str) {
+    return str == nullptr ? 0
+                          : write(reinterpret_cast<const uint8_t*>(str),
+                                  strlen(str));
+  }
+  size_t write(const char* buffer, size_t size) {
+    return write(reinterpret_cast<const uint8_t*>(buffer), size);
+  }
+  virtual int availableForWrite() { return 0; }
+  virtual void flush() {}
+
+  size_t printf(const char* format, ...)
+      __attribute__((format(printf, 2, 3)));
+
+  size_t print(const char* str) { return write(str); }
+  size_t print(const String& str) { return write(str.c_str(), str.length()); }
+  size_t print(char c) { return write(static_cast<uint8_t>(c)); }
+  size_t print(int value) { return print(static_cast<long>(value)); }
+  size_t print(unsigned int value) {
+    return print(static_cast<unsigned long>(value));
+  }
+  size_t print(long value);
+  size_t print(unsigned long value);
+
+  size_t println() { return write("\r\n", 2); }
+  template <typename T>
+  size_t println(const T& value) {
+    const size_t n = print(value);
+    return n + println();
+  }
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Host stand-in for the ESP8266 core String. Mirrors the core's small-string
+// optimisation (10 chars inline) so heap allocation counts measured on the
+// host track what the device would do.
+class String {
+ public:
+  String(const char* cstr = "");
+  String(const char* cstr, unsigned int length);
+  String(const String& other);
+  String(String&& other) noexcept;
+  explicit String(char c);
+  explicit String(int value, unsigned char base = 10);
+  explicit String(unsigned int value, unsigned char base = 10);
+  explicit String(long value, unsigned char base = 10);
+  explicit String(unsigned long value, unsigned char base = 10);
+  ~String();
+
+  String& operator=(const String& other);
+  String& operator=(String&& other) noexcept;
+  String& operator=(const char* cstr);
+
+  const char* c_str() const { return buffer(); }
+  unsigned int length() const { return len_; }
+  bool isEmpty() const { return len_ == 0; }
+
+  bool reserve(unsigned int size);
+  bool concat(const char* cstr, unsigned int length);
+  bool concat(const char* cstr);
+  bool concat(const String& other);
+  bool concat(char c);
+  bool concat(unsigned long value);
+
+  String& operator+=(const String& other);
+  String& operator+=(const char* cstr);
+  String& operator+=(char c);
+
+  bool equals(const char* cstr) const;
+  bool equals(const String& other) const;
+  bool operator==(const String& other) const { return equals(other); }
+  bool operator==(const char* cstr) const { return equals(cstr); }
+  bool operator!=(const String& other) const { return !equals(other); }
+  bool operator!=(const char* cstr) const { return !equals(cstr); }
+
+  char operator[](unsigned int index) const;
+  int indexOf(char c, unsigned int fromIndex = 0) const;
+  int indexOf(const char* needle, unsigned int fromIndex = 0) const;
+  bool startsWith(const char* prefix) const;
+  String substring(unsigned int from) const;
+  String substring(unsigned int from, unsigned int to) const;
+  long toInt() const;
+  void clear();
+
+ private:
+  static constexpr unsigned int kSsoCapacity = 10;
+
+  const char* buffer() const { return heap_ != nullptr ? heap_ : sso_; }
+  char* buffer() { return heap_ != nullptr ? heap_ : sso_; }
+  unsigned int capacity() const {
+    return heap_ != nullptr ? heapCapacity_ : kSsoCapacity;
+  }
+  void release();
+
+  char sso_[kSsoCapacity + 1] = {0};
+  char* heap_ = nullptr;
+  unsigned int heapCapacity_ = 0;
+  unsigned int len_ = 0;
+};
+
+String operator+(const String& lhs, const String& rhs);
+String operator+(const String& lhs, const char* rhs);
+String operator+(const char* lhs, const String& rhs);
+
+extern const String emptyString;
@@ -0,0 +1,99 @@
+#pragma once
+
+// Host stand-in for the core's BearSSL client, on OpenSSL when the host
+// build found it (POOT_HOST_TLS) and plain TCP otherwise. It is held to what
+// BearSSL does: TLS 1.2 at most, resumption by session id (no tickets), the
+// max_fragment_length extension whenever the receive buffer is below a full
+// 16 KB record, and the server name checked only with trust anchors set.
+//
+// connect() blocks for the handshake and calls yield() while it waits, so a
+// loopback server pumped from fake_hal::setYieldHook() can answer.
+
+#include "ESP8266WiFi.h"
+
+struct ssl_st;
+struct ssl_session_st;
+struct x509_store_st;
+
+// What BearSSL keeps of a session; only the id is filled in on the host.
+struct br_ssl_session_parameters {
+  unsigned char session_id[32];
+  unsigned char session_id_len;
+  uint16_t version;
+  uint16_t cipher_suite;
+};
+
+namespace BearSSL {
+
+class X509List {
+ public:
+  explicit X509List(const char* pem);
+  ~X509List();
+
+  X509List(const X509List&) = delete;
+  X509List& operator=(const X509List&) = delete;
+
+ private:
+  friend class WiFiClientSecure;
+  x509_store_st* store_ = nullptr;
+};
+
+class Session {
+ public:
+  Session() = default;
+  ~Session();
+
+  Session(const Session&) = delete;
+  Session& operator=(const Session&) = delete;
+
+  br_ssl_session_parameters* getSession() { return &params_; }
+
+ private:
+  friend class WiFiClientSecure;
+  void save(ssl_session_st* session);
+
+  br_ssl_session_parameters params_ = {};
+  ssl_session_st* saved_ = nullptr;
+};
+
+class WiFiClientSecure : public WiFiClient {
+ public:
+  WiFiClientSecure() = default;
+  ~WiFiClientSecure() override;
+
+  void setInsecure() { anchors_ = nullptr; }
+  void setTrustAnchors(const X509List* anchors) { anchors_ = anchors; }
+  // Takes effect at the next connect(), like the core's.
+  void setBufferSizes(int recv, int xmit);
+  void setSession(Session* session) { session_ = session; }
+
+  // Whether the server accepts records of at most `len` bytes. A full
+  // handshake here; the core only sends a ClientHello.
+  static bool probeMaxFragmentLength(const char* host, uint16_t port,
+                                     uint16_t len);
+
+  using WiFiClient::connect;
+  int connect(const char* host, uint16_t port) override;
+  uint8_t connected() override;
+  int available() override;
+  using WiFiClient::read;
+  int read(uint8_t* buffer, size_t size) override;
+  void stop() override;
+  using WiFiClient::write;
+  size_t write(const uint8_t* buffer, size_t size) override;
+
+ private:
+  // Decrypts what has arrived into in_ without blocking.
+  void fill();
+
+  const X509List* anchors_ = nullptr;
+  Session* session_ = nullptr;
+  int recvBytes_ = 16384;
+  ssl_st* ssl_ = nullptr;
+  uint8_t in_[512];
+  size_t inBegin_ = 0;
+  size_t inEnd_ = 0;
+  bool closed_ = false;
+};
+
+}  // namespace BearSSL
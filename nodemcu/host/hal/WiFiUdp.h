@@ -0,0 +1,49 @@
+#pragma once
+
+// Host stand-in for the core's WiFiUDP. Datagrams are queued and captured by
+// the fake_net::udp* hooks (fake_net.h) instead of going to a real socket.
+
+#include "Arduino.h"
+#include "IPAddress.h"
+
+class WiFiUDP {
+ public:
+  WiFiUDP() = default;
+  ~WiFiUDP() { stop(); }
+
+  WiFiUDP(const WiFiUDP&) = delete;
+  WiFiUDP& operator=(const WiFiUDP&) = delete;
+
+  // 1 on success, 0 if the port is taken.
+  uint8_t begin(uint16_t port);
+  void stop();
+
+  // Moves to the next queued datagram and returns its size (0 if none). The
+  // unread rest of the previous one is discarded.
+  int parsePacket();
+  int available();
+  int read(uint8_t* buffer, size_t len);
+  int read(char* buffer, size_t len) {
+    return read(reinterpret_cast<uint8_t*>(buffer), len);
+  }
+  IPAddress remoteIP() const { return remote_; }
+  uint16_t remotePort() const { return remotePort_; }
+
+  int beginPacket(const IPAddress& ip, uint16_t port);
+  size_t write(const uint8_t* buffer, size_t size);
+  size_t write(uint8_t c) { return write(&c, 1); }
+  int endPacket();
+
+ private:
+  uint16_t port_ = 0;
+  IPAddress remote_;
+  uint16_t remotePort_ = 0;
+  uint8_t rx_[1472];
+  size_t rxSize_ = 0;
+  size_t rxRead_ = 0;
+  IPAddress txRemote_;
+  uint16_t txPort_ = 0;
+  uint8_t tx_[1472];
+  size_t txSize_ = 0;
+  bool txOpen_ = false;
+};
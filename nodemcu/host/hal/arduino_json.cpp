@@ -0,0 +1,373 @@
+#include "ArduinoJson.h"
+
+#include <stdio.h>
+#include <string.h>
+
+using ArduinoJsonHost::Slot;
+
+JsonDocument::JsonDocument(Slot* slots, int16_t slotCapacity, char* strings,
+                           size_t stringCapacity)
+    : slots_(slots),
+      slotCapacity_(slotCapacity),
+      strings_(strings),
+      stringCapacity_(stringCapacity) {}
+
+void JsonDocument::clear() {
+  slotsUsed_ = 1;
+  stringsUsed_ = 0;
+  overflowed_ = false;
+  slots_[0] = Slot();
+  slots_[0].type = Slot::kObject;
+}
+
+int16_t JsonDocument::findOrAddMember(int16_t parent, const char* key) {
+  Slot* object = slotAt(parent);
+  if (object == nullptr || key == nullptr) {
+    return -1;
+  }
+  for (int16_t i = object->firstChild; i >= 0; i = slots_[i].next) {
+    if (strcmp(slots_[i].key, key) == 0) {
+      return i;
+    }
+  }
+  if (slotsUsed_ >= slotCapacity_) {
+    overflowed_ = true;
+    return -1;
+  }
+  const int16_t index = slotsUsed_++;
+  slots_[index] = Slot();
+  slots_[index].key = key;
+  if (object->lastChild >= 0) {
+    slots_[object->lastChild].next = index;
+  } else {
+    object->firstChild = index;
+  }
+  object->lastChild = index;
+  return index;
+}
+
+int16_t JsonDocument::addElement(int16_t parent) {
+  Slot* array = slotAt(parent);
+  if (array == nullptr) {
+    return -1;
+  }
+  if (slotsUsed_ >= slotCapacity_) {
+    overflowed_ = true;
+    return -1;
+  }
+  const int16_t index = slotsUsed_++;
+  slots_[index] = Slot();
+  if (array->lastChild >= 0) {
+    slots_[array->lastChild].next = index;
+  } else {
+    array->firstChild = index;
+  }
+  array->lastChild = index;
+  return index;
+}
+
+const char* JsonDocument::copyString(const char* str, size_t length) {
+  if (stringsUsed_ + length + 1 > stringCapacity_) {
+    overflowed_ = true;
+    return nullptr;
+  }
+  char* copy = strings_ + stringsUsed_;
+  memcpy(copy, str, length);
+  copy[length] = '\0';
+  stringsUsed_ += length + 1;
+  return copy;
+}
+
+Slot* MemberProxy::slot() {
+  return doc_->slotAt(doc_->findOrAddMember(parent_, key_));
+}
+
+MemberProxy& MemberProxy::operator=(bool value) {
+  if (Slot* s = slot()) {
+    s->type = Slot::kBool;
+    s->value.b = value;
+  }
+  return *this;
+}
+
+MemberProxy& MemberProxy::operator=(const char* value) {
+  if (Slot* s = slot()) {
+    s->type = value == nullptr ? Slot::kNull : Slot::kString;
+    s->value.s = value;
+  }
+  return *this;
+}
+
+MemberProxy& MemberProxy::operator=(char* value) {
+  if (value == nullptr) {
+    return *this = static_cast<const char*>(nullptr);
+  }
+  if (Slot* s = slot()) {
+    const char* copy = doc_->copyString(value, strlen(value));
+    s->type = copy == nullptr ? Slot::kNull : Slot::kString;
+    s->value.s = copy;
+  }
+  return *this;
+}
+
+MemberProxy& MemberProxy::operator=(const String& value) {
+  if (Slot* s = slot()) {
+    const char* copy = doc_->copyString(value.c_str(), value.length());
+    s->type = copy == nullptr ? Slot::kNull : Slot::kString;
+    s->value.s = copy;
+  }
+  return *this;
+}
+
+MemberProxy& MemberProxy::setSigned(long long value) {
+  if (Slot* s = slot()) {
+    s->type = Slot::kSigned;
+    s->value.i = value;
+  }
+  return *this;
+}
+
+MemberProxy& MemberProxy::setUnsigned(unsigned long long value) {
+  if (Slot* s = slot()) {
+    s->type = Slot::kUnsigned;
+    s->value.u = value;
+  }
+  return *this;
+}
+
+MemberProxy& MemberProxy::setDouble(double value) {
+  if (Slot* s = slot()) {
+    s->type = Slot::kDouble;
+    s->value.d = value;
+  }
+  return *this;
+}
+
+JsonObject JsonObject::createNestedObject(const char* key) const {
+  if (doc_ == nullptr) {
+    return JsonObject();
+  }
+  const int16_t index = doc_->findOrAddMember(slot_, key);
+  Slot* s = doc_->slotAt(index);
+  if (s == nullptr) {
+    return JsonObject();
+  }
+  *s = Slot{Slot::kObject, s->key, {false}, -1, -1, s->next};
+  return JsonObject(doc_, index);
+}
+
+JsonArray JsonObject::createNestedArray(const char* key) const {
+  if (doc_ == nullptr) {
+    return JsonArray();
+  }
+  const int16_t index = doc_->findOrAddMember(slot_, key);
+  Slot* s = doc_->slotAt(index);
+  if (s == nullptr) {
+    return JsonArray();
+  }
+  *s = Slot{Slot::kArray, s->key, {false}, -1, -1, s->next};
+  return JsonArray(doc_, index);
+}
+
+JsonObject JsonArray::createNestedObject() const {
+  if (doc_ == nullptr) {
+    return JsonObject();
+  }
+  const int16_t index = doc_->addElement(slot_);
+  Slot* s = doc_->slotAt(index);
+  if (s == nullptr) {
+    return JsonObject();
+  }
+  s->type = Slot::kObject;
+  return JsonObject(doc_, index);
+}
+
+namespace {
+
+// Mirrors ArduinoJson's writer adapters: a small stack buffer is flushed to
+// the destination in chunks.
+class Writer {
+ public:
+  virtual ~Writer() = default;
+  virtual void write(const char* data, size_t size) = 0;
+  size_t count = 0;
+};
+
+class StringWriter : public Writer {
+ public:
+  explicit StringWriter(String& out) : out_(out) {}
+  ~StringWriter() override { flush(); }
+
+  void write(const char* data, size_t size) override {
+    count += size;
+    for (size_t i = 0; i < size; i++) {
+      if (used_ == sizeof(buffer_) - 1) {
+        flush();
+      }
+      buffer_[used_++] = data[i];
+    }
+  }
+
+  void flush() {
+    if (used_ > 0) {
+      out_.concat(buffer_, static_cast<unsigned int>(used_));
+      used_ = 0;
+    }
+  }
+
+ private:
+  String& out_;
+  char buffer_[32];
+  size_t used_ = 0;
+};
+
+class BufferWriter : public Writer {
+ public:
+  BufferWriter(char* out, size_t size) : out_(out), size_(size) {}
+
+  void write(const char* data, size_t size) override {
+    for (size_t i = 0; i < size && used_ + 1 < size_; i++) {
+      out_[used_++] = data[i];
+    }
+    count += size;
+    if (size_ > 0) {
+      out_[used_] = '\0';
+    }
+  }
+
+ private:
+  char* out_;
+  size_t size_;
+  size_t used_ = 0;
+};
+
+class PrintWriter : public Writer {
+ public:
+  explicit PrintWriter(Print& out) : out_(out) {}
+  void write(const char* data, size_t size) override {
+    count += out_.write(data, size);
+  }
+
+ private:
+  Print& out_;
+};
+
+class CountingWriter : public Writer {
+ public:
+  void write(const char* data, size_t size) override {
+    (void)data;
+    count += size;
+  }
+};
+
+void writeString(Writer& w, const char* s) {
+  w.write("\"", 1);
+  const char* run = s;
+  for (const char* p = s; *p != '\0'; p++) {
+    const char* escape = nullptr;
+    switch (*p) {
+      case '"': escape = "\\\""; break;
+      case '\\': escape = "\\\\"; break;
+      case '\b': escape = "\\b"; break;
+      case '\f': escape = "\\f"; break;
+      case '\n': escape = "\\n"; break;
+      case '\r': escape = "\\r"; break;
+      case '\t': escape = "\\t"; break;
+      default: continue;
+    }
+    w.write(run, static_cast<size_t>(p - run));
+    w.write(escape, 2);
+    run = p + 1;
+  }
+  w.write(run, strlen(run));
+  w.write("\"", 1);
+}
+
+void writeSlot(Writer& w, const JsonDocument& doc, const Slot& slot) {
+  char number[32];
+  switch (slot.type) {
+    case Slot::kNull:
+      w.write("null", 4);
+      return;
+    case Slot::kBool:
+      if (slot.value.b) {
+        w.write("true", 4);
+      } else {
+        w.write("false", 5);
+      }
+      return;
+    case Slot::kSigned:
+      w.write(number, static_cast<size_t>(snprintf(number, sizeof(number),
+                                                   "%lld", slot.value.i)));
+      return;
+    case Slot::kUnsigned:
+      w.write(number, static_cast<size_t>(snprintf(number, sizeof(number),
+                                                   "%llu", slot.value.u)));
+      return;
+    case Slot::kDouble:
+      w.write(number, static_cast<size_t>(snprintf(number, sizeof(number),
+                                                   "%.9g", slot.value.d)));
+      return;
+    case Slot::kString:
+      writeString(w, slot.value.s);
+      return;
+    case Slot::kObject: {
+      w.write("{", 1);
+      bool first = true;
+      for (int16_t i = slot.firstChild; i >= 0;) {
+        const Slot& child = *doc.slotAt(i);
+        if (!first) {
+          w.write(",", 1);
+        }
+        first = false;
+        writeString(w, child.key);
+        w.write(":", 1);
+        writeSlot(w, doc, child);
+        i = child.next;
+      }
+      w.write("}", 1);
+      return;
+    }
+    case Slot::kArray: {
+      w.write("[", 1);
+      for (int16_t i = slot.firstChild; i >= 0;) {
+        const Slot& child = *doc.slotAt(i);
+        if (i != slot.firstChild) {
+          w.write(",", 1);
+        }
+        writeSlot(w, doc, child);
+        i = child.next;
+      }
+      w.write("]", 1);
+      return;
+    }
+  }
+}
+
+size_t serializeTo(Writer& w, const JsonDocument& doc) {
+  writeSlot(w, doc, *doc.slotAt(0));
+  return w.count;
+}
+
+}  // namespace
+
+size_t serializeJson(const JsonDocument& doc, String& output) {
+  StringWriter writer(output);
+  return serializeTo(writer, doc);
+}
+
+size_t serializeJson(const JsonDocument& doc, char* output, size_t size) {
+  BufferWriter writer(output, size);
+  const size_t n = serializeTo(writer, doc);
+  return n < size ? n : (size == 0 ? 0 : size - 1);
+}
+
+size_t serializeJson(const JsonDocument& doc, Print& output) {
+  PrintWriter writer(output);
+  return serializeTo(writer, doc);
+}
+
+size_t measureJson(const JsonDocument& doc) {
+  CountingWriter writer;
+  return serializeTo(writer, doc);
+}
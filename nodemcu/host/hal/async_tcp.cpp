@@ -0,0 +1,301 @@
+#include "ESPAsyncTCP.h"
+#include "fake_net.h"
+
+namespace {
+
+constexpr int kMaxClients = 256;
+
+constexpr int kMaxServers = 4;
+
+// Plain array rather than a vector: sketch globals unregister from their
+// destructors, which may run after this file's statics are destroyed.
+AsyncServer* gServers[kMaxServers] = {nullptr};
+AsyncClient* gClients[kMaxClients] = {nullptr};
+bool gAutoAck = true;
+// Clients closed without `now`, torn down by the next pollCloses().
+int gPendingCloses = 0;
+
+AsyncClient* clientFor(int id) {
+  return (id < 0 || id >= kMaxClients) ? nullptr : gClients[id];
+}
+
+// The library's _poll: runs every deferred close before the harness looks
+// at or drives a connection.
+void pollCloses() {
+  for (int id = 0; id < kMaxClients && gPendingCloses > 0; id++) {
+    if (AsyncClient* client = gClients[id]) {
+      client->hostPoll();
+    }
+  }
+}
+
+}  // namespace
+
+// ---- AsyncClient ----
+
+AsyncClient::AsyncClient(int connectionId) : connectionId_(connectionId) {
+  if (connectionId_ >= 0 && connectionId_ < kMaxClients) {
+    gClients[connectionId_] = this;
+  }
+}
+
+AsyncClient::~AsyncClient() {
+  if (closePending_) {
+    gPendingCloses--;
+  }
+  if (clientFor(connectionId_) == this) {
+    gClients[connectionId_] = nullptr;
+  }
+}
+
+void AsyncClient::onDisconnect(AcConnectHandler cb, void* arg) {
+  disconnectCb_ = cb;
+  disconnectArg_ = arg;
+}
+
+void AsyncClient::onData(AcDataHandler cb, void* arg) {
+  dataCb_ = cb;
+  dataArg_ = arg;
+}
+
+void AsyncClient::onError(AcErrorHandler cb, void* arg) {
+  errorCb_ = cb;
+  errorArg_ = arg;
+}
+
+void AsyncClient::onTimeout(AcTimeoutHandler cb, void* arg) {
+  timeoutCb_ = cb;
+  timeoutArg_ = arg;
+}
+
+void AsyncClient::onAck(AcAckHandler cb, void* arg) {
+  ackCb_ = cb;
+  ackArg_ = arg;
+}
+
+size_t AsyncClient::space() {
+  if (closed_) {
+    return 0;
+  }
+  const size_t used = unacked_ + pending_;
+  return used >= fake_net::kTcpSendBuffer ? 0
+                                          : fake_net::kTcpSendBuffer - used;
+}
+
+size_t AsyncClient::add(const char* data, size_t size, uint8_t apiflags) {
+  (void)apiflags;
+  fake_net::Connection* c = fake_net::connection(connectionId_);
+  if (closed_ || c == nullptr || size == 0) {
+    return 0;
+  }
+  const size_t room = space();
+  const size_t n = size < room ? size : room;
+  c->received.append(data, n);
+  c->bytesWritten += n;
+  pending_ += n;
+  return n;
+}
+
+bool AsyncClient::send() {
+  fake_net::Connection* c = fake_net::connection(connectionId_);
+  if (closed_ || c == nullptr) {
+    return false;
+  }
+  if (pending_ > 0) {
+    c->writeCalls++;
+  }
+  if (gAutoAck) {
+    pending_ = 0;
+  } else {
+    unacked_ += pending_;
+    pending_ = 0;
+  }
+  return true;
+}
+
+size_t AsyncClient::write(const char* data, size_t size, uint8_t apiflags) {
+  const size_t n = add(data, size, apiflags);
+  if (n > 0) {
+    send();
+  }
+  return n;
+}
+
+void AsyncClient::close(bool now) {
+  if (closed_) {
+    return;
+  }
+  if (!now) {
+    if (!closePending_) {
+      closePending_ = true;
+      gPendingCloses++;
+    }
+    return;
+  }
+  if (fake_net::Connection* c = fake_net::connection(connectionId_)) {
+    c->closedByServer = true;
+  }
+  fireDisconnect();
+}
+
+int8_t AsyncClient::abort() {
+  close(true);
+  return -13;  // ERR_ABRT
+}
+
+bool AsyncClient::connected() { return !closed_; }
+
+IPAddress AsyncClient::remoteIP() {
+  const fake_net::Connection* c = fake_net::connection(connectionId_);
+  return c == nullptr ? IPAddress() : c->remote;
+}
+
+uint16_t AsyncClient::remotePort() {
+  const fake_net::Connection* c = fake_net::connection(connectionId_);
+  return c == nullptr ? 0 : c->remotePort;
+}
+
+void AsyncClient::hostDeliver(const char* data, size_t size) {
+  if (!closed_ && dataCb_) {
+    dataCb_(dataArg_, this, const_cast<char*>(data), size);
+  }
+}
+
+void AsyncClient::hostAck(size_t size) {
+  const size_t n = size < unacked_ ? size : unacked_;
+  unacked_ -= n;
+  if (n > 0 && ackCb_) {
+    ackCb_(ackArg_, this, n, 1);
+  }
+}
+
+void AsyncClient::hostPoll() {
+  if (closePending_) {
+    close(true);
+  }
+}
+
+void AsyncClient::hostPeerClosed() {
+  if (!closed_) {
+    fireDisconnect();
+  }
+}
+
+void AsyncClient::fireDisconnect() {
+  closed_ = true;
+  if (closePending_) {
+    closePending_ = false;
+    gPendingCloses--;
+  }
+  if (fake_net::Connection* c = fake_net::connection(connectionId_)) {
+    c->open = false;
+  }
+  // May delete this.
+  if (disconnectCb_) {
+    AcConnectHandler cb = disconnectCb_;
+    cb(disconnectArg_, this);
+  }
+}
+
+// ---- AsyncServer ----
+
+void AsyncServer::onClient(AcConnectHandler cb, void* arg) {
+  clientCb_ = cb;
+  clientArg_ = arg;
+}
+
+void AsyncServer::begin() {
+  if (listening_) {
+    return;
+  }
+  for (AsyncServer*& slot : gServers) {
+    if (slot == nullptr) {
+      slot = this;
+      listening_ = true;
+      return;
+    }
+  }
+}
+
+void AsyncServer::end() {
+  if (!listening_) {
+    return;
+  }
+  listening_ = false;
+  for (AsyncServer*& slot : gServers) {
+    if (slot == this) {
+      slot = nullptr;
+    }
+  }
+}
+
+void AsyncServer::hostAccept(AsyncClient* client) {
+  if (clientCb_) {
+    clientCb_(clientArg_, client);
+  } else {
+    delete client;
+  }
+}
+
+// ---- fake_net hooks ----
+
+namespace fake_net {
+
+int asyncConnect(uint16_t port, const IPAddress& remote, uint16_t remotePort) {
+  pollCloses();
+  AsyncServer* server = nullptr;
+  for (AsyncServer* s : gServers) {
+    if (s != nullptr && s->hostPort() == port) {
+      server = s;
+    }
+  }
+  if (server == nullptr) {
+    return -1;
+  }
+  const int id = openConnection(remote, remotePort);
+  // A still-open client on a recycled id belongs to a finished test run.
+  if (AsyncClient* stale = clientFor(id)) {
+    stale->hostPeerClosed();
+    resetConnection(*connection(id), remote, remotePort);
+  }
+  server->hostAccept(new AsyncClient(id));
+  return id;
+}
+
+bool asyncSend(int id, const char* data, size_t size) {
+  pollCloses();
+  AsyncClient* client = clientFor(id);
+  if (client == nullptr || !client->connected()) {
+    return false;
+  }
+  client->hostDeliver(data, size);
+  return true;
+}
+
+bool asyncSend(int id, const char* text) {
+  return asyncSend(id, text, strlen(text));
+}
+
+void asyncPeerClose(int id) {
+  pollCloses();
+  if (AsyncClient* client = clientFor(id)) {
+    client->hostPeerClosed();
+  }
+}
+
+bool asyncOpen(int id) {
+  pollCloses();
+  AsyncClient* client = clientFor(id);
+  return client != nullptr && client->connected();
+}
+
+void setAsyncAutoAck(bool autoAck) { gAutoAck = autoAck; }
+
+void asyncAck(int id) {
+  pollCloses();
+  if (AsyncClient* client = clientFor(id)) {
+    client->hostAck(SIZE_MAX);
+  }
+}
+
+}  // namespace fake_net
@@ -0,0 +1,187 @@
+#include <string.h>
+
+#include "bearssl/bearssl.h"
+
+const br_hash_class br_sha256_vtable = {0};
+
+namespace {
+
+constexpr uint32_t kRound[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+void compress(uint32_t* val, const unsigned char* block) {
+  uint32_t w[64];
+  for (int i = 0; i < 16; i++) {
+    w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16 |
+           (uint32_t)block[i * 4 + 2] << 8 | block[i * 4 + 3];
+  }
+  for (int i = 16; i < 64; i++) {
+    const uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+    const uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+  uint32_t a = val[0], b = val[1], c = val[2], d = val[3];
+  uint32_t e = val[4], f = val[5], g = val[6], h = val[7];
+  for (int i = 0; i < 64; i++) {
+    const uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) +
+                        ((e & f) ^ (~e & g)) + kRound[i] + w[i];
+    const uint32_t t2 =
+        (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+  val[0] += a;
+  val[1] += b;
+  val[2] += c;
+  val[3] += d;
+  val[4] += e;
+  val[5] += f;
+  val[6] += g;
+  val[7] += h;
+}
+
+}  // namespace
+
+void br_sha256_init(br_sha256_context* ctx) {
+  static const uint32_t kInit[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372,
+                                    0xa54ff53a, 0x510e527f, 0x9b05688c,
+                                    0x1f83d9ab, 0x5be0cd19};
+  ctx->vtable = &br_sha256_vtable;
+  memcpy(ctx->val, kInit, sizeof(kInit));
+  ctx->count = 0;
+}
+
+void br_sha256_update(br_sha256_context* ctx, const void* data, size_t len) {
+  const unsigned char* p = static_cast<const unsigned char*>(data);
+  while (len > 0) {
+    const size_t used = ctx->count & 63;
+    size_t n = 64 - used;
+    if (n > len) {
+      n = len;
+    }
+    memcpy(ctx->buf + used, p, n);
+    ctx->count += n;
+    p += n;
+    len -= n;
+    if ((ctx->count & 63) == 0) {
+      compress(ctx->val, ctx->buf);
+    }
+  }
+}
+
+void br_sha256_out(const br_sha256_context* ctx, void* out) {
+  br_sha256_context copy = *ctx;
+  const uint64_t bits = copy.count * 8;
+  const unsigned char pad = 0x80;
+  br_sha256_update(&copy, &pad, 1);
+  const unsigned char zero = 0;
+  while ((copy.count & 63) != 56) {
+    br_sha256_update(&copy, &zero, 1);
+  }
+  unsigned char length[8];
+  for (int i = 0; i < 8; i++) {
+    length[i] = static_cast<unsigned char>(bits >> (56 - 8 * i));
+  }
+  br_sha256_update(&copy, length, 8);
+  unsigned char* o = static_cast<unsigned char*>(out);
+  for (int i = 0; i < 8; i++) {
+    o[i * 4] = static_cast<unsigned char>(copy.val[i] >> 24);
+    o[i * 4 + 1] = static_cast<unsigned char>(copy.val[i] >> 16);
+    o[i * 4 + 2] = static_cast<unsigned char>(copy.val[i] >> 8);
+    o[i * 4 + 3] = static_cast<unsigned char>(copy.val[i]);
+  }
+}
+
+uint64_t br_sha256_state(const br_sha256_context* ctx, void* out) {
+  unsigned char* o = static_cast<unsigned char*>(out);
+  for (int i = 0; i < 8; i++) {
+    o[i * 4] = static_cast<unsigned char>(ctx->val[i] >> 24);
+    o[i * 4 + 1] = static_cast<unsigned char>(ctx->val[i] >> 16);
+    o[i * 4 + 2] = static_cast<unsigned char>(ctx->val[i] >> 8);
+    o[i * 4 + 3] = static_cast<unsigned char>(ctx->val[i]);
+  }
+  return ctx->count;
+}
+
+void br_sha256_set_state(br_sha256_context* ctx, const void* stb,
+                         uint64_t count) {
+  const unsigned char* in = static_cast<const unsigned char*>(stb);
+  ctx->vtable = &br_sha256_vtable;
+  for (int i = 0; i < 8; i++) {
+    ctx->val[i] = (uint32_t)in[i * 4] << 24 | (uint32_t)in[i * 4 + 1] << 16 |
+                  (uint32_t)in[i * 4 + 2] << 8 | in[i * 4 + 3];
+  }
+  ctx->count = count;
+}
+
+void br_hmac_key_init(br_hmac_key_context* kc,
+                      const br_hash_class* digest_vtable, const void* key,
+                      size_t key_len) {
+  unsigned char block[64] = {0};
+  if (key_len > sizeof(block)) {
+    br_sha256_context ctx;
+    br_sha256_init(&ctx);
+    br_sha256_update(&ctx, key, key_len);
+    br_sha256_out(&ctx, block);
+  } else {
+    memcpy(block, key, key_len);
+  }
+  kc->dig_vtable = digest_vtable;
+  unsigned char pad[64];
+  br_sha256_context ctx;
+  for (size_t i = 0; i < sizeof(block); i++) {
+    pad[i] = block[i] ^ 0x36;
+  }
+  br_sha256_init(&ctx);
+  br_sha256_update(&ctx, pad, sizeof(pad));
+  br_sha256_state(&ctx, kc->ksi);
+  for (size_t i = 0; i < sizeof(block); i++) {
+    pad[i] = block[i] ^ 0x5c;
+  }
+  br_sha256_init(&ctx);
+  br_sha256_update(&ctx, pad, sizeof(pad));
+  br_sha256_state(&ctx, kc->kso);
+}
+
+void br_hmac_init(br_hmac_context* ctx, const br_hmac_key_context* kc,
+                  size_t out_len) {
+  br_sha256_set_state(&ctx->dig, kc->ksi, 64);
+  memcpy(ctx->kso, kc->kso, sizeof(ctx->kso));
+  ctx->out_len =
+      (out_len == 0 || out_len > br_sha256_SIZE) ? br_sha256_SIZE : out_len;
+}
+
+void br_hmac_update(br_hmac_context* ctx, const void* data, size_t len) {
+  br_sha256_update(&ctx->dig, data, len);
+}
+
+size_t br_hmac_out(const br_hmac_context* ctx, void* out) {
+  unsigned char inner[br_sha256_SIZE];
+  br_sha256_out(&ctx->dig, inner);
+  br_sha256_context outer;
+  br_sha256_set_state(&outer, ctx->kso, 64);
+  br_sha256_update(&outer, inner, sizeof(inner));
+  unsigned char full[br_sha256_SIZE];
+  br_sha256_out(&outer, full);
+  memcpy(out, full, ctx->out_len);
+  return ctx->out_len;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+// Host stand-in for the subset of BearSSL (bundled with the ESP8266 core)
+// the sketch uses: SHA-256 and HMAC over it. Same names and signatures;
+// only br_sha256_vtable is available as a digest.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define br_sha256_SIZE 32
+
+typedef struct br_hash_class_ {
+  size_t desc;  // unused on the host
+} br_hash_class;
+
+extern const br_hash_class br_sha256_vtable;
+
+typedef struct {
+  const br_hash_class* vtable;
+  unsigned char buf[64];
+  uint64_t count;
+  uint32_t val[8];
+} br_sha256_context;
+
+void br_sha256_init(br_sha256_context* ctx);
+void br_sha256_update(br_sha256_context* ctx, const void* data, size_t len);
+void br_sha256_out(const br_sha256_context* ctx, void* out);
+// Chaining value after a whole number of blocks, and resuming from one.
+uint64_t br_sha256_state(const br_sha256_context* ctx, void* out);
+void br_sha256_set_state(br_sha256_context* ctx, const void* stb,
+                         uint64_t count);
+
+// As in BearSSL, ksi/kso hold the hash states after the inner and outer
+// padded key blocks, so an HMAC does not hash the key again.
+typedef struct {
+  const br_hash_class* dig_vtable;
+  unsigned char ksi[64];
+  unsigned char kso[64];
+} br_hmac_key_context;
+
+typedef struct {
+  br_sha256_context dig;
+  unsigned char kso[64];
+  size_t out_len;
+} br_hmac_context;
+
+void br_hmac_key_init(br_hmac_key_context* kc,
+                      const br_hash_class* digest_vtable, const void* key,
+                      size_t key_len);
+void br_hmac_init(br_hmac_context* ctx, const br_hmac_key_context* kc,
+                  size_t out_len);
+void br_hmac_update(br_hmac_context* ctx, const void* data, size_t len);
+size_t br_hmac_out(const br_hmac_context* ctx, void* out);
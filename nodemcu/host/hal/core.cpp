@@ -0,0 +1,537 @@
+#include <stdarg.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <random>
+
+#include "Arduino.h"
+#include "fake_hal.h"
+#include "user_interface.h"
+
+// ---- String ----
+
+const String emptyString;
+
+String::String(const char* cstr) {
+  if (cstr != nullptr) {
+    concat(cstr, static_cast<unsigned int>(strlen(cstr)));
+  }
+}
+
+String::String(const char* cstr, unsigned int length) { concat(cstr, length); }
+
+String::String(const String& other) { concat(other); }
+
+String::String(String&& other) noexcept {
+  *this = static_cast<String&&>(other);
+}
+
+String::String(char c) { concat(c); }
+
+String::String(int value, unsigned char base)
+    : String(static_cast<long>(value), base) {}
+
+String::String(unsigned int value, unsigned char base)
+    : String(static_cast<unsigned long>(value), base) {}
+
+String::String(long value, unsigned char base) {
+  if (value < 0 && base == 10) {
+    concat('-');
+    concat(static_cast<unsigned long>(-(value + 1)) + 1UL);
+    return;
+  }
+  *this = String(static_cast<unsigned long>(value), base);
+}
+
+String::String(unsigned long value, unsigned char base) {
+  char digits[sizeof(unsigned long) * 8 + 1];
+  char* p = digits + sizeof(digits);
+  *--p = '\0';
+  if (base < 2) {
+    base = 10;
+  }
+  do {
+    const unsigned long digit = value % base;
+    *--p = static_cast<char>(digit < 10 ? '0' + digit : 'a' + digit - 10);
+    value /= base;
+  } while (value != 0);
+  concat(p);
+}
+
+String::~String() { release(); }
+
+String& String::operator=(const String& other) {
+  if (this != &other) {
+    len_ = 0;
+    buffer()[0] = '\0';
+    concat(other);
+  }
+  return *this;
+}
+
+String& String::operator=(String&& other) noexcept {
+  if (this == &other) {
+    return *this;
+  }
+  release();
+  if (other.heap_ != nullptr) {
+    heap_ = other.heap_;
+    heapCapacity_ = other.heapCapacity_;
+    other.heap_ = nullptr;
+    other.heapCapacity_ = 0;
+  } else {
+    memcpy(sso_, other.sso_, sizeof(sso_));
+  }
+  len_ = other.len_;
+  other.len_ = 0;
+  other.sso_[0] = '\0';
+  return *this;
+}
+
+String& String::operator=(const char* cstr) {
+  len_ = 0;
+  buffer()[0] = '\0';
+  if (cstr != nullptr) {
+    concat(cstr);
+  }
+  return *this;
+}
+
+void String::release() {
+  free(heap_);
+  heap_ = nullptr;
+  heapCapacity_ = 0;
+  len_ = 0;
+  sso_[0] = '\0';
+}
+
+void String::clear() {
+  len_ = 0;
+  buffer()[0] = '\0';
+}
+
+bool String::reserve(unsigned int size) {
+  if (size <= capacity()) {
+    return true;
+  }
+  // The core rounds heap buffers up to 16 bytes and grows them with realloc.
+  const unsigned int newCapacity = (size + 16) & ~0xfu;
+  const bool wasInline = heap_ == nullptr;
+  char* grown = static_cast<char*>(realloc(heap_, newCapacity + 1));
+  if (grown == nullptr) {
+    return false;
+  }
+  if (wasInline) {
+    memcpy(grown, sso_, len_ + 1);
+  }
+  heap_ = grown;
+  heapCapacity_ = newCapacity;
+  return true;
+}
+
+bool String::concat(const char* cstr, unsigned int length) {
+  if (cstr == nullptr) {
+    return false;
+  }
+  if (length == 0) {
+    return true;
+  }
+  const bool aliased = cstr >= buffer() && cstr <= buffer() + len_;
+  const size_t offset = aliased ? static_cast<size_t>(cstr - buffer()) : 0;
+  reserve(len_ + length);
+  if (aliased) {
+    cstr = buffer() + offset;
+  }
+  memmove(buffer() + len_, cstr, length);
+  len_ += length;
+  buffer()[len_] = '\0';
+  return true;
+}
+
+bool String::concat(const char* cstr) {
+  return cstr != nullptr &&
+         concat(cstr, static_cast<unsigned int>(strlen(cstr)));
+}
+
+bool String::concat(const String& other) {
+  return concat(other.c_str(), other.length());
+}
+
+bool String::concat(char c) { return concat(&c, 1); }
+
+bool String::concat(unsigned long value) {
+  return concat(String(value, 10));
+}
+
+String& String::operator+=(const String& other) {
+  concat(other);
+  return *this;
+}
+
+String& String::operator+=(const char* cstr) {
+  concat(cstr);
+  return *this;
+}
+
+String& String::operator+=(char c) {
+  concat(c);
+  return *this;
+}
+
+bool String::equals(const char* cstr) const {
+  if (cstr == nullptr) {
+    return len_ == 0;
+  }
+  return strcmp(c_str(), cstr) == 0;
+}
+
+bool String::equals(const String& other) const {
+  return len_ == other.len_ && memcmp(c_str(), other.c_str(), len_) == 0;
+}
+
+char String::operator[](unsigned int index) const {
+  return index < len_ ? c_str()[index] : '\0';
+}
+
+int String::indexOf(char c, unsigned int fromIndex) const {
+  if (fromIndex >= len_) {
+    return -1;
+  }
+  const char* found = strchr(c_str() + fromIndex, c);
+  return found == nullptr ? -1 : static_cast<int>(found - c_str());
+}
+
+int String::indexOf(const char* needle, unsigned int fromIndex) const {
+  if (fromIndex > len_ || needle == nullptr) {
+    return -1;
+  }
+  const char* found = strstr(c_str() + fromIndex, needle);
+  return found == nullptr ? -1 : static_cast<int>(found - c_str());
+}
+
+bool String::startsWith(const char* prefix) const {
+  const size_t n = strlen(prefix);
+  return n <= len_ && strncmp(c_str(), prefix, n) == 0;
+}
+
+String String::substring(unsigned int from) const {
+  return substring(from, len_);
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+  if (from > to) {
+    const unsigned int tmp = from;
+    from = to;
+    to = tmp;
+  }
+  if (from >= len_) {
+    return String();
+  }
+  if (to > len_) {
+    to = len_;
+  }
+  return String(c_str() + from, to - from);
+}
+
+long String::toInt() const { return strtol(c_str(), nullptr, 10); }
+
+String operator+(const String& lhs, const String& rhs) {
+  String out(lhs);
+  out.concat(rhs);
+  return out;
+}
+
+String operator+(const String& lhs, const char* rhs) {
+  String out(lhs);
+  out.concat(rhs);
+  return out;
+}
+
+String operator+(const char* lhs, const String& rhs) {
+  String out(lhs);
+  out.concat(rhs);
+  return out;
+}
+
+// ---- Print ----
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+  size_t n = 0;
+  while (size-- > 0) {
+    n += write(*buffer++);
+  }
+  return n;
+}
+
+size_t Print::printf(const char* format, ...) {
+  va_list arg;
+  va_start(arg, format);
+  char temp[64];
+  char* buffer = temp;
+  size_t len = vsnprintf(temp, sizeof(temp), format, arg);
+  va_end(arg);
+  if (len > sizeof(temp) - 1) {
+    buffer = new char[len + 1];
+    va_start(arg, format);
+    vsnprintf(buffer, len + 1, format, arg);
+    va_end(arg);
+  }
+  len = write(reinterpret_cast<const uint8_t*>(buffer), len);
+  if (buffer != temp) {
+    delete[] buffer;
+  }
+  return len;
+}
+
+size_t Print::print(long value) {
+  char digits[24];
+  return write(digits, static_cast<size_t>(
+                           snprintf(digits, sizeof(digits), "%ld", value)));
+}
+
+size_t Print::print(unsigned long value) {
+  char digits[24];
+  return write(digits, static_cast<size_t>(
+                           snprintf(digits, sizeof(digits), "%lu", value)));
+}
+
+// ---- IPAddress ----
+
+String IPAddress::toString() const {
+  char text[16];
+  snprintf(text, sizeof(text), "%u.%u.%u.%u", octets_[0], octets_[1],
+           octets_[2], octets_[3]);
+  return String(text);
+}
+
+// ---- timing ----
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const Clock::time_point gBootTime = Clock::now();
+uint64_t gVirtualOffsetUs = 0;
+
+uint64_t elapsedMicros() {
+  const auto real = std::chrono::duration_cast<std::chrono::microseconds>(
+      Clock::now() - gBootTime);
+  return static_cast<uint64_t>(real.count()) + gVirtualOffsetUs;
+}
+
+constexpr int kPinCount = 18;
+int gPinLevels[kPinCount] = {0};
+uint32_t gPinWrites[kPinCount] = {0};
+
+bool gSerialEcho = getenv("POOT_HOST_SERIAL") != nullptr &&
+                   strcmp(getenv("POOT_HOST_SERIAL"), "1") == 0;
+size_t gSerialBytes = 0;
+
+uint32_t gFreeHeap = 40 * 1024;
+uint8_t gHeapFragmentation = 25;
+uint32_t gFreeContStack = 2048;
+rst_info gResetInfo = {REASON_DEFAULT_RST, 0, 0, 0, 0, 0, 0};
+uint8_t gCpuFreqMhz = SYS_CPU_80MHZ;
+uint64_t gCyclesAtFreqChange = 0;
+uint64_t gUsAtFreqChange = 0;
+constexpr size_t kRtcUserMemoryBytes = 512;
+uint32_t gRtcUserMemory[kRtcUserMemoryBytes / 4];
+bool gRestartRequested = false;
+void (*gYieldHook)() = nullptr;
+
+std::minstd_rand gRandom;
+
+}  // namespace
+
+unsigned long millis() {
+  return static_cast<unsigned long>(
+      static_cast<uint32_t>(elapsedMicros() / 1000));
+}
+
+unsigned long micros() {
+  return static_cast<unsigned long>(static_cast<uint32_t>(elapsedMicros()));
+}
+
+void delay(unsigned long ms) { gVirtualOffsetUs += ms * 1000ULL; }
+
+void delayMicroseconds(unsigned int us) { gVirtualOffsetUs += us; }
+
+void yield() {
+  if (gYieldHook != nullptr) {
+    gYieldHook();
+  }
+}
+
+// ---- GPIO ----
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  (void)pin;
+  (void)mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  if (pin < kPinCount) {
+    gPinLevels[pin] = value;
+    gPinWrites[pin]++;
+  }
+}
+
+int digitalRead(uint8_t pin) { return pin < kPinCount ? gPinLevels[pin] : 0; }
+
+FakeGpioRegister GPOS(FakeGpioRegister::Kind::kSet);
+FakeGpioRegister GPOC(FakeGpioRegister::Kind::kClear);
+FakeGpioRegister GP16O(FakeGpioRegister::Kind::kGpio16);
+
+void FakeGpioRegister::operator=(uint32_t value) {
+  if (kind_ == Kind::kGpio16) {
+    digitalWrite(16, value & 1);
+    return;
+  }
+  for (uint8_t pin = 0; pin < 16; pin++) {
+    if (value & (1UL << pin)) {
+      digitalWrite(pin, kind_ == Kind::kSet ? HIGH : LOW);
+    }
+  }
+}
+
+int analogRead(uint8_t pin) {
+  (void)pin;
+  return 512;
+}
+
+void randomSeed(unsigned long seed) {
+  gRandom.seed(static_cast<std::minstd_rand::result_type>(seed));
+}
+
+long random(long max) { return max <= 0 ? 0 : static_cast<long>(gRandom() % max); }
+
+long random(long min, long max) {
+  return max <= min ? min : min + random(max - min);
+}
+
+// ---- Serial ----
+
+HardwareSerial Serial;
+
+size_t HardwareSerial::write(uint8_t c) { return write(&c, 1); }
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+  gSerialBytes += size;
+  if (gSerialEcho) {
+    fwrite(buffer, 1, size, stderr);
+  }
+  return size;
+}
+
+// ---- ESP ----
+
+EspClass ESP;
+
+uint32_t EspClass::getFreeHeap() { return gFreeHeap; }
+
+uint32_t EspClass::getMaxFreeBlockSize() {
+  return gFreeHeap * (100u - gHeapFragmentation) / 100u;
+}
+
+uint8_t EspClass::getHeapFragmentation() { return gHeapFragmentation; }
+
+uint32_t EspClass::getFreeContStack() { return gFreeContStack; }
+
+void EspClass::resetFreeContStack() {}
+
+String EspClass::getResetReason() {
+  switch (gResetInfo.reason) {
+    case REASON_WDT_RST:          return String("Hardware Watchdog");
+    case REASON_EXCEPTION_RST:    return String("Exception");
+    case REASON_SOFT_WDT_RST:     return String("Software Watchdog");
+    case REASON_SOFT_RESTART:     return String("Software/System restart");
+    case REASON_DEEP_SLEEP_AWAKE: return String("Deep-Sleep Wake");
+    case REASON_EXT_SYS_RST:      return String("External System");
+    default:                      return String("Power On");
+  }
+}
+
+rst_info* EspClass::getResetInfoPtr() { return &gResetInfo; }
+
+bool EspClass::rtcUserMemoryRead(uint32_t offset, uint32_t* data,
+                                 size_t size) {
+  if (offset * 4 + size > kRtcUserMemoryBytes || data == nullptr) {
+    return false;
+  }
+  memcpy(data, reinterpret_cast<uint8_t*>(gRtcUserMemory) + offset * 4, size);
+  return true;
+}
+
+bool EspClass::rtcUserMemoryWrite(uint32_t offset, uint32_t* data,
+                                  size_t size) {
+  if (offset * 4 + size > kRtcUserMemoryBytes || data == nullptr) {
+    return false;
+  }
+  memcpy(reinterpret_cast<uint8_t*>(gRtcUserMemory) + offset * 4, data, size);
+  return true;
+}
+
+uint8_t EspClass::getCpuFreqMHz() { return system_get_cpu_freq(); }
+
+uint32_t EspClass::getCycleCount() {
+  return static_cast<uint32_t>(
+      gCyclesAtFreqChange + (elapsedMicros() - gUsAtFreqChange) * gCpuFreqMhz);
+}
+
+bool system_update_cpu_freq(uint8_t freq) {
+  if (freq != SYS_CPU_80MHZ && freq != SYS_CPU_160MHZ) {
+    return false;
+  }
+  gCyclesAtFreqChange = ESP.getCycleCount();
+  gUsAtFreqChange = elapsedMicros();
+  gCpuFreqMhz = freq;
+  return true;
+}
+
+uint8_t system_get_cpu_freq() { return gCpuFreqMhz; }
+
+uint32_t EspClass::random() {
+  static std::random_device device;
+  return device();
+}
+
+void EspClass::restart() { gRestartRequested = true; }
+
+// ---- fake_hal hooks ----
+
+namespace fake_hal {
+
+void advanceMillis(uint32_t ms) { gVirtualOffsetUs += ms * 1000ULL; }
+
+void setYieldHook(void (*hook)()) { gYieldHook = hook; }
+
+int pinLevel(uint8_t pin) { return pin < kPinCount ? gPinLevels[pin] : 0; }
+
+uint32_t pinWriteCount(uint8_t pin) {
+  return pin < kPinCount ? gPinWrites[pin] : 0;
+}
+
+void setSerialEcho(bool echo) { gSerialEcho = echo; }
+
+size_t serialBytesWritten() { return gSerialBytes; }
+
+void setFreeHeap(uint32_t bytes) { gFreeHeap = bytes; }
+
+void setFreeContStack(uint32_t bytes) { gFreeContStack = bytes; }
+
+void setHeapFragmentation(uint8_t percent) {
+  gHeapFragmentation = percent > 100 ? 100 : percent;
+}
+
+void setResetInfo(uint32_t reason, uint32_t exccause, uint32_t epc1,
+                  uint32_t excvaddr) {
+  gResetInfo = rst_info{reason, exccause, epc1, 0, 0, excvaddr, 0};
+}
+
+uint8_t* rtcUserMemory() { return reinterpret_cast<uint8_t*>(gRtcUserMemory); }
+
+bool restartRequested() { return gRestartRequested; }
+
+void clearRestartRequested() { gRestartRequested = false; }
+
+}  // namespace fake_hal
@@ -0,0 +1,27 @@
+#pragma once
+
+// Host stand-in for the GPIO output registers the sketch stores to directly
+// (poot_lock/gpio_pin.h). Like on the device, Arduino.h includes it. A store
+// moves the same pin levels and write counts as digitalWrite(), so
+// fake_hal::pinLevel() sees either path.
+
+#include <stdint.h>
+
+class FakeGpioRegister {
+ public:
+  enum class Kind : uint8_t {
+    kSet,    // GPOS: drives the pins in the mask high
+    kClear,  // GPOC: drives them low
+    kGpio16,  // GP16O: bit 0 is GPIO16's level
+  };
+
+  explicit constexpr FakeGpioRegister(Kind kind) : kind_(kind) {}
+  void operator=(uint32_t value);
+
+ private:
+  Kind kind_;
+};
+
+extern FakeGpioRegister GPOS;
+extern FakeGpioRegister GPOC;
+extern FakeGpioRegister GP16O;
@@ -0,0 +1,69 @@
+#pragma once
+
+// Test and benchmark hooks for the host HAL. Nothing here exists on the
+// device; sketch code must never include this header.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Arduino.h"
+#include "ESP8266WiFi.h"
+
+namespace fake_hal {
+
+// Virtual clock. millis()/micros() report real elapsed time plus whatever has
+// been added here or by delay(), so cooldowns can be skipped without sleeping.
+void advanceMillis(uint32_t ms);
+
+// Runs from yield(), which the host TLS client calls while its handshake
+// blocks, so a loopback peer served from the same thread can answer.
+void setYieldHook(void (*hook)());
+
+// GPIO state as last written by digitalWrite().
+int pinLevel(uint8_t pin);
+uint32_t pinWriteCount(uint8_t pin);
+
+// Serial output is swallowed unless POOT_HOST_SERIAL=1 is set in the
+// environment; the byte count is always tracked.
+void setSerialEcho(bool echo);
+size_t serialBytesWritten();
+
+// WiFi station simulation. Event handlers registered by the sketch are fired
+// synchronously from these calls.
+void setStaConnected(const IPAddress& ip, const char* ssid, int32_t rssi);
+void setStaDisconnected(uint8_t reason);
+// The one access point there is: what WiFi.BSSID()/channel() report.
+void setStaAccessPoint(const uint8_t bssid[6], int32_t channel);
+// Arguments of the last WiFi.begin(): channel 0 and nullptr unless given.
+int32_t lastBeginChannel();
+const uint8_t* lastBeginBssid();
+void setApStationCount(uint8_t count);
+// A station joining or leaving the soft AP: adjusts the count and fires the
+// sketch's handlers.
+void apStationJoined(const uint8_t mac[6]);
+void apStationLeft(const uint8_t mac[6]);
+// WiFi.scanNetworks() calls so far; finishScan() completes a running async
+// scan (with no networks found).
+uint32_t scansStarted();
+void finishScan();
+
+void setFreeHeap(uint32_t bytes);
+// ESP.getHeapFragmentation(); the largest free block follows as
+// free heap * (100 - percent) / 100.
+void setHeapFragmentation(uint8_t percent);
+// ESP.getFreeContStack(); the host cannot watch its own stack the way the
+// device paints it, so this is simply reported back.
+void setFreeContStack(uint32_t bytes);
+// Reset cause reported by ESP.getResetReason()/getResetInfoPtr().
+void setResetInfo(uint32_t reason, uint32_t exccause = 0, uint32_t epc1 = 0,
+                  uint32_t excvaddr = 0);
+// Raw RTC user memory, e.g. to corrupt it or inspect what the sketch wrote.
+uint8_t* rtcUserMemory();
+// LittleFS simulation. begin() fails while unmountable.
+void setFlashMountable(bool mountable);
+size_t flashFileSize(const char* path);
+
+bool restartRequested();
+void clearRestartRequested();
+
+}  // namespace fake_hal
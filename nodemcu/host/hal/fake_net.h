@@ -0,0 +1,70 @@
+#pragma once
+
+// Simulated socket table shared by the host WiFiClient, ESPAsyncTCP and the
+// harnesses. Only the host HAL and harnesses use this.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+#include "IPAddress.h"
+
+namespace fake_net {
+
+struct Connection {
+  IPAddress remote;
+  uint16_t remotePort = 0;
+  bool open = false;
+  size_t bytesWritten = 0;
+  uint32_t writeCalls = 0;
+  // Bytes an AsyncClient sent on this connection, and whether the sketch
+  // (rather than the peer) closed it.
+  std::string received;
+  bool closedByServer = false;
+};
+
+int openConnection(const IPAddress& remote, uint16_t remotePort = 49152);
+Connection* connection(int id);
+// Reinitialises a recycled slot as a fresh open connection.
+void resetConnection(Connection& c, const IPAddress& remote,
+                     uint16_t remotePort);
+
+// ---- ESPAsyncTCP simulation ----
+
+// Opens a connection to the AsyncServer listening on `port` and runs its
+// onClient callback. Returns the connection id, or -1 if nothing listens.
+int asyncConnect(uint16_t port, const IPAddress& remote,
+                 uint16_t remotePort = 49152);
+// Delivers request bytes to the client's onData callback.
+bool asyncSend(int id, const char* data, size_t size);
+bool asyncSend(int id, const char* text);
+// The peer closes; fires onDisconnect if the client is still open.
+void asyncPeerClose(int id);
+bool asyncOpen(int id);
+
+// Sent data is acknowledged immediately by default. With auto-ack off it
+// stays in flight (reducing space()) until asyncAck() is called.
+void setAsyncAutoAck(bool autoAck);
+void asyncAck(int id);
+// Models lwIP's TCP_SND_BUF: the most a client can have in flight. 1072
+// (2 * 536-byte MSS) is the core's default "v2 Lower Memory" build.
+static constexpr size_t kTcpSendBuffer = 1072;
+
+// ---- WiFiUDP simulation ----
+
+struct Datagram {
+  IPAddress remote;
+  uint16_t remotePort = 0;
+  uint16_t localPort = 0;
+  size_t size = 0;
+  uint8_t data[1472];
+};
+
+// Queues a datagram for the WiFiUDP bound to `port`; false if none is.
+bool udpDeliver(uint16_t port, const IPAddress& remote, uint16_t remotePort,
+                const void* data, size_t size);
+// Pops the oldest datagram the sketch sent; false if there is none.
+bool udpTakeSent(Datagram& out);
+
+}  // namespace fake_net
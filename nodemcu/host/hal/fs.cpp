@@ -0,0 +1,132 @@
+#include "LittleFS.h"
+
+#include <map>
+
+#include "fake_hal.h"
+
+namespace {
+
+std::map<std::string, std::shared_ptr<std::vector<uint8_t>>> gFiles;
+bool gMountable = true;
+bool gMounted = false;
+
+}  // namespace
+
+FS LittleFS;
+
+size_t File::write(const uint8_t* buffer, size_t size) {
+  if (!data_ || !writable_) {
+    return 0;
+  }
+  if (append_) {
+    position_ = data_->size();
+  }
+  // Overwrites from the current position and grows the file past its end,
+  // like LittleFS in "r+"/"w" mode; "a" always writes at the end.
+  if (position_ + size > data_->size()) {
+    data_->resize(position_ + size);
+  }
+  memcpy(data_->data() + position_, buffer, size);
+  position_ += size;
+  return size;
+}
+
+int File::read(uint8_t* buffer, size_t size) {
+  if (!data_) {
+    return -1;
+  }
+  const size_t n = available() < static_cast<int>(size)
+                       ? static_cast<size_t>(available())
+                       : size;
+  memcpy(buffer, data_->data() + position_, n);
+  position_ += n;
+  return static_cast<int>(n);
+}
+
+int File::available() const {
+  return data_ ? static_cast<int>(data_->size() - position_) : 0;
+}
+
+bool File::seek(uint32_t pos, SeekMode mode) {
+  if (!data_) {
+    return false;
+  }
+  const size_t base = mode == SeekSet   ? 0
+                      : mode == SeekCur ? position_
+                                        : data_->size();
+  if (base + pos > data_->size()) {
+    return false;
+  }
+  position_ = base + pos;
+  return true;
+}
+
+size_t File::size() const { return data_ ? data_->size() : 0; }
+
+void File::close() {
+  data_.reset();
+  position_ = 0;
+}
+
+bool FS::begin() {
+  gMounted = gMountable;
+  return gMounted;
+}
+
+void FS::end() { gMounted = false; }
+
+File FS::open(const char* path, const char* mode) {
+  File file;
+  if (!gMounted || path == nullptr || mode == nullptr) {
+    return file;
+  }
+  auto it = gFiles.find(path);
+  if (mode[0] == 'r') {
+    if (it == gFiles.end()) {
+      return file;
+    }
+    file.data_ = it->second;
+    file.writable_ = mode[1] == '+';
+    return file;
+  }
+  if (it == gFiles.end() || mode[0] == 'w') {
+    gFiles[path] = std::make_shared<std::vector<uint8_t>>();
+    it = gFiles.find(path);
+  }
+  file.data_ = it->second;
+  file.writable_ = true;
+  file.append_ = mode[0] == 'a';
+  return file;
+}
+
+bool FS::exists(const char* path) {
+  return gMounted && gFiles.count(path) != 0;
+}
+
+bool FS::remove(const char* path) {
+  return gMounted && gFiles.erase(path) != 0;
+}
+
+bool FS::rename(const char* from, const char* to) {
+  if (!gMounted) {
+    return false;
+  }
+  auto it = gFiles.find(from);
+  if (it == gFiles.end() || gFiles.count(to) != 0) {
+    return false;
+  }
+  gFiles[to] = it->second;
+  gFiles.erase(from);
+  return true;
+}
+
+namespace fake_hal {
+
+void setFlashMountable(bool mountable) { gMountable = mountable; }
+
+size_t flashFileSize(const char* path) {
+  auto it = gFiles.find(path);
+  return it == gFiles.end() ? 0 : it->second->size();
+}
+
+}  // namespace fake_hal
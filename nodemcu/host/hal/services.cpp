@@ -0,0 +1,5 @@
+#include "ArduinoOTA.h"
+#include "ESP8266mDNS.h"
+
+MDNSResponder MDNS;
+ArduinoOTAClass ArduinoOTA;
@@ -0,0 +1,33 @@
+#pragma once
+
+// Host stand-in for the NONOS SDK reset-info types. Only the fields the
+// sketch reads are meaningful; set them with fake_hal::setResetInfo().
+
+#include <stdint.h>
+
+enum rst_reason {
+  REASON_DEFAULT_RST = 0,
+  REASON_WDT_RST = 1,
+  REASON_EXCEPTION_RST = 2,
+  REASON_SOFT_WDT_RST = 3,
+  REASON_SOFT_RESTART = 4,
+  REASON_DEEP_SLEEP_AWAKE = 5,
+  REASON_EXT_SYS_RST = 6,
+};
+
+struct rst_info {
+  uint32_t reason;
+  uint32_t exccause;
+  uint32_t epc1;
+  uint32_t epc2;
+  uint32_t epc3;
+  uint32_t excvaddr;
+  uint32_t depc;
+};
+
+#define SYS_CPU_80MHZ 80
+#define SYS_CPU_160MHZ 160
+
+// Accepts 80 or 160; the cycle counter follows the new clock.
+bool system_update_cpu_freq(uint8_t freq);
+uint8_t system_get_cpu_freq();
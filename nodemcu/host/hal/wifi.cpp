@@ -0,0 +1,336 @@
+#include <vector>
+
+#include "ESP8266WiFi.h"
+#include "fake_hal.h"
+#include "fake_net.h"
+
+ESP8266WiFiClass WiFi;
+
+namespace {
+
+struct HandlerSlot : WiFiEventHandlerOpaque {
+  std::function<void(const WiFiEventStationModeDisconnected&)> onDisconnected;
+  std::function<void(const WiFiEventStationModeGotIP&)> onGotIp;
+  std::function<void(const WiFiEventSoftAPModeStationConnected&)> onApJoin;
+  std::function<void(const WiFiEventSoftAPModeStationDisconnected&)> onApLeave;
+};
+
+struct StaState {
+  wl_status_t status = WL_DISCONNECTED;
+  IPAddress ip;
+  IPAddress gateway;
+  IPAddress subnet;
+  String ssid;
+  int32_t rssi = 0;
+  IPAddress configuredIp;
+  uint8_t apBssid[6] = {0x02, 0x50, 0x4f, 0x4f, 0x54, 0x01};
+  int32_t apChannel = 6;
+  // What the last begin() asked for; channel 0 and no BSSID mean a scan.
+  int32_t beginChannel = 0;
+  uint8_t beginBssid[6] = {0};
+  bool beginBssidSet = false;
+};
+
+StaState gSta;
+IPAddress gApIp(192, 168, 4, 1);
+uint8_t gApStations = 0;
+int8_t gScanCount = WIFI_SCAN_FAILED;
+uint32_t gScansStarted = 0;
+std::vector<std::weak_ptr<HandlerSlot>> gHandlers;
+
+template <typename Fn>
+void forEachHandler(Fn fn) {
+  for (size_t i = 0; i < gHandlers.size(); i++) {
+    if (std::shared_ptr<HandlerSlot> h = gHandlers[i].lock()) {
+      fn(*h);
+    }
+  }
+}
+
+constexpr int kMaxConnections = 256;
+fake_net::Connection gConnections[kMaxConnections];
+// What a connection captures is reserved up front, so a reply lands in the
+// capture without the harness allocating inside a timed case.
+constexpr size_t kCaptureReserve = 16 * 1024;
+const bool gCapturesReserved = [] {
+  for (fake_net::Connection& c : gConnections) {
+    c.received.reserve(kCaptureReserve);
+  }
+  return true;
+}();
+int gNextConnection = 0;
+
+}  // namespace
+
+// ---- ESP8266WiFiClass ----
+
+bool ESP8266WiFiClass::setAutoReconnect(bool autoReconnect) {
+  (void)autoReconnect;
+  return true;
+}
+
+bool ESP8266WiFiClass::setSleepMode(WiFiSleepType_t type,
+                                    uint8_t listenInterval) {
+  if (listenInterval > 10) {
+    return false;
+  }
+  sleepMode_ = type;
+  listenInterval_ = listenInterval;
+  return true;
+}
+
+bool ESP8266WiFiClass::mode(WiFiMode_t mode) {
+  mode_ = mode;
+  return true;
+}
+
+bool ESP8266WiFiClass::setHostname(const char* hostname) {
+  (void)hostname;
+  return true;
+}
+
+bool ESP8266WiFiClass::config(IPAddress local, IPAddress gateway,
+                              IPAddress subnet, IPAddress dns1,
+                              IPAddress dns2) {
+  (void)dns1;
+  (void)dns2;
+  gSta.configuredIp = local;
+  gSta.gateway = gateway;
+  gSta.subnet = subnet;
+  return true;
+}
+
+wl_status_t ESP8266WiFiClass::begin(const char* ssid, const char* passphrase,
+                                    int32_t channel, const uint8_t* bssid,
+                                    bool connect) {
+  (void)passphrase;
+  (void)connect;
+  gSta.ssid = ssid;
+  gSta.beginChannel = channel;
+  gSta.beginBssidSet = bssid != nullptr;
+  if (bssid != nullptr) {
+    memcpy(gSta.beginBssid, bssid, sizeof(gSta.beginBssid));
+  }
+  if (gSta.status != WL_CONNECTED) {
+    gSta.status = WL_DISCONNECTED;
+  }
+  return gSta.status;
+}
+
+bool ESP8266WiFiClass::disconnect(bool wifiOff) {
+  (void)wifiOff;
+  gSta.status = WL_DISCONNECTED;
+  gSta.ip = IPAddress();
+  return true;
+}
+
+wl_status_t ESP8266WiFiClass::status() { return gSta.status; }
+
+IPAddress ESP8266WiFiClass::localIP() { return gSta.ip; }
+
+String ESP8266WiFiClass::SSID() const { return gSta.ssid; }
+
+int32_t ESP8266WiFiClass::RSSI() { return gSta.rssi; }
+
+int32_t ESP8266WiFiClass::channel() { return gSta.apChannel; }
+
+uint8_t* ESP8266WiFiClass::BSSID() { return gSta.apBssid; }
+
+bool ESP8266WiFiClass::softAPConfig(IPAddress local, IPAddress gateway,
+                                    IPAddress subnet) {
+  (void)gateway;
+  (void)subnet;
+  gApIp = local;
+  return true;
+}
+
+bool ESP8266WiFiClass::softAP(const char* ssid, const char* passphrase,
+                              int channel, int hidden, int maxConnection) {
+  (void)ssid;
+  (void)passphrase;
+  (void)channel;
+  (void)hidden;
+  (void)maxConnection;
+  return true;
+}
+
+IPAddress ESP8266WiFiClass::softAPIP() { return gApIp; }
+
+uint8_t ESP8266WiFiClass::softAPgetStationNum() { return gApStations; }
+
+int8_t ESP8266WiFiClass::scanNetworks(bool async, bool showHidden) {
+  (void)showHidden;
+  gScanCount = async ? WIFI_SCAN_RUNNING : 0;
+  gScansStarted++;
+  return gScanCount;
+}
+
+int8_t ESP8266WiFiClass::scanComplete() { return gScanCount; }
+
+void ESP8266WiFiClass::scanDelete() { gScanCount = WIFI_SCAN_FAILED; }
+
+String ESP8266WiFiClass::SSID(uint8_t index) {
+  (void)index;
+  return String();
+}
+
+int32_t ESP8266WiFiClass::RSSI(uint8_t index) {
+  (void)index;
+  return 0;
+}
+
+int32_t ESP8266WiFiClass::channel(uint8_t index) {
+  (void)index;
+  return 0;
+}
+
+uint8_t ESP8266WiFiClass::encryptionType(uint8_t index) {
+  (void)index;
+  return ENC_TYPE_NONE;
+}
+
+WiFiEventHandler ESP8266WiFiClass::onStationModeDisconnected(
+    std::function<void(const WiFiEventStationModeDisconnected&)> handler) {
+  auto slot = std::make_shared<HandlerSlot>();
+  slot->onDisconnected = handler;
+  gHandlers.push_back(slot);
+  return slot;
+}
+
+WiFiEventHandler ESP8266WiFiClass::onStationModeGotIP(
+    std::function<void(const WiFiEventStationModeGotIP&)> handler) {
+  auto slot = std::make_shared<HandlerSlot>();
+  slot->onGotIp = handler;
+  gHandlers.push_back(slot);
+  return slot;
+}
+
+WiFiEventHandler ESP8266WiFiClass::onSoftAPModeStationConnected(
+    std::function<void(const WiFiEventSoftAPModeStationConnected&)> handler) {
+  auto slot = std::make_shared<HandlerSlot>();
+  slot->onApJoin = handler;
+  gHandlers.push_back(slot);
+  return slot;
+}
+
+WiFiEventHandler ESP8266WiFiClass::onSoftAPModeStationDisconnected(
+    std::function<void(const WiFiEventSoftAPModeStationDisconnected&)>
+        handler) {
+  auto slot = std::make_shared<HandlerSlot>();
+  slot->onApLeave = handler;
+  gHandlers.push_back(slot);
+  return slot;
+}
+
+// ---- fake_net / fake_hal hooks ----
+
+namespace fake_net {
+
+int openConnection(const IPAddress& remote, uint16_t remotePort) {
+  // Ids still open (a long-lived connection bridged by poot_host_lock, say)
+  // are skipped; only when every id is open is the next one recycled.
+  int id = gNextConnection;
+  for (int i = 1; i < kMaxConnections && gConnections[id].open; i++) {
+    id = (id + 1) % kMaxConnections;
+  }
+  gNextConnection = (id + 1) % kMaxConnections;
+  resetConnection(gConnections[id], remote, remotePort);
+  return id;
+}
+
+void resetConnection(Connection& c, const IPAddress& remote,
+                     uint16_t remotePort) {
+  // clear() keeps the capacity, so recycled slots stop allocating once warm.
+  std::string received = std::move(c.received);
+  received.clear();
+  c = Connection();
+  c.received = std::move(received);
+  c.remote = remote;
+  c.remotePort = remotePort;
+  c.open = true;
+}
+
+Connection* connection(int id) {
+  return (id < 0 || id >= kMaxConnections) ? nullptr : &gConnections[id];
+}
+
+}  // namespace fake_net
+
+namespace fake_hal {
+
+void setStaConnected(const IPAddress& ip, const char* ssid, int32_t rssi) {
+  gSta.status = WL_CONNECTED;
+  gSta.ip = ip;
+  gSta.ssid = ssid;
+  gSta.rssi = rssi;
+  WiFiEventStationModeGotIP event;
+  event.ip = ip;
+  event.mask = gSta.subnet;
+  event.gw = gSta.gateway;
+  forEachHandler([&](HandlerSlot& h) {
+    if (h.onGotIp) {
+      h.onGotIp(event);
+    }
+  });
+}
+
+void setStaDisconnected(uint8_t reason) {
+  WiFiEventStationModeDisconnected event;
+  event.ssid = gSta.ssid;
+  event.reason = reason;
+  gSta.status = WL_DISCONNECTED;
+  gSta.ip = IPAddress();
+  forEachHandler([&](HandlerSlot& h) {
+    if (h.onDisconnected) {
+      h.onDisconnected(event);
+    }
+  });
+}
+
+void setStaAccessPoint(const uint8_t bssid[6], int32_t channel) {
+  memcpy(gSta.apBssid, bssid, sizeof(gSta.apBssid));
+  gSta.apChannel = channel;
+}
+
+int32_t lastBeginChannel() { return gSta.beginChannel; }
+
+const uint8_t* lastBeginBssid() {
+  return gSta.beginBssidSet ? gSta.beginBssid : nullptr;
+}
+
+void setApStationCount(uint8_t count) { gApStations = count; }
+
+void apStationJoined(const uint8_t mac[6]) {
+  WiFiEventSoftAPModeStationConnected event;
+  memcpy(event.mac, mac, sizeof(event.mac));
+  event.aid = ++gApStations;
+  forEachHandler([&](HandlerSlot& h) {
+    if (h.onApJoin) {
+      h.onApJoin(event);
+    }
+  });
+}
+
+void apStationLeft(const uint8_t mac[6]) {
+  WiFiEventSoftAPModeStationDisconnected event;
+  memcpy(event.mac, mac, sizeof(event.mac));
+  event.aid = gApStations;
+  if (gApStations > 0) {
+    gApStations--;
+  }
+  forEachHandler([&](HandlerSlot& h) {
+    if (h.onApLeave) {
+      h.onApLeave(event);
+    }
+  });
+}
+
+uint32_t scansStarted() { return gScansStarted; }
+
+void finishScan() {
+  if (gScanCount == WIFI_SCAN_RUNNING) {
+    gScanCount = 0;
+  }
+}
+
+}  // namespace fake_hal
@@ -0,0 +1,134 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "ESP8266WiFi.h"
+
+WiFiClient::~WiFiClient() { stop(); }
+
+int WiFiClient::connect(const char* host, uint16_t port) {
+  stop();
+  addrinfo hints = {};
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  char service[8];
+  snprintf(service, sizeof(service), "%u", port);
+  addrinfo* found = nullptr;
+  if (getaddrinfo(host, service, &hints, &found) != 0 || found == nullptr) {
+    return 0;
+  }
+  const int fd = socket(found->ai_family, found->ai_socktype, 0);
+  const bool ok =
+      fd >= 0 && ::connect(fd, found->ai_addr, found->ai_addrlen) == 0;
+  freeaddrinfo(found);
+  if (!ok) {
+    if (fd >= 0) {
+      close(fd);
+    }
+    return 0;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  fd_ = fd;
+  peekBegin_ = peekEnd_ = 0;
+  peerClosed_ = false;
+  return 1;
+}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port) {
+  char host[16];
+  snprintf(host, sizeof(host), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+  return connect(host, port);
+}
+
+bool WiFiClient::fill() {
+  if (fd_ < 0 || peerClosed_) {
+    return false;
+  }
+  if (peekBegin_ == peekEnd_) {
+    peekBegin_ = peekEnd_ = 0;
+  }
+  if (peekEnd_ == sizeof(peek_)) {
+    return true;
+  }
+  const ssize_t n = recv(fd_, peek_ + peekEnd_, sizeof(peek_) - peekEnd_, 0);
+  if (n > 0) {
+    peekEnd_ += static_cast<size_t>(n);
+  } else if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+    peerClosed_ = true;
+  }
+  return !peerClosed_;
+}
+
+uint8_t WiFiClient::connected() {
+  fill();
+  // Like the core: still "connected" while unread bytes remain.
+  return fd_ >= 0 && (!peerClosed_ || peekBegin_ < peekEnd_) ? 1 : 0;
+}
+
+int WiFiClient::available() {
+  fill();
+  return static_cast<int>(peekEnd_ - peekBegin_);
+}
+
+int WiFiClient::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int WiFiClient::read(uint8_t* buffer, size_t size) {
+  if (peekBegin_ == peekEnd_) {
+    fill();
+  }
+  size_t n = peekEnd_ - peekBegin_;
+  if (n > size) {
+    n = size;
+  }
+  memcpy(buffer, peek_ + peekBegin_, n);
+  peekBegin_ += n;
+  return static_cast<int>(n);
+}
+
+void WiFiClient::stop() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+  fd_ = -1;
+  peekBegin_ = peekEnd_ = 0;
+  peerClosed_ = false;
+}
+
+void WiFiClient::setNoDelay(bool noDelay) {
+  if (fd_ >= 0) {
+    const int on = noDelay ? 1 : 0;
+    setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  }
+}
+
+size_t WiFiClient::write(uint8_t c) { return write(&c, 1); }
+
+// Blocks until everything is sent or the timeout passes, like the core.
+size_t WiFiClient::write(const uint8_t* buffer, size_t size) {
+  size_t sent = 0;
+  while (fd_ >= 0 && sent < size) {
+    const ssize_t n = send(fd_, buffer + sent, size - sent, MSG_NOSIGNAL);
+    if (n > 0) {
+      sent += static_cast<size_t>(n);
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      pollfd pfd = {fd_, POLLOUT, 0};
+      if (poll(&pfd, 1, static_cast<int>(timeoutMs_)) > 0) {
+        continue;
+      }
+    }
+    break;
+  }
+  return sent;
+}
@@ -0,0 +1,293 @@
+#include "WiFiClientSecure.h"
+
+#include <string.h>
+
+#ifdef POOT_HOST_TLS
+
+#include <arpa/inet.h>
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+#include <poll.h>
+
+#include <chrono>
+
+namespace BearSSL {
+
+namespace {
+
+SSL_CTX* clientContext() {
+  static SSL_CTX* context = [] {
+    SSL_CTX* ctx = SSL_CTX_new(TLS_client_method());
+    SSL_CTX_set_max_proto_version(ctx, TLS1_2_VERSION);
+    SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+    // Sessions live in Session objects, as with BearSSL.
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+    return ctx;
+  }();
+  return context;
+}
+
+bool isAddress(const char* host) {
+  in_addr address;
+  return inet_pton(AF_INET, host, &address) == 1;
+}
+
+// The largest extension code whose records fit in `bytes`; 0 for none.
+uint8_t fragmentCode(int bytes) {
+  if (bytes >= 16384) {
+    return TLSEXT_max_fragment_length_DISABLED;
+  }
+  if (bytes >= 4096) {
+    return TLSEXT_max_fragment_length_4096;
+  }
+  if (bytes >= 2048) {
+    return TLSEXT_max_fragment_length_2048;
+  }
+  if (bytes >= 1024) {
+    return TLSEXT_max_fragment_length_1024;
+  }
+  return TLSEXT_max_fragment_length_512;
+}
+
+// Drives a non-blocking SSL_connect()/SSL_write() style call to completion.
+template <typename Fn>
+int runBlocking(SSL* ssl, int fd, unsigned long timeoutMs, Fn step) {
+  using Clock = std::chrono::steady_clock;
+  const Clock::time_point deadline =
+      Clock::now() + std::chrono::milliseconds(timeoutMs);
+  for (;;) {
+    const int result = step();
+    if (result > 0) {
+      return result;
+    }
+    const int error = SSL_get_error(ssl, result);
+    if ((error != SSL_ERROR_WANT_READ && error != SSL_ERROR_WANT_WRITE) ||
+        Clock::now() >= deadline) {
+      ERR_clear_error();
+      return result;
+    }
+    yield();
+    pollfd pfd = {fd, static_cast<short>(error == SSL_ERROR_WANT_READ
+                                             ? POLLIN
+                                             : POLLOUT),
+                  0};
+    poll(&pfd, 1, 1);
+  }
+}
+
+}  // namespace
+
+X509List::X509List(const char* pem) {
+  store_ = X509_STORE_new();
+  // Any certificate listed is trusted as is, CA or not, as BearSSL does.
+  X509_STORE_set_flags(store_, X509_V_FLAG_PARTIAL_CHAIN);
+  BIO* bio = BIO_new_mem_buf(pem, -1);
+  while (X509* cert = PEM_read_bio_X509(bio, nullptr, nullptr, nullptr)) {
+    X509_STORE_add_cert(store_, cert);
+    X509_free(cert);
+  }
+  ERR_clear_error();
+  BIO_free(bio);
+}
+
+X509List::~X509List() { X509_STORE_free(store_); }
+
+Session::~Session() { SSL_SESSION_free(saved_); }
+
+void Session::save(SSL_SESSION* session) {
+  SSL_SESSION_free(saved_);
+  saved_ = session;
+  unsigned int length = 0;
+  const unsigned char* id = SSL_SESSION_get_id(session, &length);
+  if (length > sizeof(params_.session_id)) {
+    length = sizeof(params_.session_id);
+  }
+  params_.session_id_len = static_cast<unsigned char>(length);
+  memcpy(params_.session_id, id, length);
+  params_.version =
+      static_cast<uint16_t>(SSL_SESSION_get_protocol_version(session));
+  params_.cipher_suite = static_cast<uint16_t>(
+      SSL_CIPHER_get_protocol_id(SSL_SESSION_get0_cipher(session)));
+}
+
+WiFiClientSecure::~WiFiClientSecure() { stop(); }
+
+void WiFiClientSecure::setBufferSizes(int recv, int xmit) {
+  (void)xmit;
+  recvBytes_ = recv;
+}
+
+bool WiFiClientSecure::probeMaxFragmentLength(const char* host, uint16_t port,
+                                              uint16_t len) {
+  WiFiClientSecure probe;
+  probe.setBufferSizes(len, len);
+  if (!probe.connect(host, port)) {
+    return false;
+  }
+  const uint8_t agreed =
+      SSL_SESSION_get_max_fragment_length(SSL_get_session(probe.ssl_));
+  return agreed != TLSEXT_max_fragment_length_DISABLED &&
+         agreed == fragmentCode(len);
+}
+
+int WiFiClientSecure::connect(const char* host, uint16_t port) {
+  stop();
+  if (!WiFiClient::connect(host, port)) {
+    return 0;
+  }
+  ssl_ = SSL_new(clientContext());
+  SSL_set_fd(ssl_, fd());
+  if (!isAddress(host)) {
+    SSL_set_tlsext_host_name(ssl_, host);
+  }
+  if (anchors_ != nullptr) {
+    SSL_set1_verify_cert_store(ssl_, anchors_->store_);
+    SSL_set1_host(ssl_, host);
+    SSL_set_verify(ssl_, SSL_VERIFY_PEER, nullptr);
+  } else {
+    SSL_set_verify(ssl_, SSL_VERIFY_NONE, nullptr);
+  }
+  const uint8_t fragment = fragmentCode(recvBytes_);
+  if (fragment != TLSEXT_max_fragment_length_DISABLED) {
+    SSL_set_tlsext_max_fragment_length(ssl_, fragment);
+  }
+  if (session_ != nullptr && session_->saved_ != nullptr) {
+    SSL_set_session(ssl_, session_->saved_);
+  }
+  if (runBlocking(ssl_, fd(), timeoutMs(),
+                  [this] { return SSL_connect(ssl_); }) <= 0) {
+    stop();
+    return 0;
+  }
+  if (session_ != nullptr) {
+    // A copy, as BearSSL keeps: OpenSSL marks its own unresumable when the
+    // connection later ends without close_notify.
+    session_->save(SSL_SESSION_dup(SSL_get_session(ssl_)));
+  }
+  return 1;
+}
+
+void WiFiClientSecure::fill() {
+  if (ssl_ == nullptr || closed_) {
+    return;
+  }
+  if (inBegin_ == inEnd_) {
+    inBegin_ = inEnd_ = 0;
+  }
+  if (inEnd_ == sizeof(in_)) {
+    return;
+  }
+  const int n = SSL_read(ssl_, in_ + inEnd_, sizeof(in_) - inEnd_);
+  if (n > 0) {
+    inEnd_ += static_cast<size_t>(n);
+    return;
+  }
+  const int error = SSL_get_error(ssl_, n);
+  if (error != SSL_ERROR_WANT_READ && error != SSL_ERROR_WANT_WRITE) {
+    closed_ = true;
+    ERR_clear_error();
+  }
+}
+
+uint8_t WiFiClientSecure::connected() {
+  if (ssl_ == nullptr) {
+    return 0;
+  }
+  fill();
+  return !closed_ || inBegin_ < inEnd_ ? 1 : 0;
+}
+
+int WiFiClientSecure::available() {
+  fill();
+  return static_cast<int>(inEnd_ - inBegin_);
+}
+
+int WiFiClientSecure::read(uint8_t* buffer, size_t size) {
+  if (inBegin_ == inEnd_) {
+    fill();
+  }
+  size_t n = inEnd_ - inBegin_;
+  if (n > size) {
+    n = size;
+  }
+  memcpy(buffer, in_ + inBegin_, n);
+  inBegin_ += n;
+  return static_cast<int>(n);
+}
+
+size_t WiFiClientSecure::write(const uint8_t* buffer, size_t size) {
+  if (ssl_ == nullptr || closed_ || size == 0) {
+    return 0;
+  }
+  const int n = runBlocking(ssl_, fd(), timeoutMs(), [&] {
+    return SSL_write(ssl_, buffer, static_cast<int>(size));
+  });
+  return n > 0 ? static_cast<size_t>(n) : 0;
+}
+
+void WiFiClientSecure::stop() {
+  if (ssl_ != nullptr) {
+    if (!closed_) {
+      SSL_shutdown(ssl_);  // close_notify, without waiting for the reply
+    }
+    SSL_free(ssl_);
+    ERR_clear_error();
+  }
+  ssl_ = nullptr;
+  inBegin_ = inEnd_ = 0;
+  closed_ = false;
+  WiFiClient::stop();
+}
+
+}  // namespace BearSSL
+
+#else  // !POOT_HOST_TLS: plain TCP, settings accepted and ignored.
+
+namespace BearSSL {
+
+X509List::X509List(const char* pem) { (void)pem; }
+
+X509List::~X509List() {}
+
+Session::~Session() {}
+
+void Session::save(ssl_session_st* session) { (void)session; }
+
+WiFiClientSecure::~WiFiClientSecure() { stop(); }
+
+void WiFiClientSecure::setBufferSizes(int recv, int xmit) {
+  (void)xmit;
+  recvBytes_ = recv;
+}
+
+bool WiFiClientSecure::probeMaxFragmentLength(const char* host, uint16_t port,
+                                              uint16_t len) {
+  (void)host;
+  (void)port;
+  (void)len;
+  return false;
+}
+
+int WiFiClientSecure::connect(const char* host, uint16_t port) {
+  return WiFiClient::connect(host, port);
+}
+
+uint8_t WiFiClientSecure::connected() { return WiFiClient::connected(); }
+
+int WiFiClientSecure::available() { return WiFiClient::available(); }
+
+int WiFiClientSecure::read(uint8_t* buffer, size_t size) {
+  return WiFiClient::read(buffer, size);
+}
+
+size_t WiFiClientSecure::write(const uint8_t* buffer, size_t size) {
+  return WiFiClient::write(buffer, size);
+}
+
+void WiFiClientSecure::stop() { WiFiClient::stop(); }
+
+}  // namespace BearSSL
+
+#endif  // POOT_HOST_TLS
@@ -0,0 +1,158 @@
+#include <string.h>
+
+#include "WiFiUdp.h"
+#include "fake_net.h"
+
+namespace {
+
+constexpr int kMaxSockets = 4;
+constexpr size_t kQueueDepth = 16;
+
+struct Queue {
+  uint16_t port = 0;
+  fake_net::Datagram items[kQueueDepth];
+  size_t head = 0;
+  size_t count = 0;
+};
+
+// Fixed storage so queued and sent datagrams never allocate.
+Queue gInbound[kMaxSockets];
+fake_net::Datagram gSent[kQueueDepth];
+size_t gSentHead = 0;
+size_t gSentCount = 0;
+
+Queue* queueFor(uint16_t port) {
+  for (Queue& q : gInbound) {
+    if (q.port == port && port != 0) {
+      return &q;
+    }
+  }
+  return nullptr;
+}
+
+void push(Queue& q, const fake_net::Datagram& d) {
+  if (q.count == kQueueDepth) {
+    return;  // full socket buffer: dropped, like lwIP
+  }
+  q.items[(q.head + q.count) % kQueueDepth] = d;
+  q.count++;
+}
+
+}  // namespace
+
+uint8_t WiFiUDP::begin(uint16_t port) {
+  stop();
+  if (queueFor(port) != nullptr) {
+    return 0;
+  }
+  for (Queue& q : gInbound) {
+    if (q.port == 0) {
+      q = Queue();
+      q.port = port;
+      port_ = port;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+void WiFiUDP::stop() {
+  if (Queue* q = queueFor(port_)) {
+    q->port = 0;
+  }
+  port_ = 0;
+  rxSize_ = rxRead_ = 0;
+}
+
+int WiFiUDP::parsePacket() {
+  rxSize_ = rxRead_ = 0;
+  Queue* q = queueFor(port_);
+  if (q == nullptr || q->count == 0) {
+    return 0;
+  }
+  const fake_net::Datagram& d = q->items[q->head];
+  q->head = (q->head + 1) % kQueueDepth;
+  q->count--;
+  remote_ = d.remote;
+  remotePort_ = d.remotePort;
+  rxSize_ = d.size;
+  memcpy(rx_, d.data, d.size);
+  return static_cast<int>(rxSize_);
+}
+
+int WiFiUDP::available() { return static_cast<int>(rxSize_ - rxRead_); }
+
+int WiFiUDP::read(uint8_t* buffer, size_t len) {
+  const size_t n = len < rxSize_ - rxRead_ ? len : rxSize_ - rxRead_;
+  memcpy(buffer, rx_ + rxRead_, n);
+  rxRead_ += n;
+  return static_cast<int>(n);
+}
+
+int WiFiUDP::beginPacket(const IPAddress& ip, uint16_t port) {
+  txRemote_ = ip;
+  txPort_ = port;
+  txSize_ = 0;
+  txOpen_ = true;
+  return 1;
+}
+
+size_t WiFiUDP::write(const uint8_t* buffer, size_t size) {
+  if (!txOpen_) {
+    return 0;
+  }
+  const size_t room = sizeof(tx_) - txSize_;
+  const size_t n = size < room ? size : room;
+  memcpy(tx_ + txSize_, buffer, n);
+  txSize_ += n;
+  return n;
+}
+
+int WiFiUDP::endPacket() {
+  if (!txOpen_) {
+    return 0;
+  }
+  txOpen_ = false;
+  fake_net::Datagram& d = gSent[(gSentHead + gSentCount) % kQueueDepth];
+  if (gSentCount == kQueueDepth) {
+    gSentHead = (gSentHead + 1) % kQueueDepth;  // keep the newest
+  } else {
+    gSentCount++;
+  }
+  d.remote = txRemote_;
+  d.remotePort = txPort_;
+  d.localPort = port_;
+  d.size = txSize_;
+  memcpy(d.data, tx_, txSize_);
+  return 1;
+}
+
+namespace fake_net {
+
+bool udpDeliver(uint16_t port, const IPAddress& remote, uint16_t remotePort,
+                const void* data, size_t size) {
+  Queue* q = queueFor(port);
+  if (q == nullptr || size > sizeof(Datagram::data)) {
+    return false;
+  }
+  Datagram d;
+  d.remote = remote;
+  d.remotePort = remotePort;
+  d.localPort = port;
+  d.size = size;
+  memcpy(d.data, data, size);
+  push(*q, d);
+  return true;
+}
+
+bool udpTakeSent(Datagram& out) {
+  if (gSentCount == 0) {
+    return false;
+  }
+  out = gSent[gSentHead];
+  gSentHead = (gSentHead + 1) % kQueueDepth;
+  gSentCount--;
+  return true;
+}
+
+}  // namespace fake_net
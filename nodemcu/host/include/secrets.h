@@ -0,0 +1,25 @@
+#pragma once
+
+// Host-build credentials. Only used when poot_lock/secrets.h is absent; the
+// values never leave the workstation.
+
+#define WIFI_STA_SSID "host-sta"
+#define WIFI_STA_PASSWORD "host-sta-password"
+#define WIFI_STA_IP IPAddress(192, 168, 1, 192)
+#define WIFI_STA_GATEWAY IPAddress(192, 168, 1, 1)
+#define WIFI_STA_SUBNET IPAddress(255, 255, 255, 0)
+#define WIFI_STA_DNS1 IPAddress(192, 168, 1, 1)
+#define WIFI_STA_DNS2 IPAddress(8, 8, 8, 8)
+
+#define LOCK_ID "front-door"
+
+#define LOCAL_SHARED_KEY "host-local-shared-key"
+
+#define WIFI_AP_SSID "poot-fallback"
+#define WIFI_AP_PASSWORD "host-ap-password"
+#define WIFI_AP_CHANNEL 1
+
+#define OTA_PASSWORD "host-ota-password"
+
+// FIREBASE_DB_HOST is left undefined so setup() does not start the cloud
+// stream; the bench starts it itself against its loopback stand-in.
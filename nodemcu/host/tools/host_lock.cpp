@@ -0,0 +1,267 @@
+// Runs the sketch natively against the fake HAL and bridges real TCP
+// connections into its HTTP server, so poot_load, curl or the app can talk to
+// the host build like to a lock on the network.
+//
+//   poot_host_lock [--port=8080] [--client-ips=1] [--no-limits]
+//
+// Each accepted connection is handed to the sketch's server as an
+// ESPAsyncTCP client from 192.168.4.2, or from one of --client-ips
+// consecutive addresses in turn, which matters for the per-client limits
+// (client_limiter.h); --no-limits turns those off. millis() follows the host
+// clock, so pulses, cooldowns and timeouts run in real time. The key is
+// LOCAL_SHARED_KEY from host/include/secrets.h. UDP is not bridged.
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "poot_lock.ino"
+
+#include "fake_net.h"
+
+namespace {
+
+struct Options {
+  uint16_t port = 8080;
+  int clientIps = 1;
+  bool limits = true;
+};
+
+[[noreturn]] void usage(const char* argv0) {
+  fprintf(stderr, "usage: %s [--port=N] [--client-ips=N] [--no-limits]\n",
+          argv0);
+  exit(2);
+}
+
+Options parseOptions(int argc, char** argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    if (strcmp(arg, "--no-limits") == 0) {
+      options.limits = false;
+      continue;
+    }
+    const char* eq = strchr(arg, '=');
+    if (strncmp(arg, "--", 2) != 0 || eq == nullptr) {
+      usage(argv[0]);
+    }
+    const char* value = eq + 1;
+    const size_t nameLength = static_cast<size_t>(eq - arg);
+    const auto is = [&](const char* name) {
+      return strlen(name) == nameLength && strncmp(arg, name, nameLength) == 0;
+    };
+    if (is("--port")) {
+      options.port = static_cast<uint16_t>(atoi(value));
+    } else if (is("--client-ips")) {
+      options.clientIps = atoi(value);
+    } else {
+      usage(argv[0]);
+    }
+  }
+  if (options.clientIps < 1 || options.clientIps > 250) {
+    usage(argv[0]);
+  }
+  return options;
+}
+
+// One real connection and the fake_net connection it is bridged to.
+struct Peer {
+  int fd;
+  int id;  // -1 once the sketch side has closed
+  std::string outbox;  // reply bytes the socket has not taken yet
+  bool peerClosed;
+};
+
+volatile sig_atomic_t gStop = 0;
+
+void setNonBlocking(int fd) {
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+int listenOn(uint16_t port) {
+  const int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  const int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+      listen(fd, 64) != 0) {
+    close(fd);
+    return -1;
+  }
+  setNonBlocking(fd);
+  return fd;
+}
+
+// Moves what the sketch wrote since the last call into the outbox, and lets
+// go of the fake connection once the sketch has closed it (its id is
+// recycled by the next accept).
+void collect(Peer& peer) {
+  if (peer.id < 0) {
+    return;
+  }
+  fake_net::Connection* c = fake_net::connection(peer.id);
+  peer.outbox += c->received;
+  c->received.clear();
+  if (!fake_net::asyncOpen(peer.id)) {
+    peer.id = -1;
+  }
+}
+
+void readFrom(Peer& peer) {
+  char buffer[1024];
+  for (;;) {
+    const ssize_t n = recv(peer.fd, buffer, sizeof(buffer), 0);
+    if (n > 0) {
+      if (peer.id >= 0) {
+        fake_net::asyncSend(peer.id, buffer, static_cast<size_t>(n));
+      }
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return;
+    }
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    // EOF or a reset: the client is gone.
+    peer.peerClosed = true;
+    peer.outbox.clear();
+    if (peer.id >= 0 && fake_net::asyncOpen(peer.id)) {
+      fake_net::asyncPeerClose(peer.id);
+    }
+    return;
+  }
+}
+
+void writeTo(Peer& peer) {
+  while (!peer.outbox.empty()) {
+    const ssize_t n =
+        send(peer.fd, peer.outbox.data(), peer.outbox.size(), MSG_NOSIGNAL);
+    if (n > 0) {
+      peer.outbox.erase(0, static_cast<size_t>(n));
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+      return;
+    }
+    peer.peerClosed = true;
+    peer.outbox.clear();
+    return;
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const Options options = parseOptions(argc, argv);
+  signal(SIGINT, [](int) { gStop = 1; });
+  signal(SIGTERM, [](int) { gStop = 1; });
+
+  const int listener = listenOn(options.port);
+  if (listener < 0) {
+    perror("listen");
+    return 1;
+  }
+  setup();
+  if (!options.limits) {
+    server.setClientLimits(0, 0, 0);
+  }
+  printf("poot_host_lock: %s serving on port %u (key %s, %d client ip(s)%s)\n",
+         poot::kFirmwareVersion, static_cast<unsigned>(options.port),
+         LOCAL_SHARED_KEY, options.clientIps,
+         options.limits ? "" : ", no limits");
+  fflush(stdout);
+
+  std::vector<Peer> peers;
+  std::vector<pollfd> fds;
+  int nextIp = 0;
+  while (!gStop) {
+    fds.clear();
+    fds.push_back(pollfd{listener, POLLIN, 0});
+    for (const Peer& peer : peers) {
+      const short events = static_cast<short>(
+          (peer.peerClosed ? 0 : POLLIN) | (peer.outbox.empty() ? 0 : POLLOUT));
+      fds.push_back(pollfd{peer.fd, events, 0});
+    }
+    // A short wait keeps the sketch's own deadlines (timeouts, the relay)
+    // close to on time while idle.
+    poll(fds.data(), fds.size(), 1);
+
+    for (;;) {
+      sockaddr_in from = {};
+      socklen_t fromLength = sizeof(from);
+      const int fd =
+          accept(listener, reinterpret_cast<sockaddr*>(&from), &fromLength);
+      if (fd < 0) {
+        break;
+      }
+      setNonBlocking(fd);
+      const int one = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      const IPAddress remote(192, 168, 4,
+                             static_cast<uint8_t>(2 + nextIp));
+      nextIp = (nextIp + 1) % options.clientIps;
+      Peer peer = {fd,
+                   fake_net::asyncConnect(poot::kLocalHttpPort, remote,
+                                          ntohs(from.sin_port)),
+                   std::string(), false};
+      collect(peer);  // a refused connection already has its reply
+      peers.push_back(std::move(peer));
+    }
+
+    for (Peer& peer : peers) {
+      if (!peer.peerClosed) {
+        readFrom(peer);
+      }
+    }
+    loop();
+    for (Peer& peer : peers) {
+      collect(peer);
+      writeTo(peer);
+    }
+
+    for (size_t i = 0; i < peers.size();) {
+      Peer& peer = peers[i];
+      const bool done =
+          peer.peerClosed || (peer.id < 0 && peer.outbox.empty());
+      if (!done) {
+        i++;
+        continue;
+      }
+      if (peer.id >= 0 && fake_net::asyncOpen(peer.id)) {
+        fake_net::asyncPeerClose(peer.id);
+      }
+      close(peer.fd);
+      peers[i] = std::move(peers.back());
+      peers.pop_back();
+    }
+  }
+
+  for (Peer& peer : peers) {
+    close(peer.fd);
+  }
+  close(listener);
+  printf("poot_host_lock: served %lu request(s), shed %lu\n",
+         static_cast<unsigned long>(server.requestsServed()),
+         static_cast<unsigned long>(server.requestsShed() +
+                                    server.connectionsShed()));
+  return 0;
+}
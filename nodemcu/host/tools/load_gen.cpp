@@ -0,0 +1,581 @@
+// Drives the local HTTP API with concurrent clients and reports throughput,
+// latency percentiles, status codes and connection failures.
+//
+//   poot_load --host=192.168.4.1 --key=shared_local_key [--port=80]
+//             [--clients=4] [--duration-s=10]
+//             [--mix=root:1,health:4,unlock:1,bad_key:1] [--rate=0]
+//             [--keep-alive=1] [--timeout-ms=2000] [--seed=1]
+//             [--label=NAME] [--json=PATH]
+//
+// Each client is a thread with its own connection, picking routes at random
+// by the --mix weights (seeded, so a run can be repeated). With --rate=0 a
+// client sends its next request as soon as the last is answered; with
+// --rate=R it sends R per second on a fixed schedule and latency is measured
+// from the scheduled time, so a lock that falls behind is not flattered by
+// the client waiting for it. --json writes the results as one JSON object
+// ("-" for stdout) so runs against different firmware can be compared.
+//
+// Targets a real lock, or poot_host_lock (tools/host_lock.cpp) on
+// 127.0.0.1. Every request from one machine shares one client IP, so past
+// kHttpClientBurst requests the lock sheds them with 429 unless the host
+// build runs with --no-limits or --client-ips. Unlocks pulse the relay.
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+enum Route { kRoot, kHealth, kUnlock, kBadKey, kRouteCount };
+
+const char* const kRouteNames[kRouteCount] = {"root", "health", "unlock",
+                                              "bad_key"};
+
+struct Options {
+  const char* host = nullptr;
+  const char* key = nullptr;
+  uint16_t port = 80;
+  int clients = 4;
+  double durationS = 10;
+  int weights[kRouteCount] = {1, 4, 1, 1};
+  double rate = 0;
+  bool keepAlive = true;
+  int timeoutMs = 2000;
+  unsigned seed = 1;
+  const char* label = "";
+  const char* json = nullptr;
+};
+
+[[noreturn]] void usage(const char* argv0) {
+  fprintf(stderr,
+          "usage: %s --host=IP --key=KEY [--port=N] [--clients=N]\n"
+          "          [--duration-s=S] [--mix=root:W,health:W,unlock:W,"
+          "bad_key:W]\n"
+          "          [--rate=R] [--keep-alive=0|1] [--timeout-ms=N] "
+          "[--seed=N]\n"
+          "          [--label=NAME] [--json=PATH|-]\n",
+          argv0);
+  exit(2);
+}
+
+// "health:4,unlock:1": routes left out get weight 0.
+bool parseMix(const char* text, int (&weights)[kRouteCount]) {
+  int parsed[kRouteCount] = {};
+  int total = 0;
+  while (*text != '\0') {
+    const char* colon = strchr(text, ':');
+    if (colon == nullptr) {
+      return false;
+    }
+    const size_t nameLength = static_cast<size_t>(colon - text);
+    int route = -1;
+    for (int i = 0; i < kRouteCount; i++) {
+      if (strlen(kRouteNames[i]) == nameLength &&
+          strncmp(kRouteNames[i], text, nameLength) == 0) {
+        route = i;
+      }
+    }
+    char* end = nullptr;
+    const long weight = strtol(colon + 1, &end, 10);
+    if (route < 0 || end == colon + 1 || weight < 0 ||
+        (*end != ',' && *end != '\0')) {
+      return false;
+    }
+    parsed[route] = static_cast<int>(weight);
+    total += static_cast<int>(weight);
+    text = *end == ',' ? end + 1 : end;
+  }
+  if (total == 0) {
+    return false;
+  }
+  memcpy(weights, parsed, sizeof(parsed));
+  return true;
+}
+
+Options parseOptions(int argc, char** argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    const char* eq = strchr(arg, '=');
+    if (strncmp(arg, "--", 2) != 0 || eq == nullptr) {
+      usage(argv[0]);
+    }
+    const char* value = eq + 1;
+    const size_t nameLength = static_cast<size_t>(eq - arg);
+    const auto is = [&](const char* name) {
+      return strlen(name) == nameLength && strncmp(arg, name, nameLength) == 0;
+    };
+    if (is("--host")) {
+      options.host = value;
+    } else if (is("--key")) {
+      options.key = value;
+    } else if (is("--port")) {
+      options.port = static_cast<uint16_t>(atoi(value));
+    } else if (is("--clients")) {
+      options.clients = atoi(value);
+    } else if (is("--duration-s")) {
+      options.durationS = atof(value);
+    } else if (is("--mix")) {
+      if (!parseMix(value, options.weights)) {
+        usage(argv[0]);
+      }
+    } else if (is("--rate")) {
+      options.rate = atof(value);
+    } else if (is("--keep-alive")) {
+      options.keepAlive = atoi(value) != 0;
+    } else if (is("--timeout-ms")) {
+      options.timeoutMs = atoi(value);
+    } else if (is("--seed")) {
+      options.seed = static_cast<unsigned>(strtoul(value, nullptr, 10));
+    } else if (is("--label")) {
+      options.label = value;
+    } else if (is("--json")) {
+      options.json = value;
+    } else {
+      usage(argv[0]);
+    }
+  }
+  if (options.host == nullptr || options.key == nullptr ||
+      options.clients < 1 || options.durationS <= 0 || options.rate < 0 ||
+      options.timeoutMs < 1) {
+    usage(argv[0]);
+  }
+  return options;
+}
+
+struct Stats {
+  std::vector<double> latencyMs[kRouteCount];
+  std::map<int, uint64_t> statuses;
+  uint64_t connects = 0;
+  uint64_t connectFailures = 0;
+  uint64_t timeouts = 0;
+  uint64_t resets = 0;  // closed or reset before a full reply
+  uint64_t stale = 0;   // kept-alive connection gone before the request
+
+  void merge(const Stats& other) {
+    for (int i = 0; i < kRouteCount; i++) {
+      latencyMs[i].insert(latencyMs[i].end(), other.latencyMs[i].begin(),
+                          other.latencyMs[i].end());
+    }
+    for (const auto& entry : other.statuses) {
+      statuses[entry.first] += entry.second;
+    }
+    connects += other.connects;
+    connectFailures += other.connectFailures;
+    timeouts += other.timeouts;
+    resets += other.resets;
+    stale += other.stale;
+  }
+};
+
+int msUntil(Clock::time_point deadline) {
+  const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+      deadline - Clock::now());
+  return left.count() < 0 ? 0 : static_cast<int>(left.count());
+}
+
+// Non-blocking connect bounded by `deadline`; -1 on failure.
+int connectTo(const sockaddr_in& target, Clock::time_point deadline) {
+  const int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+  const int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  if (connect(fd, reinterpret_cast<const sockaddr*>(&target),
+              sizeof(target)) == 0) {
+    return fd;
+  }
+  if (errno == EINPROGRESS) {
+    pollfd pfd = {fd, POLLOUT, 0};
+    int error = 0;
+    socklen_t length = sizeof(error);
+    if (poll(&pfd, 1, msUntil(deadline)) == 1 &&
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) == 0 &&
+        error == 0) {
+      return fd;
+    }
+  }
+  close(fd);
+  return -1;
+}
+
+// kClosed: the connection ended before any reply byte, which on a reused
+// connection means the lock had already closed it (idle, or given its slot to
+// a new client).
+enum class Outcome { kReply, kTimeout, kReset, kClosed };
+
+struct Reply {
+  int status = 0;
+  bool keepAlive = false;
+};
+
+bool sendAll(int fd, const std::string& text, Clock::time_point deadline) {
+  size_t sent = 0;
+  while (sent < text.size()) {
+    const ssize_t n =
+        send(fd, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+    if (n > 0) {
+      sent += static_cast<size_t>(n);
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      pollfd pfd = {fd, POLLOUT, 0};
+      if (poll(&pfd, 1, msUntil(deadline)) != 1) {
+        return false;
+      }
+      continue;
+    }
+    return false;
+  }
+  return true;
+}
+
+// Case-insensitive header lookup in `head`; returns the value or nullptr.
+const char* findHeader(const std::string& head, const char* name) {
+  const size_t length = strlen(name);
+  for (size_t at = head.find("\r\n"); at != std::string::npos;
+       at = head.find("\r\n", at + 2)) {
+    if (strncasecmp(head.c_str() + at + 2, name, length) == 0) {
+      const char* value = head.c_str() + at + 2 + length;
+      while (*value == ' ') {
+        value++;
+      }
+      return value;
+    }
+  }
+  return nullptr;
+}
+
+// Reads one response: the head, then Content-Length bytes of body, or up to
+// the close when there is no length (streamed replies).
+Outcome readReply(int fd, Clock::time_point deadline, Reply& reply) {
+  std::string data;
+  size_t headEnd = std::string::npos;
+  long bodyLength = -1;
+  char buffer[2048];
+  for (;;) {
+    if (headEnd != std::string::npos && bodyLength >= 0 &&
+        data.size() >= headEnd + static_cast<size_t>(bodyLength)) {
+      return Outcome::kReply;
+    }
+    pollfd pfd = {fd, POLLIN, 0};
+    if (poll(&pfd, 1, msUntil(deadline)) != 1) {
+      return Outcome::kTimeout;
+    }
+    const ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+      continue;
+    }
+    if (n <= 0) {
+      // A reply without a length ends at the close.
+      if (headEnd != std::string::npos && bodyLength < 0) {
+        reply.keepAlive = false;
+        return Outcome::kReply;
+      }
+      return data.empty() ? Outcome::kClosed : Outcome::kReset;
+    }
+    data.append(buffer, static_cast<size_t>(n));
+    if (headEnd != std::string::npos) {
+      continue;
+    }
+    const size_t end = data.find("\r\n\r\n");
+    if (end == std::string::npos) {
+      continue;
+    }
+    headEnd = end + 4;
+    const std::string head = data.substr(0, end);
+    if (head.compare(0, 9, "HTTP/1.1 ") != 0 &&
+        head.compare(0, 9, "HTTP/1.0 ") != 0) {
+      return Outcome::kReset;
+    }
+    reply.status = atoi(head.c_str() + 9);
+    const char* length = findHeader(head, "Content-Length:");
+    bodyLength = length == nullptr ? -1 : atol(length);
+    const char* connection = findHeader(head, "Connection:");
+    reply.keepAlive =
+        connection != nullptr && strncasecmp(connection, "keep-alive", 10) == 0;
+  }
+}
+
+std::string requestText(Route route, const Options& options) {
+  std::string target;
+  switch (route) {
+    case kRoot:
+      target = "/";
+      break;
+    case kHealth:
+      target = std::string("/api/health?key=") + options.key;
+      break;
+    case kUnlock:
+      target = std::string("/api/local-unlock?key=") + options.key;
+      break;
+    default:
+      target = "/api/local-unlock?key=poot-load-bad-key";
+      break;
+  }
+  return "GET " + target + " HTTP/1.1\r\nHost: " + options.host + "\r\n" +
+         (options.keepAlive ? "" : "Connection: close\r\n") + "\r\n";
+}
+
+void runClient(int index, const Options& options, const sockaddr_in& target,
+               Clock::time_point end, Stats& stats) {
+  std::mt19937 random(options.seed + static_cast<unsigned>(index));
+  std::discrete_distribution<int> pick(options.weights,
+                                       options.weights + kRouteCount);
+  std::string texts[kRouteCount];
+  for (int i = 0; i < kRouteCount; i++) {
+    texts[i] = requestText(static_cast<Route>(i), options);
+  }
+  const auto interval = std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double>(options.rate > 0 ? 1.0 / options.rate
+                                                     : 0.0));
+  // Spread the clients' schedules over one interval.
+  Clock::time_point scheduled =
+      Clock::now() + interval * index / options.clients;
+
+  int fd = -1;
+  int used = 0;  // requests sent on `fd`
+  while (Clock::now() < end) {
+    if (options.rate > 0) {
+      if (scheduled >= end) {
+        break;
+      }
+      std::this_thread::sleep_until(scheduled);
+    }
+    const Clock::time_point start =
+        options.rate > 0 ? scheduled : Clock::now();
+    scheduled += interval;
+    const Clock::time_point deadline =
+        Clock::now() + std::chrono::milliseconds(options.timeoutMs);
+    const int route = pick(random);
+
+    Reply reply;
+    Outcome outcome = Outcome::kClosed;
+    // Like a browser, retry once on a fresh connection when a reused one
+    // turns out to be closed; that retry's time counts toward the latency.
+    for (int attempt = 0; attempt < 2 && outcome == Outcome::kClosed;
+         attempt++) {
+      if (fd < 0) {
+        fd = connectTo(target, deadline);
+        used = 0;
+        if (fd < 0) {
+          break;
+        }
+        stats.connects++;
+      }
+      const bool reused = used++ > 0;
+      outcome = sendAll(fd, texts[route], deadline)
+                    ? readReply(fd, deadline, reply)
+                    : Outcome::kClosed;
+      if (outcome == Outcome::kClosed && reused) {
+        stats.stale++;
+        close(fd);
+        fd = -1;
+      } else if (outcome == Outcome::kClosed) {
+        outcome = Outcome::kReset;
+      }
+    }
+    if (fd < 0 && outcome == Outcome::kClosed) {
+      stats.connectFailures++;
+      // Back off a little rather than spin on a refusing lock.
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      continue;
+    }
+    if (outcome == Outcome::kReply) {
+      stats.latencyMs[route].push_back(
+          std::chrono::duration<double, std::milli>(Clock::now() - start)
+              .count());
+      stats.statuses[reply.status]++;
+    } else if (outcome == Outcome::kTimeout) {
+      stats.timeouts++;
+    } else {
+      stats.resets++;
+    }
+    if (fd >= 0 && (outcome != Outcome::kReply || !reply.keepAlive)) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+double percentile(std::vector<double>& sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  const size_t rank = static_cast<size_t>(p * sorted.size() + 0.999999);
+  return sorted[rank == 0 ? 0 : rank - 1];
+}
+
+struct Summary {
+  size_t count;
+  double p50;
+  double p95;
+  double p99;
+  double max;
+};
+
+Summary summarize(std::vector<double>& samples) {
+  std::sort(samples.begin(), samples.end());
+  return Summary{samples.size(), percentile(samples, 0.50),
+                 percentile(samples, 0.95), percentile(samples, 0.99),
+                 samples.empty() ? 0 : samples.back()};
+}
+
+void printSummary(const char* name, const Summary& s) {
+  printf("%-10s %8zu %9.2f %9.2f %9.2f %9.2f\n", name, s.count, s.p50, s.p95,
+         s.p99, s.max);
+}
+
+void writeSummary(FILE* out, const Summary& s) {
+  fprintf(out,
+          "{\"count\":%zu,\"p50_ms\":%.3f,\"p95_ms\":%.3f,\"p99_ms\":%.3f,"
+          "\"max_ms\":%.3f}",
+          s.count, s.p50, s.p95, s.p99, s.max);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const Options options = parseOptions(argc, argv);
+  sockaddr_in target = {};
+  target.sin_family = AF_INET;
+  target.sin_port = htons(options.port);
+  if (inet_pton(AF_INET, options.host, &target.sin_addr) != 1) {
+    fprintf(stderr, "bad --host %s\n", options.host);
+    return 2;
+  }
+
+  std::vector<Stats> perClient(static_cast<size_t>(options.clients));
+  std::vector<std::thread> threads;
+  const Clock::time_point start = Clock::now();
+  const Clock::time_point end =
+      start + std::chrono::duration_cast<Clock::duration>(
+                  std::chrono::duration<double>(options.durationS));
+  for (int i = 0; i < options.clients; i++) {
+    threads.emplace_back(runClient, i, std::cref(options), std::cref(target),
+                         end, std::ref(perClient[static_cast<size_t>(i)]));
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  const double elapsedS =
+      std::chrono::duration<double>(Clock::now() - start).count();
+
+  Stats total;
+  for (const Stats& stats : perClient) {
+    total.merge(stats);
+  }
+  std::vector<double> all;
+  Summary routes[kRouteCount];
+  for (int i = 0; i < kRouteCount; i++) {
+    all.insert(all.end(), total.latencyMs[i].begin(),
+               total.latencyMs[i].end());
+    routes[i] = summarize(total.latencyMs[i]);
+  }
+  const Summary overall = summarize(all);
+  const double throughput = static_cast<double>(overall.count) / elapsedS;
+
+  printf("target %s:%u%s%s: %d client(s) for %.1f s, %s, rate %s\n",
+         options.host, static_cast<unsigned>(options.port),
+         options.label[0] != '\0' ? " label=" : "", options.label,
+         options.clients, elapsedS,
+         options.keepAlive ? "keep-alive" : "close",
+         options.rate > 0 ? "fixed" : "closed loop");
+  printf("%zu replies (%.1f/s), %llu connect(s), %llu connect failure(s), "
+         "%llu timeout(s), %llu reset(s), %llu stale keep-alive(s)\n",
+         overall.count, throughput,
+         static_cast<unsigned long long>(total.connects),
+         static_cast<unsigned long long>(total.connectFailures),
+         static_cast<unsigned long long>(total.timeouts),
+         static_cast<unsigned long long>(total.resets),
+         static_cast<unsigned long long>(total.stale));
+  printf("%-10s %8s %9s %9s %9s %9s\n", "route", "replies", "p50 ms",
+         "p95 ms", "p99 ms", "max ms");
+  printSummary("all", overall);
+  for (int i = 0; i < kRouteCount; i++) {
+    if (options.weights[i] > 0) {
+      printSummary(kRouteNames[i], routes[i]);
+    }
+  }
+  printf("status:");
+  for (const auto& entry : total.statuses) {
+    printf(" %d=%llu", entry.first,
+           static_cast<unsigned long long>(entry.second));
+  }
+  printf("\n");
+
+  if (options.json != nullptr) {
+    FILE* out =
+        strcmp(options.json, "-") == 0 ? stdout : fopen(options.json, "w");
+    if (out == nullptr) {
+      perror(options.json);
+      return 1;
+    }
+    fprintf(out,
+            "{\"label\":\"%s\",\"target\":\"%s:%u\",\"clients\":%d,"
+            "\"duration_s\":%.3f,\"keep_alive\":%s,\"rate\":%.3f,"
+            "\"seed\":%u,\"mix\":{",
+            options.label, options.host, static_cast<unsigned>(options.port),
+            options.clients, elapsedS, options.keepAlive ? "true" : "false",
+            options.rate, options.seed);
+    for (int i = 0; i < kRouteCount; i++) {
+      fprintf(out, "%s\"%s\":%d", i == 0 ? "" : ",", kRouteNames[i],
+              options.weights[i]);
+    }
+    fprintf(out, "},\"replies\":%zu,\"throughput_rps\":%.3f,\"latency\":",
+            overall.count, throughput);
+    writeSummary(out, overall);
+    fprintf(out, ",\"routes\":{");
+    bool first = true;
+    for (int i = 0; i < kRouteCount; i++) {
+      if (options.weights[i] == 0) {
+        continue;
+      }
+      fprintf(out, "%s\"%s\":", first ? "" : ",", kRouteNames[i]);
+      writeSummary(out, routes[i]);
+      first = false;
+    }
+    fprintf(out, "},\"status\":{");
+    first = true;
+    for (const auto& entry : total.statuses) {
+      fprintf(out, "%s\"%d\":%llu", first ? "" : ",", entry.first,
+              static_cast<unsigned long long>(entry.second));
+      first = false;
+    }
+    fprintf(out,
+            "},\"connects\":%llu,\"connect_failures\":%llu,"
+            "\"timeouts\":%llu,\"resets\":%llu,\"stale\":%llu}\n",
+            static_cast<unsigned long long>(total.connects),
+            static_cast<unsigned long long>(total.connectFailures),
+            static_cast<unsigned long long>(total.timeouts),
+            static_cast<unsigned long long>(total.resets),
+            static_cast<unsigned long long>(total.stale));
+    if (out != stdout) {
+      fclose(out);
+    }
+  }
+  return total.connectFailures == 0 && total.timeouts == 0 ? 0 : 1;
+}
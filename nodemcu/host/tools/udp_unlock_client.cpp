@@ -0,0 +1,211 @@
+// Sends single-datagram unlocks to a real lock and reports round-trip times.
+//
+//   poot_udp_client --host=192.168.4.1 --key=shared_local_key
+//                   [--lock-id=front-door] [--port=4210] [--count=5]
+//                   [--interval-ms=6000] [--retry-ms=150] [--retries=8]
+//
+// Each unlock is resent unchanged every --retry-ms until a reply arrives, the
+// way the app is meant to cope with loss. The first unlock after a lock boot
+// is answered with stale_epoch and resent with the new epoch; that exchange
+// is reported separately. Note every successful unlock pulses the relay, so
+// keep --interval-ms above the lock's cooldown to see "ok" replies.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "udp_protocol.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+  const char* host = nullptr;
+  const char* key = nullptr;
+  const char* lockId = "front-door";
+  uint16_t port = 4210;
+  int count = 5;
+  int intervalMs = 6000;
+  int retryMs = 150;
+  int retries = 8;
+};
+
+[[noreturn]] void usage(const char* argv0) {
+  fprintf(stderr,
+          "usage: %s --host=IP --key=KEY [--lock-id=ID] [--port=N]\n"
+          "          [--count=N] [--interval-ms=N] [--retry-ms=N] "
+          "[--retries=N]\n",
+          argv0);
+  exit(2);
+}
+
+Options parseOptions(int argc, char** argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    const char* eq = strchr(arg, '=');
+    if (strncmp(arg, "--", 2) != 0 || eq == nullptr) {
+      usage(argv[0]);
+    }
+    const char* value = eq + 1;
+    const size_t nameLength = static_cast<size_t>(eq - arg);
+    const auto is = [&](const char* name) {
+      return strlen(name) == nameLength && strncmp(arg, name, nameLength) == 0;
+    };
+    if (is("--host")) {
+      options.host = value;
+    } else if (is("--key")) {
+      options.key = value;
+    } else if (is("--lock-id")) {
+      options.lockId = value;
+    } else if (is("--port")) {
+      options.port = static_cast<uint16_t>(atoi(value));
+    } else if (is("--count")) {
+      options.count = atoi(value);
+    } else if (is("--interval-ms")) {
+      options.intervalMs = atoi(value);
+    } else if (is("--retry-ms")) {
+      options.retryMs = atoi(value);
+    } else if (is("--retries")) {
+      options.retries = atoi(value);
+    } else {
+      usage(argv[0]);
+    }
+  }
+  if (options.host == nullptr || options.key == nullptr) {
+    usage(argv[0]);
+  }
+  return options;
+}
+
+struct Exchange {
+  bool answered = false;
+  poot_udp::Reply reply = {};
+  int attempts = 0;
+  double ms = 0;
+};
+
+// Sends `request` until a matching, authentic reply arrives.
+Exchange exchange(int fd, const sockaddr_in& lock, const poot_udp::Key& key,
+                  const poot_udp::Request& request, const Options& options) {
+  uint8_t packet[poot_udp::kRequestBytes];
+  poot_udp::encodeRequest(key, request, packet);
+
+  Exchange result;
+  const Clock::time_point start = Clock::now();
+  for (int attempt = 0; attempt <= options.retries; attempt++) {
+    result.attempts = attempt + 1;
+    sendto(fd, packet, sizeof(packet), 0,
+           reinterpret_cast<const sockaddr*>(&lock), sizeof(lock));
+    const Clock::time_point deadline =
+        Clock::now() + std::chrono::milliseconds(options.retryMs);
+    for (;;) {
+      const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+          deadline - Clock::now());
+      if (left.count() <= 0) {
+        break;
+      }
+      pollfd pfd = {fd, POLLIN, 0};
+      if (poll(&pfd, 1, static_cast<int>(left.count())) <= 0) {
+        break;
+      }
+      uint8_t in[64];
+      const ssize_t n = recv(fd, in, sizeof(in), 0);
+      poot_udp::Reply reply;
+      if (n <= 0 ||
+          !poot_udp::decodeReply(key, in, static_cast<size_t>(n), reply) ||
+          reply.client != request.client ||
+          reply.counter != request.counter) {
+        continue;  // late reply to an earlier request, or noise
+      }
+      result.answered = true;
+      result.reply = reply;
+      result.ms = std::chrono::duration<double, std::milli>(Clock::now() -
+                                                            start)
+                      .count();
+      return result;
+    }
+  }
+  return result;
+}
+
+double percentile(std::vector<double> samples, double p) {
+  std::sort(samples.begin(), samples.end());
+  const size_t rank = static_cast<size_t>(p * samples.size() + 0.999999);
+  return samples[rank == 0 ? 0 : rank - 1];
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const Options options = parseOptions(argc, argv);
+
+  sockaddr_in lock = {};
+  lock.sin_family = AF_INET;
+  lock.sin_port = htons(options.port);
+  if (inet_pton(AF_INET, options.host, &lock.sin_addr) != 1) {
+    fprintf(stderr, "bad --host %s\n", options.host);
+    return 2;
+  }
+  const int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0) {
+    perror("socket");
+    return 1;
+  }
+
+  poot_udp::Key key;
+  poot_udp::initKey(key, options.key);
+  std::random_device random;
+  poot_udp::Request request = {};
+  request.client = random();
+  poot_udp::setLockId(request, options.lockId);
+
+  std::vector<double> samples;
+  int lost = 0;
+  for (int i = 0; i < options.count; i++) {
+    if (i > 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(options.intervalMs));
+    }
+    request.counter++;
+    Exchange result = exchange(fd, lock, key, request, options);
+    if (result.answered &&
+        result.reply.status == poot_udp::Status::kStaleEpoch) {
+      printf("epoch sync: %.2f ms (%d attempt(s)) epoch=%08x\n", result.ms,
+             result.attempts, static_cast<unsigned>(result.reply.epoch));
+      request.epoch = result.reply.epoch;
+      request.counter++;
+      result = exchange(fd, lock, key, request, options);
+    }
+    if (!result.answered) {
+      lost++;
+      printf("unlock %d: no reply after %d attempt(s)\n", i + 1,
+             result.attempts);
+      continue;
+    }
+    samples.push_back(result.ms);
+    printf("unlock %d: %s in %.2f ms (%d attempt(s)) window=%u ms\n", i + 1,
+           poot_udp::statusName(result.reply.status), result.ms,
+           result.attempts, static_cast<unsigned>(result.reply.windowMs));
+  }
+  close(fd);
+
+  if (!samples.empty()) {
+    printf("%zu answered, %d lost: p50=%.2f ms p99=%.2f ms max=%.2f ms\n",
+           samples.size(), lost, percentile(samples, 0.50),
+           percentile(samples, 0.99),
+           *std::max_element(samples.begin(), samples.end()));
+  }
+  return lost == 0 ? 0 : 1;
+}
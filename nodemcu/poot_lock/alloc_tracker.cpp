@@ -0,0 +1,323 @@
+#include "alloc_tracker.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <new>
+
+#include "diagnostics.h"
+
+// The C library's own allocator when linked with --wrap (see
+// alloc_tracker.h). Weak, so a link without it leaves them null and the
+// __wrap_ functions below unused.
+extern "C" {
+void* __real_malloc(size_t size) __attribute__((weak));
+void* __real_calloc(size_t count, size_t size) __attribute__((weak));
+void* __real_realloc(void* p, size_t size) __attribute__((weak));
+void __real_free(void* p) __attribute__((weak));
+}
+
+namespace poot_alloc {
+
+namespace {
+
+// The loop() ("cont") stack on the ESP8266 Arduino core.
+constexpr uint32_t kContStackBytes = 4096;
+
+// Prepended to every block while tracking. Padded to the platform's
+// strictest alignment so the block after it stays aligned like malloc()'s.
+struct Header {
+  uint32_t size;
+  ScopeId scope;
+};
+
+constexpr size_t kHeaderBytes =
+    (sizeof(Header) + alignof(max_align_t) - 1) / alignof(max_align_t) *
+    alignof(max_align_t);
+
+// Without the operator new replacement no block has a header, so the
+// tracking mode must not depend on which definition the linker picked.
+constexpr bool kTagBlocks = poot::kEnableAllocTracking && POOT_ALLOC_HOOKS;
+
+bool mallocWrapped() { return __real_malloc != nullptr; }
+
+// Beneath the hooks: malloc itself, not its wrapper.
+void* rawMalloc(size_t size) {
+  return mallocWrapped() ? __real_malloc(size) : malloc(size);
+}
+
+void rawFree(void* p) {
+  if (mallocWrapped()) {
+    __real_free(p);
+  } else {
+    free(p);
+  }
+}
+
+ScopeStats gScopes[poot::kAllocScopes] = {{"other", 0, 0, 0, 0, 0, 0, 0, 0,
+                                           kScopeDefault}};
+uint8_t gScopeCount = 1;
+Totals gTotals = {};
+Scope* gCurrent = nullptr;
+uint32_t gWindowStartMs = 0;
+
+}  // namespace
+
+// operator new/delete and the malloc wrappers land here; a class so it can
+// reach Scope's state.
+class Hooks {
+ public:
+  static void* allocate(size_t size) {
+    gTotals.allocs++;
+    gTotals.bytes += size;
+    if (!kTagBlocks) {
+      return rawMalloc(size == 0 ? 1 : size);
+    }
+    uint8_t* raw = static_cast<uint8_t*>(rawMalloc(kHeaderBytes + size));
+    if (raw == nullptr) {
+      return nullptr;
+    }
+    const ScopeId id = currentId();
+    Header* header = reinterpret_cast<Header*>(raw);
+    header->size = static_cast<uint32_t>(size);
+    header->scope = id;
+    ScopeStats& stats = gScopes[id];
+    stats.allocs++;
+    stats.bytes += size;
+    stats.liveBytes += static_cast<int32_t>(size);
+    gTotals.liveBytes += static_cast<int32_t>(size);
+    noteHeap();
+    return raw + kHeaderBytes;
+  }
+
+  static void release(void* p) {
+    if (p == nullptr) {
+      return;
+    }
+    gTotals.frees++;
+    if (!kTagBlocks) {
+      rawFree(p);
+      return;
+    }
+    uint8_t* raw = static_cast<uint8_t*>(p) - kHeaderBytes;
+    const Header* header = reinterpret_cast<const Header*>(raw);
+    ScopeStats& stats = gScopes[header->scope];
+    stats.frees++;
+    stats.liveBytes -= static_cast<int32_t>(header->size);
+    gTotals.liveBytes -= static_cast<int32_t>(header->size);
+    rawFree(raw);
+  }
+
+  // A malloc-family block of `size` bytes, which carries no header.
+  static void countMalloc(size_t size) {
+    gTotals.allocs++;
+    gTotals.bytes += size;
+    if (!poot::kEnableAllocTracking) {
+      return;
+    }
+    ScopeStats& stats = gScopes[currentId()];
+    stats.allocs++;
+    stats.bytes += size;
+    noteHeap();
+  }
+
+  static void countFree() {
+    gTotals.frees++;
+    if (poot::kEnableAllocTracking) {
+      gScopes[currentId()].frees++;
+    }
+  }
+
+ private:
+  static ScopeId currentId() {
+    return gCurrent == nullptr ? kUnattributed : gCurrent->id_;
+  }
+
+  static void noteHeap() {
+    if (gCurrent != nullptr) {
+      const uint32_t freeHeap = ESP.getFreeHeap();
+      if (freeHeap < gCurrent->minFreeHeap_) {
+        gCurrent->minFreeHeap_ = freeHeap;
+      }
+    }
+  }
+};
+
+ScopeId registerScope(const char* name, uint8_t flags) {
+  if (!poot::kEnableAllocTracking) {
+    return kUnattributed;
+  }
+  for (uint8_t i = 0; i < gScopeCount; i++) {
+    if (strcmp(gScopes[i].name, name) == 0) {
+      gScopes[i].flags |= flags;
+      return i;
+    }
+  }
+  if (gScopeCount >= poot::kAllocScopes) {
+    poot_diag::logf("ALLOC", "scope table full, %s charged to other", name);
+    return kUnattributed;
+  }
+  ScopeStats& stats = gScopes[gScopeCount];
+  memset(&stats, 0, sizeof(stats));
+  stats.name = name;
+  stats.flags = flags;
+  return gScopeCount++;
+}
+
+Scope::Scope(ScopeId id)
+    : id_(id),
+      parent_(gCurrent),
+      freeHeapAtEntry_(0),
+      minFreeHeap_(0),
+      minFreeStack_(UINT32_MAX) {
+  if (!poot::kEnableAllocTracking) {
+    return;
+  }
+  gCurrent = this;
+  freeHeapAtEntry_ = ESP.getFreeHeap();
+  minFreeHeap_ = freeHeapAtEntry_;
+  if (gScopes[id_].flags & kMeasureStack) {
+    // The repaint below hides how deep the enclosing scope got so far.
+    if (parent_ != nullptr) {
+      const uint32_t freeStack = ESP.getFreeContStack();
+      if (freeStack < parent_->minFreeStack_) {
+        parent_->minFreeStack_ = freeStack;
+      }
+    }
+    ESP.resetFreeContStack();
+  }
+}
+
+Scope::~Scope() {
+  if (!poot::kEnableAllocTracking) {
+    return;
+  }
+  gCurrent = parent_;
+  const uint32_t freeHeap = ESP.getFreeHeap();
+  if (freeHeap < minFreeHeap_) {
+    minFreeHeap_ = freeHeap;
+  }
+  ScopeStats& stats = gScopes[id_];
+  stats.calls++;
+  stats.heapDelta += static_cast<int32_t>(freeHeapAtEntry_ - freeHeap);
+  const uint32_t peak = freeHeapAtEntry_ - minFreeHeap_;
+  if (peak > stats.peakBytes) {
+    stats.peakBytes = peak;
+  }
+  if (stats.flags & kMeasureStack) {
+    const uint32_t freeStack = ESP.getFreeContStack();
+    if (freeStack < minFreeStack_) {
+      minFreeStack_ = freeStack;
+    }
+    const uint32_t used =
+        minFreeStack_ < kContStackBytes ? kContStackBytes - minFreeStack_ : 0;
+    if (used > stats.maxStackBytes) {
+      stats.maxStackBytes = static_cast<uint16_t>(used);
+    }
+  }
+  if (parent_ != nullptr) {
+    if (minFreeHeap_ < parent_->minFreeHeap_) {
+      parent_->minFreeHeap_ = minFreeHeap_;
+    }
+    if (minFreeStack_ < parent_->minFreeStack_) {
+      parent_->minFreeStack_ = minFreeStack_;
+    }
+  }
+}
+
+uint8_t scopeCount() { return gScopeCount; }
+
+const ScopeStats& scope(uint8_t index) {
+  return gScopes[index < gScopeCount ? index : 0];
+}
+
+const Totals& totals() { return gTotals; }
+
+uint32_t windowMs() { return millis() - gWindowStartMs; }
+
+void reset() {
+  for (uint8_t i = 0; i < gScopeCount; i++) {
+    ScopeStats& stats = gScopes[i];
+    stats.calls = 0;
+    stats.allocs = 0;
+    stats.frees = 0;
+    stats.bytes = 0;
+    stats.peakBytes = 0;
+    stats.heapDelta = 0;
+    stats.maxStackBytes = 0;
+  }
+  gWindowStartMs = millis();
+}
+
+bool hooksInstalled() { return POOT_ALLOC_HOOKS != 0 || mallocWrapped(); }
+
+}  // namespace poot_alloc
+
+// Reached in place of malloc and friends only when the link wraps them.
+extern "C" {
+
+void* __wrap_malloc(size_t size) {
+  void* p = __real_malloc(size);
+  if (p != nullptr) {
+    poot_alloc::Hooks::countMalloc(size);
+  }
+  return p;
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+  void* p = __real_calloc(count, size);
+  if (p != nullptr) {
+    poot_alloc::Hooks::countMalloc(count * size);
+  }
+  return p;
+}
+
+// Counted as a free of the old block and an allocation of the new one, as
+// the core's String grows by realloc.
+void* __wrap_realloc(void* old, size_t size) {
+  void* p = __real_realloc(old, size);
+  if (old != nullptr && (p != nullptr || size == 0)) {
+    poot_alloc::Hooks::countFree();
+  }
+  if (p != nullptr && size != 0) {
+    poot_alloc::Hooks::countMalloc(size);
+  }
+  return p;
+}
+
+void __wrap_free(void* p) {
+  if (p != nullptr) {
+    poot_alloc::Hooks::countFree();
+  }
+  __real_free(p);
+}
+
+}  // extern "C"
+
+#if POOT_ALLOC_HOOKS
+// Global replacements: every C++ allocation in the image (String,
+// std::function, the SDK's C++ wrappers) is counted and attributed.
+void* operator new(size_t size) {
+  void* p = poot_alloc::Hooks::allocate(size);
+  if (p == nullptr) {
+    abort();  // the core builds without exceptions
+  }
+  return p;
+}
+void* operator new[](size_t size) { return operator new(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  return poot_alloc::Hooks::allocate(size);
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  return poot_alloc::Hooks::allocate(size);
+}
+void operator delete(void* p) noexcept { poot_alloc::Hooks::release(p); }
+void operator delete[](void* p) noexcept { poot_alloc::Hooks::release(p); }
+void operator delete(void* p, size_t) noexcept {
+  poot_alloc::Hooks::release(p);
+}
+void operator delete[](void* p, size_t) noexcept {
+  poot_alloc::Hooks::release(p);
+}
+#endif  // POOT_ALLOC_HOOKS
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "config.h"
+
+// Allocations are counted two ways:
+//
+// - malloc/calloc/realloc/free, when the image is linked with
+//   -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free (see the
+//   README). This works with the stock core and sees String, the core's
+//   operator new (it calls malloc) and any library code that calls malloc.
+//   The SDK's own os_malloc/pvPortMalloc calls are not seen.
+// - operator new/delete replaced here, with POOT_ALLOC_HOOKS. The ESP8266
+//   core defines those itself (abi.cpp), so this is for the host, or a core
+//   built without them (-DPOOT_ALLOC_HOOKS=1).
+//
+// With neither, scopes still report calls, free-heap deltas and stack
+// depth, but no allocation counts.
+#ifndef POOT_ALLOC_HOOKS
+#ifdef ARDUINO_ARCH_ESP8266
+#define POOT_ALLOC_HOOKS 0
+#else
+#define POOT_ALLOC_HOOKS 1
+#endif
+#endif
+
+namespace poot_alloc {
+
+// Heap and stack accounting per code path, served at /api/alloc.
+//
+// Every wrapped malloc and every replaced operator new in the image goes
+// through this module. With kEnableAllocTracking, a block from operator new
+// also carries a small header naming the scope that allocated it, so a
+// block freed later (or elsewhere) is still charged to its owner and
+// `liveBytes` shows what a scope is holding on to. malloc blocks get no
+// header, since the core and libraries free each other's blocks: they are
+// charged to the scope current when they are allocated, and their frees to
+// the scope current when they are freed. Without kEnableAllocTracking only
+// the process-wide totals are counted.
+//
+// A Scope is entered around a handler (HTTP route, scheduler task, WiFi
+// event, the OTA/mDNS pumps) and makes it the owner of allocations until it
+// exits; scopes nest and the innermost one is charged. Entering one also
+// samples ESP.getFreeHeap() so allocations made by the SDK show up in
+// `heapDelta` and `peakBytes` even though they bypass the hooks.
+
+using ScopeId = uint8_t;
+
+// Allocations outside any scope (setup(), SDK callbacks between scopes).
+static constexpr ScopeId kUnattributed = 0;
+
+enum ScopeFlags : uint8_t {
+  kScopeDefault = 0,
+  // Also measure the deepest cont stack use per call. Costs a repaint and a
+  // scan of the free stack (tens of microseconds), so it is meant for
+  // handlers, not for pumps that run every loop() pass.
+  kMeasureStack = 0x01,
+};
+
+struct ScopeStats {
+  const char* name;
+  uint32_t calls;
+  uint32_t allocs;
+  uint32_t frees;      // see above for which scope a free is charged to
+  uint32_t bytes;      // requested through malloc or operator new
+  int32_t liveBytes;   // operator new blocks allocated here, not freed yet
+  uint32_t peakBytes;  // largest drop in free heap during one call
+  int32_t heapDelta;   // free heap lost (+) or regained (-) across calls
+  uint16_t maxStackBytes;
+  uint8_t flags;
+};
+
+struct Totals {
+  uint64_t allocs;
+  uint64_t frees;
+  uint64_t bytes;
+  int32_t liveBytes;  // operator new blocks, with kEnableAllocTracking
+};
+
+// Returns the id for `name` (a string literal), registering it on first use.
+// Falls back to kUnattributed when tracking is off, or (logged) when the
+// table is full.
+ScopeId registerScope(const char* name, uint8_t flags = kScopeDefault);
+
+class Scope {
+ public:
+  explicit Scope(ScopeId id);
+  ~Scope();
+
+  Scope(const Scope&) = delete;
+  Scope& operator=(const Scope&) = delete;
+
+ private:
+  friend class Hooks;
+
+  ScopeId id_;
+  Scope* parent_;
+  uint32_t freeHeapAtEntry_;
+  uint32_t minFreeHeap_;
+  uint32_t minFreeStack_;
+};
+
+// Whether malloc is wrapped or operator new replaced (see the top of this
+// file).
+bool hooksInstalled();
+
+uint8_t scopeCount();
+const ScopeStats& scope(uint8_t index);
+const Totals& totals();
+uint32_t windowMs();
+
+// Zeroes the per-scope counters (not liveBytes) and starts a new window.
+void reset();
+
+}  // namespace poot_alloc
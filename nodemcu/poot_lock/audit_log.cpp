@@ -0,0 +1,264 @@
+#include "audit_log.h"
+
+#include <LittleFS.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "diagnostics.h"
+
+namespace poot_audit {
+
+namespace {
+
+constexpr const char* kRingPath = "/audit.ring";
+constexpr uint32_t kMagic = 0x50415544;  // "PAUD"
+constexpr uint8_t kLayoutVersion = 1;
+constexpr uint8_t kSlots = poot::kAuditQueueEvents;
+
+struct RingHeader {
+  uint32_t magic;
+  uint32_t layout;
+  uint32_t ringId;
+  uint32_t ackedSeq;
+};
+
+static_assert(sizeof(Event) == 36, "Event is packed by hand");
+static_assert(sizeof(RingHeader) == 16, "RingHeader is packed by hand");
+static_assert(poot::kAuditStagingEvents > 0 &&
+                  poot::kAuditStagingEvents <= poot::kAuditQueueEvents,
+              "staging must fit in the queue");
+
+constexpr uint32_t kLayout = (static_cast<uint32_t>(kLayoutVersion) << 24) |
+                             (sizeof(Event) << 8) | kSlots;
+constexpr size_t kRingBytes = sizeof(RingHeader) + kSlots * sizeof(Event);
+
+uint16_t eventCheck(const Event& event) {
+  uint32_t hash = 2166136261u;
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&event);
+  for (size_t i = 0; i < sizeof(Event); i++) {
+    if (i == offsetof(Event, check) || i == offsetof(Event, check) + 1) {
+      continue;
+    }
+    hash ^= bytes[i];
+    hash *= 16777619u;
+  }
+  return static_cast<uint16_t>(hash ^ (hash >> 16));
+}
+
+size_t slotOffset(uint32_t seq) {
+  return sizeof(RingHeader) + (seq % kSlots) * sizeof(Event);
+}
+
+}  // namespace
+
+const char* sourceName(uint8_t source) {
+  switch (static_cast<Source>(source)) {
+    case Source::kLocalHttp: return "local_http";
+    case Source::kUdp:       return "udp";
+    case Source::kCloud:     return "cloud";
+    default:                 return "unknown";
+  }
+}
+
+const char* outcomeName(uint8_t outcome) {
+  switch (static_cast<Outcome>(outcome)) {
+    case Outcome::kUnlocked:      return "unlocked";
+    case Outcome::kCooldown:      return "denied_cooldown";
+    case Outcome::kUnknownAction: return "unknown_action";
+    case Outcome::kCoalesced:     return "coalesced";
+    case Outcome::kQueued:        return "queued";
+    default:                      return "unknown";
+  }
+}
+
+void AuditLog::begin() {
+  flashReady_ = LittleFS.begin();
+  oldestPendingMs_ = millis();
+  if (!flashReady_) {
+    poot_diag::logf("AUDIT", "flash unavailable, queue of %u in RAM",
+                    kStaging);
+    return;
+  }
+  File file = LittleFS.open(kRingPath, "r");
+  RingHeader header = {};
+  const bool usable =
+      file && file.size() == kRingBytes &&
+      file.read(reinterpret_cast<uint8_t*>(&header), sizeof(header)) ==
+          static_cast<int>(sizeof(header)) &&
+      header.magic == kMagic && header.layout == kLayout;
+  if (!usable) {
+    if (file) {
+      file.close();
+    }
+    createRing();
+    return;
+  }
+  ringId_ = header.ringId;
+  ackedSeq_ = header.ackedSeq;
+  uint32_t lastSeq = ackedSeq_;
+  for (uint8_t i = 0; i < kSlots; i++) {
+    Event event;
+    if (file.read(reinterpret_cast<uint8_t*>(&event), sizeof(event)) !=
+        static_cast<int>(sizeof(event))) {
+      break;
+    }
+    if (event.seq != 0 && event.check == eventCheck(event) &&
+        event.seq > lastSeq) {
+      lastSeq = event.seq;
+    }
+  }
+  file.close();
+  nextSeq_ = lastSeq + 1;
+  stagedSeq_ = nextSeq_;
+  firstSeqThisBoot_ = nextSeq_;
+  trim();
+  poot_diag::logf("AUDIT", "ring %08lx next=%lu pending=%lu",
+                  (unsigned long)ringId_, (unsigned long)nextSeq_,
+                  (unsigned long)pending());
+}
+
+void AuditLog::createRing() {
+  ringId_ = ESP.random();
+  ackedSeq_ = 0;
+  nextSeq_ = stagedSeq_ = firstSeqThisBoot_ = 1;
+  File file = LittleFS.open(kRingPath, "w");
+  if (!file) {
+    flashReady_ = false;
+    poot_diag::logf("AUDIT", "ring create failed, queue of %u in RAM",
+                    kStaging);
+    return;
+  }
+  const RingHeader header = {kMagic, kLayout, ringId_, ackedSeq_};
+  file.write(reinterpret_cast<const uint8_t*>(&header), sizeof(header));
+  const Event empty = {};
+  for (uint8_t i = 0; i < kSlots; i++) {
+    file.write(reinterpret_cast<const uint8_t*>(&empty), sizeof(empty));
+  }
+  file.close();
+  poot_diag::logf("AUDIT", "ring %08lx created slots=%u",
+                  (unsigned long)ringId_, kSlots);
+}
+
+void AuditLog::record(Source source, Outcome outcome, const char* ref) {
+  if (flashReady_ && nextSeq_ - stagedSeq_ >= kStaging) {
+    persist();  // loop() has not caught up; rare, so write inline
+  }
+  Event& event = staging_[nextSeq_ % kStaging];
+  memset(&event, 0, sizeof(event));
+  event.seq = nextSeq_++;
+  event.uptimeMs = millis();
+  event.source = static_cast<uint8_t>(source);
+  event.outcome = static_cast<uint8_t>(outcome);
+  snprintf(event.ref, sizeof(event.ref), "%s", ref != nullptr ? ref : "");
+  event.check = eventCheck(event);
+  recorded_++;
+  if (pending() == 1) {
+    oldestPendingMs_ = event.uptimeMs;
+  }
+  trim();
+}
+
+void AuditLog::persist() {
+  if (!flashReady_ || stagedSeq_ == nextSeq_) {
+    return;
+  }
+  File file = LittleFS.open(kRingPath, "r+");
+  if (!file) {
+    return;  // stays staged; trim() drops it if the queue overflows
+  }
+  for (; stagedSeq_ != nextSeq_; stagedSeq_++) {
+    const Event& event = staging_[stagedSeq_ % kStaging];
+    if (!file.seek(slotOffset(stagedSeq_)) ||
+        file.write(reinterpret_cast<const uint8_t*>(&event), sizeof(event)) !=
+            sizeof(event)) {
+      break;
+    }
+  }
+  file.close();
+}
+
+uint32_t AuditLog::capacity() const {
+  return flashReady_ ? kSlots : kStaging;
+}
+
+void AuditLog::trim() {
+  const uint32_t limit = capacity();
+  if (pending() <= limit) {
+    return;
+  }
+  // Still a full batch pending, so the flush window no longer matters.
+  const uint32_t lost = pending() - limit;
+  ackedSeq_ += lost;
+  dropped_ += lost;
+  if (dropped_ == lost || dropped_ / kSlots != (dropped_ - lost) / kSlots) {
+    // Once per queue's worth rather than per event.
+    poot_diag::logf("AUDIT", "queue full, dropped=%lu",
+                    (unsigned long)dropped_);
+  }
+}
+
+uint8_t AuditLog::peek(Event* out, uint8_t max) {
+  File file;
+  uint8_t count = 0;
+  for (uint32_t seq = ackedSeq_ + 1; seq != nextSeq_ && count < max; seq++) {
+    Event& event = out[count];
+    if (!flashReady_ || seq >= stagedSeq_) {
+      event = staging_[seq % kStaging];
+    } else {
+      if (!file) {
+        file = LittleFS.open(kRingPath, "r");
+      }
+      if (!file || !file.seek(slotOffset(seq)) ||
+          file.read(reinterpret_cast<uint8_t*>(&event), sizeof(event)) !=
+              static_cast<int>(sizeof(event))) {
+        event.seq = 0;
+      }
+    }
+    if (event.seq == seq && event.check == eventCheck(event)) {
+      count++;
+    } else if (count == 0) {
+      ackedSeq_ = seq;  // unreadable at the head; nothing can ever send it
+      dropped_++;
+    }
+  }
+  if (file) {
+    file.close();
+  }
+  return count;
+}
+
+void AuditLog::ack(uint32_t seq) {
+  if (static_cast<int32_t>(seq - ackedSeq_) <= 0 ||
+      static_cast<int32_t>(seq - nextSeq_) >= 0) {
+    return;
+  }
+  written_ += seq - ackedSeq_;
+  ackedSeq_ = seq;
+  updateOldestPending();
+  if (!flashReady_) {
+    return;
+  }
+  File file = LittleFS.open(kRingPath, "r+");
+  if (file && file.seek(offsetof(RingHeader, ackedSeq))) {
+    file.write(reinterpret_cast<const uint8_t*>(&ackedSeq_),
+               sizeof(ackedSeq_));
+  }
+  if (file) {
+    file.close();
+  }
+}
+
+void AuditLog::updateOldestPending() {
+  Event oldest;
+  if (pending() > 0 && peek(&oldest, 1) == 1 && thisBoot(oldest)) {
+    oldestPendingMs_ = oldest.uptimeMs;
+  }
+}
+
+void AuditLog::key(const Event& event, char (&out)[17]) const {
+  snprintf(out, sizeof(out), "%08lx%08lx", (unsigned long)ringId_,
+           (unsigned long)event.seq);
+}
+
+}  // namespace poot_audit
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "config.h"
+
+namespace poot_audit {
+
+// Outcomes of unlock requests that got past authentication, queued until
+// they are written to /locks/{lockId}/audit (firebase_client.h does the
+// writing). Rejected credentials are only logged; a flood of them would push
+// real events out of the queue.
+//
+// record() copies the event into a small RAM staging ring and returns, so an
+// unlock never waits on flash. persist(), from loop(), moves staged events
+// into a ring file of fixed slots on LittleFS, where they outlive WiFi
+// outages and resets until ack()ed. When the queue is full the oldest
+// unwritten event is dropped. Without flash the staging ring is the queue.
+//
+// Sequence numbers carry on across reboots. With the ring file's random id
+// they make up each event's database key, so a batch that is written again
+// after a lost reply overwrites the same children.
+
+enum class Source : uint8_t {
+  kLocalHttp,
+  kUdp,
+  kCloud,
+  kCount,
+};
+
+enum class Outcome : uint8_t {
+  kUnlocked,
+  kCooldown,  // authenticated, but the relay was cooling down
+  kUnknownAction,
+  kCoalesced,  // joined the pulse already running
+  kQueued,     // fired when the cooldown ended
+  kCount,
+};
+
+const char* sourceName(uint8_t source);
+const char* outcomeName(uint8_t outcome);
+
+struct Event {
+  uint32_t seq;       // 0 marks an empty slot
+  uint32_t uptimeMs;  // millis() when it happened
+  uint8_t source;     // Source
+  uint8_t outcome;    // Outcome
+  uint16_t check;
+  char ref[24];       // cloud command id; empty for local requests
+};
+
+class AuditLog {
+ public:
+  // Opens the ring file, or starts a new one if it is missing or from
+  // another layout. Mounts LittleFS if nothing has yet.
+  void begin();
+
+  void record(Source source, Outcome outcome, const char* ref = "");
+  bool needsPersist() const { return stagedSeq_ != nextSeq_; }
+  void persist();
+
+  uint32_t pending() const { return nextSeq_ - 1 - ackedSeq_; }
+  // millis() when the oldest pending event was queued (when this boot
+  // started, for events left by an earlier one).
+  uint32_t oldestPendingMs() const { return oldestPendingMs_; }
+  // Copies up to `max` of the oldest pending events into `out`, oldest
+  // first. Events that can no longer be read are skipped (and dropped when
+  // they are the oldest).
+  uint8_t peek(Event* out, uint8_t max);
+  // Everything up to and including `seq` has been written.
+  void ack(uint32_t seq);
+
+  // Whether `event.uptimeMs` is on this boot's millis() clock.
+  bool thisBoot(const Event& event) const {
+    return event.seq >= firstSeqThisBoot_;
+  }
+  // The event's database key: ring id and sequence number, 8 hex digits
+  // each.
+  void key(const Event& event, char (&out)[17]) const;
+
+  bool persistent() const { return flashReady_; }
+  uint32_t recorded() const { return recorded_; }
+  uint32_t dropped() const { return dropped_; }
+  uint32_t written() const { return written_; }
+
+ private:
+  static constexpr uint8_t kStaging = poot::kAuditStagingEvents;
+
+  void createRing();
+  uint32_t capacity() const;
+  // Drops whatever no longer fits in the queue.
+  void trim();
+  void updateOldestPending();
+
+  bool flashReady_ = false;
+  uint32_t ringId_ = 0;
+  uint32_t nextSeq_ = 1;
+  uint32_t stagedSeq_ = 1;  // first sequence number not yet on flash
+  uint32_t ackedSeq_ = 0;
+  uint32_t firstSeqThisBoot_ = 1;
+  uint32_t oldestPendingMs_ = 0;
+  Event staging_[kStaging] = {};
+
+  uint32_t recorded_ = 0;
+  uint32_t dropped_ = 0;
+  uint32_t written_ = 0;
+};
+
+}  // namespace poot_audit
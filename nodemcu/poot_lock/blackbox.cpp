@@ -0,0 +1,393 @@
+#include "blackbox.h"
+
+#include <LittleFS.h>
+#include <stddef.h>
+
+extern "C" {
+#include <user_interface.h>
+}
+
+#include "config.h"
+#include "diagnostics.h"
+
+namespace poot_blackbox {
+
+namespace {
+
+constexpr uint8_t kCounterCount = static_cast<uint8_t>(Counter::kCount);
+
+// The first 128 bytes of RTC user memory belong to eboot (OTA commands),
+// the last few to the STA join cache.
+constexpr uint32_t kRtcBaseBlock = 32;
+constexpr size_t kRtcBytes = (poot::kRtcStaJoinBlock - kRtcBaseBlock) * 4;
+constexpr uint32_t kMagic = 0x504f4f54;  // "POOT"
+constexpr uint8_t kLayoutVersion = 2;
+
+// Enough argument bytes for a couple of numbers or a short string; longer
+// records are cut and their remaining arguments render as '?'.
+constexpr size_t kSlotRecordBytes = poot_diag::kRecordHeaderBytes + 24;
+
+struct RtcHeader {
+  uint32_t magic;
+  uint32_t layout;
+  uint32_t buildId;
+  uint32_t uptimeMs;
+  uint32_t counters[kCounterCount];
+  RebootRecord reboots[kRebootHistory];
+};
+
+struct RtcSlot {
+  uint32_t seq;  // 0 = empty
+  uint16_t length;
+  uint16_t check;
+  uint8_t record[kSlotRecordBytes];
+};
+
+constexpr uint8_t kSlotCount =
+    static_cast<uint8_t>((kRtcBytes - sizeof(RtcHeader)) / sizeof(RtcSlot));
+
+struct RtcImage {
+  RtcHeader header;
+  RtcSlot slots[kSlotCount];
+};
+
+static_assert(sizeof(RebootRecord) == 8, "RebootRecord is packed by hand");
+static_assert(sizeof(RtcImage) <= kRtcBytes, "blackbox exceeds RTC memory");
+static_assert(sizeof(RtcHeader) % 4 == 0 && sizeof(RtcSlot) % 4 == 0,
+              "RTC memory is addressed in 4-byte blocks");
+static_assert(kSlotCount >= 4, "too few blackbox slots");
+
+constexpr uint32_t kLayout = (static_cast<uint32_t>(kLayoutVersion) << 24) |
+                             (sizeof(RtcSlot) << 8) | kSlotCount;
+
+constexpr const char* kFlashLogPath = "/blackbox.log";
+constexpr const char* kFlashOldPath = "/blackbox.old";
+
+RtcImage gPrevious;
+uint8_t gPreviousOrder[kSlotCount];
+uint8_t gPreviousCount = 0;
+bool gPreviousKnown = false;
+
+uint32_t gCounters[kCounterCount] = {0};
+RebootRecord gReboots[kRebootHistory] = {};
+uint32_t gNextSeq = 1;  // 0 marks an empty slot
+rst_info gResetInfo = {};
+bool gFlashReady = false;
+uint32_t gFlashCursor = 0;
+uint32_t gLastFlashMs = 0;
+
+uint32_t fnv1a(const uint8_t* data, size_t size, uint32_t hash) {
+  for (size_t i = 0; i < size; i++) {
+    hash ^= data[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+// Changes whenever the image is rebuilt or its layout shifts; records hold
+// raw pointers into .rodata, so only the same image may render them. The
+// stamp comes from the sketch, which is recompiled on every build, where one
+// here would only move when this file is. Cheap enough for the first
+// microseconds of boot, unlike hashing the image in flash.
+uint32_t buildId(const char* buildStamp) {
+  uint32_t hash = fnv1a(reinterpret_cast<const uint8_t*>(buildStamp),
+                        strlen(buildStamp), 2166136261u);
+  const uintptr_t anchors[] = {
+      reinterpret_cast<uintptr_t>(poot::kFirmwareVersion),
+      reinterpret_cast<uintptr_t>(&poot_diag::logf),
+  };
+  return fnv1a(reinterpret_cast<const uint8_t*>(anchors), sizeof(anchors),
+               hash);
+}
+
+uint16_t slotCheck(const RtcSlot& slot) {
+  uint32_t hash = fnv1a(reinterpret_cast<const uint8_t*>(&slot.seq),
+                        sizeof(slot.seq), 2166136261u);
+  hash = fnv1a(reinterpret_cast<const uint8_t*>(&slot.length),
+               sizeof(slot.length), hash);
+  hash = fnv1a(slot.record, sizeof(slot.record), hash);
+  return static_cast<uint16_t>(hash ^ (hash >> 16));
+}
+
+bool rtcWrite(size_t byteOffset, const void* data, size_t size) {
+  return ESP.rtcUserMemoryWrite(
+      kRtcBaseBlock + static_cast<uint32_t>(byteOffset / 4),
+      reinterpret_cast<uint32_t*>(const_cast<void*>(data)), size);
+}
+
+void writeCounter(uint8_t index) {
+  rtcWrite(offsetof(RtcHeader, counters) + index * sizeof(uint32_t),
+           &gCounters[index], sizeof(uint32_t));
+}
+
+bool isCrash(uint32_t reason) {
+  return reason == REASON_WDT_RST || reason == REASON_EXCEPTION_RST ||
+         reason == REASON_SOFT_WDT_RST;
+}
+
+// RecordSink: copies the head of every record into the next RTC slot. One
+// ~48-byte RTC write per log line, no flash and no formatting.
+void captureRecord(const uint8_t* record, size_t size) {
+  RtcSlot slot;
+  slot.seq = gNextSeq++;
+  slot.length = static_cast<uint16_t>(
+      size < sizeof(slot.record) ? size : sizeof(slot.record));
+  memcpy(slot.record, record, slot.length);
+  memset(slot.record + slot.length, 0, sizeof(slot.record) - slot.length);
+  slot.check = slotCheck(slot);
+  const uint8_t index = static_cast<uint8_t>(slot.seq % kSlotCount);
+  rtcWrite(offsetof(RtcImage, slots) + index * sizeof(RtcSlot), &slot,
+           sizeof(slot));
+}
+
+// Orders the previous boot's valid slots by sequence number.
+void indexPreviousRecords() {
+  gPreviousCount = 0;
+  uint32_t lastSeq = 0;
+  for (;;) {
+    int8_t next = -1;
+    for (uint8_t i = 0; i < kSlotCount; i++) {
+      const RtcSlot& slot = gPrevious.slots[i];
+      if (slot.seq <= lastSeq || slot.check != slotCheck(slot) ||
+          slot.length < poot_diag::kRecordHeaderBytes) {
+        continue;
+      }
+      if (next < 0 || slot.seq < gPrevious.slots[next].seq) {
+        next = static_cast<int8_t>(i);
+      }
+    }
+    if (next < 0) {
+      return;
+    }
+    gPreviousOrder[gPreviousCount++] = static_cast<uint8_t>(next);
+    lastSeq = gPrevious.slots[next].seq;
+  }
+}
+
+void rotateFlashLog() {
+  LittleFS.remove(kFlashOldPath);
+  if (!LittleFS.rename(kFlashLogPath, kFlashOldPath)) {
+    LittleFS.remove(kFlashLogPath);
+  }
+}
+
+size_t fileSize(const char* path) {
+  File file = LittleFS.open(path, "r");
+  if (!file) {
+    return 0;
+  }
+  const size_t size = file.size();
+  file.close();
+  return size;
+}
+
+}  // namespace
+
+const char* counterName(Counter counter) {
+  switch (counter) {
+    case Counter::kBoots:           return "boots";
+    case Counter::kCrashes:         return "crashes";
+    case Counter::kAutoReboots:     return "auto_reboots";
+    case Counter::kUnlocks:         return "unlocks";
+    case Counter::kWiFiDisconnects: return "wifi_disconnects";
+    default:                        return "unknown";
+  }
+}
+
+const char* resetReason() {
+  switch (gResetInfo.reason) {
+    case REASON_DEFAULT_RST:      return "Power On";
+    case REASON_WDT_RST:          return "Hardware Watchdog";
+    case REASON_EXCEPTION_RST:    return "Exception";
+    case REASON_SOFT_WDT_RST:     return "Software Watchdog";
+    case REASON_SOFT_RESTART:     return "Software/System restart";
+    case REASON_DEEP_SLEEP_AWAKE: return "Deep-Sleep Wake";
+    case REASON_EXT_SYS_RST:      return "External System";
+    default:                      return "Unknown";
+  }
+}
+
+void begin(const char* buildStamp) {
+  gResetInfo = *ESP.getResetInfoPtr();
+  ESP.rtcUserMemoryRead(kRtcBaseBlock, reinterpret_cast<uint32_t*>(&gPrevious),
+                        sizeof(gPrevious));
+  gPreviousKnown =
+      gPrevious.header.magic == kMagic && gPrevious.header.layout == kLayout;
+  const uint32_t id = buildId(buildStamp);
+  const bool sameImage = gPreviousKnown && gPrevious.header.buildId == id;
+
+  if (gPreviousKnown) {
+    memcpy(gCounters, gPrevious.header.counters, sizeof(gCounters));
+    memcpy(gReboots, gPrevious.header.reboots, sizeof(gReboots));
+  }
+  gCounters[static_cast<uint8_t>(Counter::kBoots)]++;
+  if (isCrash(gResetInfo.reason)) {
+    gCounters[static_cast<uint8_t>(Counter::kCrashes)]++;
+  }
+
+  if (sameImage) {
+    indexPreviousRecords();
+  }
+
+  // Slots are cleared every boot so they only ever hold one boot's records;
+  // the snapshot above keeps the previous boot's readable until restart.
+  RtcImage image;
+  memset(&image, 0, sizeof(image));
+  image.header.magic = kMagic;
+  image.header.layout = kLayout;
+  image.header.buildId = id;
+  memcpy(image.header.counters, gCounters, sizeof(gCounters));
+  memcpy(image.header.reboots, gReboots, sizeof(gReboots));
+  rtcWrite(0, &image, sizeof(image));
+
+  poot_diag::setRecordSink(captureRecord);
+  // Lines logged before beginFlash() still reach flash with the first flush.
+  gFlashCursor = poot_diag::oldestCursor();
+
+  poot_diag::logf("BLACKBOX",
+                  "boot=%lu crashes=%lu previous_uptime_ms=%lu records=%u "
+                  "rtc=%s",
+                  (unsigned long)counter(Counter::kBoots),
+                  (unsigned long)counter(Counter::kCrashes),
+                  (unsigned long)(gPreviousKnown ? gPrevious.header.uptimeMs
+                                                 : 0),
+                  gPreviousCount,
+                  sameImage ? "kept" : (gPreviousKnown ? "new_image" : "cold"));
+}
+
+void beginFlash() {
+  if (!poot::kEnableFlashBlackbox) {
+    poot_diag::logf("BLACKBOX", "flash=off");
+    return;
+  }
+  gFlashReady = LittleFS.begin();
+  gLastFlashMs = millis();
+  poot_diag::logf("BLACKBOX", "flash=%s", gFlashReady ? "ok" : "mount_failed");
+}
+
+void count(Counter counter) {
+  const uint8_t index = static_cast<uint8_t>(counter);
+  if (index >= kCounterCount) {
+    return;
+  }
+  gCounters[index]++;
+  writeCounter(index);
+}
+
+uint32_t counter(Counter counter) {
+  const uint8_t index = static_cast<uint8_t>(counter);
+  return index < kCounterCount ? gCounters[index] : 0;
+}
+
+void recordReboot(const RebootRecord& record) {
+  memmove(&gReboots[1], &gReboots[0],
+          sizeof(gReboots) - sizeof(gReboots[0]));
+  gReboots[0] = record;
+  rtcWrite(offsetof(RtcHeader, reboots), gReboots, sizeof(gReboots));
+}
+
+uint8_t rebootCount() {
+  uint8_t count = 0;
+  while (count < kRebootHistory && gReboots[count].reason != 0) {
+    count++;
+  }
+  return count;
+}
+
+const RebootRecord& reboot(uint8_t index) {
+  return gReboots[index < kRebootHistory ? index : 0];
+}
+
+void checkpoint() {
+  const uint32_t now = millis();
+  rtcWrite(offsetof(RtcHeader, uptimeMs), &now, sizeof(now));
+  if (gFlashReady && now - gLastFlashMs >= poot::kBlackboxFlashFlushMs) {
+    flushToFlash();
+  }
+}
+
+void flushToFlash() {
+  if (!gFlashReady) {
+    return;
+  }
+  gLastFlashMs = millis();
+  const uint32_t end = poot_diag::headCursor();
+  if (gFlashCursor == end) {
+    return;
+  }
+  File file = LittleFS.open(kFlashLogPath, "a");
+  if (!file) {
+    return;
+  }
+  char line[224];
+  if (static_cast<int32_t>(gFlashCursor - poot_diag::oldestCursor()) < 0) {
+    static const char kGap[] = "# log ring overran; lines lost\n";
+    file.write(reinterpret_cast<const uint8_t*>(kGap), sizeof(kGap) - 1);
+  }
+  while (gFlashCursor != end) {
+    const size_t len = poot_diag::readLine(gFlashCursor, line, sizeof(line));
+    if (len == 0) {
+      break;
+    }
+    file.write(reinterpret_cast<const uint8_t*>(line), len);
+  }
+  const size_t size = file.size();
+  file.close();
+  if (size >= poot::kBlackboxFlashBytes / 2) {
+    rotateFlashLog();
+  }
+}
+
+size_t describeReset(char* out, size_t size) {
+  const int len = snprintf(
+      out, size,
+      "reset_reason=%s exccause=%lu epc1=0x%08lx excvaddr=0x%08lx "
+      "previous_uptime_ms=%lu",
+      resetReason(), (unsigned long)gResetInfo.exccause,
+      (unsigned long)gResetInfo.epc1, (unsigned long)gResetInfo.excvaddr,
+      (unsigned long)(gPreviousKnown ? gPrevious.header.uptimeMs : 0));
+  if (len < 0) {
+    return 0;
+  }
+  return static_cast<size_t>(len) < size ? static_cast<size_t>(len) : size - 1;
+}
+
+uint8_t previousRecordCount() { return gPreviousCount; }
+
+size_t readPreviousRecord(uint8_t index, char* out, size_t size) {
+  if (index >= gPreviousCount) {
+    return 0;
+  }
+  const RtcSlot& slot = gPrevious.slots[gPreviousOrder[index]];
+  return poot_diag::renderRecord(slot.record, slot.length, out, size);
+}
+
+bool flashReady() { return gFlashReady; }
+
+size_t flashBytes() {
+  if (!gFlashReady) {
+    return 0;
+  }
+  return fileSize(kFlashOldPath) + fileSize(kFlashLogPath);
+}
+
+size_t readFlash(uint32_t& offset, uint8_t* out, size_t size) {
+  if (!gFlashReady) {
+    return 0;
+  }
+  const size_t oldSize = fileSize(kFlashOldPath);
+  const bool inOld = offset < oldSize;
+  File file = LittleFS.open(inOld ? kFlashOldPath : kFlashLogPath, "r");
+  if (!file || !file.seek(inOld ? offset : offset - oldSize)) {
+    return 0;
+  }
+  const int n = file.read(out, size);
+  file.close();
+  if (n <= 0) {
+    return 0;
+  }
+  offset += static_cast<uint32_t>(n);
+  return static_cast<size_t>(n);
+}
+
+}  // namespace poot_blackbox
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <Arduino.h>
+
+namespace poot_blackbox {
+
+// Post-mortem state that outlives a reset. Every poot_diag record (truncated
+// to a small slot) and a few counters are mirrored into RTC user memory as
+// they happen; that survives ESP.restart() and watchdog/exception resets but
+// not power loss. With kEnableFlashBlackbox the rendered log is also appended
+// to LittleFS in batches from loop(), so a hard reset loses at most one flush
+// interval and the hot path never waits on flash.
+
+enum class Counter : uint8_t {
+  kBoots,
+  kCrashes,  // hardware/software watchdog and exception resets
+  kAutoReboots,
+  kUnlocks,
+  kWiFiDisconnects,
+  kCount,
+};
+
+const char* counterName(Counter counter);
+
+// Call first thing in setup(): snapshots what the previous boot left in RTC
+// memory, counts this boot and starts mirroring poot_diag records.
+// `buildStamp` must change with every build of the image (the sketch's
+// __DATE__ " " __TIME__); the previous boot's records are only rendered when
+// it matches.
+void begin(const char* buildStamp);
+
+// Mounts LittleFS for the flash copy. Separate from begin() so setup() can
+// get the local API serving first; nothing logged in between is lost.
+void beginFlash();
+
+void count(Counter counter);
+uint32_t counter(Counter counter);
+
+// Records uptime so the next boot can tell how long this one lasted, and
+// appends new log lines to flash once kBlackboxFlashFlushMs has passed.
+void checkpoint();
+
+// Appends pending log lines to flash now, e.g. right before a restart.
+void flushToFlash();
+
+// Self-initiated restarts, newest first; kept in RTC memory across resets
+// like the counters. `reason` is owned by the caller (poot_health::Reason);
+// 0 marks an empty entry.
+struct RebootRecord {
+  uint32_t uptimeS;
+  uint16_t freeHeap;
+  uint8_t fragmentation;
+  uint8_t reason;
+};
+
+static constexpr uint8_t kRebootHistory = 4;
+
+// Call right before ESP.restart().
+void recordReboot(const RebootRecord& record);
+uint8_t rebootCount();
+const RebootRecord& reboot(uint8_t index);
+
+// Same text as ESP.getResetReason(), without building a String.
+const char* resetReason();
+
+// "reset_reason=... exccause=... previous_uptime_ms=..." for this boot.
+size_t describeReset(char* out, size_t size);
+
+// Records the previous boot(s) left in RTC memory, oldest first. Empty when
+// RTC memory was lost (power-on) or the firmware image changed, since the
+// records point into the old image's string literals.
+uint8_t previousRecordCount();
+size_t readPreviousRecord(uint8_t index, char* out, size_t size);
+
+// Flash log, oldest first. `offset` starts at 0 and is advanced past the
+// bytes read; returns 0 at the end or when flash is disabled.
+bool flashReady();
+size_t flashBytes();
+size_t readFlash(uint32_t& offset, uint8_t* out, size_t size);
+
+}  // namespace poot_blackbox
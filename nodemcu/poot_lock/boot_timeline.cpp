@@ -0,0 +1,52 @@
+#include "boot_timeline.h"
+
+#include "diagnostics.h"
+
+namespace poot_boot {
+
+namespace {
+
+constexpr uint8_t kPhaseCount = static_cast<uint8_t>(Phase::kCount);
+
+uint32_t gAtMs[kPhaseCount] = {0};
+bool gReached[kPhaseCount] = {false};
+
+}  // namespace
+
+const char* phaseName(Phase phase) {
+  switch (phase) {
+    case Phase::kSoftAp:      return "soft_ap";
+    case Phase::kHttp:        return "http";
+    case Phase::kReady:       return "ready";
+    case Phase::kStaBegin:    return "sta_begin";
+    case Phase::kSetup:       return "setup";
+    case Phase::kStaIp:       return "sta_ip";
+    case Phase::kCloud:       return "cloud";
+    case Phase::kSurvey:      return "survey";
+    case Phase::kFirstUnlock: return "first_unlock";
+    default:                  return "unknown";
+  }
+}
+
+void mark(Phase phase) {
+  const uint8_t index = static_cast<uint8_t>(phase);
+  if (index >= kPhaseCount || gReached[index]) {
+    return;
+  }
+  gAtMs[index] = millis();
+  gReached[index] = true;
+  poot_diag::logf("BOOT", "phase %s at %lu ms", phaseName(phase),
+                  (unsigned long)gAtMs[index]);
+}
+
+bool reached(Phase phase) {
+  const uint8_t index = static_cast<uint8_t>(phase);
+  return index < kPhaseCount && gReached[index];
+}
+
+uint32_t at(Phase phase) {
+  const uint8_t index = static_cast<uint8_t>(phase);
+  return index < kPhaseCount ? gAtMs[index] : 0;
+}
+
+}  // namespace poot_boot
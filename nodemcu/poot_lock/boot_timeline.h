@@ -0,0 +1,35 @@
+#pragma once
+
+#include <Arduino.h>
+
+namespace poot_boot {
+
+// When each startup phase was first reached, in millis() (which the SDK
+// starts shortly before setup()). setup() brings up the soft AP and the local
+// unlock API before anything that can wait: the STA join, flash, mDNS, OTA,
+// the cloud. Later phases (got IP, the cloud stream, the network survey, the
+// first unlock) are marked from wherever they happen.
+
+enum class Phase : uint8_t {
+  kSoftAp,
+  kHttp,
+  kReady,        // soft AP, HTTP and UDP unlock all serving
+  kStaBegin,     // first WiFi.begin()
+  kSetup,        // setup() returned
+  kStaIp,
+  kCloud,        // command stream first open
+  kSurvey,       // background network scan logged
+  kFirstUnlock,  // relay first fired, from any source
+  kCount,
+};
+
+const char* phaseName(Phase phase);
+
+// Records the phase the first time; later calls only cost a check, so it is
+// fine on hot paths and from WiFi event handlers.
+void mark(Phase phase);
+
+bool reached(Phase phase);
+uint32_t at(Phase phase);
+
+}  // namespace poot_boot
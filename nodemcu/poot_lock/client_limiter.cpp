@@ -0,0 +1,72 @@
+#include "client_limiter.h"
+
+namespace poot_http {
+
+void ClientLimiter::configure(uint8_t burst, uint32_t refillMs) {
+  burst_ = refillMs == 0 ? 0 : burst;
+  refillMs_ = refillMs;
+  memset(buckets_, 0, sizeof(buckets_));
+  overflow_ = Bucket{0, static_cast<uint32_t>(millis()), burst_, true};
+}
+
+bool ClientLimiter::hasToken(uint32_t ip, uint32_t now) {
+  return !enabled() || bucketFor(ip, now).tokens > 0;
+}
+
+bool ClientLimiter::take(uint32_t ip, uint32_t now) {
+  if (!enabled()) {
+    return true;
+  }
+  Bucket& bucket = bucketFor(ip, now);
+  if (bucket.tokens == 0) {
+    return false;
+  }
+  bucket.tokens--;
+  return true;
+}
+
+ClientLimiter::Bucket& ClientLimiter::bucketFor(uint32_t ip, uint32_t now) {
+  Bucket* spare = nullptr;
+  for (Bucket& bucket : buckets_) {
+    if (!bucket.used) {
+      if (spare == nullptr || spare->used) {
+        spare = &bucket;
+      }
+      continue;
+    }
+    refill(bucket, now);
+    if (bucket.ip == ip) {
+      return bucket;
+    }
+    // A full bucket is no different from a fresh one, so it can be reused.
+    if (bucket.tokens == burst_ && spare == nullptr) {
+      spare = &bucket;
+    }
+  }
+  if (spare == nullptr) {
+    refill(overflow_, now);
+    return overflow_;
+  }
+  *spare = Bucket{ip, now, burst_, true};
+  return *spare;
+}
+
+void ClientLimiter::refill(Bucket& bucket, uint32_t now) {
+  if (bucket.tokens >= burst_) {
+    bucket.refilledMs = now;
+    return;
+  }
+  const uint32_t earned = (now - bucket.refilledMs) / refillMs_;
+  if (earned == 0) {
+    return;
+  }
+  if (earned >= static_cast<uint32_t>(burst_ - bucket.tokens)) {
+    bucket.tokens = burst_;
+    bucket.refilledMs = now;
+    return;
+  }
+  bucket.tokens += static_cast<uint8_t>(earned);
+  bucket.refilledMs += earned * refillMs_;
+}
+
+}  // namespace poot_http
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "config.h"
+
+namespace poot_http {
+
+// Per-client token buckets for the local HTTP server, in a fixed table keyed
+// by IPv4 address. A client starts with `burst` tokens and gets one back
+// every `refillMs`; a request that finds its bucket empty is shed before it
+// is parsed or logged. When every entry belongs to a client that has not
+// refilled yet, newcomers share one overflow bucket rather than evicting
+// (and so forgiving) a client that is being throttled.
+class ClientLimiter {
+ public:
+  // A burst of 0 turns limiting off.
+  void configure(uint8_t burst, uint32_t refillMs);
+  bool enabled() const { return burst_ != 0; }
+
+  // Whether `ip` has a token left, without taking it.
+  bool hasToken(uint32_t ip, uint32_t now);
+  // Takes a token for `ip`; false (and nothing taken) when it has none.
+  bool take(uint32_t ip, uint32_t now);
+
+ private:
+  struct Bucket {
+    uint32_t ip;
+    uint32_t refilledMs;  // when the last token came back
+    uint8_t tokens;
+    bool used;
+  };
+
+  Bucket& bucketFor(uint32_t ip, uint32_t now);
+  void refill(Bucket& bucket, uint32_t now);
+
+  uint8_t burst_ = 0;
+  uint32_t refillMs_ = 0;
+  Bucket buckets_[poot::kHttpClientBuckets] = {};
+  Bucket overflow_ = {};
+};
+
+}  // namespace poot_http
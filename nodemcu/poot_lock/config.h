@@ -6,9 +6,38 @@ namespace poot {
 
 static constexpr uint32_t kSerialBaud = 115200;
 static constexpr bool kEnableSerialDiagnostics = true;
+// Diagnostics are captured unformatted into a RAM ring and rendered to Serial
+// only when loop() is idle (see diagnostics.h). Must be a power of two.
+static constexpr size_t kLogRingBytes = 2048;
+static constexpr size_t kLogMaxStringArg = 32;
+// Post-mortem state (see blackbox.h). The RTC copy is always on; the flash
+// copy is appended every kBlackboxFlashFlushMs and rotated at half of
+// kBlackboxFlashBytes, keeping one older file.
+static constexpr uint32_t kBlackboxCheckpointMs = 1000;
+static constexpr bool kEnableFlashBlackbox = true;
+static constexpr uint32_t kBlackboxFlashFlushMs = 60UL * 1000UL;
+static constexpr size_t kBlackboxFlashBytes = 16 * 1024;
+// RTC user memory, in 4-byte blocks: 0-31 belong to eboot, the blackbox has
+// everything from 32 up to kRtcStaJoinBlock, and the STA join cache (see
+// sta_join.h) the last four.
+static constexpr uint32_t kRtcStaJoinBlock = 124;
+// Per-stage loop() timing served at /api/perf. Costs a handful of cycle
+// counter reads per iteration, so it stays on in production.
+static constexpr bool kEnableLoopProfiler = true;
+// Per-scope heap/stack accounting served at /api/alloc (see
+// alloc_tracker.h). Adds a header of 8 bytes or so to every C++ allocation;
+// kAllocScopes bounds the named scopes: "other", every route and
+// "not_found" (12 + 1), every scheduler task (12), the five loop() pumps and
+// WiFi events.
+static constexpr bool kEnableAllocTracking = true;
+static constexpr uint8_t kAllocScopes = 32;
 
 static constexpr uint8_t kRelayPin = D1;
 static constexpr bool kRelayActiveLow = true;
+// Debug: once the lock is ready, log what one relay pin write costs through
+// digitalWrite() and through poot_gpio::OutputPins. Only the idle level is
+// written, so the relay does not move.
+static constexpr bool kLogRelayWriteCycles = false;
 
 // NodeMCU onboard LED is active-low on most ESP8266 boards.
 static constexpr uint8_t kStatusLedPin = LED_BUILTIN;
@@ -19,19 +48,174 @@ static constexpr uint32_t kWiFiConnectingWindowMs = 8000;
 
 static constexpr uint32_t kUnlockPulseMs = 5000;
 static constexpr uint32_t kUnlockCooldownMs = 5000;
+// An unlock that arrives while the pulse is on joins it. One that arrives
+// during the cooldown is queued to fire when the cooldown ends if that is at
+// most this far off, and refused otherwise; 0 refuses them all.
+static constexpr uint32_t kUnlockQueueMaxWaitMs = kUnlockCooldownMs;
 static constexpr uint32_t kWiFiReconnectMs = 12000;
 static constexpr uint32_t kNetworkEnsureMs = 1000;
 static constexpr uint32_t kWiFiStatusLogIntervalMs = 3000;
+static constexpr uint32_t kWiFiStatusPollMs = 250;
+// A join aimed at the cached BSSID and channel that has no IP after this long
+// (or is refused first) is retried with a full scan.
+static constexpr uint32_t kWiFiFastJoinTimeoutMs = 3000;
+// The once-per-boot network survey (diagnostics) scans in the background
+// after the STA join settles; an unfinished scan is abandoned after
+// kWiFiSurveyTimeoutMs.
+static constexpr uint32_t kWiFiSurveyPollMs = 100;
+static constexpr uint32_t kWiFiSurveyTimeoutMs = 10000;
+static constexpr uint32_t kStatusLedPollMs = 100;
 static constexpr uint32_t kHttpServerReassertMs = 15000;
 
 static constexpr uint16_t kLocalHttpPort = 80;
+// Local HTTP server (see http_server.h). One slot per open connection: the
+// AP's kApMaxConnections stations plus a couple arriving over STA. A request
+// head must fit in kHttpRequestBytes and arrive within kHttpRequestTimeoutMs.
+static constexpr uint8_t kHttpMaxConnections = 6;
+static constexpr size_t kHttpRequestBytes = 512;
+static constexpr uint32_t kHttpRequestTimeoutMs = 3000;
+// Keep-alive: an idle connection is closed after kHttpKeepAliveIdleMs (the
+// app reuses connections for less than that) and after
+// kHttpKeepAliveMaxRequests requests, so no client holds a slot forever.
+static constexpr uint32_t kHttpKeepAliveIdleMs = 5000;
+static constexpr uint8_t kHttpKeepAliveMaxRequests = 32;
+// Load shedding (see client_limiter.h). Each client IP has a token bucket of
+// kHttpClientBurst requests, one token back every kHttpClientRefillMs, and
+// may hold at most kHttpMaxConnectionsPerClient slots; the app's probe,
+// unlock and health polls fit well inside both. At most kHttpDispatchPerPass
+// handlers run per loop() pass so the relay and LED tasks run in between.
+static constexpr uint8_t kHttpClientBuckets = 8;
+static constexpr uint8_t kHttpClientBurst = 10;
+static constexpr uint32_t kHttpClientRefillMs = 200;
+static constexpr uint8_t kHttpMaxConnectionsPerClient = 3;
+static constexpr uint8_t kHttpDispatchPerPass = 2;
+// GET /metrics (see metrics.h). STA disconnect reasons past the first
+// kMetricsDisconnectReasons - 1 distinct ones are counted together.
+static constexpr uint8_t kMetricsDisconnectReasons = 8;
+// Live lock state at GET /api/events (see lock_events.h). Each subscriber
+// holds one HTTP slot, so at most kEventsMaxSubscribers; the last
+// kEventsRingSlots changes are kept for slow ones. A comment goes out after
+// kEventsHeartbeatMs without an event, and clients are told to reconnect
+// after kEventsRetryMs.
+static constexpr uint8_t kEventsMaxSubscribers = 2;
+static constexpr uint8_t kEventsRingSlots = 16;
+static constexpr uint32_t kEventsHeartbeatMs = 15000;
+static constexpr uint32_t kEventsRetryMs = 3000;
+// Signed local unlock (see local_auth.h). A nonce from GET /api/challenge is
+// good for one unlock attempt within kAuthNonceTtlMs. Each client IP holds
+// up to kAuthNoncesPerClient (one tap probes up to three addresses, plus a
+// retry), and kAuthNonceSlots leaves room for four such clients. Until every
+// phone signs its unlocks, kLocalUnlockAcceptsKey keeps ?key= working as
+// well.
+static constexpr uint8_t kAuthNonceSlots = 16;
+static constexpr uint8_t kAuthNoncesPerClient = 4;
+static constexpr uint32_t kAuthNonceTtlMs = 30UL * 1000UL;
+static constexpr bool kLocalUnlockAcceptsKey = true;
+// Single-datagram unlock (see udp_unlock.h). One replay window per client
+// id; more clients than kUdpReplayClients in one epoch start a new epoch.
+static constexpr bool kEnableUdpUnlock = true;
+static constexpr uint16_t kUdpUnlockPort = 4210;
+static constexpr uint8_t kUdpReplayClients = 8;
 static constexpr uint8_t  kApMaxConnections = 4;          // 0-8
 static constexpr uint16_t kOtaPort = 8266;                // ArduinoOTA default
 static constexpr const char* kMdnsHostname = "poot";
 
-// Auto-reboot every hour to reset soft state. The reboot is unconditional;
-// in-flight AP unlocks are interrupted but the phone simply retries.
-static constexpr uint32_t kAutoRebootIntervalMs = 60UL * 60UL * 1000UL;
+// Health-based reboot (see health_monitor.h). Resources are sampled every
+// kHealthSampleMs; a limit must stay crossed for kHealthBreachSamples samples
+// in a row before a reboot is wanted. It then waits until the relay is idle,
+// no client is connected and nothing was requested for kHealthQuietMs. After
+// kHealthMaxDeferMs, or below kHealthCriticalFreeHeap, only the relay can
+// hold it off. kHealthMaxUptimeMs is a backstop for slow leaks that none of
+// the limits catch.
+static constexpr uint32_t kHealthSampleMs = 5000;
+static constexpr uint8_t kHealthBreachSamples = 3;
+static constexpr uint32_t kHealthMinFreeHeap = 8 * 1024;
+static constexpr uint32_t kHealthCriticalFreeHeap = 4 * 1024;
+static constexpr uint8_t kHealthMaxFragmentation = 50;  // percent
+static constexpr uint32_t kHealthMinMaxFreeBlock = 4 * 1024;
+static constexpr uint32_t kHealthMaxLoopStallMs = 2000;
+static constexpr uint8_t kHealthMaxOpenSockets = kHttpMaxConnections;
+static constexpr uint32_t kHealthQuietMs = 30UL * 1000UL;
+static constexpr uint32_t kHealthMaxDeferMs = 10UL * 60UL * 1000UL;
+static constexpr uint32_t kHealthMaxUptimeMs = 7UL * 24UL * 60UL * 60UL * 1000UL;
+
+// WiFi power save (see power_policy.h), sampled every kPowerSampleMs. The
+// radio stays awake while the STA is not joined, a station is on the soft AP,
+// the relay is busy, or for kPowerActiveHoldMs after the last request. Then
+// it modem-sleeps, and after kPowerLightSleepAfterMs idle it light-sleeps
+// (only with kPowerSleepDropsAp), each only as deep as kPowerLatencyBudgetMs
+// allows: a sleep adds up to its listen interval times kPowerDtimMs (the home
+// AP's beacon interval times its DTIM count) before a request is seen, and
+// light sleep up to kPowerLightIdleMs more while loop() idles. Off by
+// default.
+static constexpr bool kEnablePowerSave = false;
+// The SDK only really sleeps the radio in station mode. Off, the soft AP
+// stays up, so the fallback hotspot and its stations are kept, and sleep
+// stops at modem sleep, which saves little while the AP beacons. On, the AP
+// goes down for any sleep and comes back on waking, and light sleep is used;
+// the hotspot is then only there while the lock is awake.
+static constexpr bool kPowerSleepDropsAp = false;
+static constexpr uint32_t kPowerSampleMs = 250;
+static constexpr uint32_t kPowerLatencyBudgetMs = 500;
+static constexpr uint32_t kPowerDtimMs = 102;  // 100 TU beacons, DTIM 1
+static constexpr uint32_t kPowerActiveHoldMs = 30UL * 1000UL;
+static constexpr uint32_t kPowerLightSleepAfterMs = 5UL * 60UL * 1000UL;
+static constexpr uint32_t kPowerLightIdleMs = 100;
+// The CPU runs at 160 MHz from the kPowerBurstRequests-th request within
+// kPowerBurstWindowMs until a window passes without one. Independent of
+// kEnablePowerSave: with power save off the radio never sleeps, but the power
+// task still samples and this clock switch is the one thing it changes.
+static constexpr bool kPowerBoostCpu = true;
+static constexpr uint8_t kPowerBurstRequests = 3;
+static constexpr uint32_t kPowerBurstWindowMs = 2000;
+// For the duty-cycle estimate in /api/health: how long the radio is on for
+// each beacon it wakes for.
+static constexpr uint32_t kPowerBeaconAwakeMs = 5;
+
+// Cloud command stream (see firebase_client.h). Only started when secrets.h
+// defines FIREBASE_DB_HOST. The database sends a keep-alive every 30 s, so
+// kCloudStreamIdleMs of silence means the connection is dead. Failed
+// connects back off exponentially between the min and max, with jitter.
+// Commands older than kCloudCommandMaxAgeMs are not run. kCloudEventBytes
+// bounds one event's data (a snapshot of several commands must fit).
+static constexpr bool kEnableCloud = true;
+static constexpr uint16_t kCloudPort = 443;
+static constexpr uint32_t kCloudResponseTimeoutMs = 10000;
+static constexpr uint32_t kCloudStreamIdleMs = 70UL * 1000UL;
+static constexpr uint32_t kCloudBackoffMinMs = 1000;
+static constexpr uint32_t kCloudBackoffMaxMs = 60UL * 1000UL;
+static constexpr uint32_t kCloudTokenRefreshMs = 50UL * 60UL * 1000UL;
+static constexpr uint32_t kCloudCommandMaxAgeMs = 30UL * 1000UL;
+static constexpr size_t kCloudEventBytes = 1024;
+static constexpr size_t kCloudTokenBytes = 1280;
+static constexpr size_t kCloudReadBytesPerPass = 512;
+// TLS buffers: each host is asked once whether it takes records of
+// kCloudTlsRecvBytes (MFLN). One that does not needs a receive buffer for a
+// full 16 KB record. Requests go out in small records either way.
+static constexpr uint16_t kCloudTlsRecvBytes = 1024;
+static constexpr uint16_t kCloudTlsSendBytes = 512;
+// Audit trail (see audit_log.h). Unlock outcomes wait in a ring of
+// kAuditQueueEvents slots on flash and go to the database in one PATCH per
+// batch: kAuditFlushWindowMs after the oldest one was queued, or as soon as
+// kAuditBatchEvents are waiting. A failed write is retried after a backoff
+// between the min and max; offline, nothing is tried.
+//
+// The write cannot share the command stream's connection, so each batch
+// closes the stream and costs one more blocking TLS handshake (resumed,
+// where the server keeps sessions: tens of ms rather than a second or
+// more). That is one handshake kAuditFlushWindowMs after each unlock or
+// burst of unlocks; a longer window batches more of them per handshake at
+// the price of a later audit record. The stream is only interrupted once it
+// has been quiet for kAuditStreamQuietMs, and never while the lock is busy
+// (see FirebaseClient::loop()).
+static constexpr bool kEnableAudit = true;
+static constexpr uint8_t kAuditQueueEvents = 64;
+static constexpr uint8_t kAuditStagingEvents = 8;
+static constexpr uint8_t kAuditBatchEvents = 16;
+static constexpr uint32_t kAuditFlushWindowMs = 10UL * 1000UL;
+static constexpr uint32_t kAuditStreamQuietMs = 1000;
+static constexpr uint32_t kAuditBackoffMinMs = 5000;
+static constexpr uint32_t kAuditBackoffMaxMs = 5UL * 60UL * 1000UL;
 
 static constexpr const char* kFirmwareVersion = "poot-esp8266-2.1.0";
 
@@ -0,0 +1,548 @@
+#include "diagnostics.h"
+
+#include <stdarg.h>
+
+namespace poot_diag {
+
+namespace {
+
+static_assert((poot::kLogRingBytes & (poot::kLogRingBytes - 1)) == 0,
+              "kLogRingBytes must be a power of two");
+
+constexpr size_t kMaxLineBytes = 224;
+
+enum ArgKind : uint8_t {
+  kArgNone,
+  kArgInt,
+  kArgLong,
+  kArgLongLong,
+  kArgSize,
+  kArgDouble,
+  kArgPointer,
+  kArgString,
+};
+
+// Pointers first so the struct has no padding on either target.
+struct RecordHeader {
+  const char* scope;
+  const char* format;
+  uint32_t timestampMs;
+  uint16_t size;       // header + payload
+  uint8_t truncated;   // payload ran out of room; later args render as '?'
+  uint8_t reserved;
+};
+
+static_assert(sizeof(RecordHeader) == kRecordHeaderBytes,
+              "kRecordHeaderBytes out of sync with RecordHeader");
+
+// One conversion in a printf format string.
+struct Spec {
+  const char* begin;   // '%'
+  const char* end;     // one past the conversion character
+  ArgKind kind;
+  uint8_t stars;       // '*' width/precision arguments preceding the value
+};
+
+// Advances `p` to the next conversion and describes it. Literal text runs
+// from the old `p` to spec.begin. Returns false when no conversion is left.
+bool nextSpec(const char*& p, Spec& spec) {
+  for (;;) {
+    const char* pct = strchr(p, '%');
+    if (pct == nullptr) {
+      p += strlen(p);
+      return false;
+    }
+    const char* q = pct + 1;
+    if (*q == '%') {
+      spec.begin = pct;
+      spec.end = q + 1;
+      spec.kind = kArgNone;
+      spec.stars = 0;
+      p = spec.end;
+      return true;
+    }
+    spec.begin = pct;
+    spec.stars = 0;
+    while (*q != '\0' && strchr("-+ #0", *q) != nullptr) {
+      q++;
+    }
+    if (*q == '*') {
+      spec.stars++;
+      q++;
+    }
+    while (*q >= '0' && *q <= '9') {
+      q++;
+    }
+    if (*q == '.') {
+      q++;
+      if (*q == '*') {
+        spec.stars++;
+        q++;
+      }
+      while (*q >= '0' && *q <= '9') {
+        q++;
+      }
+    }
+    ArgKind intKind = kArgInt;
+    if (*q == 'h') {
+      q += (q[1] == 'h') ? 2 : 1;
+    } else if (*q == 'l') {
+      intKind = (q[1] == 'l') ? kArgLongLong : kArgLong;
+      q += (q[1] == 'l') ? 2 : 1;
+    } else if (*q == 'j') {
+      intKind = kArgLongLong;
+      q++;
+    } else if (*q == 'z' || *q == 't') {
+      intKind = kArgSize;
+      q++;
+    }
+    switch (*q) {
+      case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+        spec.kind = intKind;
+        break;
+      case 'f': case 'F': case 'e': case 'E': case 'g': case 'G':
+        spec.kind = kArgDouble;
+        break;
+      case 's':
+        spec.kind = kArgString;
+        break;
+      case 'p':
+        spec.kind = kArgPointer;
+        break;
+      case '\0':
+        p = q;
+        return false;
+      default:
+        // Unsupported conversion (%n, %L...): emit verbatim, consume nothing.
+        spec.kind = kArgNone;
+        break;
+    }
+    spec.end = q + 1;
+    p = spec.end;
+    return true;
+  }
+}
+
+size_t argSize(ArgKind kind) {
+  switch (kind) {
+    case kArgInt:      return sizeof(int);
+    case kArgLong:     return sizeof(long);
+    case kArgLongLong: return sizeof(long long);
+    case kArgSize:     return sizeof(size_t);
+    case kArgDouble:   return sizeof(double);
+    case kArgPointer:  return sizeof(void*);
+    default:           return 0;
+  }
+}
+
+// Single-producer ring of variable-length records. Everything runs in the
+// loop/SDK task context, which is cooperative, so a record is appended or
+// evicted atomically with respect to readers without locks.
+uint8_t gRing[poot::kLogRingBytes];
+uint32_t gHead = 0;        // bytes ever written
+uint32_t gTail = 0;        // oldest retained record
+uint32_t gSerialCursor = 0;
+uint32_t gDropped = 0;     // records evicted before reaching Serial
+RecordSink gSink = nullptr;
+
+char gPendingLine[kMaxLineBytes];
+size_t gPendingLen = 0;
+size_t gPendingOffset = 0;
+
+void ringWrite(uint32_t at, const uint8_t* data, size_t size) {
+  const size_t offset = at & (poot::kLogRingBytes - 1);
+  const size_t first = poot::kLogRingBytes - offset;
+  if (size <= first) {
+    memcpy(gRing + offset, data, size);
+    return;
+  }
+  memcpy(gRing + offset, data, first);
+  memcpy(gRing, data + first, size - first);
+}
+
+void ringRead(uint32_t at, uint8_t* data, size_t size) {
+  const size_t offset = at & (poot::kLogRingBytes - 1);
+  const size_t first = poot::kLogRingBytes - offset;
+  if (size <= first) {
+    memcpy(data, gRing + offset, size);
+    return;
+  }
+  memcpy(data, gRing + offset, first);
+  memcpy(data + first, gRing, size - first);
+}
+
+uint16_t recordSizeAt(uint32_t cursor) {
+  RecordHeader header;
+  ringRead(cursor, reinterpret_cast<uint8_t*>(&header), sizeof(header));
+  return header.size;
+}
+
+void append(const uint8_t* record, uint16_t size) {
+  while (gHead + size - gTail > poot::kLogRingBytes) {
+    if (gSerialCursor == gTail) {
+      gSerialCursor += recordSizeAt(gTail);
+      gDropped++;
+    }
+    gTail += recordSizeAt(gTail);
+  }
+  ringWrite(gHead, record, size);
+  gHead += size;
+}
+
+bool cursorBefore(uint32_t a, uint32_t b) {
+  return static_cast<int32_t>(a - b) < 0;
+}
+
+// Renders a captured record. Mirrors the original Serial.printf layout.
+size_t render(const uint8_t* record, char* out, size_t size) {
+  RecordHeader header;
+  memcpy(&header, record, sizeof(header));
+  const uint8_t* arg = record + sizeof(header);
+  const uint8_t* argEnd = record + header.size;
+
+  int written = snprintf(out, size, "[%10lu] [%s] ",
+                         (unsigned long)header.timestampMs, header.scope);
+  size_t len = written < 0 ? 0 : static_cast<size_t>(written);
+
+  const char* p = header.format;
+  Spec spec;
+  for (;;) {
+    const char* literal = p;
+    const bool more = nextSpec(p, spec);
+    const char* literalEnd = more ? spec.begin : p;
+    const size_t literalLen = static_cast<size_t>(literalEnd - literal);
+    if (len < size) {
+      const size_t n = literalLen < size - len ? literalLen : size - len - 1;
+      memcpy(out + len, literal, n);
+      len += n;
+      out[len] = '\0';
+    }
+    if (!more || len + 1 >= size) {
+      break;
+    }
+
+    if (spec.kind == kArgNone) {
+      // "%%" renders as '%'; unsupported conversions are copied through.
+      const bool percent = spec.begin[1] == '%';
+      const size_t n =
+          percent ? 1 : static_cast<size_t>(spec.end - spec.begin);
+      if (len + n < size) {
+        memcpy(out + len, spec.begin + (percent ? 1 : 0), n);
+        len += n;
+        out[len] = '\0';
+      }
+      continue;
+    }
+
+    // Substitute captured '*' width/precision values into the spec.
+    char fmt[24];
+    size_t f = 0;
+    bool missing = false;
+    for (const char* s = spec.begin; s < spec.end && f < sizeof(fmt) - 12; s++) {
+      if (*s != '*') {
+        fmt[f++] = *s;
+        continue;
+      }
+      int value = 0;
+      if (arg + sizeof(int) <= argEnd) {
+        memcpy(&value, arg, sizeof(int));
+        arg += sizeof(int);
+      } else {
+        missing = true;
+      }
+      f += static_cast<size_t>(snprintf(fmt + f, 12, "%d", value));
+    }
+    fmt[f] = '\0';
+
+    char* dst = out + len;
+    const size_t room = size - len;
+    const size_t need = spec.kind == kArgString ? 1 : argSize(spec.kind);
+    if (missing || arg + need > argEnd) {
+      written = snprintf(dst, room, "?");
+    } else {
+      switch (spec.kind) {
+        case kArgInt: {
+          int v;
+          memcpy(&v, arg, sizeof(v));
+          written = snprintf(dst, room, fmt, v);
+          break;
+        }
+        case kArgLong: {
+          long v;
+          memcpy(&v, arg, sizeof(v));
+          written = snprintf(dst, room, fmt, v);
+          break;
+        }
+        case kArgLongLong: {
+          long long v;
+          memcpy(&v, arg, sizeof(v));
+          written = snprintf(dst, room, fmt, v);
+          break;
+        }
+        case kArgSize: {
+          size_t v;
+          memcpy(&v, arg, sizeof(v));
+          written = snprintf(dst, room, fmt, v);
+          break;
+        }
+        case kArgDouble: {
+          double v;
+          memcpy(&v, arg, sizeof(v));
+          written = snprintf(dst, room, fmt, v);
+          break;
+        }
+        case kArgPointer: {
+          void* v;
+          memcpy(&v, arg, sizeof(v));
+          written = snprintf(dst, room, fmt, v);
+          break;
+        }
+        case kArgString: {
+          const char* v = reinterpret_cast<const char*>(arg);
+          written = snprintf(dst, room, fmt, v);
+          arg += strnlen(v, static_cast<size_t>(argEnd - arg)) + 1;
+          break;
+        }
+        default:
+          written = 0;
+          break;
+      }
+      if (spec.kind != kArgString) {
+        arg += argSize(spec.kind);
+      }
+    }
+    if (written > 0) {
+      len += static_cast<size_t>(written) < room ? static_cast<size_t>(written)
+                                                 : room - 1;
+    }
+  }
+
+  if (len + 1 < size) {
+    out[len++] = '\n';
+    out[len] = '\0';
+  } else if (size > 1) {
+    out[size - 2] = '\n';
+    out[size - 1] = '\0';
+    len = size - 1;
+  }
+  return len;
+}
+
+size_t renderAt(uint32_t cursor, char* out, size_t size, uint16_t* recordSize) {
+  uint8_t record[kMaxRecordBytes];
+  const uint16_t recSize = recordSizeAt(cursor);
+  *recordSize = recSize;
+  if (recSize < sizeof(RecordHeader) || recSize > sizeof(record)) {
+    return 0;
+  }
+  ringRead(cursor, record, recSize);
+  return render(record, out, size);
+}
+
+}  // namespace
+
+void logf(const char* scope, const char* format, ...) {
+  if (!enabled()) {
+    return;
+  }
+
+  uint8_t record[kMaxRecordBytes];
+  RecordHeader header;
+  header.timestampMs = millis();
+  header.scope = scope;
+  header.format = format;
+  header.truncated = 0;
+  header.reserved = 0;
+
+  size_t used = sizeof(header);
+  va_list args;
+  va_start(args, format);
+  const char* p = format;
+  Spec spec;
+  while (header.truncated == 0 && nextSpec(p, spec)) {
+    for (uint8_t i = 0; i < spec.stars; i++) {
+      const int value = va_arg(args, int);
+      if (used + sizeof(value) > sizeof(record)) {
+        header.truncated = 1;
+        break;
+      }
+      memcpy(record + used, &value, sizeof(value));
+      used += sizeof(value);
+    }
+    if (header.truncated != 0) {
+      break;
+    }
+    switch (spec.kind) {
+      case kArgNone:
+        break;
+      case kArgString: {
+        const char* s = va_arg(args, const char*);
+        if (s == nullptr) {
+          s = "(null)";
+        }
+        size_t n = strnlen(s, poot::kLogMaxStringArg - 1);
+        if (used + n + 1 > sizeof(record)) {
+          header.truncated = 1;
+          break;
+        }
+        memcpy(record + used, s, n);
+        record[used + n] = '\0';
+        used += n + 1;
+        break;
+      }
+      default: {
+        const size_t n = argSize(spec.kind);
+        if (used + n > sizeof(record)) {
+          header.truncated = 1;
+          break;
+        }
+        switch (spec.kind) {
+          case kArgInt: {
+            const int v = va_arg(args, int);
+            memcpy(record + used, &v, n);
+            break;
+          }
+          case kArgLong: {
+            const long v = va_arg(args, long);
+            memcpy(record + used, &v, n);
+            break;
+          }
+          case kArgLongLong: {
+            const long long v = va_arg(args, long long);
+            memcpy(record + used, &v, n);
+            break;
+          }
+          case kArgSize: {
+            const size_t v = va_arg(args, size_t);
+            memcpy(record + used, &v, n);
+            break;
+          }
+          case kArgDouble: {
+            const double v = va_arg(args, double);
+            memcpy(record + used, &v, n);
+            break;
+          }
+          default: {
+            void* v = va_arg(args, void*);
+            memcpy(record + used, &v, n);
+            break;
+          }
+        }
+        used += n;
+        break;
+      }
+    }
+  }
+  va_end(args);
+
+  header.size = static_cast<uint16_t>(used);
+  memcpy(record, &header, sizeof(header));
+  append(record, header.size);
+  if (gSink != nullptr) {
+    gSink(record, header.size);
+  }
+}
+
+bool drainToSerial() {
+  if (!enabled()) {
+    return false;
+  }
+  if (gPendingOffset == gPendingLen) {
+    if (cursorBefore(gSerialCursor, gTail)) {
+      gSerialCursor = gTail;
+    }
+    if (gSerialCursor == gHead) {
+      return false;
+    }
+    uint16_t recordSize = 0;
+    gPendingLen = renderAt(gSerialCursor, gPendingLine, sizeof(gPendingLine),
+                           &recordSize);
+    gPendingOffset = 0;
+    gSerialCursor += recordSize;
+  }
+  const int room = Serial.availableForWrite();
+  if (room <= 0) {
+    return false;
+  }
+  const size_t remaining = gPendingLen - gPendingOffset;
+  const size_t n = remaining < static_cast<size_t>(room)
+                       ? remaining
+                       : static_cast<size_t>(room);
+  Serial.write(reinterpret_cast<const uint8_t*>(gPendingLine + gPendingOffset),
+               n);
+  gPendingOffset += n;
+  return true;
+}
+
+void flushToSerial() {
+  if (!enabled()) {
+    return;
+  }
+  if (gPendingOffset < gPendingLen) {
+    Serial.write(reinterpret_cast<const uint8_t*>(gPendingLine + gPendingOffset),
+                 gPendingLen - gPendingOffset);
+    gPendingOffset = gPendingLen;
+  }
+  if (cursorBefore(gSerialCursor, gTail)) {
+    gSerialCursor = gTail;
+  }
+  while (gSerialCursor != gHead) {
+    uint16_t recordSize = 0;
+    const size_t len = renderAt(gSerialCursor, gPendingLine,
+                                sizeof(gPendingLine), &recordSize);
+    Serial.write(reinterpret_cast<const uint8_t*>(gPendingLine), len);
+    gSerialCursor += recordSize;
+  }
+  gPendingLen = 0;
+  gPendingOffset = 0;
+}
+
+uint32_t oldestCursor() { return gTail; }
+
+uint32_t headCursor() { return gHead; }
+
+uint32_t droppedRecords() { return gDropped; }
+
+uint32_t seek(uint32_t cursor) {
+  uint32_t at = gTail;
+  while (at != gHead && cursorBefore(at, cursor)) {
+    at += recordSizeAt(at);
+  }
+  return at;
+}
+
+size_t readLine(uint32_t& cursor, char* out, size_t size) {
+  if (cursorBefore(cursor, gTail)) {
+    cursor = gTail;
+  }
+  if (cursor == gHead || !cursorBefore(cursor, gHead)) {
+    return 0;
+  }
+  uint16_t recordSize = 0;
+  const size_t len = renderAt(cursor, out, size, &recordSize);
+  cursor += recordSize;
+  return len;
+}
+
+void setRecordSink(RecordSink sink) { gSink = sink; }
+
+size_t renderRecord(const uint8_t* record, size_t size, char* out,
+                    size_t outSize) {
+  RecordHeader header;
+  if (size < sizeof(header) || outSize == 0) {
+    return 0;
+  }
+  // Zero padding terminates a %s argument that was cut off mid-string.
+  uint8_t copy[kMaxRecordBytes] = {0};
+  const size_t n = size < sizeof(copy) ? size : sizeof(copy);
+  memcpy(copy, record, n);
+  memcpy(&header, copy, sizeof(header));
+  if (header.size > n) {
+    header.size = static_cast<uint16_t>(n);
+    header.truncated = 1;
+    memcpy(copy, &header, sizeof(header));
+  }
+  return render(copy, out, outSize);
+}
+
+}  // namespace poot_diag
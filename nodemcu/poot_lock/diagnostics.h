@@ -1,7 +1,6 @@
 #pragma once
 
 #include <Arduino.h>
-#include <stdarg.h>
 
 #include "config.h"
 
@@ -9,19 +8,47 @@ namespace poot_diag {
 
 inline bool enabled() { return poot::kEnableSerialDiagnostics; }
 
-inline void logf(const char* scope, const char* format, ...) {
-  if (!enabled()) {
-    return;
-  }
-
-  char message[256];
-  va_list args;
-  va_start(args, format);
-  vsnprintf(message, sizeof(message), format, args);
-  va_end(args);
-
-  Serial.printf("[%10lu] [%s] %s\n", millis(), scope, message);
-}
+// Upper bound on the size of one captured record, and the size of its fixed
+// header (timestamp, scope/format pointers, length); arguments follow it.
+static constexpr size_t kMaxRecordBytes = 192;
+static constexpr size_t kRecordHeaderBytes = 2 * sizeof(const char*) + 8;
+
+// Records a diagnostic line without formatting it. The timestamp, scope and
+// format pointers and the raw argument bytes go into a fixed RAM ring; %s
+// arguments are copied (truncated to kLogMaxStringArg) because the caller's
+// buffer may be gone by the time the line is rendered. `scope` and `format`
+// must be string literals.
+void logf(const char* scope, const char* format, ...);
+
+// Renders pending records to Serial, writing only what the UART FIFO accepts
+// right now. Call from loop() when idle; returns true if anything was written.
+bool drainToSerial();
+
+// Blocking variant for use right before a restart.
+void flushToSerial();
+
+// Cursors are monotonically increasing byte offsets into the ring. Records
+// older than oldestCursor() have been overwritten.
+uint32_t oldestCursor();
+uint32_t headCursor();
+uint32_t droppedRecords();
+
+// Moves `cursor` to the first retained record at or after it.
+uint32_t seek(uint32_t cursor);
+
+// Renders the record at `cursor` as a "[ms] [SCOPE] message\n" line and
+// advances `cursor` past it. Returns the line length, or 0 at the head.
+size_t readLine(uint32_t& cursor, char* out, size_t size);
+
+// Receives every record logf() captures, right after it is appended to the
+// ring. Runs on the caller's path, so it must be cheap and must not log.
+using RecordSink = void (*)(const uint8_t* record, size_t size);
+void setRecordSink(RecordSink sink);
+
+// Renders a record previously handed to a RecordSink. `size` may be shorter
+// than the original record; arguments past it render as '?'. The scope and
+// format pointers inside must still be valid, i.e. same firmware image.
+size_t renderRecord(const uint8_t* record, size_t size, char* out,
+                    size_t outSize);
 
 }  // namespace poot_diag
-
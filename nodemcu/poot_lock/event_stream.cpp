@@ -0,0 +1,339 @@
+#include "event_stream.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+namespace poot_cloud {
+
+namespace {
+
+const char* trimmedValue(const char* line, size_t nameLength) {
+  const char* value = line + nameLength;
+  while (*value == ' ' || *value == '\t') {
+    value++;
+  }
+  return value;
+}
+
+bool headerIs(const char* line, const char* name, size_t nameLength) {
+  return strncasecmp(line, name, nameLength) == 0;
+}
+
+int twoDigits(const char* p) {
+  if (p[0] < '0' || p[0] > '9' || p[1] < '0' || p[1] > '9') {
+    return -1;
+  }
+  return (p[0] - '0') * 10 + (p[1] - '0');
+}
+
+// "Sun, 06 Nov 1994 08:49:37 GMT" (RFC 7231 IMF-fixdate) to Unix seconds.
+uint32_t parseHttpDate(const char* value) {
+  static const char kMonths[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+  if (strlen(value) < 25) {
+    return 0;
+  }
+  int month = -1;
+  for (int i = 0; i < 12; i++) {
+    if (strncmp(value + 8, kMonths + 3 * i, 3) == 0) {
+      month = i + 1;
+    }
+  }
+  const int day = twoDigits(value + 5);
+  const int century = twoDigits(value + 12);
+  const int yy = twoDigits(value + 14);
+  const int hour = twoDigits(value + 17);
+  const int minute = twoDigits(value + 20);
+  const int second = twoDigits(value + 23);
+  if (month < 0 || day < 1 || century < 19 || yy < 0 || hour < 0 ||
+      minute < 0 || second < 0) {
+    return 0;
+  }
+  // Days since 1970-01-01 (Howard Hinnant's days_from_civil).
+  int year = century * 100 + yy - (month <= 2 ? 1 : 0);
+  const int era = year / 400;
+  const int yoe = year - era * 400;
+  const int doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  const int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  const int32_t days = era * 146097 + doe - 719468;
+  return static_cast<uint32_t>(days) * 86400UL + hour * 3600UL +
+         minute * 60UL + second;
+}
+
+int hexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+}  // namespace
+
+// ---- ResponseHead ----
+
+void ResponseHead::reset() { *this = ResponseHead(); }
+
+ResponseHead::Result ResponseHead::feed(char c) {
+  if (c == '\r') {
+    return Result::kMore;
+  }
+  if (c == '\n') {
+    return endLine();
+  }
+  if (length_ < kLineBytes - 1) {
+    line_[length_++] = c;
+  }
+  return Result::kMore;
+}
+
+ResponseHead::Result ResponseHead::endLine() {
+  line_[length_] = '\0';
+  if (!sawStatus_) {
+    if (length_ < 12 || strncmp(line_, "HTTP/1.", 7) != 0 ||
+        line_[8] != ' ') {
+      return Result::kError;
+    }
+    status_ = atoi(line_ + 9);
+    keepAlive_ = line_[7] == '1';  // HTTP/1.1 keeps it open by default
+    sawStatus_ = true;
+  } else if (length_ == 0) {
+    return Result::kDone;
+  } else if (headerIs(line_, "transfer-encoding:", 18)) {
+    chunked_ = strncasecmp(trimmedValue(line_, 18), "chunked", 7) == 0;
+  } else if (headerIs(line_, "content-length:", 15)) {
+    contentLength_ = atol(trimmedValue(line_, 15));
+  } else if (headerIs(line_, "connection:", 11)) {
+    const char* value = trimmedValue(line_, 11);
+    if (strncasecmp(value, "close", 5) == 0) {
+      keepAlive_ = false;
+    } else if (strncasecmp(value, "keep-alive", 10) == 0) {
+      keepAlive_ = true;
+    }
+  } else if (headerIs(line_, "location:", 9)) {
+    const char* host = trimmedValue(line_, 9);
+    const char* scheme = strstr(host, "://");
+    if (scheme != nullptr) {
+      host = scheme + 3;
+    }
+    size_t n = strcspn(host, ":/?");
+    if (n >= sizeof(redirectHost_)) {
+      n = 0;  // cannot be a host we can reach; treat as absent
+    }
+    memcpy(redirectHost_, host, n);
+    redirectHost_[n] = '\0';
+  } else if (headerIs(line_, "date:", 5)) {
+    date_ = parseHttpDate(trimmedValue(line_, 5));
+  }
+  length_ = 0;
+  return Result::kMore;
+}
+
+// ---- ChunkedDecoder ----
+
+void ChunkedDecoder::reset() { *this = ChunkedDecoder(); }
+
+int ChunkedDecoder::feed(char c) {
+  switch (phase_) {
+    case Phase::kSize: {
+      const int digit = hexValue(c);
+      if (digit >= 0) {
+        if (remaining_ > 0x0FFFFFFF) {
+          phase_ = Phase::kDone;
+          return kError;
+        }
+        remaining_ = remaining_ * 16 + static_cast<uint32_t>(digit);
+        sawDigit_ = true;
+        return kFraming;
+      }
+      if (!sawDigit_) {
+        break;
+      }
+      if (c == ';' || c == ' ' || c == '\t') {
+        phase_ = Phase::kExtension;
+        return kFraming;
+      }
+      if (c == '\r') {
+        phase_ = Phase::kSizeLf;
+        return kFraming;
+      }
+      if (c != '\n') {
+        break;
+      }
+      // Bare LF ends the size line too.
+      phase_ = Phase::kSizeLf;
+      return feed('\n');
+    }
+    case Phase::kExtension:
+      if (c == '\r' || c == '\n') {
+        phase_ = Phase::kSizeLf;
+        return c == '\n' ? feed('\n') : kFraming;
+      }
+      return kFraming;
+    case Phase::kSizeLf:
+      if (c != '\n') {
+        break;
+      }
+      sawDigit_ = false;
+      phase_ = remaining_ == 0 ? Phase::kTrailer : Phase::kData;
+      trailerEmpty_ = true;
+      return kFraming;
+    case Phase::kData:
+      if (--remaining_ == 0) {
+        phase_ = Phase::kDataCr;
+      }
+      return static_cast<uint8_t>(c);
+    case Phase::kDataCr:
+      if (c == '\r') {
+        phase_ = Phase::kDataLf;
+        return kFraming;
+      }
+      if (c != '\n') {
+        break;
+      }
+      phase_ = Phase::kSize;
+      return kFraming;
+    case Phase::kDataLf:
+      if (c != '\n') {
+        break;
+      }
+      phase_ = Phase::kSize;
+      return kFraming;
+    case Phase::kTrailer:
+      if (c == '\r') {
+        phase_ = Phase::kTrailerLf;
+        return kFraming;
+      }
+      if (c != '\n') {
+        trailerEmpty_ = false;
+        return kFraming;
+      }
+      phase_ = Phase::kTrailerLf;
+      return feed('\n');
+    case Phase::kTrailerLf:
+      if (c != '\n') {
+        break;
+      }
+      if (trailerEmpty_) {
+        phase_ = Phase::kDone;
+        return kEnd;
+      }
+      trailerEmpty_ = true;
+      phase_ = Phase::kTrailer;
+      return kFraming;
+    case Phase::kDone:
+      return kEnd;
+  }
+  phase_ = Phase::kDone;
+  return kError;
+}
+
+// ---- EventStreamParser ----
+
+void EventStreamParser::reset() {
+  field_ = Field::kName;
+  nameLength_ = 0;
+  lineEmpty_ = true;
+  skipSpace_ = false;
+  lastWasCr_ = false;
+  dispatched_ = false;
+  clearEvent();
+}
+
+void EventStreamParser::clearEvent() {
+  eventLength_ = 0;
+  event_[0] = '\0';
+  dataLength_ = 0;
+  data_[0] = '\0';
+  hasData_ = false;
+  truncated_ = false;
+}
+
+bool EventStreamParser::feed(char c) {
+  if (dispatched_) {
+    dispatched_ = false;
+    clearEvent();
+  }
+  if (lastWasCr_ && c == '\n') {
+    lastWasCr_ = false;
+    return false;
+  }
+  lastWasCr_ = c == '\r';
+  if (c == '\r' || c == '\n') {
+    return endLine();
+  }
+  lineEmpty_ = false;
+  if (field_ == Field::kName) {
+    if (c == ':') {
+      startValue();
+    } else if (nameLength_ < kFieldBytes - 1) {
+      name_[nameLength_++] = c;
+    } else {
+      field_ = Field::kIgnored;  // longer than any field we handle
+    }
+    return false;
+  }
+  if (skipSpace_) {
+    skipSpace_ = false;
+    if (c == ' ') {
+      return false;
+    }
+  }
+  if (field_ == Field::kEvent) {
+    if (eventLength_ < kEventBytes - 1) {
+      event_[eventLength_++] = c;
+    }
+  } else if (field_ == Field::kData) {
+    if (dataLength_ < sizeof(data_) - 1) {
+      data_[dataLength_++] = c;
+    } else {
+      truncated_ = true;
+    }
+  }
+  return false;
+}
+
+void EventStreamParser::startValue() {
+  name_[nameLength_] = '\0';
+  skipSpace_ = true;
+  if (nameLength_ == 0) {
+    field_ = Field::kIgnored;  // ":comment", used as a keep-alive
+  } else if (strcmp(name_, "event") == 0) {
+    field_ = Field::kEvent;
+    eventLength_ = 0;
+  } else if (strcmp(name_, "data") == 0) {
+    field_ = Field::kData;
+    if (hasData_) {
+      if (dataLength_ < sizeof(data_) - 1) {
+        data_[dataLength_++] = '\n';
+      } else {
+        truncated_ = true;
+      }
+    }
+    hasData_ = true;
+  } else {
+    field_ = Field::kIgnored;
+  }
+}
+
+bool EventStreamParser::endLine() {
+  if (!lineEmpty_) {
+    if (field_ == Field::kName) {
+      startValue();  // a field name alone has an empty value
+    }
+    field_ = Field::kName;
+    nameLength_ = 0;
+    lineEmpty_ = true;
+    skipSpace_ = false;
+    return false;
+  }
+  if (!hasData_) {
+    eventLength_ = 0;
+    return false;
+  }
+  event_[eventLength_] = '\0';
+  data_[dataLength_] = '\0';
+  dispatched_ = true;
+  return true;
+}
+
+}  // namespace poot_cloud
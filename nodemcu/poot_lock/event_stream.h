@@ -0,0 +1,133 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "config.h"
+
+namespace poot_cloud {
+
+// Incremental parsers for an HTTP response carrying a text/event-stream body
+// (what the Realtime Database REST API sends to a streaming GET). Each takes
+// one byte at a time and keeps only fixed buffers, so a response can be
+// parsed straight out of the socket as it arrives, split anywhere, without
+// buffering it or allocating.
+
+// Status line and the few headers the cloud client acts on. Other headers
+// are skipped; over-long lines are truncated.
+class ResponseHead {
+ public:
+  enum class Result : uint8_t {
+    kMore,
+    kDone,   // the blank line after the headers was consumed
+    kError,  // not an HTTP/1.x status line
+  };
+
+  void reset();
+  Result feed(char c);
+
+  int status() const { return status_; }
+  bool chunked() const { return chunked_; }
+  int32_t contentLength() const { return contentLength_; }  // -1 if absent
+  // Whether the connection may carry another request after this response.
+  bool keepAlive() const { return keepAlive_; }
+  // Host part of the Location header ("" if absent).
+  const char* redirectHost() const { return redirectHost_; }
+  // Date header as Unix seconds (0 if absent or unparsable).
+  uint32_t date() const { return date_; }
+
+ private:
+  static constexpr size_t kLineBytes = 96;
+
+  Result endLine();
+
+  char line_[kLineBytes];
+  uint8_t length_ = 0;
+  bool sawStatus_ = false;
+  int status_ = 0;
+  bool chunked_ = false;
+  int32_t contentLength_ = -1;
+  bool keepAlive_ = false;
+  char redirectHost_[64] = {0};
+  uint32_t date_ = 0;
+};
+
+// Transfer-Encoding: chunked, undone byte by byte.
+class ChunkedDecoder {
+ public:
+  // feed() results that are not body bytes.
+  static constexpr int kFraming = -1;
+  static constexpr int kEnd = -2;  // last chunk and trailers consumed
+  static constexpr int kError = -3;
+
+  void reset();
+  // Returns the body byte `c` carries (0-255) or one of the codes above.
+  int feed(char c);
+
+ private:
+  enum class Phase : uint8_t {
+    kSize,
+    kExtension,
+    kSizeLf,
+    kData,
+    kDataCr,
+    kDataLf,
+    kTrailer,
+    kTrailerLf,
+    kDone,
+  };
+
+  Phase phase_ = Phase::kSize;
+  uint32_t remaining_ = 0;
+  bool sawDigit_ = false;
+  bool trailerEmpty_ = true;
+};
+
+// Server-sent events: "event:" and "data:" fields (multi-line data joined
+// with '\n'), comments, and CR, LF or CRLF line ends. Other fields (id:,
+// retry:) are ignored. Data beyond kCloudEventBytes is dropped and the event
+// is flagged as truncated rather than failing the stream.
+class EventStreamParser {
+ public:
+  void reset();
+
+  // Returns true when `c` completes an event. The event stays readable until
+  // the next call.
+  bool feed(char c);
+
+  // "message" when the event had no event: field.
+  const char* event() const { return eventLength_ == 0 ? "message" : event_; }
+  const char* data() const { return data_; }
+  size_t dataLength() const { return dataLength_; }
+  bool truncated() const { return truncated_; }
+
+ private:
+  static constexpr size_t kFieldBytes = 8;
+  static constexpr size_t kEventBytes = 16;
+
+  enum class Field : uint8_t {
+    kName,   // reading the field name
+    kEvent,
+    kData,
+    kIgnored,
+  };
+
+  void clearEvent();
+  void startValue();
+  bool endLine();
+
+  Field field_ = Field::kName;
+  char name_[kFieldBytes];
+  uint8_t nameLength_ = 0;
+  bool lineEmpty_ = true;
+  bool skipSpace_ = false;
+  bool lastWasCr_ = false;
+  bool dispatched_ = false;
+  char event_[kEventBytes];
+  uint8_t eventLength_ = 0;
+  char data_[poot::kCloudEventBytes];
+  size_t dataLength_ = 0;
+  bool hasData_ = false;
+  bool truncated_ = false;
+};
+
+}  // namespace poot_cloud
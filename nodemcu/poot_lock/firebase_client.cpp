@@ -0,0 +1,955 @@
+#include "firebase_client.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "diagnostics.h"
+
+namespace poot_cloud {
+
+namespace {
+
+// ---- just enough JSON to read an event's data, in place ----
+
+const char* skipSpace(const char* p, const char* end) {
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) {
+    p++;
+  }
+  return p;
+}
+
+// `p` is at the opening quote. Returns the byte after the closing one.
+const char* skipString(const char* p, const char* end) {
+  for (p++; p < end; p++) {
+    if (*p == '\\') {
+      p++;
+    } else if (*p == '"') {
+      return p + 1;
+    }
+  }
+  return nullptr;
+}
+
+const char* skipValue(const char* p, const char* end) {
+  p = skipSpace(p, end);
+  if (p >= end) {
+    return nullptr;
+  }
+  if (*p == '"') {
+    return skipString(p, end);
+  }
+  if (*p == '{' || *p == '[') {
+    int depth = 0;
+    while (p < end) {
+      if (*p == '"') {
+        p = skipString(p, end);
+        if (p == nullptr) {
+          return nullptr;
+        }
+        continue;
+      }
+      if (*p == '{' || *p == '[') {
+        depth++;
+      } else if ((*p == '}' || *p == ']') && --depth == 0) {
+        return p + 1;
+      }
+      p++;
+    }
+    return nullptr;
+  }
+  // Number, true, false or null.
+  while (p < end && *p != ',' && *p != '}' && *p != ']' && *p != ' ') {
+    p++;
+  }
+  return p;
+}
+
+// Copies the string at `p` into `out`; `out` is left empty when the string
+// has escapes or does not fit. Returns the byte after it, or nullptr when
+// `p` is not a string.
+const char* readString(const char* p, const char* end, char* out,
+                       size_t size) {
+  out[0] = '\0';
+  if (p >= end || *p != '"') {
+    return nullptr;
+  }
+  const char* after = skipString(p, end);
+  if (after == nullptr) {
+    return nullptr;
+  }
+  const size_t length = static_cast<size_t>(after - p) - 2;
+  if (length < size && memchr(p + 1, '\\', length) == nullptr) {
+    memcpy(out, p + 1, length);
+    out[length] = '\0';
+  }
+  return after;
+}
+
+uint64_t readUint64(const char* p, const char* end) {
+  uint64_t value = 0;
+  for (; p < end && *p >= '0' && *p <= '9'; p++) {
+    value = value * 10 + static_cast<uint64_t>(*p - '0');
+  }
+  return value;
+}
+
+// Steps through the members of the object at `p`:
+//   MemberReader members(p, end);
+//   while (members.next(key, sizeof(key))) { members.value() ... }
+class MemberReader {
+ public:
+  MemberReader(const char* p, const char* end)
+      : p_(skipSpace(p, end)), end_(end) {
+    isObject_ = p_ < end_ && *p_ == '{';
+    ok_ = isObject_;
+    p_++;
+  }
+
+  bool isObject() const { return isObject_; }
+
+  // Copies the next key (empty when it does not fit) and finds its value.
+  bool next(char* key, size_t size) {
+    if (!ok_) {
+      return false;
+    }
+    p_ = skipSpace(p_, end_);
+    if (p_ < end_ && *p_ == ',') {
+      p_ = skipSpace(p_ + 1, end_);
+    }
+    p_ = readString(p_, end_, key, size);  // fails at the closing brace
+    if (p_ != nullptr) {
+      p_ = skipSpace(p_, end_);
+    }
+    if (p_ == nullptr || p_ >= end_ || *p_ != ':') {
+      ok_ = false;
+      return false;
+    }
+    value_ = skipSpace(p_ + 1, end_);
+    p_ = skipValue(value_, end_);
+    ok_ = p_ != nullptr;
+    return ok_;
+  }
+
+  const char* value() const { return value_; }
+  const char* valueEnd() const { return p_; }
+
+ private:
+  const char* p_;
+  const char* end_;
+  const char* value_ = nullptr;
+  bool isObject_;
+  bool ok_;
+};
+
+// Push ids (what the app's push() creates) are 20 characters from this
+// alphabet, which sorts in ASCII order; the first 8 encode the creation time
+// in ms, 6 bits each.
+constexpr char kPushChars[] =
+    "-0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ_abcdefghijklmnopqrstuvwxyz";
+constexpr size_t kPushIdLength = 20;
+
+bool isKeyChar(char c) {
+  return c != '\0' && strchr(kPushChars, c) != nullptr;
+}
+
+bool validKey(const char* key) {
+  size_t n = 0;
+  for (; key[n] != '\0'; n++) {
+    if (n >= kPushIdLength || !isKeyChar(key[n])) {
+      return false;
+    }
+  }
+  return n > 0;
+}
+
+uint64_t pushIdMs(const char* key) {
+  if (strlen(key) != kPushIdLength) {
+    return 0;
+  }
+  uint64_t ms = 0;
+  for (size_t i = 0; i < 8; i++) {
+    ms = ms * 64 + static_cast<uint64_t>(strchr(kPushChars, key[i]) -
+                                         kPushChars);
+  }
+  return ms;
+}
+
+template <size_t N>
+void copyString(char (&out)[N], const char* text) {
+  snprintf(out, N, "%s", text);
+}
+
+// A request is sent in a few large writes rather than one per piece: every
+// write to the TLS client becomes its own record.
+class RequestWriter {
+ public:
+  explicit RequestWriter(WiFiClient& client) : client_(client) {}
+
+  RequestWriter& operator<<(const char* text) {
+    while (*text != '\0') {
+      if (length_ == sizeof(buffer_)) {
+        flush();
+      }
+      buffer_[length_++] = *text++;
+    }
+    return *this;
+  }
+
+  RequestWriter& operator<<(unsigned long value) {
+    char digits[12];
+    snprintf(digits, sizeof(digits), "%lu", value);
+    return *this << digits;
+  }
+
+  // Returns false if anything could not be written.
+  bool flush() {
+    if (length_ > 0 && client_.write(buffer_, length_) != length_) {
+      failed_ = true;
+    }
+    length_ = 0;
+    return !failed_;
+  }
+
+ private:
+  WiFiClient& client_;
+  uint8_t buffer_[256];
+  size_t length_ = 0;
+  bool failed_ = false;
+};
+
+}  // namespace
+
+const char* FirebaseClient::stateName(State state) {
+  switch (state) {
+    case State::kStopped:   return "stopped";
+    case State::kOffline:   return "offline";
+    case State::kSigningIn: return "signing_in";
+    case State::kOpening:   return "opening";
+    case State::kStreaming: return "streaming";
+    case State::kWriting:   return "writing";
+    case State::kBackoff:   return "backoff";
+    default:                return "unknown";
+  }
+}
+
+void FirebaseClient::begin(const Config& config, CommandFn onCommand) {
+  config_ = config;
+  onCommand_ = onCommand;
+  copyString(host_, config.dbHost);
+  if (config.caPem != nullptr) {
+    if (trustAnchors_ == nullptr) {
+      trustAnchors_ = new BearSSL::X509List(config.caPem);
+    }
+    client_.setTrustAnchors(trustAnchors_);
+  } else {
+    client_.setInsecure();
+  }
+  client_.setTimeout(poot::kCloudResponseTimeoutMs);
+  resetBackoff();
+  state_ = State::kOffline;
+  stateSinceMs_ = millis();
+  poot_diag::logf("CLOUD", "stream host=%s lock=%s tls=%s", host_,
+                  config.lockId,
+                  config.caPem != nullptr ? "verified" : "unverified");
+}
+
+void FirebaseClient::stop() {
+  client_.stop();
+  writeInFlight_ = false;
+  state_ = State::kStopped;
+}
+
+void FirebaseClient::loop(bool online, bool busy) {
+  if (state_ == State::kStopped) {
+    return;
+  }
+  busy_ = busy;
+  if (!online) {
+    if (state_ != State::kOffline) {
+      client_.stop();
+      writeInFlight_ = false;  // the batch stays queued
+      state_ = State::kOffline;
+      stateSinceMs_ = millis();
+      poot_diag::logf("CLOUD", "offline");
+    }
+    return;
+  }
+  switch (state_) {
+    case State::kOffline:
+      connectNext();
+      break;
+    case State::kBackoff:
+      if (static_cast<int32_t>(millis() - retryAtMs_) >= 0) {
+        connectNext();
+      }
+      break;
+    case State::kSigningIn:
+    case State::kOpening:
+    case State::kWriting:
+      pump();
+      break;
+    case State::kStreaming:
+      pump();
+      // Not in the middle of an event, which would be read again.
+      if (state_ == State::kStreaming && !busy && auditDue() &&
+          millis() - lastRxMs_ >= poot::kAuditStreamQuietMs) {
+        client_.stop();
+        startWrite();
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+bool FirebaseClient::needsSignIn() const {
+  return config_.apiKey != nullptr &&
+         (tokenLength_ == 0 ||
+          millis() - tokenAtMs_ >= poot::kCloudTokenRefreshMs);
+}
+
+bool FirebaseClient::auditDue() const {
+  if (audit_ == nullptr || audit_->pending() == 0 ||
+      (config_.apiKey != nullptr && !tokenComplete_) ||
+      millis() - auditFailedAtMs_ < auditDelayMs_) {
+    return false;
+  }
+  return audit_->pending() >= poot::kAuditBatchEvents ||
+         millis() - audit_->oldestPendingMs() >= poot::kAuditFlushWindowMs;
+}
+
+bool FirebaseClient::deferConnect() {
+  if (!busy_) {
+    return false;
+  }
+  client_.stop();
+  writeInFlight_ = false;  // the batch stays queued
+  if (!deferring_) {
+    deferring_ = true;
+    connectsDeferred_++;
+  }
+  state_ = State::kBackoff;
+  stateSinceMs_ = millis();
+  retryAtMs_ = stateSinceMs_;
+  return true;
+}
+
+void FirebaseClient::connectNext(bool reuse) {
+  if (needsSignIn()) {
+    client_.stop();
+    startSignIn();
+  } else if (auditDue()) {
+    startWrite(reuse);
+  } else {
+    startStream(reuse);
+  }
+}
+
+bool FirebaseClient::connectTls(const char* host, TlsHost& tls) {
+  if (!tls.probed) {
+    tls.mfln = BearSSL::WiFiClientSecure::probeMaxFragmentLength(
+        host, config_.port, poot::kCloudTlsRecvBytes);
+  }
+  client_.setBufferSizes(recvBufferBytes(tls), poot::kCloudTlsSendBytes);
+  client_.setSession(&tls.session);
+  const br_ssl_session_parameters* params = tls.session.getSession();
+  uint8_t offered[sizeof(params->session_id)];
+  const uint8_t offeredLength = params->session_id_len;
+  memcpy(offered, params->session_id, sizeof(offered));
+
+  deferring_ = false;
+  const uint32_t startMs = millis();
+  if (!client_.connect(host, config_.port)) {
+    return false;  // a probe that failed with it is asked again
+  }
+  const uint32_t elapsedMs = millis() - startMs;
+  tls.probed = true;
+  connects_++;
+  // A server resuming the session echoes its id; otherwise it sends a new
+  // one (or none).
+  const bool resumed = offeredLength != 0 &&
+                       params->session_id_len == offeredLength &&
+                       memcmp(offered, params->session_id, offeredLength) == 0;
+  if (resumed) {
+    resumedHandshakes_++;
+    lastResumedHandshakeMs_ = elapsedMs;
+  } else {
+    fullHandshakes_++;
+    lastFullHandshakeMs_ = elapsedMs;
+  }
+  if (elapsedMs > maxHandshakeMs_) {
+    maxHandshakeMs_ = elapsedMs;
+  }
+  poot_diag::logf("CLOUD", "tls %s host=%s ms=%lu rx=%u",
+                  resumed ? "resumed" : "full", host,
+                  static_cast<unsigned long>(elapsedMs),
+                  static_cast<unsigned>(recvBufferBytes(tls)));
+  return true;
+}
+
+void FirebaseClient::startSignIn() {
+  static constexpr char kEmail[] = "{\"email\":\"";
+  static constexpr char kPassword[] = "\",\"password\":\"";
+  static constexpr char kTail[] = "\",\"returnSecureToken\":true}";
+  if (deferConnect()) {
+    return;
+  }
+  if (!connectTls(config_.authHost, authTls_)) {
+    closeAndRetry("sign-in connect failed", nextBackoffMs());
+    return;
+  }
+  const unsigned long bodyLength =
+      sizeof(kEmail) - 1 + strlen(config_.email) + sizeof(kPassword) - 1 +
+      strlen(config_.password) + sizeof(kTail) - 1;
+  RequestWriter request(client_);
+  request << "POST /v1/accounts:signInWithPassword?key=" << config_.apiKey
+          << " HTTP/1.1\r\nHost: " << config_.authHost
+          << "\r\nContent-Type: application/json\r\nConnection: close\r\n"
+             "Content-Length: "
+          << bodyLength << "\r\n\r\n"
+          << kEmail << config_.email << kPassword << config_.password
+          << kTail;
+  if (!request.flush()) {
+    closeAndRetry("sign-in write failed", nextBackoffMs());
+    return;
+  }
+  tokenLength_ = 0;
+  tokenMatch_ = 0;
+  tokenComplete_ = false;
+  startResponse(State::kSigningIn);
+}
+
+void FirebaseClient::startStream(bool reuse) {
+  if (!reuse) {
+    if (deferConnect()) {
+      return;
+    }
+    if (!connectTls(host_, dbTls_)) {
+      copyString(host_, config_.dbHost);
+      closeAndRetry("stream connect failed", nextBackoffMs());
+      return;
+    }
+    client_.setNoDelay(true);
+  }
+  RequestWriter request(client_);
+  request << "GET /locks/" << config_.lockId << "/commands.json?";
+  if (tokenLength_ > 0) {
+    request << "auth=" << token_ << "&";
+  }
+  // Resuming at the last key replays that one child, which is then skipped.
+  request << "orderBy=%22%24key%22&";
+  if (lastKey_[0] != '\0') {
+    request << "startAt=%22" << lastKey_ << "%22";
+  } else {
+    request << "limitToLast=1";
+  }
+  request << " HTTP/1.1\r\nHost: " << host_
+          << "\r\nAccept: text/event-stream\r\n\r\n";
+  if (!request.flush()) {
+    closeAndRetry("stream write failed", nextBackoffMs());
+    return;
+  }
+  startResponse(State::kOpening);
+}
+
+void FirebaseClient::startWrite(bool reuse) {
+  if (!reuse && deferConnect()) {
+    return;
+  }
+  poot_audit::Event batch[poot::kAuditBatchEvents];
+  const uint8_t count = audit_->peek(batch, poot::kAuditBatchEvents);
+  if (count == 0) {
+    startStream(reuse);  // everything pending was lost from flash
+    return;
+  }
+  writeInFlight_ = true;  // failures from here on count against the batch
+  if (!reuse) {
+    if (!connectTls(host_, dbTls_)) {
+      copyString(host_, config_.dbHost);
+      closeAndRetry("audit connect failed", nextBackoffMs());
+      return;
+    }
+    client_.setNoDelay(true);
+  }
+
+  // Content-Length first, so every event is formatted twice.
+  char entry[224];
+  unsigned long bodyLength = 1;  // the closing brace
+  for (uint8_t i = 0; i < count; i++) {
+    bodyLength += 1 + formatAuditEvent(batch[i], entry, sizeof(entry));
+  }
+  RequestWriter request(client_);
+  request << "PATCH /locks/" << config_.lockId << ".json?";
+  if (tokenLength_ > 0) {
+    request << "auth=" << token_ << "&";
+  }
+  request << "print=silent HTTP/1.1\r\nHost: " << host_
+          << "\r\nContent-Type: application/json\r\nContent-Length: "
+          << bodyLength << "\r\n\r\n";
+  for (uint8_t i = 0; i < count; i++) {
+    formatAuditEvent(batch[i], entry, sizeof(entry));
+    request << (i == 0 ? "{" : ",") << entry;
+  }
+  request << "}";
+  if (!request.flush()) {
+    closeAndRetry("audit write failed", nextBackoffMs());
+    return;
+  }
+  batchSeq_ = batch[count - 1].seq;
+  batchEvents_ = count;
+  batchTimed_ = audit_->thisBoot(batch[0]);
+  batchOldestMs_ = batch[0].uptimeMs;
+  writeStartMs_ = millis();
+  startResponse(State::kWriting);
+}
+
+// One child of the multi-path update:
+//   "audit/<key>":{"source":..,"outcome":..,"command":..,"uptime_ms":..,
+//                  "at":..,"written_at":{".sv":"timestamp"}}
+// "command" is only there for cloud commands and "at" (Unix ms) only when
+// the database's clock was known while the event's boot was running.
+size_t FirebaseClient::formatAuditEvent(const poot_audit::Event& event,
+                                        char* out, size_t size) const {
+  char key[17];
+  audit_->key(event, key);
+  int length = snprintf(out, size, "\"audit/%s\":{\"source\":\"%s\","
+                        "\"outcome\":\"%s\"",
+                        key, poot_audit::sourceName(event.source),
+                        poot_audit::outcomeName(event.outcome));
+  if (event.ref[0] != '\0' && validKey(event.ref)) {
+    length += snprintf(out + length, size - length, ",\"command\":\"%s\"",
+                       event.ref);
+  }
+  length += snprintf(out + length, size - length, ",\"uptime_ms\":%lu",
+                     (unsigned long)event.uptimeMs);
+  const uint64_t nowMs = serverTimeMs();
+  if (nowMs != 0 && audit_->thisBoot(event)) {
+    // Unix ms as seconds and three digits: no 64-bit printf needed.
+    const uint64_t atMs = nowMs - (millis() - event.uptimeMs);
+    length += snprintf(out + length, size - length, ",\"at\":%lu%03u",
+                       (unsigned long)(atMs / 1000),
+                       (unsigned)(atMs % 1000));
+  }
+  length += snprintf(out + length, size - length,
+                     ",\"written_at\":{\".sv\":\"timestamp\"}}");
+  return static_cast<size_t>(length);
+}
+
+void FirebaseClient::startResponse(State state) {
+  head_.reset();
+  headDone_ = false;
+  chunked_.reset();
+  bodyLeft_ = -1;
+  state_ = state;
+  stateSinceMs_ = millis();
+  lastRxMs_ = stateSinceMs_;
+}
+
+void FirebaseClient::pump() {
+  uint8_t buffer[128];
+  size_t budget = poot::kCloudReadBytesPerPass;
+  const State reading = state_;
+  while (budget > 0 && state_ == reading) {
+    const int ready = client_.available();
+    if (ready <= 0) {
+      break;
+    }
+    size_t want = static_cast<size_t>(ready);
+    want = want < sizeof(buffer) ? want : sizeof(buffer);
+    want = want < budget ? want : budget;
+    const int n = client_.read(buffer, want);
+    if (n <= 0) {
+      break;
+    }
+    budget -= static_cast<size_t>(n);
+    lastRxMs_ = millis();
+    for (int i = 0; i < n; i++) {
+      if (!feed(static_cast<char>(buffer[i]))) {
+        return;
+      }
+    }
+  }
+  if (state_ != reading || budget == 0) {
+    return;
+  }
+
+  const uint32_t now = millis();
+  if (!client_.connected()) {
+    // A body without a length ends when the connection does.
+    if ((state_ == State::kSigningIn || state_ == State::kWriting) &&
+        headDone_ && !head_.chunked() && bodyLeft_ < 0) {
+      onBodyEnd();
+      return;
+    }
+    closeAndRetry(state_ == State::kStreaming ? "stream closed"
+                                              : "connection closed",
+                  nextBackoffMs());
+  } else if (state_ == State::kStreaming) {
+    if (now - lastRxMs_ >= poot::kCloudStreamIdleMs) {
+      closeAndRetry("stream idle", nextBackoffMs());
+    }
+  } else if (now - stateSinceMs_ >= poot::kCloudResponseTimeoutMs) {
+    closeAndRetry("no reply", nextBackoffMs());
+  }
+}
+
+bool FirebaseClient::feed(char c) {
+  if (!headDone_) {
+    switch (head_.feed(c)) {
+      case ResponseHead::Result::kMore:
+        return true;
+      case ResponseHead::Result::kError:
+        closeAndRetry("malformed reply", nextBackoffMs());
+        return false;
+      case ResponseHead::Result::kDone:
+        headDone_ = true;
+        return onHead();
+    }
+  }
+  if (head_.chunked()) {
+    const int b = chunked_.feed(c);
+    if (b == ChunkedDecoder::kFraming) {
+      return true;
+    }
+    if (b == ChunkedDecoder::kEnd) {
+      return onBodyEnd();
+    }
+    if (b == ChunkedDecoder::kError) {
+      closeAndRetry("malformed chunk", nextBackoffMs());
+      return false;
+    }
+  } else if (bodyLeft_ > 0) {
+    bodyLeft_--;
+  }
+  if (state_ == State::kSigningIn) {
+    feedToken(c);
+  } else if (state_ == State::kStreaming && parser_.feed(c)) {
+    events_++;
+    handleEvent();
+    if (state_ != State::kStreaming) {
+      return false;
+    }
+  }
+  if (bodyLeft_ == 0 && !head_.chunked()) {
+    return onBodyEnd();
+  }
+  return true;
+}
+
+bool FirebaseClient::onHead() {
+  const int status = head_.status();
+  if (!head_.chunked()) {
+    bodyLeft_ = head_.contentLength();
+  }
+  if (head_.date() != 0) {
+    serverDateS_ = head_.date();
+    serverDateAtMs_ = millis();
+  }
+  if (state_ == State::kWriting) {
+    if (status == 200 || status == 204) {
+      // 204 (print=silent) has no body whatever its headers say.
+      return status == 204 || bodyLeft_ == 0 ? onBodyEnd() : true;
+    }
+    if ((status == 301 || status == 302 || status == 307 || status == 308) &&
+        head_.redirectHost()[0] != '\0' && redirects_ < kMaxRedirects) {
+      redirects_++;
+      copyString(host_, head_.redirectHost());
+      poot_diag::logf("AUDIT", "write redirected to %s", host_);
+      client_.stop();
+      startWrite();
+      return false;
+    }
+    poot_diag::logf("AUDIT", "write refused status=%d", status);
+    if (status == 401) {
+      tokenLength_ = 0;
+      tokenComplete_ = false;
+    }
+    auditFailed("audit refused");
+    client_.stop();
+    connectNext();
+    return false;
+  }
+  if (state_ == State::kSigningIn) {
+    if (status == 200) {
+      return bodyLeft_ == 0 ? onBodyEnd() : true;
+    }
+    poot_diag::logf("CLOUD", "sign-in refused status=%d", status);
+    closeAndRetry("sign-in refused", nextBackoffMs());
+    return false;
+  }
+
+  if (status == 200) {
+    state_ = State::kStreaming;
+    stateSinceMs_ = millis();
+    redirects_ = 0;
+    resetBackoff();
+    parser_.reset();
+    snapshotPending_ = true;
+    poot_diag::logf("CLOUD", "stream open host=%s resume=%s", host_,
+                    lastKey_[0] != '\0' ? lastKey_ : "-");
+    return true;
+  }
+  if ((status == 301 || status == 302 || status == 307 || status == 308) &&
+      head_.redirectHost()[0] != '\0' && redirects_ < kMaxRedirects) {
+    redirects_++;
+    copyString(host_, head_.redirectHost());
+    poot_diag::logf("CLOUD", "stream redirected to %s", host_);
+    client_.stop();
+    startStream();
+    return false;
+  }
+  poot_diag::logf("CLOUD", "stream refused status=%d", status);
+  if (status == 401) {
+    tokenLength_ = 0;  // sign in again before the next attempt
+    tokenComplete_ = false;
+  }
+  copyString(host_, config_.dbHost);
+  redirects_ = 0;
+  closeAndRetry("stream refused", nextBackoffMs());
+  return false;
+}
+
+bool FirebaseClient::onBodyEnd() {
+  if (state_ == State::kStreaming) {
+    closeAndRetry("stream ended", nextBackoffMs());
+    return false;
+  }
+  if (state_ == State::kWriting) {
+    finishWrite();
+    const bool reuse = head_.keepAlive() && client_.connected();
+    if (!reuse) {
+      client_.stop();
+    }
+    connectNext(reuse);
+    return false;
+  }
+  client_.stop();
+  if (!tokenComplete_) {
+    tokenLength_ = 0;
+    closeAndRetry("sign-in reply without token", nextBackoffMs());
+    return false;
+  }
+  signIns_++;
+  tokenAtMs_ = millis();
+  poot_diag::logf("CLOUD", "signed in token_bytes=%u",
+                  static_cast<unsigned>(tokenLength_));
+  connectNext();
+  return false;
+}
+
+// Picks the "idToken" string out of the sign-in reply as it streams past.
+void FirebaseClient::feedToken(char c) {
+  static constexpr char kKey[] = "\"idToken\"";
+  static constexpr uint8_t kKeyLength = sizeof(kKey) - 1;
+  static constexpr uint8_t kAfterKey = kKeyLength;
+  static constexpr uint8_t kInValue = kKeyLength + 1;
+  static constexpr uint8_t kGaveUp = 0xFF;
+  if (tokenComplete_ || tokenMatch_ == kGaveUp) {
+    return;
+  }
+  if (tokenMatch_ < kKeyLength) {
+    tokenMatch_ = c == kKey[tokenMatch_] ? tokenMatch_ + 1 : (c == '"' ? 1 : 0);
+  } else if (tokenMatch_ == kAfterKey) {
+    if (c == '"') {
+      tokenMatch_ = kInValue;
+    } else if (c != ':' && c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+      tokenMatch_ = 0;
+    }
+  } else if (c == '"') {
+    token_[tokenLength_] = '\0';
+    tokenComplete_ = tokenLength_ > 0;
+  } else if (tokenLength_ + 1 < sizeof(token_)) {
+    token_[tokenLength_++] = c;
+  } else {
+    tokenLength_ = 0;
+    tokenMatch_ = kGaveUp;
+  }
+}
+
+void FirebaseClient::handleEvent() {
+  const char* name = parser_.event();
+  if (strcmp(name, "keep-alive") == 0) {
+    return;
+  }
+  if (strcmp(name, "cancel") == 0) {
+    // The rules no longer allow the read; retrying soon will not help.
+    backoffMs_ = poot::kCloudBackoffMaxMs;
+    closeAndRetry("stream cancelled", nextBackoffMs());
+    return;
+  }
+  if (strcmp(name, "auth_revoked") == 0) {
+    tokenLength_ = 0;
+    tokenComplete_ = false;
+    closeAndRetry("token expired", 0);
+    return;
+  }
+  const bool put = strcmp(name, "put") == 0;
+  if (!put && strcmp(name, "patch") != 0) {
+    return;
+  }
+  const bool snapshot = snapshotPending_ && put;
+  snapshotPending_ = false;
+  if (parser_.truncated()) {
+    if (snapshot) {
+      // Too many unfinished commands to read at once; start from the newest.
+      lastKey_[0] = '\0';
+      closeAndRetry("snapshot too large", 0);
+    } else {
+      commandsSkipped_++;
+      poot_diag::logf("CLOUD", "event over %u bytes skipped",
+                      static_cast<unsigned>(poot::kCloudEventBytes));
+    }
+    return;
+  }
+
+  const char* end = parser_.data() + parser_.dataLength();
+  char path[kKeyBytes + 1];  // "/" plus a key
+  path[0] = '\0';
+  const char* value = nullptr;
+  const char* valueEnd = nullptr;
+  char member[8];
+  MemberReader members(parser_.data(), end);
+  while (members.next(member, sizeof(member))) {
+    if (strcmp(member, "path") == 0) {
+      readString(members.value(), end, path, sizeof(path));
+    } else if (strcmp(member, "data") == 0) {
+      value = members.value();
+      valueEnd = members.valueEnd();
+    }
+  }
+  if (value == nullptr || path[0] != '/') {
+    return;  // a deeper path (a field of one command), or malformed
+  }
+  if (path[1] == '\0') {
+    // The whole list (the snapshot, or a multi-child write). Every child is
+    // compared with the last key from before the event.
+    char seen[kKeyBytes];
+    memcpy(seen, lastKey_, sizeof(seen));
+    char key[kKeyBytes];
+    MemberReader children(value, valueEnd);
+    while (children.next(key, sizeof(key))) {
+      handleCommand(key, children.value(), children.valueEnd(), seen,
+                    snapshot);
+    }
+    return;
+  }
+  if (strchr(path + 1, '/') == nullptr) {
+    char seen[kKeyBytes];
+    memcpy(seen, lastKey_, sizeof(seen));
+    handleCommand(path + 1, value, valueEnd, seen, snapshot);
+  }
+}
+
+void FirebaseClient::handleCommand(const char* key, const char* value,
+                                   const char* end, const char* seenKey,
+                                   bool snapshot) {
+  if (!validKey(key) || (seenKey[0] != '\0' && strcmp(key, seenKey) <= 0)) {
+    return;
+  }
+  if (strcmp(key, lastKey_) > 0) {
+    copyString(lastKey_, key);
+  }
+  MemberReader members(value, end);
+  if (!members.isObject()) {
+    return;  // deleted, or not a command
+  }
+  char action[kActionBytes] = {0};
+  uint64_t createdAtMs = 0;
+  char member[12];
+  while (members.next(member, sizeof(member))) {
+    if (strcmp(member, "action") == 0) {
+      readString(members.value(), end, action, sizeof(action));
+    } else if (strcmp(member, "createdAt") == 0) {
+      createdAtMs = readUint64(members.value(), members.valueEnd());
+    }
+  }
+  if (action[0] == '\0') {
+    commandsSkipped_++;
+    poot_diag::logf("CLOUD", "command %s has no action", key);
+    return;
+  }
+  if (!commandIsFresh(key, createdAtMs, snapshot)) {
+    commandsSkipped_++;
+    poot_diag::logf("CLOUD", "command %s skipped as stale", key);
+    return;
+  }
+  commandsRun_++;
+  poot_diag::logf("CLOUD", "command %s action=%s", key, action);
+  if (onCommand_ != nullptr) {
+    onCommand_(key, action);
+  }
+}
+
+bool FirebaseClient::commandIsFresh(const char* key, uint64_t createdAtMs,
+                                    bool snapshot) const {
+  const uint64_t created = createdAtMs != 0 ? createdAtMs : pushIdMs(key);
+  const uint64_t serverNowMs = serverTimeMs();
+  if (created == 0 || serverNowMs == 0) {
+    return !snapshot;
+  }
+  return created + poot::kCloudCommandMaxAgeMs >= serverNowMs;
+}
+
+uint64_t FirebaseClient::serverTimeMs() const {
+  if (serverDateS_ == 0) {
+    return 0;
+  }
+  return serverDateS_ * 1000ULL + (millis() - serverDateAtMs_);
+}
+
+void FirebaseClient::finishWrite() {
+  const uint32_t now = millis();
+  writeInFlight_ = false;
+  audit_->ack(batchSeq_);
+  auditWrites_++;
+  redirects_ = 0;
+  lastWriteMs_ = now - writeStartMs_;
+  if (batchTimed_) {
+    lastFlushMs_ = now - batchOldestMs_;
+    if (lastFlushMs_ > maxFlushMs_) {
+      maxFlushMs_ = lastFlushMs_;
+    }
+  }
+  auditBackoffMs_ = poot::kAuditBackoffMinMs;
+  auditDelayMs_ = 0;
+  poot_diag::logf("AUDIT", "wrote events=%u request_ms=%lu flush_ms=%ld",
+                  batchEvents_, (unsigned long)lastWriteMs_,
+                  batchTimed_ ? (long)lastFlushMs_ : -1L);
+}
+
+// Jittered like nextBackoffMs(), on its own schedule: a refused write must
+// not hold the stream back.
+void FirebaseClient::auditFailed(const char* why) {
+  writeInFlight_ = false;
+  auditFailures_++;
+  auditFailedAtMs_ = millis();
+  auditDelayMs_ = auditBackoffMs_ + random(auditBackoffMs_ / 4 + 1);
+  auditBackoffMs_ = auditBackoffMs_ >= poot::kAuditBackoffMaxMs / 2
+                        ? poot::kAuditBackoffMaxMs
+                        : auditBackoffMs_ * 2;
+  poot_diag::logf("AUDIT", "%s, events=%lu retry in %lu ms", why,
+                  (unsigned long)audit_->pending(),
+                  (unsigned long)auditDelayMs_);
+}
+
+uint32_t FirebaseClient::nextBackoffMs() {
+  const uint32_t delayMs = backoffMs_ + random(backoffMs_ / 4 + 1);
+  backoffMs_ = backoffMs_ >= poot::kCloudBackoffMaxMs / 2
+                   ? poot::kCloudBackoffMaxMs
+                   : backoffMs_ * 2;
+  return delayMs;
+}
+
+void FirebaseClient::closeAndRetry(const char* why, uint32_t delayMs) {
+  if (writeInFlight_) {
+    auditFailed(why);
+  }
+  client_.stop();
+  state_ = State::kBackoff;
+  stateSinceMs_ = millis();
+  retryAtMs_ = stateSinceMs_ + delayMs;
+  poot_diag::logf("CLOUD", "%s, retry in %lu ms", why,
+                  static_cast<unsigned long>(delayMs));
+}
+
+}  // namespace poot_cloud
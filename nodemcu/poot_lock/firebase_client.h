@@ -0,0 +1,243 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFiClientSecure.h>
+
+#include "audit_log.h"
+#include "config.h"
+#include "event_stream.h"
+
+namespace poot_cloud {
+
+struct Config {
+  const char* dbHost;    // e.g. "poot-default-rtdb.firebaseio.com"
+  uint16_t port;         // both hosts; kCloudPort outside the host build
+  const char* authHost;  // Identity Toolkit, for the device account
+  const char* apiKey;    // nullptr: no sign-in (rules must allow the read)
+  const char* email;
+  const char* password;
+  const char* lockId;
+  const char* caPem;     // nullptr: the server certificate is not checked
+};
+
+// Receives remote commands over one long-lived Realtime Database REST
+// stream (GET .../commands.json with Accept: text/event-stream) instead of
+// polling. The response is parsed as it arrives (event_stream.h), so a
+// command reaches the relay one network trip after it is written.
+//
+// Only children newer than the last command seen are run, so a reconnect
+// resumes with startAt=<last key> and nothing is run twice; after a boot the
+// stream starts from the newest command. A command must also be younger
+// than kCloudCommandMaxAgeMs by the database's clock (its createdAt, or the
+// time encoded in its push id, against the Date header). Commands in the
+// initial snapshot whose age cannot be checked are skipped; only ones
+// arriving live are trusted without it.
+//
+// The client signs in with the device account when the stream opens with no
+// token, when the token is older than kCloudTokenRefreshMs and after
+// auth_revoked (the database's "token expired"). A dead stream (no bytes,
+// keep-alives included, for kCloudStreamIdleMs), a closed connection or an
+// error reply reconnects after an exponential backoff. Redirects to another
+// database host are followed.
+//
+// With an audit log attached, its events go out through the same client,
+// since the lock cannot hold two TLS sessions. Once a batch is due
+// (config.h) and the stream has been quiet for kAuditStreamQuietMs, the
+// stream's connection is closed and a new one opened (a resumed handshake
+// where the server allows it; see kAuditFlushWindowMs for the cost). The
+// batch goes out on it as one multi-path PATCH of /locks/{lockId}
+// (print=silent), and the stream is reopened on that connection, resuming
+// at the last key so no command is missed. A failed write leaves the events
+// queued and is retried after its own backoff; the stream carries on
+// meanwhile.
+//
+// Connecting blocks for the TLS handshake (and, the first time, an MFLN
+// probe); everything after that is read from loop() without blocking, at
+// most kCloudReadBytesPerPass per pass. While loop() is told the lock is
+// busy no connect is started, so a handshake never holds up a pulse or a
+// local request.
+// The database connection is kept for as long as the server allows (stream
+// and audit writes share it), and every reconnect offers the host's last
+// TLS session: BearSSL resumes by session id, which skips the public-key
+// work that makes a full handshake cost a second or more. Each host is asked
+// once for MFLN; where it is taken the receive buffer shrinks from 16 KB to
+// kCloudTlsRecvBytes.
+class FirebaseClient {
+ public:
+  enum class State : uint8_t {
+    kStopped,
+    kOffline,    // waiting for the STA link
+    kSigningIn,  // reading the sign-in reply
+    kOpening,    // reading the stream's response head
+    kStreaming,
+    kWriting,    // reading the reply to an audit batch
+    kBackoff,
+  };
+
+  // `commandId` is the child key, `action` its "action" member.
+  using CommandFn = void (*)(const char* commandId, const char* action);
+
+  void begin(const Config& config, CommandFn onCommand);
+  // Writes the events queued in `log`; nullptr stops that.
+  void attachAudit(poot_audit::AuditLog* log) { audit_ = log; }
+  void stop();
+
+  // Call every loop() pass; `online` is whether the STA link is up. `busy`
+  // (the relay is on, a local request is waiting) puts off any connect to a
+  // later pass; an open stream is still read.
+  void loop(bool online, bool busy = false);
+
+  State state() const { return state_; }
+  static const char* stateName(State state);
+  bool streaming() const { return state_ == State::kStreaming; }
+
+  uint32_t connects() const { return connects_; }
+  // Connects put off because the lock was busy (once per wait).
+  uint32_t connectsDeferred() const { return connectsDeferred_; }
+  uint32_t signIns() const { return signIns_; }
+  uint32_t events() const { return events_; }
+  uint32_t commandsRun() const { return commandsRun_; }
+  uint32_t commandsSkipped() const { return commandsSkipped_; }
+  const char* lastCommandId() const { return lastKey_; }
+
+  // The database's clock in Unix ms; 0 until a reply carried a Date header.
+  uint64_t serverTimeMs() const;
+
+  uint32_t auditWrites() const { return auditWrites_; }
+  uint32_t auditFailures() const { return auditFailures_; }
+  // Time from the oldest event in a batch being queued to the batch being
+  // written: the last one and the highest. Batches that start with an event
+  // from an earlier boot are not timed.
+  uint32_t lastFlushMs() const { return lastFlushMs_; }
+  uint32_t maxFlushMs() const { return maxFlushMs_; }
+  // Request to reply of the last batch.
+  uint32_t lastWriteMs() const { return lastWriteMs_; }
+
+  // TLS handshakes by kind, and how long the last of each took (connect
+  // included).
+  uint32_t fullHandshakes() const { return fullHandshakes_; }
+  uint32_t resumedHandshakes() const { return resumedHandshakes_; }
+  uint32_t lastFullHandshakeMs() const { return lastFullHandshakeMs_; }
+  uint32_t lastResumedHandshakeMs() const { return lastResumedHandshakeMs_; }
+  uint32_t maxHandshakeMs() const { return maxHandshakeMs_; }
+  // Receive buffer the database connection uses.
+  uint16_t tlsRecvBufferBytes() const { return recvBufferBytes(dbTls_); }
+
+ private:
+  static constexpr size_t kKeyBytes = 21;     // push ids are 20 chars
+  static constexpr size_t kActionBytes = 16;
+  static constexpr uint8_t kMaxRedirects = 3;
+  static constexpr uint16_t kTlsFullRecordBytes = 16384;
+
+  // What is kept about one server's TLS: its last session, and whether it
+  // takes kCloudTlsRecvBytes records.
+  struct TlsHost {
+    BearSSL::Session session;
+    bool probed = false;
+    bool mfln = false;
+  };
+
+  static uint16_t recvBufferBytes(const TlsHost& tls) {
+    return tls.mfln ? poot::kCloudTlsRecvBytes : kTlsFullRecordBytes;
+  }
+
+  bool needsSignIn() const;
+  // True (and back to kBackoff, due at once) when a connect has to wait
+  // for a pass that is not busy.
+  bool deferConnect();
+  bool auditDue() const;
+  // Signs in, writes an audit batch or opens the stream, whichever is
+  // needed first. `reuse` sends over the open connection to host_.
+  void connectNext(bool reuse = false);
+  // Connects client_ to `host`, offering tls.session; counts the handshake.
+  bool connectTls(const char* host, TlsHost& tls);
+  void startSignIn();
+  void startStream(bool reuse = false);
+  void startWrite(bool reuse = false);
+  size_t formatAuditEvent(const poot_audit::Event& event, char* out,
+                          size_t size) const;
+  void finishWrite();
+  void auditFailed(const char* why);
+  void startResponse(State state);
+  // Reads what has arrived on the sign-in or stream connection.
+  void pump();
+  // Feeds one received byte through the head and body framing; false once
+  // the connection was closed or replaced.
+  bool feed(char c);
+  bool onHead();
+  bool onBodyEnd();
+  void feedToken(char c);
+  void handleEvent();
+  void handleCommand(const char* key, const char* value, const char* end,
+                     const char* seenKey, bool snapshot);
+  bool commandIsFresh(const char* key, uint64_t createdAtMs,
+                      bool snapshot) const;
+  void closeAndRetry(const char* why, uint32_t delayMs);
+  // The current backoff plus up to 25% jitter; doubles it for next time.
+  uint32_t nextBackoffMs();
+  void resetBackoff() { backoffMs_ = poot::kCloudBackoffMinMs; }
+
+  Config config_ = {};
+  CommandFn onCommand_ = nullptr;
+  BearSSL::WiFiClientSecure client_;
+  BearSSL::X509List* trustAnchors_ = nullptr;
+  TlsHost authTls_;
+  TlsHost dbTls_;  // also used for hosts the database redirects to
+  State state_ = State::kStopped;
+  uint32_t stateSinceMs_ = 0;
+  uint32_t lastRxMs_ = 0;
+  uint32_t backoffMs_ = poot::kCloudBackoffMinMs;
+  uint32_t retryAtMs_ = 0;
+  bool busy_ = false;       // this loop() pass's `busy`
+  bool deferring_ = false;  // a connect has been put off since the last one
+
+  char host_[64] = {0};  // dbHost, or where it redirected to
+  uint8_t redirects_ = 0;
+  ResponseHead head_;
+  bool headDone_ = false;
+  ChunkedDecoder chunked_;
+  int32_t bodyLeft_ = -1;  // Content-Length countdown, -1 when not used
+  EventStreamParser parser_;
+  bool snapshotPending_ = false;
+  // The database's clock: Date header (s) and millis() when it was read.
+  uint32_t serverDateS_ = 0;
+  uint32_t serverDateAtMs_ = 0;
+
+  char token_[poot::kCloudTokenBytes] = {0};
+  size_t tokenLength_ = 0;
+  uint8_t tokenMatch_ = 0;  // progress through "idToken" and the value
+  bool tokenComplete_ = false;
+  uint32_t tokenAtMs_ = 0;
+
+  char lastKey_[kKeyBytes] = {0};
+
+  uint32_t connects_ = 0;
+  uint32_t connectsDeferred_ = 0;
+  uint32_t signIns_ = 0;
+  uint32_t events_ = 0;
+  uint32_t commandsRun_ = 0;
+  uint32_t commandsSkipped_ = 0;
+  uint32_t fullHandshakes_ = 0;
+  uint32_t resumedHandshakes_ = 0;
+  uint32_t lastFullHandshakeMs_ = 0;
+  uint32_t lastResumedHandshakeMs_ = 0;
+  uint32_t maxHandshakeMs_ = 0;
+
+  poot_audit::AuditLog* audit_ = nullptr;
+  bool writeInFlight_ = false;
+  uint32_t batchSeq_ = 0;  // newest event in the batch being written
+  uint8_t batchEvents_ = 0;
+  uint32_t batchOldestMs_ = 0;
+  bool batchTimed_ = false;  // oldest event is from this boot
+  uint32_t writeStartMs_ = 0;
+  uint32_t auditBackoffMs_ = poot::kAuditBackoffMinMs;
+  uint32_t auditFailedAtMs_ = 0;
+  uint32_t auditDelayMs_ = 0;  // after auditFailedAtMs_; 0 when not failing
+  uint32_t auditWrites_ = 0;
+  uint32_t auditFailures_ = 0;
+  uint32_t lastFlushMs_ = 0;
+  uint32_t maxFlushMs_ = 0;
+  uint32_t lastWriteMs_ = 0;
+};
+
+}  // namespace poot_cloud
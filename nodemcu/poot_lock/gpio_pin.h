@@ -0,0 +1,63 @@
+#pragma once
+
+#include <Arduino.h>
+
+namespace poot_gpio {
+
+// Push-pull outputs fixed at compile time, for the relay and the status LED.
+// digitalWrite() takes the pin at run time: it stops any waveform or PWM on
+// it, then branches on the pin number and the level. Here the pins and their
+// polarity are template arguments, so on() and off() are each a single store
+// to GPOS or GPOC. Set and clear are separate registers, so there is no
+// read-modify-write either. GPIO16 sits in the RTC block and is driven
+// through GP16O instead. Pins given together switch in the same store, e.g. a
+// second relay channel wired to pulse with the first.
+template <bool ActiveLow, uint8_t... Pins>
+class OutputPins {
+ public:
+  static_assert(sizeof...(Pins) > 0, "no pins given");
+  static_assert(((Pins <= 16) && ...), "not an ESP8266 GPIO");
+
+  static constexpr bool kActiveLow = ActiveLow;
+  // Bit n for GPIO n, GPIO16 included.
+  static constexpr uint32_t kPins = ((1UL << Pins) | ...);
+
+  // pinMode() is only called here; it is not on any hot path.
+  static void begin() {
+    (pinMode(Pins, OUTPUT), ...);
+    off();
+  }
+
+  static inline void on() { drive<!ActiveLow>(); }
+  static inline void off() { drive<ActiveLow>(); }
+  static inline void write(bool active) {
+    if (active) {
+      on();
+    } else {
+      off();
+    }
+  }
+
+ private:
+  static constexpr uint32_t kGpioPins = kPins & 0xFFFFUL;
+  static constexpr bool kGpio16 = (kPins & (1UL << 16)) != 0;
+
+  template <bool High>
+  static inline void drive() {
+    if constexpr (kGpioPins != 0) {
+      if constexpr (High) {
+        GPOS = kGpioPins;
+      } else {
+        GPOC = kGpioPins;
+      }
+    }
+    if constexpr (kGpio16) {
+      GP16O = High ? 1 : 0;
+    }
+  }
+};
+
+template <uint8_t Pin, bool ActiveLow>
+using OutputPin = OutputPins<ActiveLow, Pin>;
+
+}  // namespace poot_gpio
@@ -0,0 +1,111 @@
+#include "health_monitor.h"
+
+#include "config.h"
+#include "diagnostics.h"
+
+namespace poot_health {
+
+const char* reasonName(Reason reason) {
+  switch (reason) {
+    case Reason::kNone:          return "none";
+    case Reason::kLowHeap:       return "low_heap";
+    case Reason::kFragmentation: return "fragmentation";
+    case Reason::kSmallBlock:    return "small_block";
+    case Reason::kLoopStall:     return "loop_stall";
+    case Reason::kSockets:       return "sockets";
+    case Reason::kUptime:        return "uptime";
+    default:                     return "unknown";
+  }
+}
+
+const char* reasonName(uint8_t reason) {
+  return reasonName(static_cast<Reason>(reason));
+}
+
+uint32_t HealthMonitor::takeLoopStall() {
+  const uint32_t stall = stallMs_;
+  stallMs_ = 0;
+  return stall;
+}
+
+uint32_t HealthMonitor::pendingMs() const {
+  return pending_ == Reason::kNone ? 0 : last_.uptimeMs - pendingSinceMs_;
+}
+
+bool HealthMonitor::breached(Reason reason, const Sample& sample) const {
+  switch (reason) {
+    case Reason::kLowHeap:
+      return sample.freeHeap < poot::kHealthMinFreeHeap;
+    case Reason::kFragmentation:
+      return sample.fragmentation > poot::kHealthMaxFragmentation;
+    case Reason::kSmallBlock:
+      return sample.maxFreeBlock < poot::kHealthMinMaxFreeBlock;
+    case Reason::kLoopStall:
+      return sample.loopStallMs > poot::kHealthMaxLoopStallMs;
+    case Reason::kSockets:
+      return sample.openSockets >= poot::kHealthMaxOpenSockets;
+    default:
+      return false;
+  }
+}
+
+Reason HealthMonitor::check(const Sample& sample) {
+  const uint32_t now = sample.uptimeMs;
+  last_ = sample;
+  if (sample.requests != lastRequests_ || sample.relayBusy ||
+      sample.openSockets > 0) {
+    lastActiveMs_ = now;
+    lastRequests_ = sample.requests;
+  }
+
+  Reason wanted = Reason::kNone;
+  for (uint8_t i = 0; i < kLimitCount; i++) {
+    const Reason reason = static_cast<Reason>(i + 1);
+    if (!breached(reason, sample)) {
+      streaks_[i] = 0;
+      continue;
+    }
+    if (streaks_[i] < poot::kHealthBreachSamples) {
+      streaks_[i]++;
+    }
+    if (wanted == Reason::kNone &&
+        streaks_[i] >= poot::kHealthBreachSamples) {
+      wanted = reason;
+    }
+  }
+  if (wanted == Reason::kNone && now >= poot::kHealthMaxUptimeMs) {
+    wanted = Reason::kUptime;
+  }
+
+  if (wanted == Reason::kNone) {
+    if (pending_ != Reason::kNone) {
+      poot_diag::logf("HEALTH", "recovered from %s after %lu ms",
+                      reasonName(pending_), (unsigned long)pendingMs());
+      pending_ = Reason::kNone;
+    }
+    return Reason::kNone;
+  }
+  if (pending_ == Reason::kNone) {
+    pendingSinceMs_ = now;
+    poot_diag::logf("HEALTH",
+                    "reboot wanted reason=%s free_heap=%lu frag=%u "
+                    "max_block=%lu stall_ms=%lu sockets=%u",
+                    reasonName(wanted), (unsigned long)sample.freeHeap,
+                    sample.fragmentation, (unsigned long)sample.maxFreeBlock,
+                    (unsigned long)sample.loopStallMs, sample.openSockets);
+  }
+  pending_ = wanted;
+
+  // Never cut a pulse short or let a reboot skip the cooldown.
+  const bool urgent = sample.freeHeap < poot::kHealthCriticalFreeHeap ||
+                      pendingMs() >= poot::kHealthMaxDeferMs;
+  const bool quiet = sample.openSockets == 0 &&
+                     now - lastActiveMs_ >= poot::kHealthQuietMs;
+  if (sample.relayBusy || !(quiet || urgent)) {
+    deferred_++;
+    return Reason::kNone;
+  }
+  return pending_;
+}
+
+}  // namespace poot_health
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <Arduino.h>
+
+namespace poot_health {
+
+// Why a reboot is wanted. Stored in the blackbox reboot history, so values
+// must not be renumbered; 0 is reserved for "no entry".
+enum class Reason : uint8_t {
+  kNone = 0,
+  kLowHeap = 1,
+  kFragmentation = 2,
+  kSmallBlock = 3,  // largest free block below kHealthMinMaxFreeBlock
+  kLoopStall = 4,
+  kSockets = 5,     // every HTTP slot held
+  kUptime = 6,      // kHealthMaxUptimeMs backstop
+};
+
+const char* reasonName(Reason reason);
+const char* reasonName(uint8_t reason);
+
+// What the sketch reads for every check.
+struct Sample {
+  uint32_t uptimeMs;
+  uint32_t freeHeap;
+  uint32_t maxFreeBlock;
+  uint8_t fragmentation;
+  uint8_t openSockets;
+  uint32_t loopStallMs;  // longest loop() gap since the previous sample
+  uint32_t requests;     // any counter that moves when a client is served
+  bool relayBusy;        // pulse on or cooling down
+};
+
+// Replaces the unconditional hourly reboot: rebooting is only wanted when a
+// resource limit from config.h stays crossed for kHealthBreachSamples checks
+// in a row, and is then held off until a quiet moment (relay idle, no open
+// connection, no request for kHealthQuietMs). Once a reboot has waited
+// kHealthMaxDeferMs, or free heap is below kHealthCriticalFreeHeap, only an
+// active pulse or cooldown holds it off. check() only decides; the sketch
+// records the reboot and restarts.
+class HealthMonitor {
+ public:
+  // Call at the top of every loop() pass; one millis() read and a compare.
+  void notePass(uint32_t nowMs) {
+    if (havePass_ && nowMs - lastPassMs_ > stallMs_) {
+      stallMs_ = nowMs - lastPassMs_;
+    }
+    lastPassMs_ = nowMs;
+    havePass_ = true;
+  }
+
+  // Longest loop() gap since the last call, then starts a new window.
+  uint32_t takeLoopStall();
+
+  // Evaluates one sample. Returns the reason to reboot now, or kNone while
+  // healthy or while a pending reboot is being deferred.
+  Reason check(const Sample& sample);
+
+  const Sample& last() const { return last_; }
+  Reason pending() const { return pending_; }
+  // How long the pending reboot has waited (0 when none is pending).
+  uint32_t pendingMs() const;
+  uint32_t deferredChecks() const { return deferred_; }
+
+ private:
+  static constexpr uint8_t kLimitCount = 5;  // kLowHeap..kSockets
+
+  bool breached(Reason reason, const Sample& sample) const;
+
+  Sample last_ = {};
+  uint8_t streaks_[kLimitCount] = {0};
+  Reason pending_ = Reason::kNone;
+  uint32_t pendingSinceMs_ = 0;
+  uint32_t lastActiveMs_ = 0;
+  uint32_t lastRequests_ = 0;
+  uint32_t deferred_ = 0;
+  uint32_t lastPassMs_ = 0;
+  uint32_t stallMs_ = 0;
+  bool havePass_ = false;
+};
+
+}  // namespace poot_health
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Fixed local API replies, pre-serialized and kept in flash. They are sent
+// as-is with send_P(), so these paths build no JsonDocument and no String.
+// Field order matches what the JsonDocument versions produced.
+namespace poot_http {
+
+// Content types stay in RAM: they are formatted into the response head.
+static const char kContentTypeJson[] = "application/json";
+static const char kContentTypeText[] = "text/plain";
+// Prometheus text exposition format.
+static const char kContentTypeMetrics[] = "text/plain; version=0.0.4";
+static const char kContentTypeEvents[] = "text/event-stream";
+
+static const char kRootReply[] PROGMEM = "Poot lock online";
+
+// Unlock replies carry the door-open window, so they are formatted into
+// kJsonBufferBytes: `open_ms` is how long the door stays open once it opens
+// and `opens_in_ms` how long until it does (for a refusal, until a retry can
+// fire). The arguments are ok, code, message, open_ms, opens_in_ms.
+static const char kUnlockReplyFormat[] PROGMEM =
+    R"({"ok":%s,"code":"%s","message":"%s","open_ms":%lu,"opens_in_ms":%lu})";
+// GET /api/challenge; the arguments are the nonce and its ttl_ms.
+static const char kChallengeReplyFormat[] PROGMEM =
+    R"({"ok":true,"nonce":"%s","ttl_ms":%lu})";
+static const char kMissingMacReply[] PROGMEM =
+    R"({"ok":false,"code":"bad_request","message":"Missing nonce and mac query parameters"})";
+static const char kMalformedMacReply[] PROGMEM =
+    R"({"ok":false,"code":"bad_request","message":"Malformed nonce or mac"})";
+static const char kStaleNonceReply[] PROGMEM =
+    R"({"ok":false,"code":"stale_nonce","message":"Fetch a new challenge"})";
+static const char kMissingKeyReply[] PROGMEM =
+    R"({"ok":false,"code":"bad_request","message":"Missing key query parameter"})";
+static const char kUnlockDeniedReply[] PROGMEM =
+    R"({"ok":false,"code":"invalid_key","message":"Local unlock denied"})";
+static const char kHealthDeniedReply[] PROGMEM =
+    R"({"ok":false,"code":"invalid_key","message":"Health denied"})";
+static const char kPerfDeniedReply[] PROGMEM =
+    R"({"ok":false,"code":"invalid_key","message":"Perf denied"})";
+static const char kLogsDeniedReply[] PROGMEM =
+    R"({"ok":false,"code":"invalid_key","message":"Logs denied"})";
+static const char kBlackboxDeniedReply[] PROGMEM =
+    R"({"ok":false,"code":"invalid_key","message":"Blackbox denied"})";
+static const char kAllocDeniedReply[] PROGMEM =
+    R"({"ok":false,"code":"invalid_key","message":"Alloc denied"})";
+static const char kMetricsDeniedReply[] PROGMEM =
+    R"({"ok":false,"code":"invalid_key","message":"Metrics denied"})";
+static const char kEventsDeniedReply[] PROGMEM =
+    R"({"ok":false,"code":"invalid_key","message":"Events denied"})";
+static const char kEventsBusyReply[] PROGMEM =
+    R"({"ok":false,"code":"busy","message":"Too many event subscribers"})";
+static const char kNotFoundReply[] PROGMEM =
+    R"({"ok":false,"code":"not_found","message":"Route not found"})";
+
+// Small dynamic JSON replies (unlock, challenge) are formatted here instead of
+// into a String. Handlers run one at a time from loop(), so a single buffer is
+// enough; larger replies (/api/health, /metrics) are streamed instead.
+static constexpr size_t kJsonBufferBytes = 512;
+
+}  // namespace poot_http
@@ -0,0 +1,824 @@
+#include "http_server.h"
+
+#include "diagnostics.h"
+
+namespace poot_http {
+
+namespace {
+
+// At most this many stream chunks per connection per loop() pass, so one
+// large download cannot hold up dispatching everyone else.
+constexpr uint8_t kChunksPerPass = 4;
+
+// The codes the server and the sketch send, in /metrics column order.
+constexpr int kStatusCodes[HttpServer::kStatusSlots - 1] = {
+    200, 202, 400, 401, 404, 408, 429, 431, 500, 503};
+
+const char* statusText(int code) {
+  switch (code) {
+    case 200: return "OK";
+    case 202: return "Accepted";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 404: return "Not Found";
+    case 408: return "Request Timeout";
+    case 429: return "Too Many Requests";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    case 503: return "Service Unavailable";
+    default:  return "";
+  }
+}
+
+Method parseMethod(const char* token, size_t length) {
+  struct Name {
+    const char* text;
+    Method method;
+  };
+  static const Name kNames[] = {
+      {"GET", Method::kGet},       {"HEAD", Method::kHead},
+      {"POST", Method::kPost},     {"PUT", Method::kPut},
+      {"DELETE", Method::kDelete},
+  };
+  for (const Name& name : kNames) {
+    if (strlen(name.text) == length && memcmp(name.text, token, length) == 0) {
+      return name.method;
+    }
+  }
+  return Method::kOther;
+}
+
+int hexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+// Decodes %XX and '+' in place; the result is never longer than the input.
+void urlDecode(char* text) {
+  char* out = text;
+  for (const char* in = text; *in != '\0'; in++) {
+    if (*in == '+') {
+      *out++ = ' ';
+    } else if (*in == '%' && hexValue(in[1]) >= 0 && hexValue(in[2]) >= 0) {
+      *out++ = static_cast<char>(hexValue(in[1]) * 16 + hexValue(in[2]));
+      in += 2;
+    } else {
+      *out++ = *in;
+    }
+  }
+  *out = '\0';
+}
+
+// Case-insensitive match of a header name at the start of `line`.
+bool headerIs(const char* line, size_t length, const char* name) {
+  const size_t nameLength = strlen(name);
+  return length >= nameLength && strncasecmp(line, name, nameLength) == 0;
+}
+
+// Case-insensitive search for `token` in a header line, e.g. "close" in
+// "Connection: Keep-Alive, Close".
+bool containsToken(const char* line, size_t length, const char* token) {
+  const size_t tokenLength = strlen(token);
+  for (size_t i = 0; i + tokenLength <= length; i++) {
+    if (strncasecmp(line + i, token, tokenLength) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+HttpServer::HttpServer(uint16_t port) : listener_(port) {
+  for (Slot& slot : slots_) {
+    slot.owner = this;
+    resetSlot(slot);
+  }
+  setClientLimits(poot::kHttpClientBurst, poot::kHttpClientRefillMs,
+                  poot::kHttpMaxConnectionsPerClient);
+}
+
+void HttpServer::setClientLimits(uint8_t burst, uint32_t refillMs,
+                                 uint8_t maxConnections) {
+  limiter_.configure(burst, refillMs);
+  maxConnectionsPerClient_ = maxConnections;
+}
+
+void HttpServer::on(const char* path, Method method, Handler handler) {
+  if (routeCount_ >= kMaxRoutes || handler == nullptr) {
+    poot_diag::logf("HTTP", "cannot add route %s", path);
+    return;
+  }
+  routes_[routeCount_++] =
+      Route{path, method, handler,
+            poot_alloc::registerScope(path, poot_alloc::kMeasureStack)};
+}
+
+void HttpServer::onNotFound(Handler handler) {
+  notFound_ = handler;
+  notFoundScope_ =
+      poot_alloc::registerScope("not_found", poot_alloc::kMeasureStack);
+}
+
+void HttpServer::begin() {
+  listener_.onClient(&HttpServer::onClient, this);
+  listener_.setNoDelay(true);
+  listener_.begin();
+  listening_ = true;
+}
+
+void HttpServer::stop() {
+  listener_.end();
+  listening_ = false;
+  for (Slot& slot : slots_) {
+    close(slot);
+  }
+}
+
+void HttpServer::loop() {
+  const uint32_t now = millis();
+  uint8_t dispatched = 0;
+  const uint8_t first = nextSlot_;
+  nextSlot_ = static_cast<uint8_t>((first + 1) % poot::kHttpMaxConnections);
+  for (uint8_t i = 0; i < poot::kHttpMaxConnections; i++) {
+    Slot& slot = slots_[(first + i) % poot::kHttpMaxConnections];
+    switch (slot.state) {
+      case SlotState::kReading: {
+        // Between requests a kept-alive connection gets the (longer) idle
+        // timeout and is closed quietly; a started request must complete
+        // within kHttpRequestTimeoutMs.
+        const bool idle = slot.requests > 0 && slot.length == 0;
+        const uint32_t limitMs = idle ? poot::kHttpKeepAliveIdleMs
+                                      : poot::kHttpRequestTimeoutMs;
+        if (now - slot.openedMs < limitMs) {
+          break;
+        }
+        if (!idle) {
+          timedOut_++;
+          slot.keepAlive = false;
+          sendStatus(slot, 408);
+        }
+        close(slot);
+        break;
+      }
+      case SlotState::kReady:
+        // Held until the reply fits, so it never has to be cut; a client
+        // that stops reading is dropped like one that stops sending.
+        if (slot.client->space() < kReplyRoomBytes) {
+          if (now - slot.openedMs >= poot::kHttpRequestTimeoutMs) {
+            close(slot);
+          }
+          break;
+        }
+        if (dispatched < poot::kHttpDispatchPerPass && dispatch(slot)) {
+          dispatched++;
+        }
+        break;
+      case SlotState::kStreaming:
+        pumpStream(slot);
+        break;
+      case SlotState::kSending:
+        pumpPending(slot);
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+const char* HttpServer::uri() const {
+  return current_ == nullptr ? "" : current_->buffer + current_->pathOffset;
+}
+
+Method HttpServer::method() const {
+  return current_ == nullptr ? Method::kOther : current_->method;
+}
+
+bool HttpServer::hasArg(const char* name) const {
+  if (current_ == nullptr) {
+    return false;
+  }
+  for (uint8_t i = 0; i < current_->argCount; i++) {
+    if (strcmp(current_->buffer + current_->argName[i], name) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+const char* HttpServer::arg(const char* name) const {
+  if (current_ == nullptr) {
+    return "";
+  }
+  for (uint8_t i = 0; i < current_->argCount; i++) {
+    if (strcmp(current_->buffer + current_->argName[i], name) == 0) {
+      return current_->buffer + current_->argValue[i];
+    }
+  }
+  return "";
+}
+
+uint32_t HttpServer::requestStartedUs() const {
+  return current_ == nullptr ? micros() : current_->startedUs;
+}
+
+IPAddress HttpServer::remoteIP() const {
+  if (current_ == nullptr || current_->client == nullptr) {
+    return IPAddress();
+  }
+  return current_->client->remoteIP();
+}
+
+void HttpServer::send(int code, const char* contentType, const char* body,
+                      size_t length) {
+  if (current_ == nullptr || current_->responded) {
+    return;
+  }
+  Slot& slot = *current_;
+  slot.responded = true;
+  countResponse(slot.route, code);
+  const size_t head =
+      formatHead(code, contentType, length, /*haveLength=*/true, slot.keepAlive);
+  sendReply(slot, head, body, length, /*inFlash=*/false);
+}
+
+void HttpServer::send_P(int code, const char* contentType, PGM_P body,
+                        size_t length) {
+  if (current_ == nullptr || current_->responded) {
+    return;
+  }
+  Slot& slot = *current_;
+  slot.responded = true;
+  countResponse(slot.route, code);
+  const size_t head = formatHead(code, contentType, length, /*haveLength=*/true,
+                                 slot.keepAlive);
+  sendReply(slot, head, body, length, /*inFlash=*/true);
+}
+
+void HttpServer::sendStream(int code, const char* contentType,
+                            StreamSource source, const StreamState& initial) {
+  if (current_ == nullptr || current_->responded || source == nullptr) {
+    return;
+  }
+  Slot& slot = *current_;
+  slot.responded = true;
+  countResponse(slot.route, code);
+  // Without a Content-Length the end of the body is the end of the
+  // connection.
+  slot.keepAlive = false;
+  const size_t head = formatHead(code, contentType, 0, /*haveLength=*/false,
+                                 /*keepAlive=*/false);
+  if (!write(slot, scratch_, head)) {
+    return;
+  }
+  slot.stream = source;
+  slot.streamState = initial;
+  slot.state = SlotState::kStreaming;
+}
+
+uint8_t HttpServer::streamsFrom(StreamSource source) const {
+  uint8_t count = 0;
+  for (const Slot& slot : slots_) {
+    if (slot.state == SlotState::kStreaming && slot.stream == source) {
+      count++;
+    }
+  }
+  return count;
+}
+
+bool HttpServer::requestsPending() const {
+  for (const Slot& slot : slots_) {
+    if (slot.state == SlotState::kReady || slot.state == SlotState::kSending ||
+        (slot.state == SlotState::kReading && slot.length > 0)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+uint8_t HttpServer::openConnections() const {
+  uint8_t open = 0;
+  for (const Slot& slot : slots_) {
+    if (slot.state != SlotState::kFree) {
+      open++;
+    }
+  }
+  return open;
+}
+
+void HttpServer::onClient(void* arg, AsyncClient* client) {
+  HttpServer* server = static_cast<HttpServer*>(arg);
+  const uint32_t ip = client->remoteIP();
+  if (!server->limiter_.hasToken(ip, millis())) {
+    server->shed_++;
+    server->countResponse(kRouteNone, 429);
+    rejectClient(client, /*tooMany=*/true);
+    return;
+  }
+  if (server->maxConnectionsPerClient_ != 0 &&
+      server->connectionsFrom(ip) >= server->maxConnectionsPerClient_) {
+    server->shedConnections_++;
+    server->countResponse(kRouteNone, 503);
+    rejectClient(client, /*tooMany=*/false);
+    return;
+  }
+  Slot* slot = nullptr;
+  for (Slot& candidate : server->slots_) {
+    if (candidate.state == SlotState::kFree) {
+      slot = &candidate;
+      break;
+    }
+  }
+  if (slot == nullptr) {
+    // Every slot is taken. An idle kept-alive connection is only a shortcut
+    // for its client, so it gives way to a new one, closed now rather than
+    // at the library's next poll so its pcb goes too.
+    slot = server->oldestIdleSlot();
+    if (slot == nullptr) {
+      server->rejected_++;
+      server->countResponse(kRouteNone, 503);
+      rejectClient(client, /*tooMany=*/false);
+      return;
+    }
+    server->close(*slot, /*now=*/true);
+  }
+  slot->client = client;
+  slot->remoteIp = ip;
+  slot->state = SlotState::kReading;
+  slot->openedMs = millis();
+  client->setNoDelay(true);
+  client->onData(&HttpServer::onData, slot);
+  client->onDisconnect(&HttpServer::onDisconnect, slot);
+}
+
+uint8_t HttpServer::connectionsFrom(uint32_t ip) const {
+  uint8_t count = 0;
+  for (const Slot& slot : slots_) {
+    if (slot.state != SlotState::kFree && slot.remoteIp == ip) {
+      count++;
+    }
+  }
+  return count;
+}
+
+HttpServer::Slot* HttpServer::oldestIdleSlot() {
+  Slot* oldest = nullptr;
+  for (Slot& slot : slots_) {
+    if (slot.state != SlotState::kReading || slot.requests == 0 ||
+        slot.length != 0) {
+      continue;
+    }
+    if (oldest == nullptr ||
+        static_cast<int32_t>(slot.openedMs - oldest->openedMs) < 0) {
+      oldest = &slot;
+    }
+  }
+  return oldest;
+}
+
+void HttpServer::onData(void* arg, AsyncClient* client, void* data,
+                        size_t len) {
+  Slot* slot = static_cast<Slot*>(arg);
+  if (slot->client != client) {
+    return;
+  }
+  slot->owner->append(*slot, static_cast<const char*>(data), len);
+}
+
+void HttpServer::onDisconnect(void* arg, AsyncClient* client) {
+  Slot* slot = static_cast<Slot*>(arg);
+  if (slot->client == client) {
+    resetSlot(*slot);
+  }
+  delete client;
+}
+
+void HttpServer::rejectClient(AsyncClient* client, bool tooMany) {
+  static const char kBusy[] =
+      "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\n"
+      "Connection: close\r\n\r\n";
+  static const char kTooMany[] =
+      "HTTP/1.1 429 Too Many Requests\r\nContent-Length: 0\r\n"
+      "Connection: close\r\n\r\n";
+  client->onDisconnect([](void*, AsyncClient* c) { delete c; }, nullptr);
+  if (tooMany) {
+    client->write(kTooMany, sizeof(kTooMany) - 1);
+  } else {
+    client->write(kBusy, sizeof(kBusy) - 1);
+  }
+  client->close();
+}
+
+void HttpServer::countResponse(uint8_t route, int code) {
+  uint8_t status = 0;
+  while (status < kStatusSlots - 1 && kStatusCodes[status] != code) {
+    status++;
+  }
+  responses_[route < kRouteSlots ? route : kRouteNone][status]++;
+}
+
+const char* HttpServer::routeName(uint8_t route) const {
+  if (route < routeCount_) {
+    return routes_[route].path;
+  }
+  if (route == kRouteNotFound) {
+    return "not_found";
+  }
+  return route == kRouteNone ? "none" : nullptr;
+}
+
+int HttpServer::statusCode(uint8_t status) {
+  return status < kStatusSlots - 1 ? kStatusCodes[status] : 0;
+}
+
+uint32_t HttpServer::responses(uint8_t route, uint8_t status) const {
+  return route < kRouteSlots && status < kStatusSlots
+             ? responses_[route][status]
+             : 0;
+}
+
+void HttpServer::resetSlot(Slot& slot) {
+  HttpServer* owner = slot.owner;
+  memset(&slot, 0, offsetof(Slot, buffer));
+  slot.owner = owner;
+  slot.route = kRouteNone;
+  slot.state = SlotState::kFree;
+  slot.buffer[0] = '\0';
+}
+
+void HttpServer::append(Slot& slot, const char* data, size_t len) {
+  // Keep one byte for the terminator parse() adds.
+  const size_t room = sizeof(slot.buffer) - 1 - slot.length;
+  const size_t n = len < room ? len : room;
+  if (slot.state != SlotState::kReading) {
+    // A pipelined request arriving while this one is handled; it is picked
+    // up by finishRequest(). If it does not fit, close after this response.
+    if (n < len) {
+      slot.closeAfterReply = true;
+    }
+    memcpy(slot.buffer + slot.length, data, n);
+    slot.length += static_cast<uint16_t>(n);
+    return;
+  }
+  if (slot.length == 0) {
+    slot.startedUs = micros();
+    if (slot.requests > 0) {
+      slot.openedMs = millis();  // the idle wait is over; a request starts
+    }
+  }
+  memcpy(slot.buffer + slot.length, data, n);
+  slot.length += static_cast<uint16_t>(n);
+  scanHead(slot);
+  if (slot.state == SlotState::kReading && n < len) {
+    slot.overflow = true;
+    slot.state = SlotState::kReady;
+  }
+}
+
+void HttpServer::scanHead(Slot& slot) {
+  // The head ends at an empty line ("\r\n\r\n", or "\n\n" from lax clients).
+  // Resume a little before the previous end so a split terminator is found.
+  for (size_t i = slot.scanFrom; i < slot.length; i++) {
+    if (slot.buffer[i] != '\n') {
+      continue;
+    }
+    size_t end = 0;
+    if (i + 1 < slot.length && slot.buffer[i + 1] == '\n') {
+      end = i + 2;
+    } else if (i + 2 < slot.length && slot.buffer[i + 1] == '\r' &&
+               slot.buffer[i + 2] == '\n') {
+      end = i + 3;
+    }
+    if (end != 0) {
+      slot.headLength = static_cast<uint16_t>(end);
+      slot.state = SlotState::kReady;
+      return;
+    }
+  }
+  slot.scanFrom = static_cast<uint16_t>(slot.length > 2 ? slot.length - 2 : 0);
+}
+
+bool HttpServer::parse(Slot& slot) {
+  char* buffer = slot.buffer;
+  buffer[slot.length] = '\0';
+
+  char* lineEnd = strchr(buffer, '\n');
+  if (lineEnd == nullptr) {
+    return false;
+  }
+  *lineEnd = '\0';
+  if (lineEnd > buffer && lineEnd[-1] == '\r') {
+    lineEnd[-1] = '\0';
+  }
+
+  char* space = strchr(buffer, ' ');
+  if (space == nullptr) {
+    return false;
+  }
+  slot.method = parseMethod(buffer, static_cast<size_t>(space - buffer));
+  char* target = space + 1;
+  char* version = strchr(target, ' ');
+  if (version == nullptr || target[0] != '/' ||
+      strncmp(version + 1, "HTTP/", 5) != 0) {
+    return false;
+  }
+  *version = '\0';
+  // HTTP/1.1 is persistent unless the client says otherwise; 1.0 is not.
+  slot.keepAlive = strncmp(version + 1, "HTTP/1.1", 8) == 0;
+  parseHeaders(slot, lineEnd + 1, buffer + slot.headLength);
+
+  slot.pathOffset = static_cast<uint16_t>(target - buffer);
+  char* query = strchr(target, '?');
+  if (query == nullptr) {
+    return true;
+  }
+  *query++ = '\0';
+  while (*query != '\0' && slot.argCount < kMaxArgs) {
+    char* next = strchr(query, '&');
+    if (next != nullptr) {
+      *next++ = '\0';
+    }
+    char* value = strchr(query, '=');
+    if (value != nullptr) {
+      *value++ = '\0';
+    } else {
+      value = query + strlen(query);  // points at the terminator: ""
+    }
+    if (*query != '\0') {
+      urlDecode(query);
+      urlDecode(value);
+      slot.argName[slot.argCount] = static_cast<uint16_t>(query - buffer);
+      slot.argValue[slot.argCount] = static_cast<uint16_t>(value - buffer);
+      slot.argCount++;
+    }
+    if (next == nullptr) {
+      break;
+    }
+    query = next;
+  }
+  return true;
+}
+
+void HttpServer::parseHeaders(Slot& slot, const char* from, const char* end) {
+  while (from < end) {
+    const char* eol = static_cast<const char*>(memchr(from, '\n', end - from));
+    if (eol == nullptr) {
+      eol = end;
+    }
+    const size_t lineLength = static_cast<size_t>(eol - from);
+    if (headerIs(from, lineLength, "Connection:")) {
+      if (containsToken(from, lineLength, "close")) {
+        slot.keepAlive = false;
+      } else if (containsToken(from, lineLength, "keep-alive")) {
+        slot.keepAlive = true;
+      }
+    } else if (headerIs(from, lineLength, "Content-Length:")) {
+      // No route takes a body. Rather than skip one, close after replying.
+      const char* value = from + 15;
+      while (value < eol && (*value == ' ' || *value == '0')) {
+        value++;
+      }
+      if (value < eol && *value >= '1' && *value <= '9') {
+        slot.keepAlive = false;
+      }
+    } else if (headerIs(from, lineLength, "Transfer-Encoding:")) {
+      slot.keepAlive = false;
+    }
+    from = eol + 1;
+  }
+}
+
+bool HttpServer::dispatch(Slot& slot) {
+  slot.keepAlive = false;  // until parse() has read the request line
+  if (!limiter_.take(slot.remoteIp, millis())) {
+    shed_++;
+    sendStatus(slot, 429);
+    close(slot);
+    return false;
+  }
+  if (slot.overflow) {
+    sendStatus(slot, 431);
+    close(slot);
+    return false;
+  }
+  if (!parse(slot)) {
+    sendStatus(slot, 400);
+    close(slot);
+    return false;
+  }
+
+  if (++slot.requests > 1) {
+    reused_++;
+  }
+  if (slot.requests >= poot::kHttpKeepAliveMaxRequests || !listening_ ||
+      slot.closeAfterReply) {
+    slot.keepAlive = false;
+  }
+  current_ = &slot;
+  const char* path = slot.buffer + slot.pathOffset;
+  Handler handler = notFound_;
+  poot_alloc::ScopeId scope = notFoundScope_;
+  slot.route = kRouteNotFound;
+  for (uint8_t i = 0; i < routeCount_; i++) {
+    if (routes_[i].method == slot.method && strcmp(routes_[i].path, path) == 0) {
+      handler = routes_[i].handler;
+      scope = routes_[i].scope;
+      slot.route = i;
+      break;
+    }
+  }
+  if (handler != nullptr) {
+    poot_alloc::Scope accounting(scope);
+    handler();
+  }
+  current_ = nullptr;
+  served_++;
+
+  if (!slot.responded) {
+    sendStatus(slot, handler == nullptr ? 404 : 500);
+  }
+  if (slot.state == SlotState::kSending) {
+    pumpPending(slot);  // often all of it, once the first segment is acked
+  } else if (slot.state == SlotState::kReady) {
+    completeReply(slot);
+  }
+  return true;
+}
+
+void HttpServer::completeReply(Slot& slot) {
+  if (slot.keepAlive && slot.client != nullptr) {
+    finishRequest(slot);
+  } else {
+    close(slot);
+  }
+}
+
+void HttpServer::finishRequest(Slot& slot) {
+  // Move a pipelined follow-up (if any) to the front and start over.
+  const uint16_t leftover = static_cast<uint16_t>(slot.length - slot.headLength);
+  memmove(slot.buffer, slot.buffer + slot.headLength, leftover);
+  slot.length = leftover;
+  slot.headLength = 0;
+  slot.scanFrom = 0;
+  slot.overflow = false;
+  slot.responded = false;
+  slot.argCount = 0;
+  slot.pathOffset = 0;
+  slot.route = kRouteNone;
+  slot.openedMs = millis();
+  // A pipelined request already here is timed from now.
+  slot.startedUs = micros();
+  slot.state = SlotState::kReading;
+  scanHead(slot);
+}
+
+void HttpServer::pumpStream(Slot& slot) {
+  for (uint8_t i = 0; i < kChunksPerPass; i++) {
+    const size_t space = slot.client->space();
+    if (space < kStreamChunkBytes) {
+      return;  // wait for acks
+    }
+    // Coalesce small pieces (log lines) into one segment.
+    const size_t room = space < sizeof(scratch_) ? space : sizeof(scratch_);
+    size_t used = 0;
+    bool done = false;
+    bool pending = false;
+    while (room - used >= kStreamChunkBytes) {
+      const size_t n =
+          slot.stream(slot.streamState, scratch_ + used, room - used);
+      if (n == kStreamPending) {
+        pending = true;
+        break;
+      }
+      if (n == 0) {
+        done = true;
+        break;
+      }
+      used += n;
+    }
+    if (used > 0 && !write(slot, scratch_, used)) {
+      return;
+    }
+    if (done) {
+      close(slot);
+      return;
+    }
+    if (pending) {
+      return;
+    }
+  }
+}
+
+void HttpServer::pumpPending(Slot& slot) {
+  const uint32_t now = millis();
+  for (uint8_t i = 0; i < kChunksPerPass && slot.pendingLength > 0; i++) {
+    const size_t space = slot.client->space();
+    if (space < kStreamChunkBytes && space < slot.pendingLength) {
+      if (now - slot.openedMs >= poot::kHttpRequestTimeoutMs) {
+        poot_diag::logf("HTTP", "reply stalled with %lu bytes unsent",
+                        (unsigned long)slot.pendingLength);
+        close(slot);
+      }
+      return;  // wait for acks
+    }
+    size_t n = space < slot.pendingLength ? space : slot.pendingLength;
+    const char* from = slot.pending;
+    if (slot.pendingInFlash) {
+      // Flash can't be handed to lwIP directly; copy through scratch_.
+      if (n > sizeof(scratch_)) {
+        n = sizeof(scratch_);
+      }
+      memcpy_P(scratch_, slot.pending, n);
+      from = scratch_;
+    }
+    if (!write(slot, from, n)) {
+      return;
+    }
+    slot.pending += n;
+    slot.pendingLength -= static_cast<uint32_t>(n);
+    slot.openedMs = now;
+  }
+  if (slot.pendingLength == 0) {
+    slot.state = SlotState::kReady;
+    completeReply(slot);
+  }
+}
+
+void HttpServer::close(Slot& slot, bool now) {
+  AsyncClient* client = slot.client;
+  resetSlot(slot);
+  if (client == nullptr) {
+    return;
+  }
+  client->onData(nullptr, nullptr);
+  client->onDisconnect([](void*, AsyncClient* c) { delete c; }, nullptr);
+  client->close(now);
+}
+
+void HttpServer::sendStatus(Slot& slot, int code) {
+  countResponse(slot.route, code);
+  const size_t head = formatHead(code, "text/plain", 0, /*haveLength=*/true,
+                                 slot.keepAlive);
+  write(slot, scratch_, head);
+}
+
+size_t HttpServer::formatHead(int code, const char* contentType, size_t length,
+                              bool haveLength, bool keepAlive) {
+  int n = snprintf(scratch_, sizeof(scratch_),
+                   "HTTP/1.1 %d %s\r\nContent-Type: %s\r\n", code,
+                   statusText(code), contentType);
+  if (haveLength) {
+    n += snprintf(scratch_ + n, sizeof(scratch_) - n,
+                  "Content-Length: %u\r\n", static_cast<unsigned>(length));
+  }
+  n += snprintf(scratch_ + n, sizeof(scratch_) - n, "Connection: %s\r\n\r\n",
+                keepAlive ? "keep-alive" : "close");
+  return static_cast<size_t>(n);
+}
+
+void HttpServer::sendReply(Slot& slot, size_t head, const char* body,
+                           size_t length, bool inFlash) {
+  if (slot.client == nullptr) {
+    return;
+  }
+  const size_t space = slot.client->space();
+  const size_t room = space < sizeof(scratch_) ? space : sizeof(scratch_);
+  size_t n = room > head ? room - head : 0;
+  if (n > length) {
+    n = length;
+  }
+  if (inFlash) {
+    memcpy_P(scratch_ + head, body, n);
+  } else {
+    memcpy(scratch_ + head, body, n);
+  }
+  if (!write(slot, scratch_, head + n) || n == length) {
+    return;
+  }
+  slot.pending = body + n;
+  slot.pendingLength = static_cast<uint32_t>(length - n);
+  slot.pendingInFlash = inFlash;
+  slot.openedMs = millis();
+  slot.state = SlotState::kSending;
+}
+
+bool HttpServer::write(Slot& slot, const char* data, size_t length) {
+  if (slot.client == nullptr) {
+    return false;
+  }
+  const size_t added =
+      length == 0 ? 0 : slot.client->add(data, length, ASYNC_WRITE_FLAG_COPY);
+  slot.client->send();
+  if (added != length) {
+    poot_diag::logf("HTTP", "send buffer full (%u of %u bytes)",
+                    static_cast<unsigned>(added),
+                    static_cast<unsigned>(length));
+    close(slot);
+    return false;
+  }
+  return true;
+}
+
+}  // namespace poot_http
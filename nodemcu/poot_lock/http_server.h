@@ -0,0 +1,248 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncTCP.h>
+
+#include "alloc_tracker.h"
+#include "client_limiter.h"
+#include "config.h"
+
+namespace poot_http {
+
+enum class Method : uint8_t {
+  kGet,
+  kHead,
+  kPost,
+  kPut,
+  kDelete,
+  kOther,
+};
+
+using Handler = void (*)();
+
+// Cursor for a streamed response body, zeroed except for what the handler
+// passes to sendStream().
+struct StreamState {
+  uint32_t position;
+  uint32_t end;
+  uint16_t index;
+  uint8_t phase;
+  uint8_t flags;
+};
+
+// Produces the next piece of a streamed body. Called from loop() whenever the
+// socket can take at least kStreamChunkBytes; writes at most `room` bytes and
+// returns how many, or 0 once the body is complete. A source with nothing to
+// send yet returns kStreamPending and is asked again on the next pass; the
+// connection stays open in between (server-sent events).
+using StreamSource = size_t (*)(StreamState& state, char* out, size_t room);
+
+static constexpr size_t kStreamPending = SIZE_MAX;
+
+// Non-blocking HTTP/1.1 server on ESPAsyncTCP. Every open connection owns a
+// fixed slot; bytes are appended to it from the TCP callbacks as they arrive,
+// so a client that connects and stalls only ties up its own slot. Complete
+// requests are dispatched from loop(), which keeps handlers in the same
+// context as the rest of the sketch (the callbacks run in lwIP's SYS task).
+// Connections are kept alive between requests (pipelining included) up to
+// kHttpKeepAliveMaxRequests, unless the client asks to close, the request
+// has a body or the reply is streamed. An idle kept-alive connection is
+// closed after kHttpKeepAliveIdleMs, or earlier if its slot is needed.
+// Handlers use the request/response calls below, which refer to the request
+// being dispatched. A request is only dispatched once its socket can take
+// kReplyRoomBytes, so an ordinary reply goes out in one piece; a longer one
+// is finished from loop() as acks free space, like a stream. Nothing here
+// allocates after begin(); ESPAsyncTCP itself allocates one AsyncClient per
+// accepted connection.
+//
+// Under a flood from one client the rest still get through: each client IP
+// is held to a token bucket (ClientLimiter) and a share of the slots, and
+// what is over either is refused with a canned reply before it is parsed,
+// logged or given a slot. loop() runs at most kHttpDispatchPerPass handlers,
+// starting from a different slot each pass.
+class HttpServer {
+ public:
+  static constexpr size_t kStreamChunkBytes = 256;
+  static constexpr uint8_t kMaxRoutes = 12;
+
+  explicit HttpServer(uint16_t port);
+
+  // Each route is also an allocation scope named by its path (see
+  // alloc_tracker.h); unmatched requests are charged to "not_found".
+  void on(const char* path, Method method, Handler handler);
+  void onNotFound(Handler handler);
+
+  // Per-client limits; the constructor applies the config.h ones. 0 turns a
+  // limit off.
+  void setClientLimits(uint8_t burst, uint32_t refillMs,
+                       uint8_t maxConnections);
+
+  void begin();
+  // Stops listening and closes every open connection.
+  void stop();
+
+  // Dispatches complete requests, feeds streamed responses and expires
+  // connections that never finish their request. Call every loop() pass.
+  void loop();
+
+  // ---- request (inside a handler) ----
+  const char* uri() const;  // path without the query string
+  Method method() const;
+  bool hasArg(const char* name) const;
+  const char* arg(const char* name) const;  // "" when absent
+  IPAddress remoteIP() const;
+  // micros() when the request's first bytes arrived.
+  uint32_t requestStartedUs() const;
+
+  // ---- response (inside a handler; one per request) ----
+  // A body that does not fit in kReplyRoomBytes with the head is sent from
+  // `body` as the socket drains, so it must stay unchanged until then (a
+  // literal, or a buffer no other reply reuses). Shorter ones are copied.
+  void send(int code, const char* contentType, const char* body,
+            size_t length);
+  // `body` may live in flash; `contentType` must be in RAM.
+  void send_P(int code, const char* contentType, PGM_P body, size_t length);
+  // Sends the status line now and pulls the body from `source` on later
+  // loop() passes; the connection closes when the source is exhausted.
+  void sendStream(int code, const char* contentType, StreamSource source,
+                  const StreamState& initial = StreamState());
+
+  uint8_t openConnections() const;
+  // Whether a request has started arriving, or is waiting to be dispatched
+  // or for its reply to go out. Idle kept-alive connections and streams do
+  // not count.
+  bool requestsPending() const;
+  // Connections whose reply is streaming from `source`.
+  uint8_t streamsFrom(StreamSource source) const;
+  uint32_t requestsServed() const { return served_; }
+  // Requests that arrived on an already-used (kept-alive) connection.
+  uint32_t requestsReusingConnection() const { return reused_; }
+  // Connections turned away because every slot was busy.
+  uint32_t connectionsRejected() const { return rejected_; }
+  // Requests that did not arrive in full within kHttpRequestTimeoutMs.
+  uint32_t requestsTimedOut() const { return timedOut_; }
+  // Requests and connections refused with 429 because the client's bucket
+  // was empty.
+  uint32_t requestsShed() const { return shed_; }
+  // Connections refused because the client already held its share of slots.
+  uint32_t connectionsShed() const { return shedConnections_; }
+
+  // Responses by route and status code, for /metrics. Routes are numbered
+  // in on() order; kRouteNotFound counts unmatched paths and kRouteNone
+  // what was refused before routing (shed, busy, timed out, malformed).
+  // Codes outside kStatusCodes are counted in the last column.
+  static constexpr uint8_t kRouteNotFound = kMaxRoutes;
+  static constexpr uint8_t kRouteNone = kMaxRoutes + 1;
+  static constexpr uint8_t kRouteSlots = kMaxRoutes + 2;
+  static constexpr uint8_t kStatusSlots = 11;
+  // The route's path, "not_found" or "none"; nullptr for an unused number.
+  const char* routeName(uint8_t route) const;
+  // 0 for the last column.
+  static int statusCode(uint8_t status);
+  uint32_t responses(uint8_t route, uint8_t status) const;
+
+ private:
+  static constexpr uint8_t kMaxArgs = 6;
+  static constexpr size_t kScratchBytes = 512;
+  static constexpr size_t kReplyRoomBytes = kScratchBytes;
+
+  enum class SlotState : uint8_t {
+    kFree,
+    kReading,    // waiting for the end of the request head
+    kReady,      // head complete, waiting for loop() to dispatch
+    kStreaming,  // handler returned a StreamSource
+    kSending,    // reply longer than the socket took; the rest is pending
+  };
+
+  struct Route {
+    const char* path;
+    Method method;
+    Handler handler;
+    poot_alloc::ScopeId scope;
+  };
+
+  struct Slot {
+    HttpServer* owner;
+    AsyncClient* client;
+    uint32_t remoteIp;
+    SlotState state;
+    Method method;
+    bool overflow;
+    bool responded;
+    bool keepAlive;
+    bool closeAfterReply;  // a pipelined request did not fit
+    uint8_t requests;  // dispatched on this connection so far
+    uint8_t route;     // counted against; kRouteNone until matched
+    uint8_t argCount;
+    uint16_t length;
+    uint16_t scanFrom;
+    uint16_t headLength;  // bytes of the current request; more may follow
+    uint16_t pathOffset;
+    uint16_t argName[kMaxArgs];
+    uint16_t argValue[kMaxArgs];
+    uint32_t openedMs;  // accept, start of the request or start of idle
+    uint32_t startedUs;  // first bytes of the current request
+    StreamSource stream;
+    StreamState streamState;
+    const char* pending;  // unsent rest of the reply body
+    uint32_t pendingLength;
+    bool pendingInFlash;
+    char buffer[poot::kHttpRequestBytes];
+  };
+
+  static void onClient(void* arg, AsyncClient* client);
+  static void onData(void* arg, AsyncClient* client, void* data, size_t len);
+  static void onDisconnect(void* arg, AsyncClient* client);
+  static void rejectClient(AsyncClient* client, bool tooMany);
+  uint8_t connectionsFrom(uint32_t ip) const;
+  void countResponse(uint8_t route, int code);
+
+  static void resetSlot(Slot& slot);
+  Slot* oldestIdleSlot();
+  void append(Slot& slot, const char* data, size_t len);
+  static void scanHead(Slot& slot);
+  bool parse(Slot& slot);
+  static void parseHeaders(Slot& slot, const char* from, const char* end);
+  // Returns true when a handler ran.
+  bool dispatch(Slot& slot);
+  // Keeps the connection for the next request or closes it, once the reply
+  // is out.
+  void completeReply(Slot& slot);
+  void finishRequest(Slot& slot);
+  void pumpStream(Slot& slot);
+  void pumpPending(Slot& slot);
+  // Frees the slot at once and leaves the client to delete itself whenever
+  // the library gets to its onDisconnect: on its next poll, or before this
+  // returns when `now`.
+  void close(Slot& slot, bool now = false);
+  void sendStatus(Slot& slot, int code);
+  size_t formatHead(int code, const char* contentType, size_t length,
+                    bool haveLength, bool keepAlive);
+  // Sends the head in scratch_ and as much of the body as the socket takes;
+  // the rest is left pending for loop().
+  void sendReply(Slot& slot, size_t head, const char* body, size_t length,
+                 bool inFlash);
+  bool write(Slot& slot, const char* data, size_t length);
+
+  AsyncServer listener_;
+  Route routes_[kMaxRoutes];
+  uint8_t routeCount_ = 0;
+  Handler notFound_ = nullptr;
+  poot_alloc::ScopeId notFoundScope_ = poot_alloc::kUnattributed;
+  Slot slots_[poot::kHttpMaxConnections];
+  Slot* current_ = nullptr;
+  uint8_t nextSlot_ = 0;  // where the next loop() pass starts
+  ClientLimiter limiter_;
+  uint8_t maxConnectionsPerClient_ = 0;
+  bool listening_ = false;
+  char scratch_[kScratchBytes];
+  uint32_t served_ = 0;
+  uint32_t reused_ = 0;
+  uint32_t rejected_ = 0;
+  uint32_t timedOut_ = 0;
+  uint32_t shed_ = 0;
+  uint32_t shedConnections_ = 0;
+  uint32_t responses_[kRouteSlots][kStatusSlots] = {};
+};
+
+}  // namespace poot_http
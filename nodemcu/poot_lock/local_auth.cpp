@@ -0,0 +1,191 @@
+#include "local_auth.h"
+
+#include <string.h>
+
+namespace poot_auth {
+
+namespace {
+
+constexpr char kMessagePrefix[] = "poot-unlock:";
+constexpr size_t kPrefixChars = sizeof(kMessagePrefix) - 1;
+constexpr char kHexDigits[] = "0123456789abcdef";
+
+void toHex(const uint8_t* in, size_t size, char* out) {
+  for (size_t i = 0; i < size; i++) {
+    out[i * 2] = kHexDigits[in[i] >> 4];
+    out[i * 2 + 1] = kHexDigits[in[i] & 0x0f];
+  }
+  out[size * 2] = '\0';
+}
+
+int hexValue(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+// False unless `hex` is exactly 2 * size hex digits.
+bool fromHex(const char* hex, uint8_t* out, size_t size) {
+  if (hex == nullptr || strlen(hex) != size * 2) {
+    return false;
+  }
+  for (size_t i = 0; i < size; i++) {
+    const int high = hexValue(hex[i * 2]);
+    const int low = hexValue(hex[i * 2 + 1]);
+    if (high < 0 || low < 0) {
+      return false;
+    }
+    out[i] = static_cast<uint8_t>(high << 4 | low);
+  }
+  return true;
+}
+
+}  // namespace
+
+const char* verdictName(Verdict verdict) {
+  switch (verdict) {
+    case Verdict::kOk:         return "ok";
+    case Verdict::kMalformed:  return "malformed";
+    case Verdict::kStaleNonce: return "stale_nonce";
+    case Verdict::kBadMac:     return "bad_mac";
+    default:                   return "unknown";
+  }
+}
+
+void ChallengeAuth::begin(const char* secret) {
+  br_hmac_key_init(&key_, &br_sha256_vtable, secret, strlen(secret));
+}
+
+bool ChallengeAuth::outstanding(const Slot& slot, uint32_t nowMs) const {
+  return slot.live && nowMs - slot.issuedMs <= poot::kAuthNonceTtlMs;
+}
+
+uint8_t ChallengeAuth::heldBy(uint32_t clientIp, uint32_t nowMs) const {
+  uint8_t held = 0;
+  for (const Slot& slot : slots_) {
+    if (slot.clientIp == clientIp && outstanding(slot, nowMs)) {
+      held++;
+    }
+  }
+  return held;
+}
+
+ChallengeAuth::Slot& ChallengeAuth::slotFor(uint32_t clientIp,
+                                            uint32_t nowMs) {
+  const bool full = heldBy(clientIp, nowMs) >= poot::kAuthNoncesPerClient;
+  Slot* oldest = nullptr;
+  uint8_t oldestHeld = 0;
+  for (Slot& slot : slots_) {
+    if (!outstanding(slot, nowMs)) {
+      if (!full) {
+        return slot;
+      }
+      continue;
+    }
+    if (full && slot.clientIp != clientIp) {
+      continue;
+    }
+    // With no free slot, the client holding the most gives up its oldest.
+    const uint8_t held = full ? 0 : heldBy(slot.clientIp, nowMs);
+    if (oldest == nullptr || held > oldestHeld ||
+        (held == oldestHeld &&
+         nowMs - slot.issuedMs > nowMs - oldest->issuedMs)) {
+      oldest = &slot;
+      oldestHeld = held;
+    }
+  }
+  return *oldest;
+}
+
+void ChallengeAuth::issue(uint32_t nowMs, uint32_t clientIp,
+                          char (&out)[kNonceHexChars + 1]) {
+  Slot& slot = slotFor(clientIp, nowMs);
+  for (size_t i = 0; i < kNonceBytes; i += 4) {
+    const uint32_t word = ESP.random();
+    memcpy(slot.nonce + i, &word, 4);
+  }
+  slot.issuedMs = nowMs;
+  slot.clientIp = clientIp;
+  slot.live = true;
+  issued_++;
+  toHex(slot.nonce, kNonceBytes, out);
+}
+
+void ChallengeAuth::computeMac(const uint8_t (&nonce)[kNonceBytes],
+                               uint8_t (&out)[br_sha256_SIZE]) const {
+  char message[kPrefixChars + kNonceHexChars + 1];
+  memcpy(message, kMessagePrefix, kPrefixChars);
+  toHex(nonce, kNonceBytes, message + kPrefixChars);
+  br_hmac_context ctx;
+  br_hmac_init(&ctx, &key_, 0);
+  br_hmac_update(&ctx, message, kPrefixChars + kNonceHexChars);
+  br_hmac_out(&ctx, out);
+}
+
+Verdict ChallengeAuth::verify(const char* nonce, const char* mac,
+                              uint32_t nowMs) {
+  uint8_t nonceBytes[kNonceBytes];
+  uint8_t received[br_sha256_SIZE];
+  if (!fromHex(nonce, nonceBytes, kNonceBytes) ||
+      !fromHex(mac, received, br_sha256_SIZE)) {
+    rejected_++;
+    return Verdict::kMalformed;
+  }
+  // Nonces are public, so finding the slot need not be constant time.
+  Slot* slot = nullptr;
+  for (uint8_t i = 0; i < poot::kAuthNonceSlots; i++) {
+    if (slots_[i].live &&
+        memcmp(slots_[i].nonce, nonceBytes, kNonceBytes) == 0) {
+      slot = &slots_[i];
+      break;
+    }
+  }
+  if (slot == nullptr || nowMs - slot->issuedMs > poot::kAuthNonceTtlMs) {
+    if (slot != nullptr) {
+      slot->live = false;
+    }
+    stale_++;
+    return Verdict::kStaleNonce;
+  }
+  slot->live = false;
+
+  const uint32_t startCycles = ESP.getCycleCount();
+  uint8_t expected[br_sha256_SIZE];
+  computeMac(slot->nonce, expected);
+  // Constant time, so a forger learns nothing from how fast it is refused.
+  uint8_t diff = 0;
+  for (size_t i = 0; i < br_sha256_SIZE; i++) {
+    diff |= static_cast<uint8_t>(expected[i] ^ received[i]);
+  }
+  lastCycles_ = ESP.getCycleCount() - startCycles;
+  if (lastCycles_ > maxCycles_) {
+    maxCycles_ = lastCycles_;
+  }
+  if (diff != 0) {
+    rejected_++;
+    return Verdict::kBadMac;
+  }
+  verified_++;
+  return Verdict::kOk;
+}
+
+void ChallengeAuth::sign(const char* nonce,
+                         char (&out)[kMacHexChars + 1]) const {
+  uint8_t nonceBytes[kNonceBytes];
+  uint8_t tag[br_sha256_SIZE];
+  if (!fromHex(nonce, nonceBytes, kNonceBytes)) {
+    out[0] = '\0';
+    return;
+  }
+  computeMac(nonceBytes, tag);
+  toHex(tag, sizeof(tag), out);
+}
+
+}  // namespace poot_auth
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <Arduino.h>
+#include <bearssl/bearssl.h>
+
+#include "config.h"
+
+namespace poot_auth {
+
+// Challenge-response for GET /api/local-unlock, so the shared key never
+// crosses the network. The phone takes a nonce from GET /api/challenge and
+// sends it back with
+//
+//   mac = hex(HMAC-SHA256(shared key, "poot-unlock:" nonce))
+//
+// where nonce is the kNonceHexChars lowercase hex digits as issued. The HMAC
+// key schedule (the SHA-256 states after the inner and outer padded key
+// blocks) is computed once in begin(), and the 44-byte message fits one
+// block, so a verification costs two compressions plus a constant-time
+// compare. A nonce is spent by the first attempt that names it, right or
+// wrong, and expires after kAuthNonceTtlMs.
+
+static constexpr size_t kNonceBytes = 16;
+static constexpr size_t kNonceHexChars = kNonceBytes * 2;
+static constexpr size_t kMacHexChars = br_sha256_SIZE * 2;
+
+enum class Verdict : uint8_t {
+  kOk,
+  kMalformed,   // nonce or mac is not hex of the right length
+  kStaleNonce,  // never issued, already spent or expired: fetch another
+  kBadMac,
+};
+
+const char* verdictName(Verdict verdict);
+
+class ChallengeAuth {
+ public:
+  void begin(const char* secret);
+
+  // Writes a fresh nonce for `clientIp`, NUL-terminated. A client past
+  // kAuthNoncesPerClient replaces its own oldest; otherwise a free or
+  // expired slot is used, and only with none left the oldest nonce of the
+  // client holding the most. So polling /api/challenge cannot evict the
+  // nonce another phone prefetched.
+  void issue(uint32_t nowMs, uint32_t clientIp,
+             char (&out)[kNonceHexChars + 1]);
+  Verdict verify(const char* nonce, const char* mac, uint32_t nowMs);
+  // The mac a client sends for `nonce` (kNonceHexChars hex digits).
+  void sign(const char* nonce, char (&out)[kMacHexChars + 1]) const;
+
+  uint32_t issued() const { return issued_; }
+  uint32_t verified() const { return verified_; }
+  uint32_t stale() const { return stale_; }
+  uint32_t rejected() const { return rejected_; }
+  // Cycles the last and slowest HMAC + compare took.
+  uint32_t lastVerifyCycles() const { return lastCycles_; }
+  uint32_t maxVerifyCycles() const { return maxCycles_; }
+
+ private:
+  struct Slot {
+    uint8_t nonce[kNonceBytes];
+    uint32_t issuedMs;
+    uint32_t clientIp;
+    bool live;
+  };
+
+  bool outstanding(const Slot& slot, uint32_t nowMs) const;
+  uint8_t heldBy(uint32_t clientIp, uint32_t nowMs) const;
+  Slot& slotFor(uint32_t clientIp, uint32_t nowMs);
+
+  void computeMac(const uint8_t (&nonce)[kNonceBytes],
+                  uint8_t (&out)[br_sha256_SIZE]) const;
+
+  br_hmac_key_context key_;
+  Slot slots_[poot::kAuthNonceSlots] = {};
+  uint32_t issued_ = 0;
+  uint32_t verified_ = 0;
+  uint32_t stale_ = 0;
+  uint32_t rejected_ = 0;
+  uint32_t lastCycles_ = 0;
+  uint32_t maxCycles_ = 0;
+};
+
+}  // namespace poot_auth
@@ -0,0 +1,58 @@
+#include "lock_events.h"
+
+namespace poot_events {
+
+namespace {
+
+LockState gState = {};
+Event gRing[poot::kEventsRingSlots] = {};
+uint32_t gHead = 0;
+
+void push(Kind kind, uint8_t value) {
+  gRing[gHead % poot::kEventsRingSlots] = Event{kind, value};
+  gHead++;
+}
+
+}  // namespace
+
+const char* kindName(Kind kind) {
+  switch (kind) {
+    case Kind::kRelay:    return "relay";
+    case Kind::kCooldown: return "cooldown";
+    case Kind::kSta:      return "sta";
+    case Kind::kAp:       return "ap";
+    default:              return "unknown";
+  }
+}
+
+uint8_t publish(const LockState& state) {
+  const uint32_t before = gHead;
+  if (state.relayOn != gState.relayOn) {
+    push(Kind::kRelay, state.relayOn ? 1 : 0);
+  }
+  if (state.coolingDown != gState.coolingDown) {
+    push(Kind::kCooldown, state.coolingDown ? 1 : 0);
+  }
+  if (state.staUp != gState.staUp) {
+    push(Kind::kSta, state.staUp ? 1 : 0);
+  }
+  if (state.apStations != gState.apStations) {
+    push(Kind::kAp, state.apStations);
+  }
+  gState = state;
+  return static_cast<uint8_t>(gHead - before);
+}
+
+const LockState& current() { return gState; }
+
+uint32_t head() { return gHead; }
+
+bool event(uint32_t seq, Event& out) {
+  if (gHead - seq - 1 >= poot::kEventsRingSlots) {
+    return false;  // not yet (seq == head) or overwritten
+  }
+  out = gRing[seq % poot::kEventsRingSlots];
+  return true;
+}
+
+}  // namespace poot_events
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "config.h"
+
+namespace poot_events {
+
+// Lock state changes for GET /api/events (server-sent events). The sketch
+// publishes a fresh LockState wherever something may have changed; each
+// field that differs from the last one published becomes an event in a ring
+// of kEventsRingSlots. Subscribers keep their own cursor into the ring (the
+// sequence number of the next event they need), so publishing costs the
+// same with any number of them and nothing is formatted until a
+// subscriber's socket has room. Call from loop() context only.
+
+struct LockState {
+  bool relayOn;
+  bool coolingDown;  // the pulse has ended and the relay is not ready yet
+  bool staUp;        // joined with an IP
+  uint8_t apStations;
+};
+
+enum class Kind : uint8_t {
+  kRelay,     // value: 1 on, 0 off
+  kCooldown,  // value: 1 started, 0 ended
+  kSta,       // value: 1 up, 0 down
+  kAp,        // value: stations on the soft AP
+};
+
+struct Event {
+  Kind kind;
+  uint8_t value;
+};
+
+// Also the field an event carries in its data ({"relay":true}).
+const char* kindName(Kind kind);
+
+// Returns how many events it queued; 0 when nothing changed.
+uint8_t publish(const LockState& state);
+// The last state published.
+const LockState& current();
+// Sequence number the next event gets.
+uint32_t head();
+// Event `seq`; false once the ring has overwritten it, or before it happens.
+bool event(uint32_t seq, Event& out);
+
+}  // namespace poot_events
@@ -0,0 +1,140 @@
+#include "loop_profiler.h"
+
+#include "config.h"
+
+namespace poot_perf {
+
+uint8_t LatencyHistogram::bucketFor(uint32_t cycles) {
+  if (cycles < 2) {
+    return 0;
+  }
+  const uint8_t msb = 31 - __builtin_clz(cycles);
+  const uint8_t half = (cycles >> (msb - 1)) & 1u;
+  return static_cast<uint8_t>(msb * 2 + half);
+}
+
+uint32_t LatencyHistogram::bucketUpperBound(uint8_t bucket) {
+  const uint8_t msb = bucket / 2;
+  if (msb == 0) {
+    return 1;
+  }
+  const uint32_t halfWidth = 1u << (msb - 1);
+  const uint64_t lower = (1ull << msb) + ((bucket & 1u) ? halfWidth : 0);
+  const uint64_t upper = lower + halfWidth - 1;
+  return upper > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(upper);
+}
+
+void LatencyHistogram::record(uint32_t cycles) {
+  const uint8_t bucket = bucketFor(cycles);
+  if (buckets_[bucket] == UINT16_MAX) {
+    bucketTotal_ = 0;
+    for (uint8_t i = 0; i < kBucketCount; i++) {
+      buckets_[i] >>= 1;
+      bucketTotal_ += buckets_[i];
+    }
+  }
+  buckets_[bucket]++;
+  bucketTotal_++;
+  count_++;
+  sum_ += cycles;
+  if (cycles < min_) {
+    min_ = cycles;
+  }
+  if (cycles > max_) {
+    max_ = cycles;
+  }
+}
+
+void LatencyHistogram::reset() { *this = LatencyHistogram(); }
+
+uint32_t LatencyHistogram::meanCycles() const {
+  return count_ == 0 ? 0 : static_cast<uint32_t>(sum_ / count_);
+}
+
+uint32_t LatencyHistogram::percentileCycles(uint16_t perMille) const {
+  if (bucketTotal_ == 0) {
+    return 0;
+  }
+  uint32_t rank =
+      static_cast<uint32_t>((static_cast<uint64_t>(bucketTotal_) * perMille +
+                             999) / 1000);
+  if (rank == 0) {
+    rank = 1;
+  }
+  uint32_t seen = 0;
+  for (uint8_t i = 0; i < kBucketCount; i++) {
+    seen += buckets_[i];
+    if (seen >= rank) {
+      const uint32_t upper = bucketUpperBound(i);
+      if (upper > max_) {
+        return max_;
+      }
+      return upper < min_ ? min_ : upper;
+    }
+  }
+  return max_;
+}
+
+const char* stageName(Stage stage) {
+  switch (stage) {
+    case Stage::kLocalServer:   return "local_server";
+    case Stage::kRelay:         return "relay";
+    case Stage::kWiFiStatus:    return "wifi_status";
+    case Stage::kNetworkEnsure: return "network_ensure";
+    case Stage::kOta:           return "ota";
+    case Stage::kMdns:          return "mdns";
+    case Stage::kStatusLed:     return "status_led";
+    case Stage::kHousekeeping:  return "housekeeping";
+    case Stage::kLogDrain:      return "log_drain";
+    case Stage::kCloud:         return "cloud";
+    default:                    return "unknown";
+  }
+}
+
+void LoopProfiler::beginIteration() {
+  if (!poot::kEnableLoopProfiler) {
+    return;
+  }
+  const uint32_t now = ESP.getCycleCount();
+  if (haveLastEnd_) {
+    gap_.record(now - lastEnd_);
+  }
+  iterationStart_ = now;
+  lastMark_ = now;
+}
+
+void LoopProfiler::mark(Stage stage) {
+  if (!poot::kEnableLoopProfiler) {
+    return;
+  }
+  const uint32_t now = ESP.getCycleCount();
+  pending_[static_cast<uint8_t>(stage)] += now - lastMark_;
+  lastMark_ = now;
+}
+
+void LoopProfiler::endIteration() {
+  if (!poot::kEnableLoopProfiler) {
+    return;
+  }
+  const uint32_t now = ESP.getCycleCount();
+  loop_.record(now - iterationStart_);
+  for (uint8_t i = 0; i < kStageCount; i++) {
+    stages_[i].record(pending_[i]);
+    pending_[i] = 0;
+  }
+  lastEnd_ = now;
+  haveLastEnd_ = true;
+}
+
+void LoopProfiler::reset() {
+  for (uint8_t i = 0; i < kStageCount; i++) {
+    stages_[i].reset();
+    pending_[i] = 0;
+  }
+  loop_.reset();
+  gap_.reset();
+  haveLastEnd_ = false;
+  windowStartMs_ = millis();
+}
+
+}  // namespace poot_perf
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <Arduino.h>
+
+namespace poot_perf {
+
+// Fixed-size latency histogram over CPU cycle counts. Buckets split each
+// power of two in half (so any percentile is within ~25% of the true value)
+// and hold 16-bit counts; when a bucket would overflow every bucket is halved,
+// which keeps the shape of the distribution while bounding RAM to 128 bytes.
+class LatencyHistogram {
+ public:
+  static constexpr uint8_t kBucketCount = 64;
+
+  void record(uint32_t cycles);
+  void reset();
+
+  uint32_t count() const { return count_; }
+  uint32_t minCycles() const { return count_ == 0 ? 0 : min_; }
+  uint32_t maxCycles() const { return max_; }
+  uint32_t meanCycles() const;
+  // q in [0, 1000] (per-mille). Returns the upper bound of the bucket that
+  // holds the q-th sample, clamped to the observed min/max.
+  uint32_t percentileCycles(uint16_t perMille) const;
+
+ private:
+  static uint8_t bucketFor(uint32_t cycles);
+  static uint32_t bucketUpperBound(uint8_t bucket);
+
+  uint16_t buckets_[kBucketCount] = {0};
+  uint32_t bucketTotal_ = 0;
+  uint32_t count_ = 0;
+  uint64_t sum_ = 0;
+  uint32_t min_ = UINT32_MAX;
+  uint32_t max_ = 0;
+};
+
+enum class Stage : uint8_t {
+  kLocalServer,
+  kRelay,
+  kWiFiStatus,
+  kNetworkEnsure,
+  kOta,
+  kMdns,
+  kStatusLed,
+  kHousekeeping,
+  kLogDrain,
+  kCloud,
+  kCount,
+};
+
+const char* stageName(Stage stage);
+
+// Per-stage loop() profiler. mark() reads the cycle counter once and charges
+// the time since the previous mark to `stage`, so stages that run more than
+// once per iteration (the server pump) are summed. endIteration() records one
+// sample per stage plus the whole loop body; the time between iterations
+// (SDK/WiFi work outside loop()) is tracked separately as the gap.
+class LoopProfiler {
+ public:
+  void beginIteration();
+  void mark(Stage stage);
+  void endIteration();
+  void reset();
+
+  const LatencyHistogram& stage(Stage stage) const {
+    return stages_[static_cast<uint8_t>(stage)];
+  }
+  const LatencyHistogram& loopBody() const { return loop_; }
+  const LatencyHistogram& gap() const { return gap_; }
+  uint32_t windowMs() const { return millis() - windowStartMs_; }
+  uint32_t iterations() const { return loop_.count(); }
+
+ private:
+  static constexpr uint8_t kStageCount = static_cast<uint8_t>(Stage::kCount);
+
+  LatencyHistogram stages_[kStageCount];
+  LatencyHistogram loop_;
+  LatencyHistogram gap_;
+  uint32_t pending_[kStageCount] = {0};
+  uint32_t iterationStart_ = 0;
+  uint32_t lastMark_ = 0;
+  uint32_t lastEnd_ = 0;
+  bool haveLastEnd_ = false;
+  uint32_t windowStartMs_ = 0;
+};
+
+// Converts cycle counts to microseconds at the current CPU clock.
+inline uint32_t cyclesToMicros(uint32_t cycles) {
+  return cycles / ESP.getCpuFreqMHz();
+}
+
+}  // namespace poot_perf
@@ -0,0 +1,144 @@
+#include "metrics.h"
+
+namespace poot_metrics {
+
+namespace {
+
+constexpr uint8_t kCounterCount = static_cast<uint8_t>(Counter::kCount);
+
+// Upper bounds in ms. Direct unlocks land in the first few; queued ones wait
+// out the cooldown, up to kUnlockQueueMaxWaitMs.
+constexpr uint16_t kBucketBoundsMs[kLatencyBuckets] = {
+    1, 2, 5, 10, 20, 50, 100, 250, 500, 1000, 2500, 5000};
+
+struct ReasonCount {
+  uint8_t reason;
+  uint32_t count;
+};
+
+uint32_t gCounters[kCounterCount] = {0};
+uint32_t gUnlocks[kUnlockSources][kUnlockResults] = {{0}};
+LatencyHistogram gLatency[kUnlockSources] = {};
+ReasonCount gDisconnects[poot::kMetricsDisconnectReasons] = {};
+uint8_t gDisconnectReasons = 0;
+uint32_t gMinFreeHeap = UINT32_MAX;
+uint32_t gMinMaxFreeBlock = UINT32_MAX;
+
+}  // namespace
+
+const char* counterName(Counter counter) {
+  switch (counter) {
+    case Counter::kRelayPulses:     return "poot_relay_pulses_total";
+    case Counter::kStaReconnects:   return "poot_wifi_sta_reconnects_total";
+    case Counter::kApStationJoins:  return "poot_wifi_ap_station_joins_total";
+    case Counter::kApStationLeaves: return "poot_wifi_ap_station_leaves_total";
+    default:                        return "poot_unknown_total";
+  }
+}
+
+const char* counterHelp(Counter counter) {
+  switch (counter) {
+    case Counter::kRelayPulses:     return "Relay pulses started.";
+    case Counter::kStaReconnects:   return "STA reconnect attempts.";
+    case Counter::kApStationJoins:  return "Stations that joined the soft AP.";
+    case Counter::kApStationLeaves: return "Stations that left the soft AP.";
+    default:                        return "";
+  }
+}
+
+void count(Counter counter) {
+  const uint8_t index = static_cast<uint8_t>(counter);
+  if (index < kCounterCount) {
+    gCounters[index]++;
+  }
+}
+
+uint32_t counter(Counter counter) {
+  const uint8_t index = static_cast<uint8_t>(counter);
+  return index < kCounterCount ? gCounters[index] : 0;
+}
+
+void countUnlock(poot_audit::Source source, RelayController::Result result) {
+  const uint8_t s = static_cast<uint8_t>(source);
+  const uint8_t r = static_cast<uint8_t>(result);
+  if (s < kUnlockSources && r < kUnlockResults) {
+    gUnlocks[s][r]++;
+  }
+}
+
+uint32_t unlocks(uint8_t source, uint8_t result) {
+  return source < kUnlockSources && result < kUnlockResults
+             ? gUnlocks[source][result]
+             : 0;
+}
+
+uint32_t bucketBoundUs(uint8_t bucket) {
+  return bucket < kLatencyBuckets ? kBucketBoundsMs[bucket] * 1000UL
+                                  : UINT32_MAX;
+}
+
+void observeUnlockLatency(poot_audit::Source source, uint32_t latencyUs) {
+  const uint8_t s = static_cast<uint8_t>(source);
+  if (s >= kUnlockSources) {
+    return;
+  }
+  LatencyHistogram& histogram = gLatency[s];
+  uint8_t bucket = 0;
+  while (bucket < kLatencyBuckets && latencyUs > bucketBoundUs(bucket)) {
+    bucket++;
+  }
+  histogram.buckets[bucket]++;
+  histogram.count++;
+  histogram.sumUs += latencyUs;
+}
+
+const LatencyHistogram& unlockLatency(uint8_t source) {
+  return gLatency[source < kUnlockSources ? source : 0];
+}
+
+void countDisconnect(uint8_t reason) {
+  for (uint8_t i = 0; i < gDisconnectReasons; i++) {
+    if (gDisconnects[i].reason == reason) {
+      gDisconnects[i].count++;
+      return;
+    }
+  }
+  if (gDisconnectReasons < poot::kMetricsDisconnectReasons - 1) {
+    gDisconnects[gDisconnectReasons++] = ReasonCount{reason, 1};
+    return;
+  }
+  // The last entry collects whatever did not get one of its own.
+  ReasonCount& other = gDisconnects[poot::kMetricsDisconnectReasons - 1];
+  other.reason = 0;
+  other.count++;
+  gDisconnectReasons = poot::kMetricsDisconnectReasons;
+}
+
+uint8_t disconnectReasonCount() { return gDisconnectReasons; }
+
+uint8_t disconnectReason(uint8_t index) {
+  return index < gDisconnectReasons ? gDisconnects[index].reason : 0;
+}
+
+uint32_t disconnects(uint8_t index) {
+  return index < gDisconnectReasons ? gDisconnects[index].count : 0;
+}
+
+void sampleHeap(uint32_t freeHeap, uint32_t maxFreeBlock) {
+  if (freeHeap < gMinFreeHeap) {
+    gMinFreeHeap = freeHeap;
+  }
+  if (maxFreeBlock < gMinMaxFreeBlock) {
+    gMinMaxFreeBlock = maxFreeBlock;
+  }
+}
+
+uint32_t minFreeHeap() {
+  return gMinFreeHeap == UINT32_MAX ? 0 : gMinFreeHeap;
+}
+
+uint32_t minMaxFreeBlock() {
+  return gMinMaxFreeBlock == UINT32_MAX ? 0 : gMinMaxFreeBlock;
+}
+
+}  // namespace poot_metrics
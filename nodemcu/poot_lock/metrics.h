@@ -0,0 +1,70 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "audit_log.h"
+#include "config.h"
+#include "relay_control.h"
+
+namespace poot_metrics {
+
+// Counters for GET /metrics (Prometheus text exposition). They only ever go
+// up, from boot, and updating one is a plain increment, so they are fine on
+// the unlock path and from WiFi event handlers. HTTP responses by route and
+// status are counted by HttpServer itself. Nothing here formats text; the
+// sketch streams the exposition a line at a time.
+
+enum class Counter : uint8_t {
+  kRelayPulses,      // pulses started, on request or from the queue
+  kStaReconnects,    // connectSta(true): dropped links and fast-join misses
+  kApStationJoins,
+  kApStationLeaves,
+  kCount,
+};
+
+const char* counterName(Counter counter);
+const char* counterHelp(Counter counter);
+
+void count(Counter counter);
+uint32_t counter(Counter counter);
+
+// Authenticated unlocks by source and relay result.
+static constexpr uint8_t kUnlockSources =
+    static_cast<uint8_t>(poot_audit::Source::kCount);
+static constexpr uint8_t kUnlockResults =
+    static_cast<uint8_t>(RelayController::Result::kCooldown) + 1;
+
+void countUnlock(poot_audit::Source source, RelayController::Result result);
+uint32_t unlocks(uint8_t source, uint8_t result);
+
+// Request-to-relay-on time per source, in fixed buckets (bucketBoundUs()).
+// An unlock that is coalesced into a running pulse is not observed: the
+// relay was already on.
+static constexpr uint8_t kLatencyBuckets = 12;
+
+struct LatencyHistogram {
+  uint32_t buckets[kLatencyBuckets + 1];  // the last one is +Inf
+  uint32_t count;
+  uint64_t sumUs;
+};
+
+uint32_t bucketBoundUs(uint8_t bucket);
+void observeUnlockLatency(poot_audit::Source source, uint32_t latencyUs);
+const LatencyHistogram& unlockLatency(uint8_t source);
+
+// WiFiEventStationModeDisconnected::reason, in a table of
+// kMetricsDisconnectReasons; reasons seen after it fills are counted under
+// reason 0.
+void countDisconnect(uint8_t reason);
+uint8_t disconnectReasonCount();
+uint8_t disconnectReason(uint8_t index);
+uint32_t disconnects(uint8_t index);
+
+// Lowest free heap and largest free block seen. The ESP8266 keeps no
+// low-water mark itself, so these are sampled (each health check and each
+// scrape) and can miss a brief dip.
+void sampleHeap(uint32_t freeHeap, uint32_t maxFreeBlock);
+uint32_t minFreeHeap();
+uint32_t minMaxFreeBlock();
+
+}  // namespace poot_metrics
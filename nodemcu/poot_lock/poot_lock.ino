@@ -1,21 +1,73 @@
 #include <Arduino.h>
 #include <ArduinoJson.h>
 #include <ArduinoOTA.h>
-#include <ESP8266WebServer.h>
 #include <ESP8266WiFi.h>
 #include <ESP8266mDNS.h>
+#include <user_interface.h>
 
+#include "alloc_tracker.h"
+#include "audit_log.h"
+#include "blackbox.h"
+#include "boot_timeline.h"
 #include "config.h"
 #include "diagnostics.h"
+#include "firebase_client.h"
+#include "gpio_pin.h"
+#include "health_monitor.h"
+#include "http_replies.h"
+#include "http_server.h"
+#include "local_auth.h"
+#include "lock_events.h"
+#include "loop_profiler.h"
+#include "metrics.h"
+#include "power_policy.h"
 #include "relay_control.h"
+#include "scheduler.h"
 #include "secrets.h"
+#include "sta_join.h"
+#include "udp_unlock.h"
 
-RelayController relay(poot::kRelayPin, poot::kRelayActiveLow);
-ESP8266WebServer server(poot::kLocalHttpPort);
+using StatusLed =
+    poot_gpio::OutputPin<poot::kStatusLedPin, poot::kStatusLedActiveLow>;
+
+using RelayOutput =
+    poot_gpio::OutputPin<poot::kRelayPin, poot::kRelayActiveLow>;
+
+Relay<RelayOutput> relay;
+poot_http::HttpServer server(poot::kLocalHttpPort);
+poot_udp::UdpUnlockServer udpUnlock(poot::kUdpUnlockPort);
+poot_auth::ChallengeAuth localAuth;
+poot_cloud::FirebaseClient cloud;
+poot_audit::AuditLog auditLog;
+poot_perf::LoopProfiler loopProfiler;
+poot_health::HealthMonitor healthMonitor;
+poot_power::PowerPolicy powerPolicy;
+poot_sched::Scheduler scheduler;
+poot_sched::TaskId gRelayTask = poot_sched::kInvalidTask;
+poot_sched::TaskId gStatusLedTask = poot_sched::kInvalidTask;
+poot_sched::TaskId gAuditTask = poot_sched::kInvalidTask;
+poot_sched::TaskId gSurveyTask = poot_sched::kInvalidTask;
+
+// Allocation scopes for the pumps and callbacks that are not routes or
+// scheduler tasks (those get theirs automatically).
+poot_alloc::ScopeId gHttpScope = poot_alloc::kUnattributed;
+poot_alloc::ScopeId gUdpScope = poot_alloc::kUnattributed;
+poot_alloc::ScopeId gOtaScope = poot_alloc::kUnattributed;
+poot_alloc::ScopeId gMdnsScope = poot_alloc::kUnattributed;
+poot_alloc::ScopeId gCloudScope = poot_alloc::kUnattributed;
+poot_alloc::ScopeId gWiFiEventScope = poot_alloc::kUnattributed;
+static_assert(poot::kAllocScopes >= 1 + poot_http::HttpServer::kMaxRoutes +
+                                        1 + poot_sched::Scheduler::kMaxTasks +
+                                        6,
+              "kAllocScopes must cover every route, task, pump and event");
 
 WiFiEventHandler gOnStaDisconnected;
 WiFiEventHandler gOnStaGotIp;
+WiFiEventHandler gOnApStationJoined;
+WiFiEventHandler gOnApStationLeft;
 volatile bool gReassertHttpRequested = false;
+// Set by the WiFi event handlers; loop() publishes the change.
+volatile bool gLockStateChanged = false;
 
 const IPAddress kStaIp = WIFI_STA_IP;
 const IPAddress kStaGateway = WIFI_STA_GATEWAY;
@@ -24,7 +76,6 @@ const IPAddress kStaDns1 = WIFI_STA_DNS1;
 const IPAddress kStaDns2 = WIFI_STA_DNS2;
 
 uint32_t lastWiFiReconnectMs = 0;
-uint32_t lastNetworkEnsureMs = 0;
 uint32_t lastWiFiBeginMs = 0;
 bool serverRoutesRegistered = false;
 bool serverStarted = false;
@@ -77,9 +128,7 @@ const char* encTypeName(uint8_t enc) {
   }
 }
 
-void scanAndLogNetworks() {
-  poot_diag::logf("WIFI", "scanning for networks...");
-  const int count = WiFi.scanNetworks();
+void logScanResults(int count) {
   if (count <= 0) {
     poot_diag::logf("WIFI", "scan found 0 networks (count=%d)", count);
     return;
@@ -90,7 +139,6 @@ void scanAndLogNetworks() {
                     i, WiFi.SSID(i).c_str(), WiFi.RSSI(i),
                     WiFi.channel(i), encTypeName(WiFi.encryptionType(i)));
   }
-  WiFi.scanDelete();
 }
 
 void logWiFiStatusIfChanged() {
@@ -115,20 +163,25 @@ void logWiFiStatusIfChanged() {
 }
 
 void pumpLocalServer() {
-  server.handleClient();
+  {
+    poot_alloc::Scope accounting(gHttpScope);
+    server.loop();
+  }
+  {
+    poot_alloc::Scope accounting(gUdpScope);
+    udpUnlock.loop();
+  }
   yield();
 }
 
 void writeStatusLed(bool on) {
   ledIsLit = on;
-  const uint8_t level = poot::kStatusLedActiveLow ? (on ? LOW : HIGH)
-                                                   : (on ? HIGH : LOW);
-  digitalWrite(poot::kStatusLedPin, level);
+  StatusLed::write(on);
 }
 
 void setupStatusLed() {
-  pinMode(poot::kStatusLedPin, OUTPUT);
-  writeStatusLed(false);
+  StatusLed::begin();
+  ledIsLit = false;
   poot_diag::logf("LED", "status LED initialized pin=%u activeLow=%u",
                   poot::kStatusLedPin, poot::kStatusLedActiveLow ? 1 : 0);
 }
@@ -143,6 +196,41 @@ bool isWiFiConnecting() {
   return millis() - lastWiFiBeginMs <= poot::kWiFiConnectingWindowMs;
 }
 
+enum class SurveyState : uint8_t { kWaiting, kScanning, kDone };
+
+SurveyState surveyState = SurveyState::kWaiting;
+uint32_t surveyStartMs = 0;
+
+// Lists the networks in range once per boot, for diagnostics only. The scan
+// runs in the background once the STA join has settled: in setup() it held
+// everything up for about 2 s, and during the join it competes for the
+// radio. Returns how long until the next step, 0 once done.
+uint32_t surveyNetworks() {
+  if (surveyState == SurveyState::kWaiting) {
+    if (isWiFiConnecting()) {
+      return poot::kWiFiSurveyPollMs;
+    }
+    poot_diag::logf("WIFI", "scanning for networks...");
+    WiFi.scanNetworks(/*async=*/true);
+    surveyState = SurveyState::kScanning;
+    surveyStartMs = millis();
+    return poot::kWiFiSurveyPollMs;
+  }
+  if (surveyState == SurveyState::kDone) {
+    return 0;
+  }
+  const int count = WiFi.scanComplete();
+  if (count == WIFI_SCAN_RUNNING &&
+      millis() - surveyStartMs < poot::kWiFiSurveyTimeoutMs) {
+    return poot::kWiFiSurveyPollMs;
+  }
+  logScanResults(count);
+  WiFi.scanDelete();
+  surveyState = SurveyState::kDone;
+  poot_boot::mark(poot_boot::Phase::kSurvey);
+  return 0;
+}
+
 LedMode desiredLedMode() {
   if (relay.isRelayOn()) {
     return LedMode::kOff;
@@ -156,7 +244,9 @@ LedMode desiredLedMode() {
   return LedMode::kBlinkSlow;
 }
 
-void updateStatusLed() {
+// Returns how long until the LED needs attention again: the next blink edge,
+// or a short poll interval so WiFi state changes show up promptly.
+uint32_t updateStatusLed() {
   const LedMode target = desiredLedMode();
   const uint32_t nowMs = millis();
 
@@ -189,9 +279,12 @@ void updateStatusLed() {
         ledLastToggleMs = nowMs;
         writeStatusLed(!ledIsLit);
       }
-      break;
+      const uint32_t untilToggleMs = intervalMs - (nowMs - ledLastToggleMs);
+      return untilToggleMs < poot::kStatusLedPollMs ? untilToggleMs
+                                                    : poot::kStatusLedPollMs;
     }
   }
+  return poot::kStatusLedPollMs;
 }
 
 bool configureStaNetwork() {
@@ -216,6 +309,7 @@ void connectSta(bool forceReconnect = false) {
                   forceReconnect ? 1 : 0, wifiStatusName(prevStatus), prevStatus);
 
   if (forceReconnect) {
+    poot_metrics::count(poot_metrics::Counter::kStaReconnects);
     WiFi.disconnect(false);
     yield();
   }
@@ -223,102 +317,1167 @@ void connectSta(bool forceReconnect = false) {
   configureStaNetwork();
   lastWiFiBeginMs = millis();
   lastWiFiReconnectMs = lastWiFiBeginMs;
-  poot_diag::logf("WIFI", "STA connecting to ssid=%s pwdLen=%u",
-                  WIFI_STA_SSID, (unsigned)strlen(WIFI_STA_PASSWORD));
-  WiFi.begin(WIFI_STA_SSID, WIFI_STA_PASSWORD);
+  // With the last access point's BSSID and channel the SDK skips the scan.
+  const poot_sta::AccessPoint* target = poot_sta::fastTarget();
+  poot_diag::logf("WIFI", "STA connecting to ssid=%s pwdLen=%u join=%s",
+                  WIFI_STA_SSID, (unsigned)strlen(WIFI_STA_PASSWORD),
+                  target != nullptr ? "fast" : "scan");
+  poot_sta::noteBegin(target != nullptr);
+  if (target != nullptr) {
+    WiFi.begin(WIFI_STA_SSID, WIFI_STA_PASSWORD, target->channel,
+               target->bssid);
+  } else {
+    WiFi.begin(WIFI_STA_SSID, WIFI_STA_PASSWORD);
+  }
+}
+
+// Queues an /api/events event for whatever changed since the last call.
+void publishLockState() {
+  poot_events::LockState state;
+  state.relayOn = relay.isRelayOn();
+  state.coolingDown = !state.relayOn && relay.isCoolingDown();
+  state.staUp = WiFi.status() == WL_CONNECTED;
+  state.apStations = WiFi.softAPgetStationNum();
+  poot_events::publish(state);
+}
+
+// The first request waiting on the queued pulse, timed when it fires.
+struct QueuedUnlock {
+  bool waiting;
+  poot_audit::Source source;
+  uint32_t requestedUs;
+};
+
+QueuedUnlock gQueuedUnlock = {};
+
+// A pulse has just started, on request or from the queue: hands its end to
+// the scheduler and refreshes the status LED so it goes dark with the pulse.
+void pulseStarted() {
+  poot_metrics::count(poot_metrics::Counter::kRelayPulses);
+  if (gQueuedUnlock.waiting) {
+    gQueuedUnlock.waiting = false;
+    poot_metrics::observeUnlockLatency(gQueuedUnlock.source,
+                                       micros() - gQueuedUnlock.requestedUs);
+  }
+  scheduler.scheduleIn(gRelayTask, relay.msUntilPulseEnd());
+  scheduler.scheduleIn(gStatusLedTask, 0);
+  publishLockState();
+  poot_blackbox::count(poot_blackbox::Counter::kUnlocks);
+  poot_boot::mark(poot_boot::Phase::kFirstUnlock);
+}
+
+// What an unlock request is answered with: the door opens in `opensInMs` and
+// stays open `openMs`. For a refusal, `opensInMs` is when a retry can fire.
+struct UnlockResult {
+  RelayController::Result result;
+  uint32_t opensInMs;
+  uint32_t openMs;
+};
+
+// Every unlock source comes through here. Requests that land in a running
+// pulse are coalesced into it and ones in the cooldown are queued (see
+// kUnlockQueueMaxWaitMs), so two people tapping at once both see success.
+// `requestedUs` is micros() when the request arrived, for the latency
+// histogram in /metrics.
+UnlockResult triggerUnlockPulse(poot_audit::Source source,
+                                uint32_t requestedUs) {
+  UnlockResult unlock = {
+      relay.triggerPulse(poot::kUnlockPulseMs, poot::kUnlockCooldownMs,
+                         poot::kUnlockQueueMaxWaitMs),
+      0, 0};
+  poot_metrics::countUnlock(source, unlock.result);
+  switch (unlock.result) {
+    case RelayController::Result::kFired: {
+      const uint32_t latencyUs = micros() - requestedUs;
+      poot_metrics::observeUnlockLatency(source, latencyUs);
+      powerPolicy.noteUnlock(latencyUs);
+      pulseStarted();
+      unlock.openMs = relay.msUntilPulseEnd();
+      break;
+    }
+    case RelayController::Result::kCoalesced:
+      unlock.openMs = relay.msUntilPulseEnd();
+      break;
+    case RelayController::Result::kQueued:
+      // The relay task fires it; nothing else wakes up when a cooldown ends.
+      unlock.opensInMs = relay.msUntilReady();
+      unlock.openMs = poot::kUnlockPulseMs;
+      scheduler.scheduleIn(gRelayTask, unlock.opensInMs);
+      if (!gQueuedUnlock.waiting) {
+        gQueuedUnlock = QueuedUnlock{true, source, requestedUs};
+      }
+      break;
+    case RelayController::Result::kCooldown:
+      unlock.opensInMs = relay.msUntilReady();
+      break;
+  }
+  return unlock;
 }
 
+// Queues an audit event; the "audit" task moves it to flash right after
+// this loop() pass, so the unlock reply is not held up by a flash write.
+void recordAudit(poot_audit::Source source, poot_audit::Outcome outcome,
+                 const char* ref = "") {
+  if (!poot::kEnableAudit) {
+    return;
+  }
+  auditLog.record(source, outcome, ref);
+  scheduler.scheduleIn(gAuditTask, 0);
+}
+
+poot_audit::Outcome unlockOutcome(const UnlockResult& unlock) {
+  switch (unlock.result) {
+    case RelayController::Result::kFired:
+      return poot_audit::Outcome::kUnlocked;
+    case RelayController::Result::kCoalesced:
+      return poot_audit::Outcome::kCoalesced;
+    case RelayController::Result::kQueued:
+      return poot_audit::Outcome::kQueued;
+    default:
+      return poot_audit::Outcome::kCooldown;
+  }
+}
+
+// UdpUnlockServer's UnlockFn. Repeats of a datagram are answered without
+// calling it, so each unlock is audited once. It runs as soon as the
+// datagram is read and verified, so that is when the request is timed from.
+poot_udp::Status udpUnlockPulse(uint32_t& windowMs) {
+  const UnlockResult unlock =
+      triggerUnlockPulse(poot_audit::Source::kUdp, micros());
+  recordAudit(poot_audit::Source::kUdp, unlockOutcome(unlock));
+  switch (unlock.result) {
+    case RelayController::Result::kFired:
+      windowMs = unlock.openMs;
+      return poot_udp::Status::kOk;
+    case RelayController::Result::kCoalesced:
+      windowMs = unlock.openMs;
+      return poot_udp::Status::kCoalesced;
+    case RelayController::Result::kQueued:
+      windowMs = unlock.opensInMs;
+      return poot_udp::Status::kQueued;
+    default:
+      windowMs = unlock.opensInMs;
+      return poot_udp::Status::kCooldown;
+  }
+}
+
+// Remote commands from the cloud stream; "unlock" is the only action.
+void onCloudCommand(const char* commandId, const char* action) {
+  if (strcmp(action, "unlock") != 0) {
+    poot_diag::logf("CLOUD", "command %s unknown action=%s", commandId,
+                    action);
+    recordAudit(poot_audit::Source::kCloud,
+                poot_audit::Outcome::kUnknownAction, commandId);
+    return;
+  }
+  const UnlockResult unlock =
+      triggerUnlockPulse(poot_audit::Source::kCloud, micros());
+  poot_diag::logf("CLOUD", "unlock %s",
+                  RelayController::resultName(unlock.result));
+  recordAudit(poot_audit::Source::kCloud, unlockOutcome(unlock), commandId);
+}
+
+char gJsonBuffer[poot_http::kJsonBufferBytes];
+
 template <typename TDoc>
 void sendJson(int code, const TDoc& doc) {
-  String body;
-  serializeJson(doc, body);
-  server.send(code, "application/json", body);
+  const size_t len = serializeJson(doc, gJsonBuffer, sizeof(gJsonBuffer));
+  server.send(code, poot_http::kContentTypeJson, gJsonBuffer, len);
+}
+
+template <size_t N>
+void sendFixed(int code, const char* contentType, const char (&reply)[N]) {
+  server.send_P(code, contentType, reply, N - 1);
+}
+
+// Queued is answered right away with 202 and the wait rather than holding
+// the single-threaded server until the door opens.
+void sendUnlockReply(const UnlockResult& unlock) {
+  int code = 200;
+  const char* name = "ok";
+  const char* message = "Unlocked";
+  switch (unlock.result) {
+    case RelayController::Result::kFired:
+      break;
+    case RelayController::Result::kCoalesced:
+      name = "coalesced";
+      message = "Already unlocked";
+      break;
+    case RelayController::Result::kQueued:
+      code = 202;
+      name = "queued";
+      message = "Unlocking after cooldown";
+      break;
+    case RelayController::Result::kCooldown:
+      code = 429;
+      name = "cooldown";
+      message = "Relay cooldown active";
+      break;
+  }
+  const int len = snprintf_P(gJsonBuffer, sizeof(gJsonBuffer),
+                             poot_http::kUnlockReplyFormat,
+                             code == 429 ? "false" : "true", name, message,
+                             (unsigned long)unlock.openMs,
+                             (unsigned long)unlock.opensInMs);
+  server.send(code, poot_http::kContentTypeJson, gJsonBuffer,
+              static_cast<size_t>(len));
+}
+
+template <size_t N>
+void sendFixedJson(int code, const char (&reply)[N]) {
+  sendFixed(code, poot_http::kContentTypeJson, reply);
+}
+
+// Constant time over the key, like ChallengeAuth::verify(), so how fast a
+// guess is refused says nothing about how much of it was right.
+bool hasValidKey() {
+  static const char kKey[] = LOCAL_SHARED_KEY;
+  const char* key = server.arg("key");
+  uint8_t diff = 0;
+  size_t at = 0;
+  for (size_t i = 0; i < sizeof(kKey) - 1; i++) {
+    diff |= static_cast<uint8_t>(kKey[i] ^ key[at]);
+    if (key[at] != '\0') {
+      at++;
+    }
+  }
+  diff |= static_cast<uint8_t>(key[at]);  // longer than the key
+  return key[0] != '\0' && diff == 0;
+}
+
+// Checks /api/local-unlock's nonce and mac (or, while kLocalUnlockAcceptsKey,
+// its key) and sends the refusal when they do not hold.
+bool isUnlockAuthorized() {
+  if (!server.hasArg("mac") && poot::kLocalUnlockAcceptsKey &&
+      server.hasArg("key")) {
+    if (hasValidKey()) {
+      return true;
+    }
+    poot_diag::logf("LOCAL_HTTP", "unlock denied reason=invalid_key");
+    sendFixedJson(401, poot_http::kUnlockDeniedReply);
+    return false;
+  }
+  if (!server.hasArg("nonce") || !server.hasArg("mac")) {
+    poot_diag::logf("LOCAL_HTTP", "bad_request: missing nonce or mac");
+    if (poot::kLocalUnlockAcceptsKey) {
+      sendFixedJson(400, poot_http::kMissingKeyReply);
+    } else {
+      sendFixedJson(400, poot_http::kMissingMacReply);
+    }
+    return false;
+  }
+  const poot_auth::Verdict verdict =
+      localAuth.verify(server.arg("nonce"), server.arg("mac"), millis());
+  switch (verdict) {
+    case poot_auth::Verdict::kOk:
+      return true;
+    case poot_auth::Verdict::kMalformed:
+      sendFixedJson(400, poot_http::kMalformedMacReply);
+      break;
+    case poot_auth::Verdict::kStaleNonce:
+      sendFixedJson(401, poot_http::kStaleNonceReply);
+      break;
+    default:
+      sendFixedJson(401, poot_http::kUnlockDeniedReply);
+      break;
+  }
+  poot_diag::logf("LOCAL_HTTP", "unlock denied reason=%s",
+                  poot_auth::verdictName(verdict));
+  return false;
+}
+
+// Dotted-quad without going through IPAddress::toString()'s String.
+const char* formatIp(const IPAddress& ip, char (&out)[16]) {
+  snprintf(out, sizeof(out), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+  return out;
+}
+
+// Streamed reports. The server pulls each one a piece at a time from loop()
+// as the socket drains, so none of them needs a document or body buffer and
+// a slow reader never stalls the loop. Every piece fits in
+// kStreamChunkBytes.
+
+size_t formatPerfHistogram(char* out, size_t room, const char* name,
+                           const poot_perf::LatencyHistogram& histogram,
+                           bool first) {
+  using poot_perf::cyclesToMicros;
+  const int len = snprintf(
+      out, room,
+      "%s\"%s\":{\"count\":%lu,\"min_us\":%lu,\"p50_us\":%lu,"
+      "\"p99_us\":%lu,\"max_us\":%lu,\"mean_us\":%lu}",
+      first ? "" : ",", name, (unsigned long)histogram.count(),
+      (unsigned long)cyclesToMicros(histogram.minCycles()),
+      (unsigned long)cyclesToMicros(histogram.percentileCycles(500)),
+      (unsigned long)cyclesToMicros(histogram.percentileCycles(990)),
+      (unsigned long)cyclesToMicros(histogram.maxCycles()),
+      (unsigned long)cyclesToMicros(histogram.meanCycles()));
+  return static_cast<size_t>(len);
+}
+
+constexpr uint8_t kPerfResetWhenDone = 0x01;
+
+enum PerfPhase : uint8_t {
+  kPerfSummary,
+  kPerfLoop,
+  kPerfGap,
+  kPerfStages,
+  kPerfClose,
+  kPerfDone,
+};
+
+// The profiler snapshot; `flags` carries ?reset=1, applied once the last
+// piece has been produced.
+size_t perfReportSource(poot_http::StreamState& state, char* out,
+                        size_t room) {
+  switch (state.phase) {
+    case kPerfSummary: {
+      const uint32_t windowMs = loopProfiler.windowMs();
+      const uint32_t iterations = loopProfiler.iterations();
+      const uint32_t perSecond =
+          windowMs == 0
+              ? 0
+              : static_cast<uint32_t>(static_cast<uint64_t>(iterations) *
+                                      1000u / windowMs);
+      state.phase = kPerfLoop;
+      return static_cast<size_t>(snprintf(
+          out, room,
+          "{\"ok\":true,\"enabled\":%s,\"cpu_mhz\":%u,\"window_ms\":%lu,"
+          "\"iterations\":%lu,\"iter_per_s\":%lu,",
+          poot::kEnableLoopProfiler ? "true" : "false",
+          (unsigned)ESP.getCpuFreqMHz(), (unsigned long)windowMs,
+          (unsigned long)iterations, (unsigned long)perSecond));
+    }
+    case kPerfLoop:
+      state.phase = kPerfGap;
+      return formatPerfHistogram(out, room, "loop", loopProfiler.loopBody(),
+                                 /*first=*/true);
+    case kPerfGap: {
+      state.phase = kPerfStages;
+      const size_t len = formatPerfHistogram(out, room, "gap",
+                                             loopProfiler.gap(),
+                                             /*first=*/false);
+      memcpy(out + len, ",\"stages\":{", 11);
+      return len + 11;
+    }
+    case kPerfStages: {
+      const poot_perf::Stage stage =
+          static_cast<poot_perf::Stage>(state.index);
+      const size_t len = formatPerfHistogram(
+          out, room, poot_perf::stageName(stage), loopProfiler.stage(stage),
+          /*first=*/state.index == 0);
+      if (++state.index == static_cast<uint8_t>(poot_perf::Stage::kCount)) {
+        state.phase = kPerfClose;
+      }
+      return len;
+    }
+    case kPerfClose:
+      state.phase = kPerfDone;
+      memcpy(out, "}}", 2);
+      return 2;
+    default:
+      if (state.flags & kPerfResetWhenDone) {
+        state.flags = 0;
+        loopProfiler.reset();
+        poot_diag::logf("PERF", "loop profiler reset");
+      }
+      return 0;
+  }
+}
+
+constexpr uint8_t kAllocResetWhenDone = 0x01;
+
+enum AllocPhase : uint8_t {
+  kAllocSummary,
+  kAllocScopes,
+  kAllocClose,
+  kAllocDone,
+};
+
+// Per-scope heap/stack counters; `flags` carries ?reset=1 like /api/perf.
+size_t allocReportSource(poot_http::StreamState& state, char* out,
+                         size_t room) {
+  switch (state.phase) {
+    case kAllocSummary: {
+      const poot_alloc::Totals& totals = poot_alloc::totals();
+      state.phase = kAllocScopes;
+      return static_cast<size_t>(snprintf(
+          out, room,
+          "{\"ok\":true,\"enabled\":%s,\"hooks\":%s,\"window_ms\":%lu,"
+          "\"free_heap\":%lu,\"free_cont_stack\":%lu,\"allocs\":%lu,"
+          "\"frees\":%lu,\"live_bytes\":%ld,\"scopes\":{",
+          poot::kEnableAllocTracking ? "true" : "false",
+          poot_alloc::hooksInstalled() ? "true" : "false",
+          (unsigned long)poot_alloc::windowMs(),
+          (unsigned long)ESP.getFreeHeap(),
+          (unsigned long)ESP.getFreeContStack(),
+          (unsigned long)totals.allocs, (unsigned long)totals.frees,
+          (long)totals.liveBytes));
+    }
+    case kAllocScopes: {
+      if (state.index >= poot_alloc::scopeCount()) {
+        state.phase = kAllocClose;
+        return allocReportSource(state, out, room);
+      }
+      const poot_alloc::ScopeStats& scope = poot_alloc::scope(state.index);
+      const int len = snprintf(
+          out, room,
+          "%s\"%s\":{\"calls\":%lu,\"allocs\":%lu,\"frees\":%lu,"
+          "\"bytes\":%lu,\"live_bytes\":%ld,\"peak_bytes\":%lu,"
+          "\"heap_delta\":%ld,\"stack_bytes\":%u}",
+          state.index == 0 ? "" : ",", scope.name,
+          (unsigned long)scope.calls, (unsigned long)scope.allocs,
+          (unsigned long)scope.frees, (unsigned long)scope.bytes,
+          (long)scope.liveBytes, (unsigned long)scope.peakBytes,
+          (long)scope.heapDelta, (unsigned)scope.maxStackBytes);
+      state.index++;
+      return static_cast<size_t>(len);
+    }
+    case kAllocClose:
+      state.phase = kAllocDone;
+      memcpy(out, "}}", 2);
+      return 2;
+    default:
+      if (state.flags & kAllocResetWhenDone) {
+        state.flags = 0;
+        poot_alloc::reset();
+        poot_diag::logf("ALLOC", "counters reset");
+      }
+      return 0;
+  }
+}
+
+// Log lines from `position` up to `end`, then a "# next=" trailer.
+size_t logsSource(poot_http::StreamState& state, char* out, size_t room) {
+  if (state.phase != 0) {
+    return 0;
+  }
+  if (state.position != state.end) {
+    const size_t len = poot_diag::readLine(state.position, out, room);
+    if (len != 0) {
+      return len;
+    }
+  }
+  state.phase = 1;
+  return static_cast<size_t>(
+      snprintf(out, room, "# next=%lu dropped=%lu\n",
+               (unsigned long)state.position,
+               (unsigned long)poot_diag::droppedRecords()));
+}
+
+enum BlackboxPhase : uint8_t {
+  kBlackboxCounters,
+  kBlackboxReset,
+  kBlackboxRtcHeader,
+  kBlackboxRtcRecords,
+  kBlackboxFlashHeader,
+  kBlackboxFlash,
+  kBlackboxDone,
+};
+
+// Plain-text post-mortem: counters and reset cause, the previous boot's last
+// records from RTC memory, then the flash log (oldest first).
+size_t blackboxSource(poot_http::StreamState& state, char* out, size_t room) {
+  using poot_blackbox::Counter;
+
+  switch (state.phase) {
+    case kBlackboxCounters: {
+      int len = snprintf(out, room, "#");
+      for (uint8_t i = 0; i < static_cast<uint8_t>(Counter::kCount); i++) {
+        const Counter c = static_cast<Counter>(i);
+        len += snprintf(out + len, room - len, " %s=%lu",
+                        poot_blackbox::counterName(c),
+                        (unsigned long)poot_blackbox::counter(c));
+      }
+      out[len++] = '\n';
+      state.phase = kBlackboxReset;
+      return static_cast<size_t>(len);
+    }
+    case kBlackboxReset: {
+      out[0] = '#';
+      out[1] = ' ';
+      size_t len = 2 + poot_blackbox::describeReset(out + 2, room - 3);
+      out[len++] = '\n';
+      state.phase = kBlackboxRtcHeader;
+      return len;
+    }
+    case kBlackboxRtcHeader:
+      state.phase = kBlackboxRtcRecords;
+      return static_cast<size_t>(
+          snprintf(out, room, "# previous boot (rtc): %u record(s)\n",
+                   poot_blackbox::previousRecordCount()));
+    case kBlackboxRtcRecords:
+      while (state.index < poot_blackbox::previousRecordCount()) {
+        const size_t len = poot_blackbox::readPreviousRecord(
+            static_cast<uint8_t>(state.index++), out, room);
+        if (len != 0) {
+          return len;
+        }
+      }
+      state.phase = kBlackboxFlashHeader;
+      return blackboxSource(state, out, room);
+    case kBlackboxFlashHeader:
+      if (!poot_blackbox::flashReady()) {
+        state.phase = kBlackboxDone;
+        memcpy(out, "# flash: unavailable\n", 21);
+        return 21;
+      }
+      state.phase = kBlackboxFlash;
+      return static_cast<size_t>(
+          snprintf(out, room, "# flash: %lu byte(s)\n",
+                   (unsigned long)poot_blackbox::flashBytes()));
+    case kBlackboxFlash: {
+      const size_t len = poot_blackbox::readFlash(
+          state.position, reinterpret_cast<uint8_t*>(out), room);
+      if (len == 0) {
+        state.phase = kBlackboxDone;
+      }
+      return len;
+    }
+    default:
+      return 0;
+  }
+}
+
+enum MetricsPhase : uint8_t {
+  kMetricsResponses,
+  kMetricsUnlocks,
+  kMetricsLatency,
+  kMetricsCounters,
+  kMetricsDisconnects,
+  kMetricsGauges,
+  kMetricsDone,
+};
+
+// Lines per source in the latency histogram: the buckets, +Inf, sum, count.
+constexpr uint16_t kMetricsLatencyLines = poot_metrics::kLatencyBuckets + 3;
+
+struct MetricGauge {
+  const char* name;
+  const char* help;
+  uint32_t (*read)();
+};
+
+const MetricGauge kMetricGauges[] = {
+    {"poot_uptime_seconds", "Time since boot.",
+     []() -> uint32_t { return millis() / 1000; }},
+    {"poot_heap_free_bytes", "Free heap.",
+     []() -> uint32_t { return ESP.getFreeHeap(); }},
+    {"poot_heap_free_min_bytes", "Lowest free heap sampled since boot.",
+     poot_metrics::minFreeHeap},
+    {"poot_heap_max_block_min_bytes",
+     "Smallest largest free heap block sampled since boot.",
+     poot_metrics::minMaxFreeBlock},
+    {"poot_wifi_ap_stations", "Stations on the soft AP.",
+     []() -> uint32_t { return WiFi.softAPgetStationNum(); }},
+    {"poot_http_connections", "Open local HTTP connections.",
+     []() -> uint32_t { return server.openConnections(); }},
+};
+
+constexpr uint8_t kMetricGaugeCount =
+    sizeof(kMetricGauges) / sizeof(kMetricGauges[0]);
+
+size_t formatMetricHead(char* out, size_t room, const char* name,
+                        const char* type, const char* help) {
+  return static_cast<size_t>(snprintf(out, room,
+                                      "# HELP %s %s\n# TYPE %s %s\n", name,
+                                      help, name, type));
+}
+
+// Prometheus text exposition, a family or a series per piece. `index`
+// walks the series of the current family; series still at zero are left
+// out where the label set is open-ended (routes by code).
+size_t metricsSource(poot_http::StreamState& state, char* out, size_t room) {
+  using poot_http::HttpServer;
+  using poot_metrics::kUnlockResults;
+  using poot_metrics::kUnlockSources;
+
+  switch (state.phase) {
+    case kMetricsResponses: {
+      if (state.index == 0 && state.flags == 0) {
+        state.flags = 1;
+        return formatMetricHead(out, room, "poot_http_responses_total",
+                                "counter",
+                                "Local HTTP responses by route and code.");
+      }
+      while (state.index < HttpServer::kRouteSlots * HttpServer::kStatusSlots) {
+        const uint8_t route = state.index / HttpServer::kStatusSlots;
+        const uint8_t status = state.index % HttpServer::kStatusSlots;
+        state.index++;
+        const char* name = server.routeName(route);
+        const uint32_t n = server.responses(route, status);
+        if (name == nullptr || n == 0) {
+          continue;
+        }
+        const int code = HttpServer::statusCode(status);
+        char codeText[8];
+        if (code == 0) {
+          memcpy(codeText, "other", 6);
+        } else {
+          snprintf(codeText, sizeof(codeText), "%d", code);
+        }
+        return static_cast<size_t>(snprintf(
+            out, room,
+            "poot_http_responses_total{route=\"%s\",code=\"%s\"} %lu\n",
+            name, codeText, (unsigned long)n));
+      }
+      state.phase = kMetricsUnlocks;
+      state.index = 0;
+      state.flags = 0;
+      return formatMetricHead(
+          out, room, "poot_unlock_requests_total", "counter",
+          "Authenticated unlock requests by source and relay result.");
+    }
+    case kMetricsUnlocks: {
+      if (state.index < kUnlockSources * kUnlockResults) {
+        const uint8_t source = state.index / kUnlockResults;
+        const uint8_t result = state.index % kUnlockResults;
+        state.index++;
+        return static_cast<size_t>(snprintf(
+            out, room,
+            "poot_unlock_requests_total{source=\"%s\",result=\"%s\"} %lu\n",
+            poot_audit::sourceName(source),
+            RelayController::resultName(
+                static_cast<RelayController::Result>(result)),
+            (unsigned long)poot_metrics::unlocks(source, result)));
+      }
+      state.phase = kMetricsLatency;
+      state.index = 0;
+      return formatMetricHead(
+          out, room, "poot_unlock_latency_seconds", "histogram",
+          "Time from an unlock request arriving to the relay switching on.");
+    }
+    case kMetricsLatency: {
+      if (state.index >= kUnlockSources * kMetricsLatencyLines) {
+        state.phase = kMetricsCounters;
+        state.index = 0;
+        return metricsSource(state, out, room);
+      }
+      const uint8_t source = state.index / kMetricsLatencyLines;
+      const uint8_t line = state.index % kMetricsLatencyLines;
+      state.index++;
+      const char* name = poot_audit::sourceName(source);
+      const poot_metrics::LatencyHistogram& histogram =
+          poot_metrics::unlockLatency(source);
+      if (line < poot_metrics::kLatencyBuckets) {
+        uint32_t cumulative = 0;
+        for (uint8_t i = 0; i <= line; i++) {
+          cumulative += histogram.buckets[i];
+        }
+        const uint32_t boundMs = poot_metrics::bucketBoundUs(line) / 1000;
+        return static_cast<size_t>(snprintf(
+            out, room,
+            "poot_unlock_latency_seconds_bucket{source=\"%s\","
+            "le=\"%lu.%03lu\"} %lu\n",
+            name, (unsigned long)(boundMs / 1000),
+            (unsigned long)(boundMs % 1000), (unsigned long)cumulative));
+      }
+      if (line == poot_metrics::kLatencyBuckets) {
+        return static_cast<size_t>(snprintf(
+            out, room,
+            "poot_unlock_latency_seconds_bucket{source=\"%s\",le=\"+Inf\"}"
+            " %lu\n",
+            name, (unsigned long)histogram.count));
+      }
+      if (line == poot_metrics::kLatencyBuckets + 1) {
+        return static_cast<size_t>(snprintf(
+            out, room,
+            "poot_unlock_latency_seconds_sum{source=\"%s\"} %lu.%06lu\n",
+            name, (unsigned long)(histogram.sumUs / 1000000u),
+            (unsigned long)(histogram.sumUs % 1000000u)));
+      }
+      return static_cast<size_t>(snprintf(
+          out, room, "poot_unlock_latency_seconds_count{source=\"%s\"} %lu\n",
+          name, (unsigned long)histogram.count));
+    }
+    case kMetricsCounters: {
+      if (state.index >=
+          static_cast<uint8_t>(poot_metrics::Counter::kCount)) {
+        state.phase = kMetricsDisconnects;
+        state.index = 0;
+        return formatMetricHead(out, room, "poot_wifi_sta_disconnects_total",
+                                "counter",
+                                "STA disconnects by SDK reason code.");
+      }
+      const poot_metrics::Counter counter =
+          static_cast<poot_metrics::Counter>(state.index++);
+      const char* name = poot_metrics::counterName(counter);
+      const size_t len =
+          formatMetricHead(out, room, name, "counter",
+                           poot_metrics::counterHelp(counter));
+      return len + static_cast<size_t>(
+                       snprintf(out + len, room - len, "%s %lu\n", name,
+                                (unsigned long)poot_metrics::counter(counter)));
+    }
+    case kMetricsDisconnects: {
+      if (state.index >= poot_metrics::disconnectReasonCount()) {
+        state.phase = kMetricsGauges;
+        state.index = 0;
+        return metricsSource(state, out, room);
+      }
+      const uint8_t index = static_cast<uint8_t>(state.index++);
+      return static_cast<size_t>(snprintf(
+          out, room, "poot_wifi_sta_disconnects_total{reason=\"%u\"} %lu\n",
+          (unsigned)poot_metrics::disconnectReason(index),
+          (unsigned long)poot_metrics::disconnects(index)));
+    }
+    case kMetricsGauges: {
+      if (state.index >= kMetricGaugeCount) {
+        state.phase = kMetricsDone;
+        return 0;
+      }
+      const MetricGauge& gauge = kMetricGauges[state.index++];
+      const size_t len =
+          formatMetricHead(out, room, gauge.name, "gauge", gauge.help);
+      return len + static_cast<size_t>(
+                       snprintf(out + len, room - len, "%s %lu\n",
+                                gauge.name, (unsigned long)gauge.read()));
+    }
+    default:
+      return 0;
+  }
+}
+
+enum HealthPhase : uint8_t {
+  kHealthTop,
+  kHealthSsid,
+  kHealthSta,
+  kHealthBoot,
+  kHealthLocal,
+  kHealthHttp,
+  kHealthPower,
+  kHealthPowerModes,
+  kHealthAuth,
+  kHealthReboot,
+  kHealthLimits,
+  kHealthHistory,
+  kHealthCloud,
+  kHealthTls,
+  kHealthAudit,
+  kHealthDone,
+};
+
+const char* boolText(bool value) { return value ? "true" : "false"; }
+
+// `text` as a JSON string. Only the SSID needs it; at 32 bytes even all
+// control characters fit in a piece.
+size_t formatJsonString(char* out, size_t room, const char* text) {
+  size_t len = 0;
+  out[len++] = '"';
+  for (; *text != '\0' && len + 8 < room; text++) {
+    const unsigned char c = static_cast<unsigned char>(*text);
+    if (c == '"' || c == '\\') {
+      out[len++] = '\\';
+      out[len++] = static_cast<char>(c);
+    } else if (c < 0x20) {
+      len += snprintf(out + len, room - len, "\\u%04x", c);
+    } else {
+      out[len++] = static_cast<char>(c);
+    }
+  }
+  out[len++] = '"';
+  return len;
+}
+
+// /api/health, an object or two per piece. Streamed rather than built in a
+// document: it outgrew any buffer worth keeping, and a truncated reply
+// would not be JSON.
+size_t healthSource(poot_http::StreamState& state, char* out, size_t room) {
+  switch (state.phase) {
+    case kHealthTop: {
+      char staIp[16];
+      state.phase = kHealthSsid;
+      return static_cast<size_t>(snprintf(
+          out, room,
+          "{\"ok\":true,\"version\":\"%s\",\"uptime_ms\":%lu,"
+          "\"free_heap\":%lu,\"reset_reason\":\"%s\",\"sta\":{"
+          "\"status\":\"%s\",\"ip\":\"%s\",\"rssi\":%d,\"ssid\":",
+          poot::kFirmwareVersion, (unsigned long)millis(),
+          (unsigned long)ESP.getFreeHeap(), poot_blackbox::resetReason(),
+          wifiStatusName(WiFi.status()), formatIp(WiFi.localIP(), staIp),
+          (int)WiFi.RSSI()));
+    }
+    case kHealthSsid:
+      state.phase = kHealthSta;
+      // connectSta() only ever joins WIFI_STA_SSID.
+      return formatJsonString(out, room, WIFI_STA_SSID);
+    case kHealthSta:
+      state.phase = kHealthBoot;
+      return static_cast<size_t>(snprintf(
+          out, room,
+          ",\"join\":\"%s\",\"join_ms\":%lu,\"join_max_ms\":%lu,"
+          "\"fast_joins\":%lu,\"fast_misses\":%lu,\"scan_joins\":%lu},"
+          "\"boot\":{",
+          poot_sta::joinKindName(poot_sta::lastJoin()),
+          (unsigned long)poot_sta::lastJoinMs(),
+          (unsigned long)poot_sta::maxJoinMs(),
+          (unsigned long)poot_sta::fastJoins(),
+          (unsigned long)poot_sta::fastMisses(),
+          (unsigned long)poot_sta::scanJoins()));
+    case kHealthBoot: {
+      const poot_boot::Phase phase = static_cast<poot_boot::Phase>(state.index);
+      if (++state.index == static_cast<uint8_t>(poot_boot::Phase::kCount)) {
+        state.phase = kHealthLocal;
+        state.index = 0;
+      }
+      return static_cast<size_t>(snprintf(
+          out, room, "%s\"%s\":%ld",
+          phase == static_cast<poot_boot::Phase>(0) ? "" : ",",
+          poot_boot::phaseName(phase),
+          poot_boot::reached(phase) ? static_cast<long>(poot_boot::at(phase))
+                                    : -1L));
+    }
+    case kHealthLocal: {
+      char apIp[16];
+      state.phase = kHealthHttp;
+      return static_cast<size_t>(snprintf(
+          out, room,
+          "},\"ap\":{\"ip\":\"%s\",\"stations\":%u},\"relay\":{\"on\":%s,"
+          "\"cooling\":%s,\"queued\":%s},\"resources\":{"
+          "\"max_free_block\":%lu,\"frag\":%u,\"loop_stall_ms\":%lu,"
+          "\"sockets\":%u},",
+          formatIp(WiFi.softAPIP(), apIp),
+          (unsigned)WiFi.softAPgetStationNum(), boolText(relay.isRelayOn()),
+          boolText(relay.isCoolingDown()), boolText(relay.hasQueuedPulse()),
+          (unsigned long)ESP.getMaxFreeBlockSize(),
+          (unsigned)ESP.getHeapFragmentation(),
+          (unsigned long)healthMonitor.last().loopStallMs,
+          (unsigned)server.openConnections()));
+    }
+    case kHealthHttp:
+      state.phase = kHealthPower;
+      return static_cast<size_t>(snprintf(
+          out, room,
+          "\"http\":{\"served\":%lu,\"shed\":%lu,\"shed_conns\":%lu,"
+          "\"busy\":%lu,\"timed_out\":%lu},",
+          (unsigned long)server.requestsServed(),
+          (unsigned long)server.requestsShed(),
+          (unsigned long)server.connectionsShed(),
+          (unsigned long)server.connectionsRejected(),
+          (unsigned long)server.requestsTimedOut()));
+    case kHealthPower: {
+      const poot_power::Decision& decision = powerPolicy.decision();
+      state.phase = kHealthPowerModes;
+      return static_cast<size_t>(snprintf(
+          out, room,
+          "\"power\":{\"mode\":\"%s\",\"listen_interval\":%u,\"cpu_mhz\":%u,"
+          "\"budget_ms\":%lu,\"added_ms\":%lu,\"duty_permille\":%u,"
+          "\"switches\":%lu,\"boosts\":%lu,\"ms\":{",
+          poot_power::modeName(decision.mode),
+          (unsigned)decision.listenInterval, (unsigned)ESP.getCpuFreqMHz(),
+          (unsigned long)powerPolicy.latencyBudgetMs(),
+          (unsigned long)powerPolicy.addedLatencyMs(decision.mode),
+          (unsigned)powerPolicy.dutyPermille(),
+          (unsigned long)powerPolicy.switches(),
+          (unsigned long)powerPolicy.boosts()));
+    }
+    case kHealthPowerModes: {
+      if (state.index == static_cast<uint8_t>(poot_power::Mode::kCount)) {
+        state.phase = kHealthAuth;
+        state.index = 0;
+        return static_cast<size_t>(snprintf(
+            out, room,
+            "},\"asleep_unlocks\":{\"count\":%lu,"
+            "\"firmware_last_us\":%lu,\"firmware_max_us\":%lu},"
+            "\"ap_kept\":%s},",
+            (unsigned long)powerPolicy.asleepUnlocks(),
+            (unsigned long)powerPolicy.lastAsleepUnlockUs(),
+            (unsigned long)powerPolicy.maxAsleepUnlockUs(),
+            boolText(!powerPolicy.dropsAp())));
+      }
+      const poot_power::Mode mode = static_cast<poot_power::Mode>(state.index);
+      return static_cast<size_t>(snprintf(
+          out, room, "%s\"%s\":%lu", state.index++ == 0 ? "" : ",",
+          poot_power::modeName(mode), (unsigned long)powerPolicy.msIn(mode)));
+    }
+    case kHealthAuth:
+      state.phase = kHealthReboot;
+      return static_cast<size_t>(snprintf(
+          out, room,
+          "\"auth\":{\"challenges\":%lu,\"verified\":%lu,\"stale\":%lu,"
+          "\"rejected\":%lu,\"verify_us\":%lu,\"max_verify_us\":%lu},",
+          (unsigned long)localAuth.issued(),
+          (unsigned long)localAuth.verified(),
+          (unsigned long)localAuth.stale(),
+          (unsigned long)localAuth.rejected(),
+          (unsigned long)poot_perf::cyclesToMicros(
+              localAuth.lastVerifyCycles()),
+          (unsigned long)poot_perf::cyclesToMicros(
+              localAuth.maxVerifyCycles())));
+    case kHealthReboot:
+      state.phase = kHealthLimits;
+      return static_cast<size_t>(snprintf(
+          out, room,
+          "\"reboot\":{\"pending\":\"%s\",\"pending_ms\":%lu,\"limits\":{",
+          poot_health::reasonName(healthMonitor.pending()),
+          (unsigned long)healthMonitor.pendingMs()));
+    case kHealthLimits:
+      state.phase = kHealthHistory;
+      return static_cast<size_t>(snprintf(
+          out, room,
+          "\"min_free_heap\":%lu,\"critical_free_heap\":%lu,\"max_frag\":%u,"
+          "\"min_free_block\":%lu,\"max_loop_stall_ms\":%lu,"
+          "\"max_sockets\":%u,\"breach_samples\":%u,\"quiet_ms\":%lu,"
+          "\"max_defer_ms\":%lu,\"max_uptime_ms\":%lu},\"history\":[",
+          (unsigned long)poot::kHealthMinFreeHeap,
+          (unsigned long)poot::kHealthCriticalFreeHeap,
+          (unsigned)poot::kHealthMaxFragmentation,
+          (unsigned long)poot::kHealthMinMaxFreeBlock,
+          (unsigned long)poot::kHealthMaxLoopStallMs,
+          (unsigned)poot::kHealthMaxOpenSockets,
+          (unsigned)poot::kHealthBreachSamples,
+          (unsigned long)poot::kHealthQuietMs,
+          (unsigned long)poot::kHealthMaxDeferMs,
+          (unsigned long)poot::kHealthMaxUptimeMs));
+    case kHealthHistory: {
+      if (state.index >= poot_blackbox::rebootCount()) {
+        state.phase = kHealthCloud;
+        return healthSource(state, out, room);
+      }
+      const poot_blackbox::RebootRecord& record =
+          poot_blackbox::reboot(static_cast<uint8_t>(state.index));
+      return static_cast<size_t>(snprintf(
+          out, room,
+          "%s{\"reason\":\"%s\",\"uptime_s\":%lu,\"free_heap\":%u,"
+          "\"frag\":%u}",
+          state.index++ == 0 ? "" : ",",
+          poot_health::reasonName(record.reason),
+          (unsigned long)record.uptimeS, (unsigned)record.freeHeap,
+          (unsigned)record.fragmentation));
+    }
+    case kHealthCloud:
+      state.phase = kHealthTls;
+      return static_cast<size_t>(snprintf(
+          out, room,
+          "]},\"cloud\":{\"state\":\"%s\",\"connects\":%lu,\"deferred\":%lu,"
+          "\"commands\":%lu,",
+          poot_cloud::FirebaseClient::stateName(cloud.state()),
+          (unsigned long)cloud.connects(),
+          (unsigned long)cloud.connectsDeferred(),
+          (unsigned long)cloud.commandsRun()));
+    case kHealthTls:
+      state.phase = kHealthAudit;
+      return static_cast<size_t>(snprintf(
+          out, room,
+          "\"tls\":{\"full\":%lu,\"resumed\":%lu,\"full_ms\":%lu,"
+          "\"resumed_ms\":%lu,\"max_ms\":%lu,\"rx_buffer\":%u}},",
+          (unsigned long)cloud.fullHandshakes(),
+          (unsigned long)cloud.resumedHandshakes(),
+          (unsigned long)cloud.lastFullHandshakeMs(),
+          (unsigned long)cloud.lastResumedHandshakeMs(),
+          (unsigned long)cloud.maxHandshakeMs(),
+          (unsigned)cloud.tlsRecvBufferBytes()));
+    case kHealthAudit:
+      state.phase = kHealthDone;
+      return static_cast<size_t>(snprintf(
+          out, room,
+          "\"audit\":{\"queued\":%lu,\"persistent\":%s,\"dropped\":%lu,"
+          "\"written\":%lu,\"writes\":%lu,\"failures\":%lu,"
+          "\"flush_ms\":%lu,\"max_flush_ms\":%lu,\"write_ms\":%lu}}",
+          (unsigned long)auditLog.pending(), boolText(auditLog.persistent()),
+          (unsigned long)auditLog.dropped(), (unsigned long)auditLog.written(),
+          (unsigned long)cloud.auditWrites(),
+          (unsigned long)cloud.auditFailures(),
+          (unsigned long)cloud.lastFlushMs(), (unsigned long)cloud.maxFlushMs(),
+          (unsigned long)cloud.lastWriteMs()));
+    default:
+      return 0;
+  }
+}
+
+enum EventsPhase : uint8_t {
+  kEventsHello,
+  kEventsLive,
+};
+
+// Server-sent events for /api/events: the whole state as a "state" event,
+// then one event per change carrying just that field, and a comment after
+// kEventsHeartbeatMs of silence so a dead connection shows up on both ends.
+// `position` is the subscriber's cursor into poot_events and `end` when it
+// was last sent anything. One that fell more than the ring behind gets a
+// fresh "state" event instead of what it missed.
+size_t eventsSource(poot_http::StreamState& state, char* out, size_t room) {
+  const uint32_t nowMs = millis();
+  poot_events::Event event;
+  if (state.phase == kEventsLive && state.position == poot_events::head()) {
+    if (nowMs - state.end < poot::kEventsHeartbeatMs) {
+      return poot_http::kStreamPending;
+    }
+    state.end = nowMs;
+    memcpy(out, ":\n\n", 3);
+    return 3;
+  }
+  state.end = nowMs;
+  if (state.phase == kEventsLive &&
+      poot_events::event(state.position, event)) {
+    state.position++;
+    const char* name = poot_events::kindName(event.kind);
+    if (event.kind == poot_events::Kind::kAp) {
+      return static_cast<size_t>(
+          snprintf(out, room, "event: %s\ndata: {\"%s\":%u}\n\n", name, name,
+                   (unsigned)event.value));
+    }
+    return static_cast<size_t>(
+        snprintf(out, room, "event: %s\ndata: {\"%s\":%s}\n\n", name, name,
+                 event.value != 0 ? "true" : "false"));
+  }
+  const bool hello = state.phase == kEventsHello;
+  state.phase = kEventsLive;
+  state.position = poot_events::head();
+  const poot_events::LockState& lock = poot_events::current();
+  char retry[24] = "";
+  if (hello) {
+    snprintf(retry, sizeof(retry), "retry: %lu\n",
+             (unsigned long)poot::kEventsRetryMs);
+  }
+  return static_cast<size_t>(snprintf(
+      out, room,
+      "%sevent: state\ndata: {\"relay\":%s,\"cooldown\":%s,\"sta\":%s,"
+      "\"ap\":%u}\n\n",
+      retry, lock.relayOn ? "true" : "false",
+      lock.coolingDown ? "true" : "false", lock.staUp ? "true" : "false",
+      (unsigned)lock.apStations));
 }
 
 void ensureHttpServer(bool forceRestart = false) {
   if (!serverRoutesRegistered) {
-    server.on("/", HTTP_GET, []() {
+    server.on("/", poot_http::Method::kGet, []() {
       poot_diag::logf("HTTP", "GET /");
-      server.send(200, "text/plain", "Poot lock online");
+      sendFixed(200, poot_http::kContentTypeText, poot_http::kRootReply);
     });
 
-    server.on("/api/local-unlock", HTTP_GET, []() {
-      StaticJsonDocument<256> response;
-      const String remoteIp = server.client().remoteIP().toString();
+    server.on("/api/local-unlock", poot_http::Method::kGet, []() {
+      char remoteIp[16];
       poot_diag::logf("LOCAL_HTTP", "GET /api/local-unlock from %s",
-                      remoteIp.c_str());
-
-      if (!server.hasArg("key")) {
-        poot_diag::logf("LOCAL_HTTP", "bad_request: missing key");
-        response["ok"] = false;
-        response["code"] = "bad_request";
-        response["message"] = "Missing key query parameter";
-        sendJson(400, response);
+                      formatIp(server.remoteIP(), remoteIp));
+
+      if (!isUnlockAuthorized()) {
         return;
       }
 
-      const String key = server.arg("key");
-      if (key.isEmpty() || key != LOCAL_SHARED_KEY) {
-        poot_diag::logf("LOCAL_HTTP", "unlock denied reason=invalid_key");
-        response["ok"] = false;
-        response["code"] = "invalid_key";
-        response["message"] = "Local unlock denied";
-        sendJson(401, response);
+      const UnlockResult unlock = triggerUnlockPulse(
+          poot_audit::Source::kLocalHttp, server.requestStartedUs());
+      poot_diag::logf("LOCAL_HTTP", "unlock %s",
+                      RelayController::resultName(unlock.result));
+      recordAudit(poot_audit::Source::kLocalHttp, unlockOutcome(unlock));
+      sendUnlockReply(unlock);
+    });
+
+    // No key: a nonce is only worth something to whoever can sign it.
+    server.on("/api/challenge", poot_http::Method::kGet, []() {
+      char nonce[poot_auth::kNonceHexChars + 1];
+      localAuth.issue(millis(), server.remoteIP(), nonce);
+      const int len = snprintf_P(gJsonBuffer, sizeof(gJsonBuffer),
+                                 poot_http::kChallengeReplyFormat, nonce,
+                                 (unsigned long)poot::kAuthNonceTtlMs);
+      server.send(200, poot_http::kContentTypeJson, gJsonBuffer,
+                  static_cast<size_t>(len));
+    });
+
+    server.on("/api/health", poot_http::Method::kGet, []() {
+      char remoteIp[16];
+      poot_diag::logf("LOCAL_HTTP", "GET /api/health from %s",
+                      formatIp(server.remoteIP(), remoteIp));
+
+      if (!hasValidKey()) {
+        sendFixedJson(401, poot_http::kHealthDeniedReply);
         return;
       }
 
-      const bool fired =
-          relay.triggerPulse(poot::kUnlockPulseMs, poot::kUnlockCooldownMs);
-      const String reason = fired ? "ok" : "cooldown";
-      poot_diag::logf("LOCAL_HTTP", "unlock %s",
-                      fired ? "success" : "denied_cooldown");
+      server.sendStream(200, poot_http::kContentTypeJson, healthSource);
+    });
+
+    server.on("/api/perf", poot_http::Method::kGet, []() {
+      poot_diag::logf("LOCAL_HTTP", "GET /api/perf reset=%u",
+                      server.hasArg("reset") ? 1 : 0);
+
+      if (!hasValidKey()) {
+        sendFixedJson(401, poot_http::kPerfDeniedReply);
+        return;
+      }
+
+      poot_http::StreamState state = {};
+      state.flags = server.hasArg("reset") ? kPerfResetWhenDone : 0;
+      server.sendStream(200, poot_http::kContentTypeJson, perfReportSource,
+                        state);
+    });
+
+    server.on("/api/alloc", poot_http::Method::kGet, []() {
+      poot_diag::logf("LOCAL_HTTP", "GET /api/alloc reset=%u",
+                      server.hasArg("reset") ? 1 : 0);
+
+      if (!hasValidKey()) {
+        sendFixedJson(401, poot_http::kAllocDeniedReply);
+        return;
+      }
 
-      response["ok"] = fired;
-      response["code"] = reason;
-      response["message"] = fired ? "Unlocked" : "Relay cooldown active";
-      sendJson(fired ? 200 : 429, response);
+      poot_http::StreamState state = {};
+      state.flags = server.hasArg("reset") ? kAllocResetWhenDone : 0;
+      server.sendStream(200, poot_http::kContentTypeJson, allocReportSource,
+                        state);
     });
 
-    server.on("/api/health", HTTP_GET, []() {
-      const String remoteIp = server.client().remoteIP().toString();
-      poot_diag::logf("LOCAL_HTTP", "GET /api/health from %s", remoteIp.c_str());
+    server.on("/api/logs", poot_http::Method::kGet, []() {
+      poot_diag::logf("LOCAL_HTTP", "GET /api/logs");
 
-      if (!server.hasArg("key") || server.arg("key") != LOCAL_SHARED_KEY) {
-        StaticJsonDocument<128> denied;
-        denied["ok"] = false;
-        denied["code"] = "invalid_key";
-        denied["message"] = "Health denied";
-        sendJson(401, denied);
+      if (!hasValidKey()) {
+        sendFixedJson(401, poot_http::kLogsDeniedReply);
         return;
       }
 
-      StaticJsonDocument<384> health;
-      health["ok"] = true;
-      health["version"] = poot::kFirmwareVersion;
-      health["uptime_ms"] = millis();
-      health["free_heap"] = ESP.getFreeHeap();
-      health["reset_reason"] = ESP.getResetReason();
-      JsonObject sta = health.createNestedObject("sta");
-      sta["status"] = wifiStatusName(WiFi.status());
-      sta["ip"] = WiFi.localIP().toString();
-      sta["rssi"] = WiFi.RSSI();
-      sta["ssid"] = WiFi.SSID();
-      JsonObject ap = health.createNestedObject("ap");
-      ap["ip"] = WiFi.softAPIP().toString();
-      ap["stations"] = WiFi.softAPgetStationNum();
-      JsonObject rly = health.createNestedObject("relay");
-      rly["on"] = relay.isRelayOn();
-      rly["cooling"] = relay.isCoolingDown();
-      sendJson(200, health);
+      poot_http::StreamState state = {};
+      state.position = poot_diag::oldestCursor();
+      if (server.hasArg("since")) {
+        const unsigned long since = strtoul(server.arg("since"), nullptr, 10);
+        state.position = poot_diag::seek(static_cast<uint32_t>(since));
+      }
+      // Records logged while streaming (including this request's own line)
+      // are left for the next poll.
+      state.end = poot_diag::headCursor();
+      server.sendStream(200, poot_http::kContentTypeText, logsSource, state);
+    });
+
+    server.on("/api/blackbox", poot_http::Method::kGet, []() {
+      poot_diag::logf("LOCAL_HTTP", "GET /api/blackbox");
+
+      if (!hasValidKey()) {
+        sendFixedJson(401, poot_http::kBlackboxDeniedReply);
+        return;
+      }
+
+      server.sendStream(200, poot_http::kContentTypeText, blackboxSource);
+    });
+
+    server.on("/metrics", poot_http::Method::kGet, []() {
+      if (!hasValidKey()) {
+        sendFixedJson(401, poot_http::kMetricsDeniedReply);
+        return;
+      }
+
+      // Not logged: a scraper polls this every few seconds.
+      poot_metrics::sampleHeap(ESP.getFreeHeap(), ESP.getMaxFreeBlockSize());
+      server.sendStream(200, poot_http::kContentTypeMetrics, metricsSource);
+    });
+
+    server.on("/api/events", poot_http::Method::kGet, []() {
+      char remoteIp[16];
+      poot_diag::logf("LOCAL_HTTP", "GET /api/events from %s",
+                      formatIp(server.remoteIP(), remoteIp));
+
+      if (!hasValidKey()) {
+        sendFixedJson(401, poot_http::kEventsDeniedReply);
+        return;
+      }
+      if (server.streamsFrom(eventsSource) >= poot::kEventsMaxSubscribers) {
+        sendFixedJson(503, poot_http::kEventsBusyReply);
+        return;
+      }
+
+      server.sendStream(200, poot_http::kContentTypeEvents, eventsSource);
     });
 
     server.onNotFound([]() {
-      poot_diag::logf("HTTP", "404 %s", server.uri().c_str());
-      StaticJsonDocument<128> response;
-      response["ok"] = false;
-      response["code"] = "not_found";
-      response["message"] = "Route not found";
-      sendJson(404, response);
+      poot_diag::logf("HTTP", "404 %s", server.uri());
+      sendFixedJson(404, poot_http::kNotFoundReply);
     });
 
     serverRoutesRegistered = true;
@@ -353,22 +1512,94 @@ void setupSoftAp() {
                   (unsigned)WIFI_AP_CHANNEL, (unsigned)poot::kApMaxConnections);
 }
 
+// Logs what one signature costs on this chip: the same HMAC a signed
+// unlock's check runs, without spending a nonce. Runs once the servers are
+// up, so it does not hold up the first request.
+void logAuthCost() {
+  constexpr uint8_t kRounds = 8;
+  const char nonce[] = "00112233445566778899aabbccddeeff";
+  char mac[poot_auth::kMacHexChars + 1];
+  const uint32_t start = ESP.getCycleCount();
+  for (uint8_t i = 0; i < kRounds; i++) {
+    localAuth.sign(nonce, mac);
+  }
+  const uint32_t cycles = (ESP.getCycleCount() - start) / kRounds;
+  poot_diag::logf("AUTH", "hmac cycles=%lu us=%lu",
+                  (unsigned long)cycles,
+                  (unsigned long)poot_perf::cyclesToMicros(cycles));
+}
+
+// Cycles per relay pin write through digitalWrite() and through the
+// compile-time driver (kLogRelayWriteCycles). Both write the idle level the
+// pin already has, so the relay stays put; skipped while a pulse is on.
+void logRelayWriteCycles() {
+  constexpr uint8_t kWrites = 16;
+  if (!poot::kLogRelayWriteCycles || relay.isRelayOn()) {
+    return;
+  }
+  const uint8_t idle = poot::kRelayActiveLow ? HIGH : LOW;
+  uint32_t start = ESP.getCycleCount();
+  for (uint8_t i = 0; i < kWrites; i++) {
+    digitalWrite(poot::kRelayPin, idle);
+  }
+  const uint32_t viaDigitalWrite = ESP.getCycleCount() - start;
+  start = ESP.getCycleCount();
+  for (uint8_t i = 0; i < kWrites; i++) {
+    RelayOutput::off();
+  }
+  const uint32_t viaRegister = ESP.getCycleCount() - start;
+  poot_diag::logf("RELAY", "write cycles digitalWrite=%lu register=%lu",
+                  (unsigned long)(viaDigitalWrite / kWrites),
+                  (unsigned long)(viaRegister / kWrites));
+}
+
 void registerWiFiEventHandlers() {
+  gWiFiEventScope =
+      poot_alloc::registerScope("wifi_event", poot_alloc::kMeasureStack);
   gOnStaDisconnected =
       WiFi.onStationModeDisconnected([](const WiFiEventStationModeDisconnected& e) {
+        poot_alloc::Scope accounting(gWiFiEventScope);
         poot_diag::logf("WIFI", "STA disconnected ssid=%s reason=%u",
                         e.ssid.c_str(), e.reason);
+        poot_blackbox::count(poot_blackbox::Counter::kWiFiDisconnects);
+        poot_metrics::countDisconnect(e.reason);
+        poot_sta::noteDisconnected(e.reason);
+        gLockStateChanged = true;
       });
   gOnStaGotIp = WiFi.onStationModeGotIP([](const WiFiEventStationModeGotIP& e) {
+    poot_alloc::Scope accounting(gWiFiEventScope);
     poot_diag::logf("WIFI", "STA got ip=%s mask=%s gw=%s",
                     e.ip.toString().c_str(), e.mask.toString().c_str(),
                     e.gw.toString().c_str());
     // Defer server.stop()/begin() and mDNS work to loop() — running them
     // inside the SDK event context can race the active server.
     gReassertHttpRequested = true;
+    gLockStateChanged = true;
+    poot_sta::noteGotIp();
+    poot_boot::mark(poot_boot::Phase::kStaIp);
   });
+  gOnApStationJoined = WiFi.onSoftAPModeStationConnected(
+      [](const WiFiEventSoftAPModeStationConnected& e) {
+        poot_alloc::Scope accounting(gWiFiEventScope);
+        poot_diag::logf("AP", "station joined mac=%02x:%02x:%02x:%02x:%02x:%02x"
+                        " aid=%u", e.mac[0], e.mac[1], e.mac[2], e.mac[3],
+                        e.mac[4], e.mac[5], e.aid);
+        poot_metrics::count(poot_metrics::Counter::kApStationJoins);
+        gLockStateChanged = true;
+      });
+  gOnApStationLeft = WiFi.onSoftAPModeStationDisconnected(
+      [](const WiFiEventSoftAPModeStationDisconnected& e) {
+        poot_alloc::Scope accounting(gWiFiEventScope);
+        poot_diag::logf("AP", "station left mac=%02x:%02x:%02x:%02x:%02x:%02x"
+                        " aid=%u", e.mac[0], e.mac[1], e.mac[2], e.mac[3],
+                        e.mac[4], e.mac[5], e.aid);
+        poot_metrics::count(poot_metrics::Counter::kApStationLeaves);
+        gLockStateChanged = true;
+      });
 }
 
+// Brings up the soft AP only; the STA join is started by setupSta() once the
+// local API is serving.
 void setupWiFi() {
   WiFi.persistent(false);
   WiFi.setAutoReconnect(true);
@@ -377,14 +1608,20 @@ void setupWiFi() {
   WiFi.setHostname(poot::kMdnsHostname);
   poot_diag::logf("WIFI", "mode AP_STA hostname=%s", poot::kMdnsHostname);
   setupSoftAp();
+}
+
+void setupSta() {
   registerWiFiEventHandlers();
-  scanAndLogNetworks();
+  poot_sta::begin(WIFI_STA_SSID);
   connectSta();
 }
 
 void setupMdns() {
   if (MDNS.begin(poot::kMdnsHostname)) {
     MDNS.addService("http", "tcp", poot::kLocalHttpPort);
+    if (poot::kEnableUdpUnlock) {
+      MDNS.addService("poot-unlock", "udp", poot::kUdpUnlockPort);
+    }
     poot_diag::logf("MDNS", "responder up as %s.local", poot::kMdnsHostname);
   } else {
     poot_diag::logf("MDNS", "begin failed");
@@ -414,24 +1651,119 @@ void setupOta() {
                   (unsigned)poot::kOtaPort);
 }
 
-void maybeAutoReboot() {
-  if (millis() < poot::kAutoRebootIntervalMs) {
+void setupCloud() {
+#ifdef FIREBASE_DB_HOST
+  if (!poot::kEnableCloud) {
+    return;
+  }
+  poot_cloud::Config config = {};
+  config.dbHost = FIREBASE_DB_HOST;
+#ifdef FIREBASE_PORT
+  config.port = FIREBASE_PORT;
+#else
+  config.port = poot::kCloudPort;
+#endif
+#ifdef FIREBASE_AUTH_HOST
+  config.authHost = FIREBASE_AUTH_HOST;
+#else
+  config.authHost = "identitytoolkit.googleapis.com";
+#endif
+  config.apiKey = FIREBASE_API_KEY;
+  config.email = FIREBASE_DEVICE_EMAIL;
+  config.password = FIREBASE_DEVICE_PASSWORD;
+  config.lockId = LOCK_ID;
+#ifdef FIREBASE_CA_PEM
+  config.caPem = FIREBASE_CA_PEM;
+#endif
+  cloud.begin(config, onCloudCommand);
+  if (poot::kEnableAudit) {
+    cloud.attachAudit(&auditLog);
+  }
+#else
+  poot_diag::logf("CLOUD", "disabled, FIREBASE_DB_HOST not set");
+#endif
+}
+
+poot_health::Sample readHealthSample() {
+  poot_health::Sample sample;
+  sample.uptimeMs = millis();
+  sample.freeHeap = ESP.getFreeHeap();
+  sample.maxFreeBlock = ESP.getMaxFreeBlockSize();
+  poot_metrics::sampleHeap(sample.freeHeap, sample.maxFreeBlock);
+  sample.fragmentation = ESP.getHeapFragmentation();
+  sample.openSockets = server.openConnections();
+  sample.loopStallMs = healthMonitor.takeLoopStall();
+  sample.requests = server.requestsServed() + udpUnlock.unlocksFired();
+  sample.relayBusy = relay.isRelayOn() || relay.isCoolingDown();
+  return sample;
+}
+
+void checkHealth() {
+  const poot_health::Reason reason = healthMonitor.check(readHealthSample());
+  if (reason == poot_health::Reason::kNone) {
     return;
   }
-  poot_diag::logf("WDT", "auto-reboot: %lu ms uptime, scheduled hourly reset",
-                  millis());
+  const poot_health::Sample& sample = healthMonitor.last();
+  poot_diag::logf("HEALTH", "reboot reason=%s uptime_ms=%lu waited_ms=%lu",
+                  poot_health::reasonName(reason),
+                  (unsigned long)sample.uptimeMs,
+                  (unsigned long)healthMonitor.pendingMs());
+  poot_blackbox::count(poot_blackbox::Counter::kAutoReboots);
+  poot_blackbox::recordReboot(
+      {sample.uptimeMs / 1000,
+       static_cast<uint16_t>(sample.freeHeap > UINT16_MAX ? UINT16_MAX
+                                                          : sample.freeHeap),
+       sample.fragmentation, static_cast<uint8_t>(reason)});
+  poot_blackbox::flushToFlash();
+  poot_diag::flushToSerial();
   Serial.flush();
   delay(50);
   ESP.restart();
 }
 
-void ensureNetworkStack() {
-  const uint32_t nowMs = millis();
-  if (nowMs - lastNetworkEnsureMs < poot::kNetworkEnsureMs) {
-    return;
+poot_power::Sample readPowerSample() {
+  poot_power::Sample sample;
+  sample.nowMs = millis();
+  sample.requests = server.requestsServed() + udpUnlock.unlocksFired() +
+                    cloud.commandsRun();
+  sample.openSockets = server.openConnections();
+  sample.apStations = WiFi.softAPgetStationNum();
+  sample.relayBusy = relay.isRelayOn() || relay.isCoolingDown() ||
+                     relay.hasQueuedPulse();
+  sample.staUp = WiFi.status() == WL_CONNECTED;
+  return sample;
+}
+
+// Applies a power policy decision. The SDK only really sleeps the radio in
+// station mode, so with kPowerSleepDropsAp the AP goes down for a sleep and
+// comes back on waking; otherwise it stays up and the sleep is modem sleep.
+void applyPowerDecision(const poot_power::Decision& decision) {
+  const bool apDown = poot::kPowerSleepDropsAp &&
+                      decision.mode != poot_power::Mode::kAwake;
+  const bool apUp = (WiFi.getMode() & WIFI_AP) != 0;
+  if (apDown == apUp) {
+    WiFi.mode(apDown ? WIFI_STA : WIFI_AP_STA);
+    if (!apDown) {
+      setupSoftAp();
+    }
+    MDNS.notifyAPChange();
   }
-  lastNetworkEnsureMs = nowMs;
+  WiFiSleepType_t type = WIFI_NONE_SLEEP;
+  if (decision.mode == poot_power::Mode::kModemSleep) {
+    type = WIFI_MODEM_SLEEP;
+  } else if (decision.mode == poot_power::Mode::kLightSleep) {
+    type = WIFI_LIGHT_SLEEP;
+  }
+  const bool sleepOk = WiFi.setSleepMode(type, decision.listenInterval);
+  system_update_cpu_freq(decision.boostCpu ? SYS_CPU_160MHZ : SYS_CPU_80MHZ);
+  poot_diag::logf("POWER", "mode=%s listen=%u sleep=%s cpu=%u MHz ap=%s",
+                  poot_power::modeName(decision.mode),
+                  (unsigned)decision.listenInterval, sleepOk ? "ok" : "failed",
+                  (unsigned)ESP.getCpuFreqMHz(), apDown ? "down" : "up");
+}
 
+void ensureNetworkStack() {
+  const uint32_t nowMs = millis();
   ensureHttpServer();
 
   if (WiFi.status() == WL_CONNECTED) {
@@ -452,41 +1784,200 @@ void ensureNetworkStack() {
   connectSta(true);
 }
 
+// Everything in loop() that is not network I/O runs from the scheduler, so an
+// idle iteration is just the server/OTA/mDNS pumps plus one deadline check.
+void registerLoopTasks() {
+  using poot_perf::Stage;
+
+  gRelayTask = scheduler.addOneShot("relay", []() {
+    const bool queuedFired = relay.loop();
+    loopProfiler.mark(Stage::kRelay);
+    if (queuedFired) {
+      pulseStarted();
+      return;
+    }
+    if (relay.isRelayOn()) {
+      scheduler.scheduleIn(gRelayTask, relay.msUntilPulseEnd());
+      return;
+    }
+    // Back when the cooldown ends, to fire a queued pulse or just to tell
+    // /api/events subscribers the lock is ready again.
+    if (relay.hasQueuedPulse() || relay.isCoolingDown()) {
+      scheduler.scheduleIn(gRelayTask, relay.msUntilReady());
+    }
+    publishLockState();
+    scheduler.scheduleIn(gStatusLedTask, 0);
+  });
+  gAuditTask = scheduler.addOneShot("audit", []() {
+    auditLog.persist();
+    loopProfiler.mark(Stage::kHousekeeping);
+  });
+  gSurveyTask = scheduler.addOneShot("wifi_survey", []() {
+    const uint32_t nextMs = surveyNetworks();
+    loopProfiler.mark(Stage::kWiFiStatus);
+    if (nextMs > 0) {
+      scheduler.scheduleIn(gSurveyTask, nextMs);
+    }
+  });
+  scheduler.scheduleIn(gSurveyTask, poot::kWiFiSurveyPollMs);
+  gStatusLedTask = scheduler.addOneShot("status_led", []() {
+    const uint32_t nextMs = updateStatusLed();
+    loopProfiler.mark(Stage::kStatusLed);
+    scheduler.scheduleIn(gStatusLedTask, nextMs);
+  });
+  scheduler.scheduleIn(gStatusLedTask, 0);
+
+  scheduler.addPeriodic("wifi_status", poot::kWiFiStatusPollMs, []() {
+    logWiFiStatusIfChanged();
+    if (poot_sta::poll()) {
+      connectSta(true);
+    }
+    loopProfiler.mark(Stage::kWiFiStatus);
+  });
+  scheduler.addPeriodic(
+      "network_ensure", poot::kNetworkEnsureMs,
+      []() {
+        ensureNetworkStack();
+        loopProfiler.mark(Stage::kNetworkEnsure);
+      },
+      poot::kNetworkEnsureMs);
+
+  scheduler.addPeriodic("blackbox", poot::kBlackboxCheckpointMs, []() {
+    poot_blackbox::checkpoint();
+    loopProfiler.mark(Stage::kHousekeeping);
+  });
+
+  scheduler.addPeriodic(
+      "health", poot::kHealthSampleMs,
+      []() {
+        checkHealth();
+        loopProfiler.mark(Stage::kHousekeeping);
+      },
+      poot::kHealthSampleMs);
+
+  scheduler.addPeriodic("power", poot::kPowerSampleMs, []() {
+    if (powerPolicy.update(readPowerSample())) {
+      applyPowerDecision(powerPolicy.decision());
+    }
+    loopProfiler.mark(Stage::kHousekeeping);
+  });
+
+  poot_diag::logf("SCHED", "loop tasks registered next=%lu ms",
+                  (unsigned long)scheduler.msUntilNext());
+}
+
+// Serve first: the soft AP and the local unlock API come up before anything
+// that can wait (the STA join, flash, mDNS, OTA, the cloud), and nothing in
+// setup() blocks on the radio. Phases are timestamped in poot_boot.
 void setup() {
   Serial.begin(poot::kSerialBaud);
+  poot_blackbox::begin(__DATE__ " " __TIME__);
   relay.begin();
-  delay(150);
+  // Logging only fills a RAM ring, so there is no need to wait for Serial.
   poot_diag::logf("BOOT", "Poot firmware booting version=%s",
                   poot::kFirmwareVersion);
-  poot_diag::logf("BOOT", "reset reason=%s", ESP.getResetReason().c_str());
+  poot_diag::logf("BOOT", "reset reason=%s", poot_blackbox::resetReason());
   poot_diag::logf("BOOT", "build timestamp=%s %s", __DATE__, __TIME__);
   randomSeed(analogRead(A0));
 
   setupStatusLed();
-  poot_diag::logf("BOOT", "local auth=shared_key ip=%s",
+  poot_diag::logf("BOOT", "local auth=%s ip=%s",
+                  poot::kLocalUnlockAcceptsKey ? "challenge+key" : "challenge",
                   kStaIp.toString().c_str());
+  gHttpScope = poot_alloc::registerScope("http");
+  gUdpScope = poot_alloc::registerScope("udp");
+  gOtaScope = poot_alloc::registerScope("ota");
+  gMdnsScope = poot_alloc::registerScope("mdns");
+  gCloudScope = poot_alloc::registerScope("cloud");
 
   setupWiFi();
+  poot_boot::mark(poot_boot::Phase::kSoftAp);
+  localAuth.begin(LOCAL_SHARED_KEY);
   ensureHttpServer();
+  poot_boot::mark(poot_boot::Phase::kHttp);
+  if (poot::kEnableUdpUnlock) {
+    udpUnlock.begin(LOCAL_SHARED_KEY, LOCK_ID, udpUnlockPulse);
+  }
+  poot_boot::mark(poot_boot::Phase::kReady);
+  logAuthCost();
+  logRelayWriteCycles();
+
+  setupSta();
+  poot_boot::mark(poot_boot::Phase::kStaBegin);
+  poot_blackbox::beginFlash();
+  if (poot::kEnableAudit) {
+    auditLog.begin();
+  }
   setupMdns();
   setupOta();
+  setupCloud();
+  registerLoopTasks();
+  publishLockState();
+  loopProfiler.reset();
+  poot_alloc::reset();
+  poot_boot::mark(poot_boot::Phase::kSetup);
 }
 
 void loop() {
+  using poot_perf::Stage;
+
+  loopProfiler.beginIteration();
+  healthMonitor.notePass(millis());
+  // Before the pump, so subscribers get a WiFi change in the same pass.
+  if (gLockStateChanged) {
+    gLockStateChanged = false;
+    publishLockState();
+  }
   pumpLocalServer();
+  loopProfiler.mark(Stage::kLocalServer);
   if (gReassertHttpRequested) {
     gReassertHttpRequested = false;
     poot_diag::logf("HTTP", "re-asserting after STA got IP");
     ensureHttpServer(/*forceRestart=*/true);
     MDNS.notifyAPChange();
   }
-  relay.loop();
-  logWiFiStatusIfChanged();
-  ensureNetworkStack();
-  pumpLocalServer();
-  ArduinoOTA.handle();
-  MDNS.update();
-  maybeAutoReboot();
-  updateStatusLed();
-  yield();
+  loopProfiler.mark(Stage::kHousekeeping);
+  const bool ranTasks = scheduler.runDue() > 0;
+  if (ranTasks) {
+    // Scheduler overhead after the last task.
+    loopProfiler.mark(Stage::kHousekeeping);
+    pumpLocalServer();
+    loopProfiler.mark(Stage::kLocalServer);
+  }
+  {
+    poot_alloc::Scope accounting(gOtaScope);
+    ArduinoOTA.handle();
+  }
+  loopProfiler.mark(Stage::kOta);
+  {
+    poot_alloc::Scope accounting(gMdnsScope);
+    MDNS.update();
+  }
+  loopProfiler.mark(Stage::kMdns);
+  {
+    poot_alloc::Scope accounting(gCloudScope);
+    // A connect blocks loop() for its TLS handshake, so it waits until the
+    // relay and the local servers have nothing in hand.
+    cloud.loop(WiFi.status() == WL_CONNECTED,
+               relay.isRelayOn() || relay.hasQueuedPulse() ||
+                   server.requestsPending() || udpUnlock.backlogged());
+  }
+  if (cloud.streaming()) {
+    poot_boot::mark(poot_boot::Phase::kCloud);
+  }
+  loopProfiler.mark(Stage::kCloud);
+  if (!ranTasks) {
+    poot_diag::drainToSerial();
+    loopProfiler.mark(Stage::kLogDrain);
+  }
+  loopProfiler.endIteration();
+  // Light sleep only engages while the CPU idles in delay(). The policy keeps
+  // the delay within its latency budget; the next task deadline cuts it short.
+  const uint32_t idleMs = ranTasks ? 0 : powerPolicy.idleDelayMs();
+  if (idleMs > 0) {
+    const uint32_t nextMs = scheduler.msUntilNext();
+    delay(nextMs < idleMs ? nextMs : idleMs);
+  } else {
+    yield();
+  }
 }
@@ -0,0 +1,154 @@
+#include "power_policy.h"
+
+namespace poot_power {
+
+namespace {
+
+// The SDK takes listen intervals of 1 to 10 DTIM periods.
+constexpr uint32_t kMaxListenInterval = 10;
+
+uint8_t intervalWithin(uint32_t budgetMs) {
+  const uint32_t periods = budgetMs / poot::kPowerDtimMs;
+  return static_cast<uint8_t>(periods > kMaxListenInterval ? kMaxListenInterval
+                                                            : periods);
+}
+
+}  // namespace
+
+const char* modeName(Mode mode) {
+  switch (mode) {
+    case Mode::kAwake:      return "awake";
+    case Mode::kModemSleep: return "modem";
+    case Mode::kLightSleep: return "light";
+    default:                return "unknown";
+  }
+}
+
+PowerPolicy::PowerPolicy(bool sleepAllowed, uint32_t latencyBudgetMs,
+                         bool dropsAp)
+    : sleepAllowed_(sleepAllowed),
+      dropsAp_(dropsAp),
+      budgetMs_(latencyBudgetMs),
+      // Modem sleep wakes for every DTIM beacon; light sleep stretches the
+      // interval over whatever the idle delay leaves of the budget.
+      modemInterval_(intervalWithin(latencyBudgetMs) > 0 ? 1 : 0),
+      lightInterval_(latencyBudgetMs > poot::kPowerLightIdleMs
+                         ? intervalWithin(latencyBudgetMs -
+                                          poot::kPowerLightIdleMs)
+                         : 0) {}
+
+uint8_t PowerPolicy::listenInterval(Mode mode) const {
+  switch (mode) {
+    case Mode::kModemSleep: return modemInterval_;
+    case Mode::kLightSleep: return lightInterval_;
+    default:                return 0;
+  }
+}
+
+uint32_t PowerPolicy::addedLatencyMs(Mode mode) const {
+  const uint32_t radioMs = listenInterval(mode) * poot::kPowerDtimMs;
+  return mode == Mode::kLightSleep ? radioMs + poot::kPowerLightIdleMs
+                                   : radioMs;
+}
+
+uint32_t PowerPolicy::idleDelayMs() const {
+  return decision_.mode == Mode::kLightSleep ? poot::kPowerLightIdleMs : 0;
+}
+
+Mode PowerPolicy::wantedMode(const Sample& sample) const {
+  if (!sleepAllowed_ || !sample.staUp || sample.apStations > 0 ||
+      sample.relayBusy || modemInterval_ == 0) {
+    return Mode::kAwake;
+  }
+  const uint32_t idleMs = sample.nowMs - lastTrafficMs_;
+  if (idleMs < poot::kPowerActiveHoldMs) {
+    return Mode::kAwake;
+  }
+  // Light sleep needs the AP down; with it kept, modem sleep is the floor.
+  if (dropsAp_ && idleMs >= poot::kPowerLightSleepAfterMs &&
+      lightInterval_ > 0) {
+    return Mode::kLightSleep;
+  }
+  return Mode::kModemSleep;
+}
+
+bool PowerPolicy::update(const Sample& sample) {
+  const uint32_t now = sample.nowMs;
+  if (!started_) {
+    started_ = true;
+    lastSampleMs_ = now;
+    lastRequests_ = sample.requests;
+    lastTrafficMs_ = now;
+    burstStartMs_ = now;
+  }
+  msIn_[static_cast<uint8_t>(decision_.mode)] += now - lastSampleMs_;
+  lastSampleMs_ = now;
+
+  if (sample.requests != lastRequests_) {
+    if (now - burstStartMs_ > poot::kPowerBurstWindowMs) {
+      burstStartMs_ = now;
+      burstRequests_ = 0;
+    }
+    burstRequests_ += sample.requests - lastRequests_;
+    lastRequests_ = sample.requests;
+    lastTrafficMs_ = now;
+  } else if (sample.openSockets > 0) {
+    lastTrafficMs_ = now;  // a kept-alive or streaming client
+  }
+  // Once boosted, the clock stays up until a whole window goes by quietly.
+  const bool burst = now - burstStartMs_ <= poot::kPowerBurstWindowMs &&
+                     burstRequests_ >= poot::kPowerBurstRequests;
+  const bool boost =
+      poot::kPowerBoostCpu &&
+      (burst || (decision_.boostCpu &&
+                 now - lastTrafficMs_ <= poot::kPowerBurstWindowMs));
+
+  const Mode mode = wantedMode(sample);
+  const Decision next = {mode, listenInterval(mode), boost};
+  if (next == decision_) {
+    return false;
+  }
+  if (next.mode != decision_.mode) {
+    switches_++;
+  }
+  if (next.boostCpu && !decision_.boostCpu) {
+    boosts_++;
+  }
+  decision_ = next;
+  return true;
+}
+
+void PowerPolicy::noteUnlock(uint32_t firmwareUs) {
+  if (decision_.mode == Mode::kAwake) {
+    return;
+  }
+  asleepUnlocks_++;
+  lastAsleepUnlockUs_ = firmwareUs;
+  if (firmwareUs > maxAsleepUnlockUs_) {
+    maxAsleepUnlockUs_ = firmwareUs;
+  }
+}
+
+uint32_t PowerPolicy::msIn(Mode mode) const {
+  return mode < Mode::kCount ? msIn_[static_cast<uint8_t>(mode)] : 0;
+}
+
+uint16_t PowerPolicy::dutyPermille() const {
+  uint64_t totalMs = 0;
+  uint64_t onMs = 0;
+  for (uint8_t i = 0; i < static_cast<uint8_t>(Mode::kCount); i++) {
+    const Mode mode = static_cast<Mode>(i);
+    totalMs += msIn_[i];
+    const uint32_t cycleMs = listenInterval(mode) * poot::kPowerDtimMs;
+    // The soft AP keeps beaconing, so the radio never goes quiet for it.
+    if (!dropsAp_ || cycleMs == 0 || cycleMs <= poot::kPowerBeaconAwakeMs) {
+      onMs += msIn_[i];
+    } else {
+      onMs += static_cast<uint64_t>(msIn_[i]) * poot::kPowerBeaconAwakeMs /
+              cycleMs;
+    }
+  }
+  return totalMs == 0 ? 1000 : static_cast<uint16_t>(onMs * 1000 / totalMs);
+}
+
+}  // namespace poot_power
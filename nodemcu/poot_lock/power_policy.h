@@ -0,0 +1,114 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "config.h"
+
+namespace poot_power {
+
+// How deeply the radio may sleep. Values index PowerPolicy::msIn().
+enum class Mode : uint8_t {
+  kAwake,       // WIFI_NONE_SLEEP
+  kModemSleep,  // radio off between listened beacons, CPU running
+  kLightSleep,  // radio off between listened beacons, CPU idle in delay()
+  kCount,
+};
+
+const char* modeName(Mode mode);
+
+// What the sketch reads for every decision.
+struct Sample {
+  uint32_t nowMs;
+  uint32_t requests;  // any counter that moves when a client is served
+  uint8_t openSockets;
+  uint8_t apStations;
+  bool relayBusy;     // pulse on, cooling down or queued
+  bool staUp;         // joined with an IP
+};
+
+struct Decision {
+  Mode mode;
+  uint8_t listenInterval;  // DTIM periods between wakes; 0 while awake
+  bool boostCpu;           // 160 MHz instead of 80
+
+  bool operator==(const Decision& other) const {
+    return mode == other.mode && listenInterval == other.listenInterval &&
+           boostCpu == other.boostCpu;
+  }
+  bool operator!=(const Decision& other) const { return !(*this == other); }
+};
+
+// Replaces the fixed WIFI_NONE_SLEEP: picks the deepest sleep that recent
+// traffic (an open connection counts), the soft AP and the relay allow (see
+// kEnablePowerSave), with a listen interval chosen so that the latency a
+// sleep can add stays within the budget, and raises the CPU clock during
+// request bursts whether or not sleep is allowed. update() only decides; the
+// sketch applies the decision. It also keeps what /api/health reports: time
+// in each mode, an estimated radio duty cycle, and how long unlocks that
+// arrived while asleep took to fire in the firmware.
+class PowerPolicy {
+ public:
+  // With `dropsAp` false the soft AP is kept through sleep, which caps it at
+  // modem sleep (see kPowerSleepDropsAp).
+  explicit PowerPolicy(bool sleepAllowed = poot::kEnablePowerSave,
+                       uint32_t latencyBudgetMs = poot::kPowerLatencyBudgetMs,
+                       bool dropsAp = poot::kPowerSleepDropsAp);
+
+  // Evaluates one sample. Returns true when decision() changed and has to be
+  // applied.
+  bool update(const Sample& sample);
+  const Decision& decision() const { return decision_; }
+
+  uint32_t latencyBudgetMs() const { return budgetMs_; }
+  bool dropsAp() const { return dropsAp_; }
+  // Listen interval `mode` sleeps with; 0 when the budget rules it out.
+  uint8_t listenInterval(Mode mode) const;
+  // The most `mode` can add to a request: the listened DTIM periods, plus
+  // the loop() idle delay in light sleep. Within the budget by construction.
+  uint32_t addedLatencyMs(Mode mode) const;
+  // How long loop() may sit in delay() so the SDK can light-sleep; 0 unless
+  // light-sleeping.
+  uint32_t idleDelayMs() const;
+
+  // An unlock fired `firmwareUs` after its request's first bytes arrived,
+  // counted when the radio was sleeping. This is in-firmware latency only:
+  // the radio's wake-up comes before the request is seen, so only a client
+  // can measure the whole delay (addedLatencyMs() bounds it).
+  void noteUnlock(uint32_t firmwareUs);
+  uint32_t asleepUnlocks() const { return asleepUnlocks_; }
+  uint32_t lastAsleepUnlockUs() const { return lastAsleepUnlockUs_; }
+  uint32_t maxAsleepUnlockUs() const { return maxAsleepUnlockUs_; }
+
+  // Time spent in `mode` up to the last sample.
+  uint32_t msIn(Mode mode) const;
+  // Estimated share of that time the radio was powered, in permille: all of
+  // it while awake or while the soft AP is kept, kPowerBeaconAwakeMs per
+  // listened beacon while asleep.
+  uint16_t dutyPermille() const;
+  uint32_t switches() const { return switches_; }
+  uint32_t boosts() const { return boosts_; }
+
+ private:
+  Mode wantedMode(const Sample& sample) const;
+
+  bool sleepAllowed_;
+  bool dropsAp_;
+  uint32_t budgetMs_;
+  uint8_t modemInterval_;
+  uint8_t lightInterval_;
+  Decision decision_ = {Mode::kAwake, 0, false};
+  bool started_ = false;
+  uint32_t lastSampleMs_ = 0;
+  uint32_t lastRequests_ = 0;
+  uint32_t lastTrafficMs_ = 0;
+  uint32_t burstStartMs_ = 0;
+  uint32_t burstRequests_ = 0;
+  uint32_t msIn_[static_cast<uint8_t>(Mode::kCount)] = {0};
+  uint32_t switches_ = 0;
+  uint32_t boosts_ = 0;
+  uint32_t asleepUnlocks_ = 0;
+  uint32_t lastAsleepUnlockUs_ = 0;
+  uint32_t maxAsleepUnlockUs_ = 0;
+};
+
+}  // namespace poot_power
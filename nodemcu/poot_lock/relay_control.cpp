@@ -10,42 +10,87 @@ bool timeReached(uint32_t now, uint32_t target) {
 
 }  // namespace
 
-RelayController::RelayController(uint8_t pin, bool activeLow)
-    : pin_(pin), activeLow_(activeLow) {}
-
-void RelayController::begin() {
-  pinMode(pin_, OUTPUT);
-  writeRelay(false);
-  poot_diag::logf("RELAY", "initialized pin=%u activeLow=%u", pin_,
-                  activeLow_ ? 1 : 0);
+const char* RelayController::resultName(Result result) {
+  switch (result) {
+    case Result::kFired:     return "fired";
+    case Result::kCoalesced: return "coalesced";
+    case Result::kQueued:    return "queued";
+    case Result::kCooldown:  return "denied_cooldown";
+    default:                 return "unknown";
+  }
 }
 
-void RelayController::loop() {
-  const uint32_t now = millis();
+uint8_t RelayController::advance(uint32_t now) {
+  uint8_t edges = 0;
   if (relayOn_ && timeReached(now, pulseEndMs_)) {
-    writeRelay(false);
-    poot_diag::logf("RELAY", "pulse ended");
+    relayOn_ = false;
+    edges |= kPulseEnded;
   }
+  // Forgotten once passed: 24.8 days on, it would read as still ahead.
+  if (!relayOn_ && cooldownUntilMs_ != 0 &&
+      timeReached(now, cooldownUntilMs_)) {
+    cooldownUntilMs_ = 0;
+    if (queued_) {
+      queued_ = false;
+      startPulse(now, queuedDurationMs_, queuedCooldownMs_);
+      edges |= kQueuedStarted;
+    }
+  }
+  return edges;
 }
 
-bool RelayController::triggerPulse(uint32_t durationMs, uint32_t cooldownMs) {
-  const uint32_t now = millis();
+RelayController::Result RelayController::request(uint32_t now,
+                                                 uint32_t durationMs,
+                                                 uint32_t cooldownMs,
+                                                 uint32_t maxWaitMs) {
   if (relayOn_) {
-    poot_diag::logf("RELAY", "trigger denied: pulse active until=%lu now=%lu",
+    poot_diag::logf("RELAY",
+                    "trigger coalesced: pulse active until=%lu now=%lu",
                     pulseEndMs_, now);
-    return false;
+    return Result::kCoalesced;
   }
   if (cooldownUntilMs_ != 0 && !timeReached(now, cooldownUntilMs_)) {
-    poot_diag::logf("RELAY", "trigger denied: cooldown until=%lu now=%lu",
+    if (queued_) {
+      return Result::kQueued;
+    }
+    if (cooldownUntilMs_ - now > maxWaitMs) {
+      poot_diag::logf("RELAY", "trigger denied: cooldown until=%lu now=%lu",
+                      cooldownUntilMs_, now);
+      return Result::kCooldown;
+    }
+    queued_ = true;
+    queuedDurationMs_ = durationMs;
+    queuedCooldownMs_ = cooldownMs;
+    poot_diag::logf("RELAY", "trigger queued: cooldown until=%lu now=%lu",
                     cooldownUntilMs_, now);
-    return false;
+    return Result::kQueued;
   }
-  writeRelay(true);
-  pulseEndMs_ = now + durationMs;
-  cooldownUntilMs_ = pulseEndMs_ + cooldownMs;
+  // A queued pulse whose cooldown ended before loop() got to it is served
+  // by this one.
+  queued_ = false;
+  startPulse(now, durationMs, cooldownMs);
+  return Result::kFired;
+}
+
+void RelayController::logBegin(uint32_t pins, bool activeLow) const {
+  poot_diag::logf("RELAY", "initialized pins=0x%05lx activeLow=%u",
+                  (unsigned long)pins, activeLow ? 1 : 0);
+}
+
+void RelayController::logEdges(uint8_t edges) const {
+  if (edges & kPulseEnded) {
+    poot_diag::logf("RELAY", "pulse ended");
+  }
+  if (edges & kQueuedStarted) {
+    logPulseStarted(queuedDurationMs_, queuedCooldownMs_);
+    poot_diag::logf("RELAY", "queued pulse started");
+  }
+}
+
+void RelayController::logPulseStarted(uint32_t durationMs,
+                                      uint32_t cooldownMs) const {
   poot_diag::logf("RELAY", "pulse started duration=%lu ms cooldown=%lu ms",
                   durationMs, cooldownMs);
-  return true;
 }
 
 bool RelayController::isRelayOn() const { return relayOn_; }
@@ -54,8 +99,25 @@ bool RelayController::isCoolingDown() const {
   return cooldownUntilMs_ != 0 && !timeReached(millis(), cooldownUntilMs_);
 }
 
-void RelayController::writeRelay(bool on) {
-  relayOn_ = on;
-  const uint8_t level = activeLow_ ? (on ? LOW : HIGH) : (on ? HIGH : LOW);
-  digitalWrite(pin_, level);
+uint32_t RelayController::msUntilReady() const {
+  if (cooldownUntilMs_ == 0) {
+    return 0;
+  }
+  const int32_t remaining = static_cast<int32_t>(cooldownUntilMs_ - millis());
+  return remaining <= 0 ? 0 : static_cast<uint32_t>(remaining);
+}
+
+uint32_t RelayController::msUntilPulseEnd() const {
+  if (!relayOn_) {
+    return 0;
+  }
+  const int32_t remaining = static_cast<int32_t>(pulseEndMs_ - millis());
+  return remaining <= 0 ? 0 : static_cast<uint32_t>(remaining);
+}
+
+void RelayController::startPulse(uint32_t now, uint32_t durationMs,
+                                 uint32_t cooldownMs) {
+  relayOn_ = true;
+  pulseEndMs_ = now + durationMs;
+  cooldownUntilMs_ = pulseEndMs_ + cooldownMs;
 }
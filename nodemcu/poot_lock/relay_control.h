@@ -2,24 +2,95 @@
 
 #include <Arduino.h>
 
+#include "gpio_pin.h"
+
+// Pulse, cooldown and queue bookkeeping for one relay channel. It never
+// touches a pin itself: Relay<Output> below switches its output at the edges
+// this reports, so the pins and their polarity are fixed at compile time.
 class RelayController {
  public:
-  RelayController(uint8_t pin, bool activeLow);
+  enum class Result : uint8_t {
+    kFired,      // pulse started now
+    kCoalesced,  // joined the pulse already running; the door is open
+    kQueued,     // fires when the cooldown ends
+    kCooldown,   // cooling down for longer than the caller would wait
+  };
 
-  void begin();
-  void loop();
+  static const char* resultName(Result result);
 
-  bool triggerPulse(uint32_t durationMs, uint32_t cooldownMs);
   bool isRelayOn() const;
   bool isCoolingDown() const;
+  bool hasQueuedPulse() const { return queued_; }
+  // Time left in the active pulse, or 0 when the relay is off.
+  uint32_t msUntilPulseEnd() const;
+  // Time until the cooldown ends (and a queued pulse fires), or 0.
+  uint32_t msUntilReady() const;
 
- private:
-  void writeRelay(bool on);
+ protected:
+  // What advance() did. Both can happen in one call if loop() runs late.
+  static constexpr uint8_t kPulseEnded = 0x01;
+  static constexpr uint8_t kQueuedStarted = 0x02;
+
+  RelayController() = default;
 
-  uint8_t pin_;
-  bool activeLow_;
+  uint8_t advance(uint32_t now);
+  Result request(uint32_t now, uint32_t durationMs, uint32_t cooldownMs,
+                 uint32_t maxWaitMs);
+  // Logging is left until the output has switched, so it adds nothing to
+  // the edge.
+  void logBegin(uint32_t pins, bool activeLow) const;
+  void logEdges(uint8_t edges) const;
+  void logPulseStarted(uint32_t durationMs, uint32_t cooldownMs) const;
+
+ private:
+  void startPulse(uint32_t now, uint32_t durationMs, uint32_t cooldownMs);
 
   bool relayOn_ = false;
   uint32_t pulseEndMs_ = 0;
   uint32_t cooldownUntilMs_ = 0;
+  bool queued_ = false;
+  uint32_t queuedDurationMs_ = 0;
+  uint32_t queuedCooldownMs_ = 0;
+};
+
+// A relay channel on `Output`, a poot_gpio::OutputPins. Another channel with
+// its own pulse and cooldown is another Relay on other pins; pins that must
+// pulse together go in one OutputPins.
+template <typename Output>
+class Relay : public RelayController {
+ public:
+  void begin() {
+    Output::begin();
+    logBegin(Output::kPins, Output::kActiveLow);
+  }
+
+  // Ends the pulse and starts a queued one once their time has come. Returns
+  // true when it started a queued pulse.
+  bool loop() {
+    const uint8_t edges = advance(millis());
+    if (edges & kPulseEnded) {
+      Output::off();
+    }
+    if (edges & kQueuedStarted) {
+      Output::on();
+    }
+    logEdges(edges);
+    return (edges & kQueuedStarted) != 0;
+  }
+
+  // Starts a pulse when the relay is idle. A request that arrives while a
+  // pulse runs is coalesced into it, since the door is already open. One
+  // that arrives during the cooldown is queued to fire when the cooldown
+  // ends if that is at most `maxWaitMs` away (later ones join the queued
+  // pulse), and refused otherwise.
+  Result triggerPulse(uint32_t durationMs, uint32_t cooldownMs,
+                      uint32_t maxWaitMs = 0) {
+    const Result result =
+        request(millis(), durationMs, cooldownMs, maxWaitMs);
+    if (result == Result::kFired) {
+      Output::on();
+      logPulseStarted(durationMs, cooldownMs);
+    }
+    return result;
+  }
 };
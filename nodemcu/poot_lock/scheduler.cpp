@@ -0,0 +1,181 @@
+#include "scheduler.h"
+
+#include "diagnostics.h"
+
+namespace poot_sched {
+
+namespace {
+
+bool timeReached(uint32_t now, uint32_t target) {
+  return static_cast<int32_t>(now - target) >= 0;
+}
+
+}  // namespace
+
+TaskId Scheduler::addTask(const char* name, uint32_t periodMs, TaskFn fn) {
+  if (taskCount_ >= kMaxTasks || fn == nullptr) {
+    poot_diag::logf("SCHED", "cannot add task %s (count=%u)", name,
+                    taskCount_);
+    return kInvalidTask;
+  }
+  const TaskId id = taskCount_++;
+  tasks_[id].name = name;
+  tasks_[id].fn = fn;
+  tasks_[id].periodMs = periodMs;
+  tasks_[id].scope = poot_alloc::registerScope(name, poot_alloc::kMeasureStack);
+  return id;
+}
+
+TaskId Scheduler::addPeriodic(const char* name, uint32_t periodMs, TaskFn fn,
+                              uint32_t firstDelayMs) {
+  const TaskId id = addTask(name, periodMs, fn);
+  if (id != kInvalidTask) {
+    scheduleIn(id, firstDelayMs);
+  }
+  return id;
+}
+
+TaskId Scheduler::addOneShot(const char* name, TaskFn fn) {
+  return addTask(name, 0, fn);
+}
+
+void Scheduler::scheduleIn(TaskId id, uint32_t delayMs) {
+  scheduleAt(id, millis() + delayMs);
+}
+
+void Scheduler::scheduleAt(TaskId id, uint32_t deadlineMs) {
+  if (id >= taskCount_) {
+    return;
+  }
+  Task& task = tasks_[id];
+  const bool later = task.heapIndex != kNotQueued &&
+                     static_cast<int32_t>(deadlineMs - task.deadlineMs) > 0;
+  task.deadlineMs = deadlineMs;
+  if (task.heapIndex == kNotQueued) {
+    task.heapIndex = heapSize_;
+    heap_[heapSize_++] = id;
+    siftUp(task.heapIndex);
+  } else if (later) {
+    siftDown(task.heapIndex);
+  } else {
+    siftUp(task.heapIndex);
+  }
+}
+
+void Scheduler::cancel(TaskId id) {
+  if (id < taskCount_ && tasks_[id].heapIndex != kNotQueued) {
+    removeFromHeap(id);
+  }
+}
+
+bool Scheduler::isArmed(TaskId id) const {
+  return id < taskCount_ && tasks_[id].heapIndex != kNotQueued;
+}
+
+uint8_t Scheduler::runDue() {
+  uint8_t ran = 0;
+  // Bounded so a task that keeps re-arming itself with a zero delay cannot
+  // starve the network pumps in loop().
+  while (heapSize_ > 0 && ran < kMaxTasks) {
+    const uint32_t now = millis();
+    const TaskId id = heap_[0];
+    Task& task = tasks_[id];
+    if (!timeReached(now, task.deadlineMs)) {
+      break;
+    }
+    const uint32_t lateness = now - task.deadlineMs;
+    if (lateness > task.maxLatenessMs) {
+      task.maxLatenessMs = lateness;
+    }
+    removeFromHeap(id);
+    if (task.periodMs != 0) {
+      scheduleAt(id, now + task.periodMs);
+    }
+    task.runs++;
+    {
+      poot_alloc::Scope accounting(task.scope);
+      task.fn();
+    }
+    ran++;
+  }
+  return ran;
+}
+
+uint32_t Scheduler::msUntilNext() const {
+  if (heapSize_ == 0) {
+    return UINT32_MAX;
+  }
+  const int32_t remaining =
+      static_cast<int32_t>(tasks_[heap_[0]].deadlineMs - millis());
+  return remaining <= 0 ? 0 : static_cast<uint32_t>(remaining);
+}
+
+const char* Scheduler::taskName(TaskId id) const {
+  return id < taskCount_ ? tasks_[id].name : "invalid";
+}
+
+uint32_t Scheduler::runCount(TaskId id) const {
+  return id < taskCount_ ? tasks_[id].runs : 0;
+}
+
+uint32_t Scheduler::maxLatenessMs(TaskId id) const {
+  return id < taskCount_ ? tasks_[id].maxLatenessMs : 0;
+}
+
+bool Scheduler::earlier(uint8_t heapA, uint8_t heapB) const {
+  return static_cast<int32_t>(tasks_[heap_[heapA]].deadlineMs -
+                              tasks_[heap_[heapB]].deadlineMs) < 0;
+}
+
+void Scheduler::swapHeap(uint8_t a, uint8_t b) {
+  const TaskId tmp = heap_[a];
+  heap_[a] = heap_[b];
+  heap_[b] = tmp;
+  tasks_[heap_[a]].heapIndex = a;
+  tasks_[heap_[b]].heapIndex = b;
+}
+
+void Scheduler::siftUp(uint8_t index) {
+  while (index > 0) {
+    const uint8_t parent = (index - 1) / 2;
+    if (!earlier(index, parent)) {
+      return;
+    }
+    swapHeap(index, parent);
+    index = parent;
+  }
+}
+
+void Scheduler::siftDown(uint8_t index) {
+  for (;;) {
+    const uint8_t left = index * 2 + 1;
+    const uint8_t right = left + 1;
+    uint8_t smallest = index;
+    if (left < heapSize_ && earlier(left, smallest)) {
+      smallest = left;
+    }
+    if (right < heapSize_ && earlier(right, smallest)) {
+      smallest = right;
+    }
+    if (smallest == index) {
+      return;
+    }
+    swapHeap(index, smallest);
+    index = smallest;
+  }
+}
+
+void Scheduler::removeFromHeap(TaskId id) {
+  const uint8_t index = tasks_[id].heapIndex;
+  const uint8_t last = --heapSize_;
+  tasks_[id].heapIndex = kNotQueued;
+  if (index == last) {
+    return;
+  }
+  heap_[index] = heap_[last];
+  tasks_[heap_[index]].heapIndex = index;
+  siftDown(index);
+  siftUp(index);
+}
+
+}  // namespace poot_sched
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "alloc_tracker.h"
+
+namespace poot_sched {
+
+using TaskFn = void (*)();
+using TaskId = uint8_t;
+
+static constexpr TaskId kInvalidTask = 0xff;
+
+// Deadline-ordered cooperative scheduler for loop() housekeeping. Tasks live
+// in a fixed table and armed tasks are kept in an indexed binary min-heap, so
+// checking for due work is a single comparison against the earliest deadline
+// and re-arming a task is O(log n). Deadlines use wrap-safe millis()
+// arithmetic.
+//
+// A periodic task is re-armed `periodMs` after it ran (not after its previous
+// deadline), so a stalled loop never causes a burst of catch-up runs. A
+// one-shot task stays idle until scheduleIn()/scheduleAt() arms it; either
+// kind may re-arm itself from its own callback.
+//
+// Every task runs inside its own allocation scope, named after the task.
+class Scheduler {
+ public:
+  static constexpr uint8_t kMaxTasks = 12;
+
+  TaskId addPeriodic(const char* name, uint32_t periodMs, TaskFn fn,
+                     uint32_t firstDelayMs = 0);
+  TaskId addOneShot(const char* name, TaskFn fn);
+
+  void scheduleIn(TaskId id, uint32_t delayMs);
+  void scheduleAt(TaskId id, uint32_t deadlineMs);
+  void cancel(TaskId id);
+  bool isArmed(TaskId id) const;
+
+  // Runs every task whose deadline has passed, earliest first. Returns the
+  // number of tasks run.
+  uint8_t runDue();
+  // Milliseconds until the earliest armed deadline (0 if one is due,
+  // UINT32_MAX if nothing is armed).
+  uint32_t msUntilNext() const;
+
+  const char* taskName(TaskId id) const;
+  uint32_t runCount(TaskId id) const;
+  // Worst observed delay between a task's deadline and its start.
+  uint32_t maxLatenessMs(TaskId id) const;
+
+ private:
+  static constexpr uint8_t kNotQueued = 0xff;
+
+  struct Task {
+    const char* name = nullptr;
+    TaskFn fn = nullptr;
+    uint32_t periodMs = 0;
+    uint32_t deadlineMs = 0;
+    uint32_t runs = 0;
+    uint32_t maxLatenessMs = 0;
+    uint8_t heapIndex = kNotQueued;
+    poot_alloc::ScopeId scope = poot_alloc::kUnattributed;
+  };
+
+  TaskId addTask(const char* name, uint32_t periodMs, TaskFn fn);
+  bool earlier(uint8_t heapA, uint8_t heapB) const;
+  void swapHeap(uint8_t a, uint8_t b);
+  void siftUp(uint8_t index);
+  void siftDown(uint8_t index);
+  void removeFromHeap(TaskId id);
+
+  Task tasks_[kMaxTasks];
+  uint8_t taskCount_ = 0;
+  TaskId heap_[kMaxTasks];
+  uint8_t heapSize_ = 0;
+};
+
+}  // namespace poot_sched
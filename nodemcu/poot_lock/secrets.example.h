@@ -23,3 +23,14 @@
 
 // Wireless OTA (only reachable on STA).
 #define OTA_PASSWORD "REPLACE_WITH_OTA_PASSWORD"
+
+// Cloud command stream (Realtime Database). Leave FIREBASE_DB_HOST undefined
+// to run local-only. The device signs in with its own email/password account
+// (see /locks/{lockId}/deviceAccount in the README).
+#define FIREBASE_DB_HOST "YOUR_PROJECT-default-rtdb.firebaseio.com"
+#define FIREBASE_API_KEY "YOUR_WEB_API_KEY"
+#define FIREBASE_DEVICE_EMAIL "lock-device@example.com"
+#define FIREBASE_DEVICE_PASSWORD "REPLACE_WITH_DEVICE_PASSWORD"
+// Optional: PEM of the root CA to verify the database and auth hosts
+// against. Without it the connection is encrypted but not authenticated.
+// #define FIREBASE_CA_PEM "-----BEGIN CERTIFICATE-----\n...\n-----END CERTIFICATE-----\n"
@@ -0,0 +1,257 @@
+#include "sta_join.h"
+
+#include <ESP8266WiFi.h>
+#include <LittleFS.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+#include "diagnostics.h"
+
+namespace poot_sta {
+
+namespace {
+
+constexpr const char* kFlashPath = "/sta.bin";
+constexpr uint32_t kMagic = 0x50535441;  // "PSTA"
+constexpr uint8_t kLayoutVersion = 1;
+
+struct Cache {
+  uint32_t magic;
+  AccessPoint ap;
+  uint8_t layout;
+  uint32_t check;  // covers the SSID, so a new network starts cold
+};
+
+static_assert(sizeof(AccessPoint) == 7, "AccessPoint is packed by hand");
+static_assert(sizeof(Cache) == 16, "Cache is packed by hand");
+static_assert(poot::kRtcStaJoinBlock * 4 + sizeof(Cache) <= 512,
+              "STA join cache exceeds RTC memory");
+
+uint32_t gSsidHash = 2166136261u;
+Cache gCache = {};
+bool gCached = false;
+bool gFastMissed = false;
+bool gFlashReady = false;
+
+JoinKind gAttempt = JoinKind::kNone;  // the join in flight, if any
+uint32_t gStartMs = 0;
+
+volatile bool gGotIp = false;
+volatile uint32_t gGotIpMs = 0;
+volatile bool gDropped = false;
+volatile uint8_t gDropReason = 0;
+volatile uint32_t gDropMs = 0;
+
+JoinKind gLastJoin = JoinKind::kNone;
+uint32_t gLastJoinMs = 0;
+uint32_t gMaxJoinMs = 0;
+uint32_t gFastJoins = 0;
+uint32_t gFastMisses = 0;
+uint32_t gScanJoins = 0;
+
+uint32_t fnv1a(const uint8_t* data, size_t size, uint32_t hash) {
+  for (size_t i = 0; i < size; i++) {
+    hash ^= data[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+uint32_t cacheCheck(const AccessPoint& ap) {
+  return fnv1a(reinterpret_cast<const uint8_t*>(&ap), sizeof(ap), gSsidHash);
+}
+
+bool usable(const Cache& cache) {
+  return cache.magic == kMagic && cache.layout == kLayoutVersion &&
+         cache.check == cacheCheck(cache.ap) && cache.ap.channel >= 1 &&
+         cache.ap.channel <= 14;
+}
+
+void formatBssid(const uint8_t* bssid, char* out, size_t size) {
+  snprintf(out, size, "%02x:%02x:%02x:%02x:%02x:%02x", bssid[0], bssid[1],
+           bssid[2], bssid[3], bssid[4], bssid[5]);
+}
+
+bool rtcWrite(const Cache& cache) {
+  return ESP.rtcUserMemoryWrite(
+      poot::kRtcStaJoinBlock,
+      reinterpret_cast<uint32_t*>(const_cast<Cache*>(&cache)), sizeof(cache));
+}
+
+bool readFlash(Cache& cache) {
+  File file = LittleFS.open(kFlashPath, "r");
+  if (!file) {
+    return false;
+  }
+  const bool complete =
+      file.read(reinterpret_cast<uint8_t*>(&cache), sizeof(cache)) ==
+      static_cast<int>(sizeof(cache));
+  file.close();
+  return complete;
+}
+
+bool writeFlash(const Cache& cache) {
+  File file = LittleFS.open(kFlashPath, "w");
+  if (!file) {
+    return false;
+  }
+  const bool complete =
+      file.write(reinterpret_cast<const uint8_t*>(&cache), sizeof(cache)) ==
+      sizeof(cache);
+  file.close();
+  return complete;
+}
+
+// Caches `ap` if it is not what is cached already; flash is only written
+// when the access point changes, so it sees one write per roam.
+void remember(const AccessPoint& ap) {
+  if (gCached && memcmp(&gCache.ap, &ap, sizeof(ap)) == 0) {
+    return;
+  }
+  gCache.magic = kMagic;
+  gCache.ap = ap;
+  gCache.layout = kLayoutVersion;
+  gCache.check = cacheCheck(ap);
+  gCached = true;
+  rtcWrite(gCache);
+  const bool flashed = gFlashReady && writeFlash(gCache);
+  char bssid[18];
+  formatBssid(ap.bssid, bssid, sizeof(bssid));
+  poot_diag::logf("WIFI", "STA cached bssid=%s channel=%u flash=%s", bssid,
+                  ap.channel, flashed ? "ok" : "off");
+}
+
+void finishJoin() {
+  const JoinKind kind = gAttempt;
+  gAttempt = JoinKind::kNone;
+  gFastMissed = false;
+  if (kind != JoinKind::kNone) {
+    gLastJoin = kind;
+    gLastJoinMs = gGotIpMs - gStartMs;
+    if (gLastJoinMs > gMaxJoinMs) {
+      gMaxJoinMs = gLastJoinMs;
+    }
+    if (kind == JoinKind::kFast) {
+      gFastJoins++;
+    } else if (kind == JoinKind::kScan) {
+      gScanJoins++;
+    }
+    poot_diag::logf("WIFI", "STA joined via %s in %lu ms", joinKindName(kind),
+                    (unsigned long)gLastJoinMs);
+  }
+  AccessPoint ap;
+  memcpy(ap.bssid, WiFi.BSSID(), sizeof(ap.bssid));
+  ap.channel = static_cast<uint8_t>(WiFi.channel());
+  remember(ap);
+}
+
+bool missFast(const char* why) {
+  gAttempt = JoinKind::kNone;
+  gFastMissed = true;
+  gFastMisses++;
+  poot_diag::logf("WIFI", "STA fast join %s after %lu ms reason=%u, scanning",
+                  why, (unsigned long)(millis() - gStartMs),
+                  (unsigned)gDropReason);
+  return true;
+}
+
+}  // namespace
+
+const char* joinKindName(JoinKind kind) {
+  switch (kind) {
+    case JoinKind::kFast: return "fast";
+    case JoinKind::kScan: return "scan";
+    case JoinKind::kAuto: return "auto";
+    default:              return "none";
+  }
+}
+
+void begin(const char* ssid) {
+  gSsidHash = fnv1a(reinterpret_cast<const uint8_t*>(ssid), strlen(ssid),
+                    2166136261u);
+  gFlashReady = LittleFS.begin();
+  const char* source = "none";
+  Cache cache;
+  if (ESP.rtcUserMemoryRead(poot::kRtcStaJoinBlock,
+                            reinterpret_cast<uint32_t*>(&cache),
+                            sizeof(cache)) &&
+      usable(cache)) {
+    source = "rtc";
+  } else if (gFlashReady && readFlash(cache) && usable(cache)) {
+    source = "flash";
+    rtcWrite(cache);
+  }
+  gCached = strcmp(source, "none") != 0;
+  if (!gCached) {
+    poot_diag::logf("WIFI", "STA join cache empty, first join scans");
+    return;
+  }
+  gCache = cache;
+  char bssid[18];
+  formatBssid(gCache.ap.bssid, bssid, sizeof(bssid));
+  poot_diag::logf("WIFI", "STA join cache from %s bssid=%s channel=%u", source,
+                  bssid, gCache.ap.channel);
+}
+
+const AccessPoint* fastTarget() {
+  return gCached && !gFastMissed ? &gCache.ap : nullptr;
+}
+
+void noteBegin(bool fast) {
+  gAttempt = fast ? JoinKind::kFast : JoinKind::kScan;
+  gStartMs = millis();
+  gGotIp = false;
+  gDropped = false;
+}
+
+void noteDisconnected(uint8_t reason) {
+  // connectSta()'s own WiFi.disconnect(), reported after the begin() that
+  // followed it; not the access point's answer.
+  if (reason == WIFI_DISCONNECT_REASON_ASSOC_LEAVE) {
+    return;
+  }
+  gDropReason = reason;
+  gDropMs = millis();
+  gDropped = true;
+}
+
+void noteGotIp() {
+  gGotIpMs = millis();
+  gGotIp = true;
+}
+
+bool poll() {
+  if (gGotIp) {
+    gGotIp = false;
+    gDropped = false;
+    finishJoin();
+    return false;
+  }
+  if (gDropped) {
+    gDropped = false;
+    if (gAttempt == JoinKind::kFast) {
+      return missFast("refused");
+    }
+    if (gAttempt == JoinKind::kNone) {
+      // The link was up: the SDK rejoins on its own, timed from the drop.
+      gAttempt = JoinKind::kAuto;
+      gStartMs = gDropMs;
+    }
+    return false;
+  }
+  if (gAttempt == JoinKind::kFast &&
+      millis() - gStartMs >= poot::kWiFiFastJoinTimeoutMs) {
+    return missFast("timed out");
+  }
+  return false;
+}
+
+JoinKind lastJoin() { return gLastJoin; }
+uint32_t lastJoinMs() { return gLastJoinMs; }
+uint32_t maxJoinMs() { return gMaxJoinMs; }
+uint32_t fastJoins() { return gFastJoins; }
+uint32_t fastMisses() { return gFastMisses; }
+uint32_t scanJoins() { return gScanJoins; }
+
+}  // namespace poot_sta
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <Arduino.h>
+
+namespace poot_sta {
+
+// Fast STA rejoin. A plain WiFi.begin(ssid, pass) scans every channel before
+// it associates, which is most of the time a reboot or a dropped link spends
+// offline. The BSSID and channel of the access point last joined are kept in
+// RTC user memory (survives resets) and on LittleFS (survives power loss),
+// and connectSta() hands them to WiFi.begin() so the SDK probes that one
+// channel. A join aimed that way which is refused, or has no IP after
+// kWiFiFastJoinTimeoutMs, is retried with a scan; the next success makes
+// joins fast again. The static IP (WiFi.config()) already spares DHCP.
+//
+// The event handlers only record what happened; poll() from loop() does the
+// bookkeeping and the RTC/flash writes.
+
+enum class JoinKind : uint8_t {
+  kNone,
+  kFast,  // WiFi.begin() with the cached BSSID and channel
+  kScan,  // WiFi.begin() with the SSID only
+  kAuto,  // the SDK's own reconnect after the link dropped
+};
+
+const char* joinKindName(JoinKind kind);
+
+struct AccessPoint {
+  uint8_t bssid[6];
+  uint8_t channel;
+};
+
+// Loads the cache, RTC memory first and then flash; an entry saved for
+// another SSID is ignored. Call before the first connectSta().
+void begin(const char* ssid);
+
+// The access point to aim the next WiFi.begin() at, or nullptr when it has
+// to scan: nothing cached yet, or the last fast join failed.
+const AccessPoint* fastTarget();
+
+// Call right before WiFi.begin(); starts the time-to-connected clock.
+void noteBegin(bool fast);
+
+// From the WiFi event handlers (SDK context): flags only.
+void noteDisconnected(uint8_t reason);
+void noteGotIp();
+
+// From loop(). Records a finished join and caches the access point; returns
+// true when a fast join has failed and the caller should begin a scan.
+bool poll();
+
+JoinKind lastJoin();
+// begin() (or the drop, for kAuto) to got-IP, in ms.
+uint32_t lastJoinMs();
+uint32_t maxJoinMs();
+uint32_t fastJoins();
+uint32_t fastMisses();
+uint32_t scanJoins();
+
+}  // namespace poot_sta
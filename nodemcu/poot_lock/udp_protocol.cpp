@@ -0,0 +1,140 @@
+#include "udp_protocol.h"
+
+#include <string.h>
+
+namespace poot_udp {
+
+namespace {
+
+void putU32(uint8_t* out, uint32_t value) {
+  out[0] = static_cast<uint8_t>(value);
+  out[1] = static_cast<uint8_t>(value >> 8);
+  out[2] = static_cast<uint8_t>(value >> 16);
+  out[3] = static_cast<uint8_t>(value >> 24);
+}
+
+uint32_t getU32(const uint8_t* in) {
+  return static_cast<uint32_t>(in[0]) | static_cast<uint32_t>(in[1]) << 8 |
+         static_cast<uint32_t>(in[2]) << 16 |
+         static_cast<uint32_t>(in[3]) << 24;
+}
+
+void putHeader(uint8_t* out, Type type) {
+  out[0] = 'P';
+  out[1] = 'U';
+  out[2] = kVersion;
+  out[3] = static_cast<uint8_t>(type);
+}
+
+bool headerIs(const uint8_t* in, Type type) {
+  return in[0] == 'P' && in[1] == 'U' && in[2] == kVersion &&
+         in[3] == static_cast<uint8_t>(type);
+}
+
+void mac(const Key& key, const uint8_t* data, size_t size,
+         uint8_t (&out)[kMacBytes]) {
+  br_hmac_context ctx;
+  br_hmac_init(&ctx, &key.hmac, kMacBytes);
+  br_hmac_update(&ctx, data, size);
+  br_hmac_out(&ctx, out);
+}
+
+// Constant time, so a forger learns nothing from how fast a reply is dropped.
+bool macMatches(const Key& key, const uint8_t* data, size_t size,
+                const uint8_t* received) {
+  uint8_t expected[kMacBytes];
+  mac(key, data, size, expected);
+  uint8_t diff = 0;
+  for (size_t i = 0; i < kMacBytes; i++) {
+    diff |= static_cast<uint8_t>(expected[i] ^ received[i]);
+  }
+  return diff == 0;
+}
+
+}  // namespace
+
+const char* statusName(Status status) {
+  switch (status) {
+    case Status::kOk:         return "ok";
+    case Status::kCooldown:   return "cooldown";
+    case Status::kReplay:     return "replay";
+    case Status::kStaleEpoch: return "stale_epoch";
+    case Status::kWrongLock:  return "wrong_lock";
+    case Status::kCoalesced:  return "coalesced";
+    case Status::kQueued:     return "queued";
+    default:                  return "unknown";
+  }
+}
+
+void initKey(Key& key, const char* secret) {
+  br_hmac_key_init(&key.hmac, &br_sha256_vtable, secret, strlen(secret));
+}
+
+void setLockId(Request& request, const char* lockId) {
+  memset(request.lockId, 0, sizeof(request.lockId));
+  const size_t length = strlen(lockId);
+  memcpy(request.lockId, lockId,
+         length < sizeof(request.lockId) ? length : sizeof(request.lockId));
+}
+
+bool lockIdMatches(const Request& request, const char* lockId) {
+  Request expected;
+  setLockId(expected, lockId);
+  return memcmp(expected.lockId, request.lockId, sizeof(request.lockId)) == 0;
+}
+
+void encodeRequest(const Key& key, const Request& request,
+                   uint8_t (&out)[kRequestBytes]) {
+  putHeader(out, Type::kUnlock);
+  putU32(out + 4, request.epoch);
+  putU32(out + 8, request.client);
+  putU32(out + 12, request.counter);
+  memcpy(out + 16, request.lockId, kLockIdBytes);
+  uint8_t tag[kMacBytes];
+  mac(key, out, 32, tag);
+  memcpy(out + 32, tag, kMacBytes);
+}
+
+void encodeReply(const Key& key, const Reply& reply,
+                 uint8_t (&out)[kReplyBytes]) {
+  putHeader(out, Type::kReply);
+  putU32(out + 4, reply.epoch);
+  putU32(out + 8, reply.client);
+  putU32(out + 12, reply.counter);
+  out[16] = static_cast<uint8_t>(reply.status);
+  out[17] = 0;
+  out[18] = static_cast<uint8_t>(reply.windowMs);
+  out[19] = static_cast<uint8_t>(reply.windowMs >> 8);
+  uint8_t tag[kMacBytes];
+  mac(key, out, 20, tag);
+  memcpy(out + 20, tag, kMacBytes);
+}
+
+bool decodeRequest(const Key& key, const uint8_t* data, size_t size,
+                   Request& out) {
+  if (size != kRequestBytes || !headerIs(data, Type::kUnlock) ||
+      !macMatches(key, data, 32, data + 32)) {
+    return false;
+  }
+  out.epoch = getU32(data + 4);
+  out.client = getU32(data + 8);
+  out.counter = getU32(data + 12);
+  memcpy(out.lockId, data + 16, kLockIdBytes);
+  return true;
+}
+
+bool decodeReply(const Key& key, const uint8_t* data, size_t size,
+                 Reply& out) {
+  if (size != kReplyBytes || !headerIs(data, Type::kReply) ||
+      !macMatches(key, data, 20, data + 20)) {
+    return false;
+  }
+  out.epoch = getU32(data + 4);
+  out.client = getU32(data + 8);
+  out.counter = getU32(data + 12);
+  out.status = static_cast<Status>(data[16]);
+  out.windowMs = static_cast<uint16_t>(data[18] | data[19] << 8);
+  return true;
+}
+
+}  // namespace poot_udp
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <bearssl/bearssl.h>
+
+// Wire format of the single-datagram unlock (see udp_unlock.h). Shared by the
+// firmware and host/tools/udp_unlock_client.cpp, so it depends on nothing but
+// BearSSL. All integers are little-endian.
+//
+// Request (48 bytes):
+//   0  'P' 'U'   magic
+//   2  version   kVersion
+//   3  type      Type::kUnlock
+//   4  epoch     lock's current epoch, as last seen in a reply (0 if unknown)
+//   8  client    random per-install client id
+//   12 counter   strictly increasing per client within an epoch
+//   16 lock id   LOCK_ID, NUL-padded to kLockIdBytes
+//   32 mac       HMAC-SHA256(shared key, bytes 0..31), first kMacBytes
+//
+// Reply (36 bytes): magic, version, Type::kReply, the lock's epoch, the
+// request's client and counter, a Status byte, 1 reserved byte, the window
+// (u16 ms, saturated), then the MAC over bytes 0..19. The window is how long
+// the door stays open for kOk and kCoalesced, how long until it opens for
+// kQueued and until a retry can fire for kCooldown; 0 otherwise.
+namespace poot_udp {
+
+static constexpr uint8_t kVersion = 1;
+static constexpr size_t kLockIdBytes = 16;
+static constexpr size_t kMacBytes = 16;
+static constexpr size_t kRequestBytes = 32 + kMacBytes;
+static constexpr size_t kReplyBytes = 20 + kMacBytes;
+
+enum class Type : uint8_t {
+  kUnlock = 1,
+  kReply = 2,
+};
+
+enum class Status : uint8_t {
+  kOk = 0,
+  kCooldown = 1,    // relay is still cooling down; nothing fired
+  kReplay = 2,      // counter already used or too old
+  kStaleEpoch = 3,  // resend with the reply's epoch and a new counter
+  kWrongLock = 4,
+  kCoalesced = 5,   // joined the pulse already running; the door is open
+  kQueued = 6,      // fires when the cooldown ends
+};
+
+const char* statusName(Status status);
+
+struct Request {
+  uint32_t epoch;
+  uint32_t client;
+  uint32_t counter;
+  char lockId[kLockIdBytes];  // not NUL-terminated when full
+};
+
+struct Reply {
+  uint32_t epoch;
+  uint32_t client;
+  uint32_t counter;
+  Status status;
+  uint16_t windowMs;
+};
+
+// HMAC key schedule for the shared secret; computed once.
+struct Key {
+  br_hmac_key_context hmac;
+};
+
+void initKey(Key& key, const char* secret);
+
+// Copies `lockId` into the fixed field, truncating or NUL-padding.
+void setLockId(Request& request, const char* lockId);
+bool lockIdMatches(const Request& request, const char* lockId);
+
+void encodeRequest(const Key& key, const Request& request,
+                   uint8_t (&out)[kRequestBytes]);
+void encodeReply(const Key& key, const Reply& reply,
+                 uint8_t (&out)[kReplyBytes]);
+
+// False unless `size` matches, the header is right and the MAC verifies.
+bool decodeRequest(const Key& key, const uint8_t* data, size_t size,
+                   Request& out);
+bool decodeReply(const Key& key, const uint8_t* data, size_t size, Reply& out);
+
+}  // namespace poot_udp
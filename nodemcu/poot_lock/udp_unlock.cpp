@@ -0,0 +1,160 @@
+#include "udp_unlock.h"
+
+#include "diagnostics.h"
+
+namespace poot_udp {
+
+void UdpUnlockServer::begin(const char* sharedKey, const char* lockId,
+                            UnlockFn unlock) {
+  initKey(key_, sharedKey);
+  lockId_ = lockId;
+  unlock_ = unlock;
+  if (epoch_ == 0) {
+    newEpoch();
+  }
+  running_ = socket_.begin(port_) == 1;
+  poot_diag::logf("UDP", "unlock listener %s on port=%u",
+                  running_ ? "started" : "failed", port_);
+}
+
+void UdpUnlockServer::stop() {
+  socket_.stop();
+  running_ = false;
+}
+
+void UdpUnlockServer::loop() {
+  backlogged_ = false;
+  if (!running_) {
+    return;
+  }
+  backlogged_ = true;
+  for (uint8_t i = 0; i < kPacketsPerPass; i++) {
+    const int size = socket_.parsePacket();
+    if (size <= 0) {
+      backlogged_ = false;
+      return;
+    }
+    uint8_t packet[kRequestBytes];
+    if (static_cast<size_t>(size) != sizeof(packet)) {
+      dropped_++;
+      continue;  // parsePacket() discards the unread rest
+    }
+    socket_.read(packet, sizeof(packet));
+    handle(packet, sizeof(packet));
+  }
+}
+
+void UdpUnlockServer::handle(const uint8_t* data, size_t size) {
+  Request request;
+  if (!decodeRequest(key_, data, size, request)) {
+    dropped_++;
+    return;
+  }
+  if (!lockIdMatches(request, lockId_)) {
+    reply(request, Status::kWrongLock);
+    return;
+  }
+  if (request.epoch != epoch_) {
+    reply(request, Status::kStaleEpoch);
+    return;
+  }
+
+  Window* window = nullptr;
+  switch (admit(request.client, request.counter, window)) {
+    case Verdict::kRepeat:
+      reply(request, window->lastStatus, window->lastWindowMs);
+      return;
+    case Verdict::kReplay:
+      replays_++;
+      poot_diag::logf("UDP", "replay client=%08lx counter=%lu",
+                      (unsigned long)request.client,
+                      (unsigned long)request.counter);
+      reply(request, Status::kReplay);
+      return;
+    case Verdict::kNoRoom:
+      newEpoch();
+      reply(request, Status::kStaleEpoch);
+      return;
+    case Verdict::kFresh:
+      break;
+  }
+
+  uint32_t windowMs = 0;
+  const Status status =
+      unlock_ != nullptr ? unlock_(windowMs) : Status::kCooldown;
+  if (status == Status::kOk) {
+    fired_++;
+  }
+  const uint16_t replyWindowMs =
+      windowMs > 0xFFFF ? 0xFFFF : static_cast<uint16_t>(windowMs);
+  if (request.counter == window->highest) {
+    window->lastStatus = status;
+    window->lastWindowMs = replyWindowMs;
+  }
+  poot_diag::logf("UDP", "unlock %s window=%u ms client=%08lx counter=%lu",
+                  statusName(status), (unsigned)replyWindowMs,
+                  (unsigned long)request.client,
+                  (unsigned long)request.counter);
+  reply(request, status, replyWindowMs);
+}
+
+UdpUnlockServer::Verdict UdpUnlockServer::admit(uint32_t client,
+                                                uint32_t counter,
+                                                Window*& window) {
+  window = nullptr;
+  Window* freeWindow = nullptr;
+  for (Window& w : windows_) {
+    if (w.used && w.client == client) {
+      window = &w;
+      break;
+    }
+    if (!w.used && freeWindow == nullptr) {
+      freeWindow = &w;
+    }
+  }
+  if (window == nullptr) {
+    if (freeWindow == nullptr) {
+      return Verdict::kNoRoom;
+    }
+    window = freeWindow;
+    *window = Window{client, counter, 1, Status::kOk, 0, true};
+    return Verdict::kFresh;
+  }
+
+  if (counter > window->highest) {
+    const uint32_t shift = counter - window->highest;
+    window->seen = shift >= 32 ? 1 : (window->seen << shift) | 1;
+    window->highest = counter;
+    return Verdict::kFresh;
+  }
+  if (counter == window->highest) {
+    return Verdict::kRepeat;
+  }
+  const uint32_t age = window->highest - counter;
+  if (age >= 32 || (window->seen & (1UL << age)) != 0) {
+    return Verdict::kReplay;
+  }
+  window->seen |= 1UL << age;  // late but unused: still valid
+  return Verdict::kFresh;
+}
+
+void UdpUnlockServer::newEpoch() {
+  do {
+    epoch_ = ESP.random();
+  } while (epoch_ == 0);  // 0 means "unknown" to clients
+  memset(windows_, 0, sizeof(windows_));
+  poot_diag::logf("UDP", "epoch=%08lx", (unsigned long)epoch_);
+}
+
+void UdpUnlockServer::reply(const Request& request, Status status,
+                            uint16_t windowMs) {
+  const Reply out = {epoch_, request.client, request.counter, status,
+                     windowMs};
+  uint8_t packet[kReplyBytes];
+  encodeReply(key_, out, packet);
+  socket_.beginPacket(socket_.remoteIP(), socket_.remotePort());
+  socket_.write(packet, sizeof(packet));
+  socket_.endPacket();
+}
+
+}  // namespace poot_udp
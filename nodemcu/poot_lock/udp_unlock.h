@@ -0,0 +1,85 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFiUdp.h>
+
+#include "config.h"
+#include "udp_protocol.h"
+
+namespace poot_udp {
+
+// Unlock over a single authenticated datagram (format in udp_protocol.h),
+// listening next to the HTTP server. No handshake and no parsing beyond a
+// fixed layout, and the app recovers from a lost packet by resending it.
+//
+// Replay protection: each client id has a 32-counter sliding window per
+// epoch. Resending the newest counter just repeats its status and window (as
+// of the first answer) without firing again; anything older or already seen
+// gets kReplay. The epoch is random
+// per boot, so packets captured before a reset are stale afterwards. When
+// the window table is full a new epoch is started rather than forgetting a
+// client (which would let its old packets replay).
+//
+// Datagrams that fail the size/header/MAC check are dropped silently.
+class UdpUnlockServer {
+ public:
+  // Fires the relay like /api/local-unlock and returns kOk, kCoalesced,
+  // kQueued or kCooldown, with the reply's window in `windowMs`.
+  using UnlockFn = Status (*)(uint32_t& windowMs);
+
+  explicit UdpUnlockServer(uint16_t port) : port_(port) {}
+
+  void begin(const char* sharedKey, const char* lockId, UnlockFn unlock);
+  void stop();
+
+  // Handles the datagrams that have arrived since the last call. Call every
+  // loop() pass.
+  void loop();
+
+  uint32_t epoch() const { return epoch_; }
+  uint32_t unlocksFired() const { return fired_; }
+  uint32_t droppedPackets() const { return dropped_; }
+  uint32_t replaysRejected() const { return replays_; }
+  // Whether the last loop() stopped at kPacketsPerPass with datagrams
+  // possibly still waiting.
+  bool backlogged() const { return backlogged_; }
+
+ private:
+  static constexpr uint8_t kPacketsPerPass = 4;
+
+  struct Window {
+    uint32_t client;
+    uint32_t highest;  // newest counter seen
+    uint32_t seen;     // bit i: counter (highest - i) was used
+    Status lastStatus;
+    uint16_t lastWindowMs;
+    bool used;
+  };
+
+  enum class Verdict : uint8_t {
+    kFresh,
+    kRepeat,  // the newest counter again: answer with lastStatus
+    kReplay,
+    kNoRoom,
+  };
+
+  void handle(const uint8_t* data, size_t size);
+  Verdict admit(uint32_t client, uint32_t counter, Window*& window);
+  void newEpoch();
+  void reply(const Request& request, Status status, uint16_t windowMs = 0);
+
+  uint16_t port_;
+  WiFiUDP socket_;
+  bool running_ = false;
+  Key key_;
+  const char* lockId_ = "";
+  UnlockFn unlock_ = nullptr;
+  uint32_t epoch_ = 0;
+  Window windows_[poot::kUdpReplayClients] = {};
+  uint32_t fired_ = 0;
+  uint32_t dropped_ = 0;
+  uint32_t replays_ = 0;
+  bool backlogged_ = false;
+};
+
+}  // namespace poot_udp